@@ -0,0 +1,276 @@
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "enclave/enclave_alloc.h"
+#include "enclave/enclave_mem.h"
+#include "enclave/enclave_util.h"
+#include "enclave/lthread.h"
+#include "enclave/lthread_int.h"
+#include "enclave/ticketlock.h"
+#include "openenclave/corelibc/oemalloc.h"
+
+/* Alignment and granularity of the size classes */
+#define ALLOC_ALIGN 16
+
+/* Largest object size served from the size classes */
+#define ALLOC_MAX_SIZE 2048
+
+/* Size of the enclave_mmap chunks that are carved into objects of one class */
+#define ALLOC_SLAB_SIZE (64 * 1024)
+
+/* Objects moved between an ethread cache and the central lists at once */
+#define ALLOC_BATCH_BYTES 8192
+#define ALLOC_BATCH_MAX 64
+
+#define ALLOC_NUM_CLASSES 14
+
+static const size_t class_size[ALLOC_NUM_CLASSES] =
+    {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+
+/* Number of objects in a batch of each size class */
+static size_t class_batch[ALLOC_NUM_CLASSES];
+
+/* Size class of each object size, in units of ALLOC_ALIGN */
+static uint8_t size_class[ALLOC_MAX_SIZE / ALLOC_ALIGN + 1];
+
+/*
+ * Size class plus one of each page that enclave_mmap hands out, or zero for
+ * pages that do not belong to a slab. Set by enclave_alloc_init; until then,
+ * all allocations come from the Open Enclave heap.
+ */
+static uint8_t* page_class;
+static char* range_base;
+static size_t range_size;
+
+/*
+ * Free objects are linked through their first word. On the central lists,
+ * batches are linked through the second word of their first object, so that
+ * a whole batch can be moved while holding the lock for a few instructions.
+ */
+struct free_obj
+{
+    struct free_obj* next;
+    struct free_obj* next_batch;
+};
+
+struct free_list
+{
+    struct free_obj* head;
+    size_t count;
+};
+
+/* Per-ethread cache, only accessed by its ethread */
+struct enclave_alloc_cache
+{
+    struct free_list lists[ALLOC_NUM_CLASSES];
+};
+
+static struct central_list
+{
+    struct ticketlock lock;
+    struct free_obj* batches;
+} central[ALLOC_NUM_CLASSES];
+
+void enclave_alloc_init(void)
+{
+    void* base;
+    size_t c = 0;
+
+    for (size_t i = 0; i < ALLOC_NUM_CLASSES; i++)
+    {
+        class_batch[i] = ALLOC_BATCH_BYTES / class_size[i];
+        if (class_batch[i] > ALLOC_BATCH_MAX)
+            class_batch[i] = ALLOC_BATCH_MAX;
+    }
+
+    for (size_t i = 0; i <= ALLOC_MAX_SIZE / ALLOC_ALIGN; i++)
+    {
+        while (class_size[c] < i * ALLOC_ALIGN)
+            c++;
+        size_class[i] = c;
+    }
+
+    enclave_mem_range(&base, &range_size);
+    range_base = base;
+
+    size_t map_size =
+        (range_size / PAGE_SIZE + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint8_t* map = enclave_mmap(0, map_size, 0, PROT_READ | PROT_WRITE, 1);
+    if ((intptr_t)map < 0)
+    {
+        sgxlkl_warn("Failed to allocate allocator page map, using OE heap\n");
+        return;
+    }
+    page_class = map;
+}
+
+static struct enclave_alloc_cache* cache_self(void)
+{
+    struct schedctx* sc = __scheduler_self();
+
+    if (!sc->alloc_cache)
+        sc->alloc_cache = oe_calloc_or_die(
+            1,
+            sizeof(struct enclave_alloc_cache),
+            "Could not allocate allocator cache\n");
+
+    return sc->alloc_cache;
+}
+
+/* Carves a new slab into objects of class c, fills the empty list with some
+ * of them and puts the others on the central list. */
+static int alloc_slab(struct free_list* list, size_t c)
+{
+    const size_t size = class_size[c];
+    const size_t batch = class_batch[c];
+    const size_t num_objs = ALLOC_SLAB_SIZE / size;
+
+    char* slab = enclave_mmap(0, ALLOC_SLAB_SIZE, 0, PROT_READ | PROT_WRITE, 0);
+    if ((intptr_t)slab < 0)
+        return 0;
+
+    memset(
+        page_class + (slab - range_base) / PAGE_SIZE,
+        c + 1,
+        ALLOC_SLAB_SIZE / PAGE_SIZE);
+
+    // The list gets more than a batch, so that a few frees do not
+    // immediately move a batch back to the central list. It is not
+    // necessarily empty any more if enclave_mmap allocated.
+    size_t num_list = batch + num_objs % batch;
+    struct free_obj* obj = list->head;
+    for (size_t i = num_list; i-- > 0;)
+    {
+        struct free_obj* o = (struct free_obj*)(slab + i * size);
+        o->next = obj;
+        obj = o;
+    }
+    list->head = obj;
+    list->count += num_list;
+
+    struct free_obj* batches = NULL;
+    for (size_t i = num_objs; i > num_list; i -= batch)
+    {
+        obj = NULL;
+        for (size_t j = i; j-- > i - batch;)
+        {
+            struct free_obj* o = (struct free_obj*)(slab + j * size);
+            o->next = obj;
+            obj = o;
+        }
+        obj->next_batch = batches;
+        batches = obj;
+    }
+
+    if (batches)
+    {
+        struct free_obj* last = batches;
+        while (last->next_batch)
+            last = last->next_batch;
+
+        ticket_lock(&central[c].lock);
+        last->next_batch = central[c].batches;
+        central[c].batches = batches;
+        ticket_unlock(&central[c].lock);
+    }
+
+    return 1;
+}
+
+static int alloc_refill(struct free_list* list, size_t c)
+{
+    struct central_list* cl = &central[c];
+
+    ticket_lock(&cl->lock);
+    struct free_obj* batch = cl->batches;
+    if (batch)
+        cl->batches = batch->next_batch;
+    ticket_unlock(&cl->lock);
+
+    if (!batch)
+        return alloc_slab(list, c);
+
+    list->head = batch;
+    list->count = class_batch[c];
+    return 1;
+}
+
+static void alloc_flush(struct free_list* list, size_t c)
+{
+    struct central_list* cl = &central[c];
+    struct free_obj* batch = list->head;
+    struct free_obj* last = batch;
+
+    for (size_t i = 1; i < class_batch[c]; i++)
+        last = last->next;
+    list->head = last->next;
+    list->count -= class_batch[c];
+    last->next = NULL;
+
+    ticket_lock(&cl->lock);
+    batch->next_batch = cl->batches;
+    cl->batches = batch;
+    ticket_unlock(&cl->lock);
+}
+
+void* enclave_malloc(size_t size)
+{
+    if (!page_class || size > ALLOC_MAX_SIZE)
+        return oe_malloc(size);
+
+    size_t c = size_class[(size + ALLOC_ALIGN - 1) / ALLOC_ALIGN];
+    struct free_list* list = &cache_self()->lists[c];
+
+    if (!list->head && !alloc_refill(list, c))
+        return NULL;
+
+    struct free_obj* obj = list->head;
+    list->head = obj->next;
+    list->count--;
+
+    return obj;
+}
+
+void* enclave_calloc(size_t nmemb, size_t size)
+{
+    size_t total;
+
+    if (__builtin_mul_overflow(nmemb, size, &total))
+        return NULL;
+
+    if (!page_class || total > ALLOC_MAX_SIZE)
+        return oe_calloc(nmemb, size);
+
+    void* ptr = enclave_malloc(total);
+    if (ptr)
+        memset(ptr, 0, total);
+
+    return ptr;
+}
+
+void enclave_free(void* ptr)
+{
+    size_t offset = (char*)ptr - range_base;
+
+    if (!ptr)
+        return;
+
+    // Objects outside of the enclave_mmap range come from the OE heap
+    if (!page_class || offset >= range_size)
+    {
+        oe_free(ptr);
+        return;
+    }
+
+    size_t c = page_class[offset / PAGE_SIZE] - 1;
+    SGXLKL_ASSERT(c < ALLOC_NUM_CLASSES);
+
+    struct free_list* list = &cache_self()->lists[c];
+    struct free_obj* obj = ptr;
+
+    obj->next = list->head;
+    list->head = obj;
+    if (++list->count >= 2 * class_batch[c])
+        alloc_flush(list, c);
+}
@@ -3,6 +3,8 @@
 
 #include <lkl/virtio.h>
 
+#include "enclave/enclave_stats.h"
+#include "enclave/enclave_switchless.h"
 #include "enclave/enclave_util.h"
 #include "enclave/lthread.h"
 #include "enclave/lthread_int.h"
@@ -161,9 +163,11 @@ void initialize_enclave_event_channel(
 
         *dev_id = enc_dev_config[i].dev_id;
 
+        // Device events complete I/O that other lthreads wait for
+        struct lthread_attr attr = {.priority = LTHREAD_PRIO_HIGH};
         if (lthread_create(
                 &vio_tasks[i],
-                NULL,
+                &attr,
                 vio_enclave_process_host_event,
                 (void*)dev_id) != 0)
         {
@@ -193,9 +197,13 @@ void vio_enclave_notify_enclave_event(uint8_t dev_id, uint32_t qidx)
 
     *qidx_p = qidx;
 
+    SGXLKL_STATS_INC(device_notifies);
+
     /* host task sleeping, wake up (ocall) */
     if (cur & 1)
-        sgxlkl_host_device_request(dev_id);
+    {
+        enclave_host_device_request(dev_id);
+    }
 }
 
 /*
@@ -5,6 +5,7 @@
 #include "openenclave/corelibc/oemalloc.h"
 #include "openenclave/corelibc/oestring.h"
 
+#include "enclave/enclave_alloc.h"
 #include "enclave/enclave_mem.h"
 #include "enclave/enclave_oe.h"
 #include "enclave/enclave_util.h"
@@ -26,6 +27,7 @@ int __gdb_get_load_debug_symbols_alive(void)
 }
 
 extern struct mpmcq __scheduler_queue;
+extern struct mpmcq __scheduler_queue_high;
 
 _Noreturn void __dls3(elf64_stack_t* conf, void* tos);
 extern void init_sysconf(long nproc_conf, long nproc_onln);
@@ -240,6 +242,7 @@ int __libc_init_enclave(int argc, char** argv)
     SGXLKL_VERBOSE("calling enclave_mman_init()\n");
     enclave_mman_init(
         sgxlkl_heap_base, sgxlkl_heap_size / PAGESIZE, cfg->mmap_files);
+    enclave_alloc_init();
 
     libc.user_tls_enabled = sgxlkl_in_sw_debug_mode() ? 1 : cfg->fsgsbase;
 
@@ -258,8 +261,10 @@ int __libc_init_enclave(int argc, char** argv)
     max_lthreads = next_power_of_2(max_lthreads);
 
     newmpmcq(&__scheduler_queue, max_lthreads, 0);
+    newmpmcq(&__scheduler_queue_high, max_lthreads, 0);
     
-    init_ethread_tp();
+    /* The host enters the enclave with ethread id 0 on this ethread */
+    init_ethread_tp(0);
 
     size_t espins = cfg->espins;
     size_t esleep = cfg->esleep;
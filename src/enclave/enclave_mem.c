@@ -16,6 +16,7 @@
 #include "enclave/lthread.h"
 
 #include "enclave/enclave_mem.h"
+#include "enclave/enclave_switchless.h"
 #include "enclave/enclave_util.h"
 #include "enclave/lthread_int.h"
 #include "enclave/sgxlkl_t.h"
@@ -35,6 +36,12 @@ int mmap_files; // Allow MAP_PRIVATE or MAP_SHARED?
 static size_t used_pages =
     0; // Tracks the number of used pages for the mmap tracing
 
+static size_t fallback_index_top; // First page of the fallback range
+static size_t fallback_index_end; // Page after the fallback range
+
+// Called after pages have been allocated or freed
+static void (*mem_pressure_handler)(size_t failed_pages);
+
 #if DEBUG
 extern int sgxlkl_trace_mmap;
 static size_t mmap_max_allocated = 0; // Maximum amount of memory used thus far
@@ -87,7 +94,9 @@ static inline unsigned long bitmap_find_next_zero_area(
 
 static int in_mmap_range(void* addr, size_t size)
 {
-    return addr >= mmap_base && ((char*)addr + size) <= (char*)mmap_end;
+    // mmap_end is the start of the highest page (index 0)
+    return addr >= mmap_base &&
+           ((char*)addr + size) <= (char*)mmap_end + PAGE_SIZE;
 }
 
 static void* index_to_addr(size_t index)
@@ -106,6 +115,63 @@ void enclave_mem_info(size_t* total, size_t* free)
     *free = (mmap_num_pages - used_pages) * PAGESIZE;
 }
 
+void enclave_mem_range(void** base, size_t* length)
+{
+    *base = mmap_base;
+    *length = (char*)mmap_end + PAGE_SIZE - (char*)mmap_base;
+}
+
+void enclave_mem_set_fallback_range(void* addr, size_t length)
+{
+    size_t pages = DIV_ROUNDUP(length, PAGE_SIZE);
+
+    ticket_lock(&mmaplock);
+    if (addr == NULL || !in_mmap_range(addr, length))
+    {
+        fallback_index_top = 0;
+        fallback_index_end = 0;
+    }
+    else
+    {
+        fallback_index_top = addr_to_index(addr) - (pages - 1);
+        fallback_index_end = fallback_index_top + pages;
+    }
+    ticket_unlock(&mmaplock);
+}
+
+void enclave_mem_set_pressure_handler(void (*handler)(size_t failed_pages))
+{
+    mem_pressure_handler = handler;
+}
+
+/*
+ * Finds a free area of the given number of pages, preferring pages outside of
+ * the fallback range. Must be called with mmaplock held.
+ */
+static size_t find_free_area(size_t pages)
+{
+    size_t index_top;
+
+    if (fallback_index_end == 0)
+        return bitmap_find_next_zero_area(
+            mmap_bitmap, mmap_num_pages, 0, pages);
+
+    // Pages before the fallback range
+    index_top =
+        bitmap_find_next_zero_area(mmap_bitmap, fallback_index_top, 0, pages);
+    if (index_top + pages <= fallback_index_top)
+        return index_top;
+
+    // Pages after the fallback range
+    index_top = bitmap_find_next_zero_area(
+        mmap_bitmap, mmap_num_pages, fallback_index_end, pages);
+    if (index_top + pages <= mmap_num_pages)
+        return index_top;
+
+    // Any pages, including the fallback range
+    return bitmap_find_next_zero_area(mmap_bitmap, mmap_num_pages, 0, pages);
+}
+
 /*
  * Initializes the enclave memory management.
  *
@@ -221,8 +287,7 @@ void* enclave_mmap(
     // Find next area with sufficient space
     if (ret == 0)
     {
-        index_top =
-            bitmap_find_next_zero_area(mmap_bitmap, mmap_num_pages, 0, pages);
+        index_top = find_free_area(pages);
         if (index_top + pages > mmap_num_pages)
         {
             ret = (void*)-ENOMEM;
@@ -239,7 +304,6 @@ void* enclave_mmap(
     if (((intptr_t)ret) >= 0)
     {
         int found_only_fresh_pages = 0;
-        int mprotect_ret;
 
         if (zero_pages)
         {
@@ -265,8 +329,7 @@ void* enclave_mmap(
             if (prot != -1)
             {
                 // Make pages writeable
-                sgxlkl_host_syscall_mprotect(
-                    &mprotect_ret, ret, length, prot | PROT_WRITE);
+                enclave_host_mprotect(ret, length, prot | PROT_WRITE);
             }
 
             // Set all allocated pages to zero
@@ -275,7 +338,7 @@ void* enclave_mmap(
             // Restore the correct page permissions
             if (prot != -1 && ((prot | PROT_WRITE) != prot))
             {
-                sgxlkl_host_syscall_mprotect(&mprotect_ret, ret, length, prot);
+                enclave_host_mprotect(ret, length, prot);
             }
         }
 
@@ -284,7 +347,7 @@ void* enclave_mmap(
         if (prot != -1 && (!zero_pages || found_only_fresh_pages))
         {
             // Set requested page permission
-            sgxlkl_host_syscall_mprotect(&mprotect_ret, ret, length, prot);
+            enclave_host_mprotect(ret, length, prot);
         }
 
         used_pages += pages - replaced_pages;
@@ -323,6 +386,43 @@ void* enclave_mmap(
     }
 #endif
 
+    if (mem_pressure_handler)
+        mem_pressure_handler((intptr_t)ret == -ENOMEM ? pages : 0);
+
+    return ret;
+}
+
+/*
+ * Marks the given pages as used if none of them is in use. Unlike a fixed
+ * enclave_mmap, it never takes over pages that are in use, and it leaves the
+ * page contents and protections untouched.
+ */
+long enclave_mmap_reserve(void* addr, size_t length)
+{
+    size_t pages = DIV_ROUNDUP(length, PAGE_SIZE);
+    long ret = 0;
+
+    if ((uintptr_t)addr % PAGE_SIZE != 0 || length == 0 ||
+        !in_mmap_range(addr, length))
+    {
+        return -EINVAL;
+    }
+
+    size_t index_top = addr_to_index(addr) - (pages - 1);
+
+    ticket_lock(&mmaplock);
+    if (bitmap_count_set_bits(mmap_bitmap, mmap_num_pages, index_top, pages))
+    {
+        ret = -EBUSY;
+    }
+    else
+    {
+        bitmap_set(mmap_bitmap, index_top, pages);
+        bitmap_clear(mmap_fresh_bitmap, index_top, pages);
+        used_pages += pages;
+    }
+    ticket_unlock(&mmaplock);
+
     return ret;
 }
 
@@ -372,6 +472,9 @@ long enclave_munmap(void* addr, size_t length)
     }
 #endif
 
+    if (mem_pressure_handler)
+        mem_pressure_handler(0);
+
     return 0;
 }
 
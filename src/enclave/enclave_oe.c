@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include <openenclave/bits/eeid.h>
+#include <openenclave/enclave.h>
 #include <openenclave/corelibc/oemalloc.h>
 #include <openenclave/corelibc/oestring.h>
 #include <openenclave/internal/globals.h>
@@ -282,7 +283,7 @@ static void _sgxlkl_enclave_show_attribute(const void* sgxlkl_enclave_base)
 }
 #endif
 
-int sgxlkl_ethread_init(void)
+int sgxlkl_ethread_init(int ethread_id)
 {
     void* tls_page;
     __asm__ __volatile__("mov %%gs:0,%0" : "=r"(tls_page));
@@ -292,6 +293,8 @@ int sgxlkl_ethread_init(void)
 
     size_t tls_offset = SCHEDCTX_OFFSET;
     sched_tcb->schedctx = (struct schedctx*)((char*)tls_page + tls_offset);
+    sched_tcb->schedctx->stats = NULL;
+    sched_tcb->schedctx->alloc_cache = NULL;
 
     /* Wait until libc has been initialized */
     while (sgxlkl_enclave_state.libc_state != libc_initialized)
@@ -300,7 +303,7 @@ int sgxlkl_ethread_init(void)
     }
 
     /* Initialization completed, now run the scheduler */
-    init_ethread_tp();
+    init_ethread_tp(ethread_id);
     _lthread_sched_init(sgxlkl_enclave_state.config->stacksize);
 
     return lthread_run();
@@ -343,6 +346,46 @@ static void _copy_shared_memory(const sgxlkl_shared_memory_t* host)
     /* timer_dev_mem is required to be outside the enclave */
     enc->timer_dev_mem = host->timer_dev_mem;
 
+    /* stats is written by the enclave, so it must be outside the enclave */
+    if (host->stats)
+    {
+        if (!oe_is_outside_enclave(host->stats, sizeof(sgxlkl_stats_t)))
+            sgxlkl_fail("Statistics page is not outside the enclave\n");
+        enc->stats = host->stats;
+    }
+
+    /* The switchless call ring is written by the enclave, so it must be
+     * outside the enclave */
+    if (host->switchless)
+    {
+        if (!oe_is_outside_enclave(
+                host->switchless, sizeof(sgxlkl_switchless_t)))
+            sgxlkl_fail("Switchless call ring is not outside the enclave\n");
+        enc->switchless = host->switchless;
+    }
+
+#ifdef DEBUG
+    /* profile is written by the enclave, so it must be outside the enclave */
+    if (host->profile)
+    {
+        if (!oe_is_outside_enclave(host->profile, sizeof(sgxlkl_profile_t)))
+            sgxlkl_fail("Profile buffer is not outside the enclave\n");
+
+        size_t capacity = host->profile->capacity;
+        if (capacity == 0 ||
+            capacity > (SIZE_MAX - sizeof(sgxlkl_profile_t)) /
+                           sizeof(sgxlkl_profile_sample_t) ||
+            !oe_is_outside_enclave(
+                host->profile,
+                sizeof(sgxlkl_profile_t) +
+                    capacity * sizeof(sgxlkl_profile_sample_t)))
+            sgxlkl_fail("Profile buffer is not outside the enclave\n");
+
+        enc->profile = host->profile;
+        sgxlkl_enclave_state.profile_capacity = capacity;
+    }
+#endif
+
     if (cfg->io.block)
     {
         enc->num_virtio_blk_dev = host->num_virtio_blk_dev;
@@ -355,6 +398,14 @@ static void _copy_shared_memory(const sgxlkl_shared_memory_t* host)
             enc->num_virtio_blk_dev,
             sizeof(char*),
             "Could not allocate memory for virtio block devices\n");
+        enc->virtio_blk_dev_direct = oe_calloc_or_die(
+            enc->num_virtio_blk_dev,
+            sizeof(void*),
+            "Could not allocate memory for virtio block devices\n");
+        enc->virtio_blk_dev_direct_size = oe_calloc_or_die(
+            enc->num_virtio_blk_dev,
+            sizeof(size_t),
+            "Could not allocate memory for virtio block devices\n");
         for (size_t i = 0; i < enc->num_virtio_blk_dev; i++)
         {
             enc->virtio_blk_dev_mem[i] = host->virtio_blk_dev_mem[i];
@@ -365,6 +416,18 @@ static void _copy_shared_memory(const sgxlkl_shared_memory_t* host)
                 sizeof(char),
                 "Could not allocate memory for virtio block device name\n");
             memcpy(enc->virtio_blk_dev_names[i], name, name_len);
+
+            /* Direct disk mappings are read in place, so they must be
+             * outside the enclave */
+            void* direct = host->virtio_blk_dev_direct[i];
+            size_t direct_size = host->virtio_blk_dev_direct_size[i];
+            if (direct)
+            {
+                if (!oe_is_outside_enclave(direct, direct_size))
+                    sgxlkl_fail("Disk mapping is not outside the enclave\n");
+                enc->virtio_blk_dev_direct[i] = direct;
+                enc->virtio_blk_dev_direct_size[i] = direct_size;
+            }
         }
     }
 
@@ -393,6 +456,8 @@ static void _free_shared_memory()
 
     oe_free(shm->virtio_blk_dev_mem);
     oe_free(shm->virtio_blk_dev_names);
+    oe_free(shm->virtio_blk_dev_direct);
+    oe_free(shm->virtio_blk_dev_direct_size);
 
     for (size_t i = 0; shm->env[i] != 0; i++)
         oe_free(shm->env[i]);
@@ -431,6 +496,8 @@ int sgxlkl_enclave_init(const sgxlkl_shared_memory_t* shared_memory)
 
     size_t tls_offset = SCHEDCTX_OFFSET;
     sched_tcb->schedctx = (struct schedctx*)((char*)tls_page + tls_offset);
+    sched_tcb->schedctx->stats = NULL;
+    sched_tcb->schedctx->alloc_cache = NULL;
 
     const void* sgxlkl_enclave_base = __oe_get_enclave_base();
 
@@ -0,0 +1,146 @@
+#include <openenclave/enclave.h>
+#include <openenclave/internal/globals.h>
+
+#include "enclave/enclave_preempt.h"
+#include "enclave/enclave_stats.h"
+#include "enclave/lthread.h"
+#include "enclave/lthread_int.h"
+
+/* Size of the System V red zone below the stack pointer */
+#define RED_ZONE_SIZE 128
+
+/*
+ * Extended state components saved across a preemption: x87, SSE, AVX and
+ * AVX-512. Components that the kernel enables lazily (e.g. AMX) are left
+ * out, as touching them may fault. The area is large enough for all of them
+ * in the standard format.
+ */
+#define XSAVE_MASK 0xe7
+#define XSAVE_AREA_SIZE 3072
+
+#define STR(x) #x
+#define XSTR(x) STR(x)
+
+void sgxlkl_preempt_trampoline(void);
+uint64_t sgxlkl_preempt_yield(void);
+
+/*
+ * Entered instead of the interrupted instruction, with the interrupted stack
+ * pointer. The exception handler does not touch the stack, which may still
+ * hold the host's signal frame, so the trampoline steps over the red zone
+ * itself, with lea to leave the flags intact, and reserves a slot for the
+ * return address. It saves all registers that the scheduler may clobber,
+ * including the extended state, as the lthreads that run next may use any
+ * vector register. After the lthread is resumed, it stores the interrupted
+ * instruction returned by sgxlkl_preempt_yield() in the slot, returns to it
+ * and releases the red zone gap with `ret $RED_ZONE_SIZE`.
+ */
+__asm__("    .text                                              \n"
+        "    .p2align 4                                         \n"
+        ".globl sgxlkl_preempt_trampoline                       \n"
+        "sgxlkl_preempt_trampoline:                             \n"
+        "    leaq -" XSTR(RED_ZONE_SIZE) "-8(%rsp), %rsp        \n"
+        "    pushfq                                             \n"
+        "    pushq %rax                                         \n"
+        "    pushq %rcx                                         \n"
+        "    pushq %rdx                                         \n"
+        "    pushq %rsi                                         \n"
+        "    pushq %rdi                                         \n"
+        "    pushq %r8                                          \n"
+        "    pushq %r9                                          \n"
+        "    pushq %r10                                         \n"
+        "    pushq %r11                                         \n"
+        "    pushq %rbx                                         \n"
+        "    movq %rsp, %rbx                                    \n"
+        "    subq $" XSTR(XSAVE_AREA_SIZE) ", %rsp              \n"
+        "    andq $-64, %rsp                                    \n"
+        "    # xrstor requires a zeroed XSAVE header            \n"
+        "    xorl %eax, %eax                                    \n"
+        "    movq %rax, 512(%rsp)                               \n"
+        "    movq %rax, 520(%rsp)                               \n"
+        "    movq %rax, 528(%rsp)                               \n"
+        "    movq %rax, 536(%rsp)                               \n"
+        "    movq %rax, 544(%rsp)                               \n"
+        "    movq %rax, 552(%rsp)                               \n"
+        "    movq %rax, 560(%rsp)                               \n"
+        "    movq %rax, 568(%rsp)                               \n"
+        "    movl $" XSTR(XSAVE_MASK) ", %eax                   \n"
+        "    xorl %edx, %edx                                    \n"
+        "    xsave64 (%rsp)                                     \n"
+        "    call sgxlkl_preempt_yield                          \n"
+        "    # return address slot above rflags and 10 registers \n"
+        "    movq %rax, 88(%rbx)                                \n"
+        "    movl $" XSTR(XSAVE_MASK) ", %eax                   \n"
+        "    xorl %edx, %edx                                    \n"
+        "    xrstor64 (%rsp)                                    \n"
+        "    movq %rbx, %rsp                                    \n"
+        "    popq %rbx                                          \n"
+        "    popq %r11                                          \n"
+        "    popq %r10                                          \n"
+        "    popq %r9                                           \n"
+        "    popq %r8                                           \n"
+        "    popq %rdi                                          \n"
+        "    popq %rsi                                          \n"
+        "    popq %rdx                                          \n"
+        "    popq %rcx                                          \n"
+        "    popq %rax                                          \n"
+        "    popfq                                              \n"
+        "    ret $" XSTR(RED_ZONE_SIZE) "                       \n");
+
+static void _preempt_requeue(void* lt)
+{
+    __scheduler_enqueue(lt);
+}
+
+uint64_t sgxlkl_preempt_yield(void)
+{
+    struct lthread* lt = lthread_self();
+    uint64_t rip = lt->preempt_rip;
+
+    SGXLKL_STATS_INC(preemptions);
+
+    // The lthread is made runnable again once it has been switched out
+    _lthread_yield_cb(lt, _preempt_requeue, lt);
+
+    return rip;
+}
+
+void sgxlkl_preempt_tick(oe_context_t* context)
+{
+    const uint64_t app_start = (uint64_t)__oe_get_heap_base();
+    const uint64_t app_end =
+        (uint64_t)__oe_get_enclave_base() + __oe_get_enclave_size();
+
+    // Application code is loaded into enclave memory after the image. Ticks
+    // that arrive while the ethread executes the image or host code (e.g.
+    // during an OCALL) are dropped.
+    if (context->rip < app_start || context->rip >= app_end)
+        return;
+
+    // Skip ethreads that have not set up their scheduler context yet
+    struct schedctx* sc = __scheduler_self();
+    if (!sc || sc->self != sc)
+        return;
+
+    struct lthread_sched* sched = &sc->sched;
+    struct lthread* lt = sched->current_lthread;
+    if (!lt || lt->no_preempt)
+        return;
+
+    // Only preempt an lthread that has been running for a whole tick period,
+    // i.e. that was already running at the previous tick and has not been
+    // switched out since.
+    if (sched->preempt_lt != lt || sched->preempt_resumes != sched->resumes)
+    {
+        sched->preempt_lt = lt;
+        sched->preempt_resumes = sched->resumes;
+        return;
+    }
+    sched->preempt_lt = NULL;
+
+    // Resume in the trampoline, which returns to the interrupted instruction
+    // once the lthread runs again. The stack is left alone here, as the
+    // host's signal frame may still be in use below the stack pointer.
+    lt->preempt_rip = context->rip;
+    context->rip = (uint64_t)sgxlkl_preempt_trampoline;
+}
@@ -0,0 +1,65 @@
+#include <string.h>
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/globals.h>
+
+#include "enclave/enclave_profile.h"
+#include "enclave/enclave_state.h"
+#include "enclave/enclave_util.h"
+#include "enclave/lthread.h"
+#include "enclave/lthread_int.h"
+#include "shared/sgxlkl_profile.h"
+
+#ifdef DEBUG
+/**
+ * Provide access to an internal OE function to unwind the stack from the
+ * frame pointer of the interrupted context (see sgxlkl_print_backtrace).
+ */
+extern int oe_backtrace_impl(void** start_frame, void** buffer, int size);
+
+void sgxlkl_profile_sample(const oe_context_t* context)
+{
+    sgxlkl_profile_t* profile = sgxlkl_enclave_state.shared_memory.profile;
+    const uint64_t base = (uint64_t)__oe_get_enclave_base();
+    const uint64_t size = __oe_get_enclave_size();
+    void* frames[SGXLKL_PROFILE_MAX_DEPTH];
+    int depth;
+
+    if (!profile)
+        return;
+
+    // Ticks that arrive while the ethread executes host code (e.g. during an
+    // OCALL) are dropped: the thread pointer is not set up for the enclave.
+    if (context->rip < base || context->rip >= base + size)
+        return;
+
+    // Skip ethreads that have not set up their scheduler context yet
+    struct schedctx* sc = __scheduler_self();
+    if (!sc || sc->self != sc)
+        return;
+
+    frames[0] = (void*)context->rip;
+    depth = 1 + oe_backtrace_impl(
+                    (void**)context->rbp,
+                    frames + 1,
+                    SGXLKL_PROFILE_MAX_DEPTH - 1);
+
+    // The capacity was validated when the shared memory was copied
+    uint64_t idx = __atomic_fetch_add(&profile->head, 1, __ATOMIC_RELAXED);
+    sgxlkl_profile_sample_t* sample =
+        &profile->samples[idx % sgxlkl_enclave_state.profile_capacity];
+
+    struct lthread* lt = sc->sched.current_lthread;
+
+    sample->ethread = sc->ethread_id;
+    sample->depth = depth;
+    memset(sample->funcname, 0, sizeof(sample->funcname));
+    if (lt)
+        memcpy(
+            sample->funcname,
+            lt->attr.funcname,
+            sizeof(sample->funcname) - 1);
+    for (int i = 0; i < depth; i++)
+        sample->frames[i] = (uint64_t)frames[i] - base;
+}
+#endif
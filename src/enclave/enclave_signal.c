@@ -14,10 +14,14 @@
 #include <openenclave/internal/cpuid.h>
 
 #include "enclave/enclave_oe.h"
+#include "enclave/enclave_preempt.h"
+#include "enclave/enclave_profile.h"
+#include "enclave/enclave_stats.h"
 #include "enclave/enclave_util.h"
 #include "enclave/lthread.h"
 #include "enclave/sgxlkl_t.h"
 #include "shared/env.h"
+#include "shared/sgxlkl_preempt.h"
 
 #define RDTSC_OPCODE 0x310F
 // -----------------------------------------------------------------------
@@ -127,6 +131,22 @@ static void deserialize_ucontext(
 static uint64_t sgxlkl_enclave_signal_handler(
     oe_exception_record_t* exception_record)
 {
+#ifdef DEBUG
+    /* Profiling ticks are forwarded by the host in software mode */
+    if (exception_record->code == SGXLKL_PROFILE_TICK)
+    {
+        sgxlkl_profile_sample(exception_record->context);
+        return OE_EXCEPTION_CONTINUE_EXECUTION;
+    }
+#endif
+
+    /* Preemption ticks are forwarded by the host in software mode */
+    if (exception_record->code == SGXLKL_PREEMPT_TICK)
+    {
+        sgxlkl_preempt_tick(exception_record->context);
+        return OE_EXCEPTION_CONTINUE_EXECUTION;
+    }
+
     int ret = -1;
     siginfo_t info;
     struct ucontext uctx;
@@ -216,9 +236,17 @@ static uint64_t sgxlkl_enclave_signal_handler(
 
         /**
          * The trap is is passed to LKL. If it can be handled, excecution will
-         * continue, otherwise LKL will abort the process.
+         * continue, otherwise LKL will abort the process. The application's
+         * signal handler runs on top of the exception handler, so it must not
+         * be preempted: in software mode, the host still blocks the signal
+         * for this ethread.
          */
+        struct lthread* lt = lthread_self();
+        if (lt)
+            lt->no_preempt++;
         lkl_do_trap(trap_info.trapnr, trap_info.signo, NULL, &uctx, 0, &info);
+        if (lt)
+            lt->no_preempt--;
         deserialize_ucontext(&uctx, oe_ctx);
     }
     else
@@ -253,6 +281,7 @@ static void _sgxlkl_illegal_instr_hook(uint16_t opcode, oe_context_t* context)
             if (context->rax != 0xff)
             {
                 /* Call into host to execute the CPUID instruction. */
+                SGXLKL_STATS_OCALL(SGXLKL_STATS_OCALL_CPUID);
                 sgxlkl_host_hw_cpuid(
                     (uint32_t)context->rax, /* leaf */
                     (uint32_t)context->rcx, /* subleaf */
@@ -269,6 +298,7 @@ static void _sgxlkl_illegal_instr_hook(uint16_t opcode, oe_context_t* context)
         case RDTSC_OPCODE:
             rax = 0, rdx = 0;
             /* Call into host to execute the RDTSC instruction */
+            SGXLKL_STATS_OCALL(SGXLKL_STATS_OCALL_RDTSC);
             sgxlkl_host_hw_rdtsc(&rax, &rdx);
             context->rax = rax;
             context->rdx = rdx;
@@ -0,0 +1,113 @@
+#include <stdbool.h>
+
+#include "enclave/enclave_state.h"
+#include "enclave/enclave_stats.h"
+#include "enclave/enclave_switchless.h"
+#include "enclave/lthread.h"
+#include "enclave/lthread_int.h"
+#include "enclave/sgxlkl_t.h"
+#include "shared/sgxlkl_switchless.h"
+
+/*
+ * Posts a call to the switchless ring. Returns false if the ring is disabled
+ * or there is no idle worker to take the call, in which case the caller
+ * makes a regular OCALL. If ret is NULL, returns as soon as the call is
+ * posted, otherwise polls until a worker has completed it.
+ */
+static bool switchless_call(
+    sgxlkl_switchless_func_t func,
+    uint64_t arg0,
+    uint64_t arg1,
+    uint64_t arg2,
+    int64_t* ret)
+{
+    sgxlkl_switchless_t* sl = sgxlkl_enclave_state.shared_memory.switchless;
+    sgxlkl_switchless_call_t* call = NULL;
+
+    if (!sl)
+        return false;
+
+    // Workers are saturated if every idle worker already has a call waiting
+    uint64_t pending = __atomic_load_n(&sl->pending, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&sl->idle_workers, __ATOMIC_RELAXED) <=
+        (uint64_t)__builtin_popcountll(pending))
+        return false;
+
+    // Start looking for a free slot at a different slot on each ethread
+    size_t start = __scheduler_self()->tid;
+    for (size_t i = 0; i < SGXLKL_SWITCHLESS_SLOTS && !call; i++)
+    {
+        sgxlkl_switchless_call_t* c =
+            &sl->calls[(start + i) % SGXLKL_SWITCHLESS_SLOTS];
+        uint32_t state = SGXLKL_SWITCHLESS_FREE;
+
+        if (__atomic_load_n(&c->state, __ATOMIC_RELAXED) == state &&
+            __atomic_compare_exchange_n(
+                &c->state,
+                &state,
+                SGXLKL_SWITCHLESS_CLAIMED,
+                false,
+                __ATOMIC_ACQUIRE,
+                __ATOMIC_RELAXED))
+            call = c;
+    }
+    if (!call)
+        return false;
+
+    uint64_t bit = 1ULL << (call - sl->calls);
+    call->func = func;
+    call->args[0] = arg0;
+    call->args[1] = arg1;
+    call->args[2] = arg2;
+    __atomic_fetch_or(&sl->pending, bit, __ATOMIC_SEQ_CST);
+
+    // A worker that goes to sleep stops counting itself as idle before it
+    // checks pending for the last time. If no worker is idle any more, the
+    // call may have been missed, so take it back unless a worker already
+    // took it.
+    if (__atomic_load_n(&sl->idle_workers, __ATOMIC_SEQ_CST) == 0 &&
+        (__atomic_fetch_and(&sl->pending, ~bit, __ATOMIC_SEQ_CST) & bit))
+    {
+        __atomic_store_n(
+            &call->state, SGXLKL_SWITCHLESS_FREE, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    SGXLKL_STATS_INC(switchless_calls);
+
+    // Calls without a result are freed by the worker
+    if (!ret)
+        return true;
+
+    while (__atomic_load_n(&call->state, __ATOMIC_ACQUIRE) !=
+           SGXLKL_SWITCHLESS_DONE)
+        __builtin_ia32_pause();
+
+    *ret = call->ret;
+    __atomic_store_n(&call->state, SGXLKL_SWITCHLESS_FREE, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+int enclave_host_mprotect(void* addr, size_t len, int prot)
+{
+    int64_t sl_ret;
+    int ret;
+
+    if (switchless_call(
+            SGXLKL_SWITCHLESS_MPROTECT, (uint64_t)addr, len, prot, &sl_ret))
+        return sl_ret;
+
+    SGXLKL_STATS_OCALL(SGXLKL_STATS_OCALL_MPROTECT);
+    sgxlkl_host_syscall_mprotect(&ret, addr, len, prot);
+    return ret;
+}
+
+void enclave_host_device_request(uint8_t dev_id)
+{
+    if (switchless_call(SGXLKL_SWITCHLESS_DEVICE_REQUEST, dev_id, 0, 0, NULL))
+        return;
+
+    SGXLKL_STATS_OCALL(SGXLKL_STATS_OCALL_DEVICE_REQUEST);
+    sgxlkl_host_device_request(dev_id);
+}
@@ -94,7 +94,7 @@ void sgxlkl_print_backtrace(void** start_frame)
     size = oe_backtrace_impl(
         start_frame == NULL ? __builtin_frame_address(0) : start_frame,
         buf,
-        sizeof(buf));
+        sizeof(buf) / sizeof(buf[0]));
     strings = oe_backtrace_symbols(buf, size);
 
     for (i = 0; i < size; i++)
@@ -38,14 +38,31 @@
 #include "enclave/enclave_util.h"
 #include "enclave/mpmc_queue.h"
 
-static void _mpmc_pause(void);
-static void _mpmc_pause()
+/* Upper bound of the exponential backoff, in pause instructions */
+#define MPMC_BACKOFF_MAX 64
+
+static inline void _mpmc_pause(void)
 {
-#ifdef __x86__
-    __builtin_ia32_pause()
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
 #endif
 }
 
+/* Back off after losing a race for a queue position. The number of pauses
+ * doubles with every lost race, so that ethreads contending for the same
+ * position spread out instead of hammering its cache line. */
+static inline void _mpmc_backoff(unsigned* backoff)
+{
+    for (unsigned i = 0; i < *backoff; i++)
+    {
+        _mpmc_pause();
+    }
+    if (*backoff < MPMC_BACKOFF_MAX)
+    {
+        *backoff <<= 1;
+    }
+}
+
 /* user is responsible for freeing the queue buffer, but it's tied to the
    runtime of the enclave, so is not necessary in practice */
 int newmpmcq(struct mpmcq* q, size_t buffer_size, void* buffer)
@@ -68,8 +85,9 @@ int newmpmcq(struct mpmcq* q, size_t buffer_size, void* buffer)
 int mpmc_enqueue(volatile struct mpmcq* q, void* data)
 {
     struct cell_t* cell;
-    size_t seq, exp;
+    size_t seq;
     intptr_t dif;
+    unsigned backoff = 1;
     size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
     for (;;)
     {
@@ -78,10 +96,9 @@ int mpmc_enqueue(volatile struct mpmcq* q, void* data)
         dif = (intptr_t)seq - (intptr_t)pos;
         if (dif == 0)
         {
-            exp = pos;
             if (__atomic_compare_exchange_n(
                     &q->enqueue_pos,
-                    &exp,
+                    &pos,
                     pos + 1,
                     1,
                     __ATOMIC_RELAXED,
@@ -89,6 +106,7 @@ int mpmc_enqueue(volatile struct mpmcq* q, void* data)
             {
                 break;
             }
+            _mpmc_backoff(&backoff);
         }
         else if (dif < 0)
         {
@@ -96,8 +114,8 @@ int mpmc_enqueue(volatile struct mpmcq* q, void* data)
         }
         else
         {
+            _mpmc_backoff(&backoff);
             pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
-            _mpmc_pause();
         }
     }
     cell->data = data;
@@ -110,6 +128,7 @@ int mpmc_dequeue(volatile struct mpmcq* q, void** data)
     struct cell_t* cell;
     size_t seq;
     intptr_t dif;
+    unsigned backoff = 1;
     size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
     for (;;)
     {
@@ -118,10 +137,9 @@ int mpmc_dequeue(volatile struct mpmcq* q, void** data)
         dif = (intptr_t)seq - (intptr_t)(pos + 1);
         if (dif == 0)
         {
-            size_t exp = pos;
             if (__atomic_compare_exchange_n(
                     &q->dequeue_pos,
-                    &exp,
+                    &pos,
                     pos + 1,
                     1,
                     __ATOMIC_RELAXED,
@@ -129,6 +147,7 @@ int mpmc_dequeue(volatile struct mpmcq* q, void** data)
             {
                 break;
             }
+            _mpmc_backoff(&backoff);
         }
         else if (dif < 0)
         {
@@ -136,11 +155,84 @@ int mpmc_dequeue(volatile struct mpmcq* q, void** data)
         }
         else
         {
+            _mpmc_backoff(&backoff);
             pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
-            _mpmc_pause();
         }
     }
     *data = cell->data;
     __atomic_store_n(&cell->seq, pos + q->buffer_mask + 1, __ATOMIC_RELEASE);
     return 1;
 }
+
+/*
+ * The batch enqueue claims a run of consecutive positions with a single CAS
+ * on the enqueue position. A cell past the current position can only become
+ * free through the thread that dequeues the previous lap of that cell, never
+ * the other way round, so a run of cells that was seen to be free is still
+ * free when the CAS succeeds.
+ */
+
+size_t mpmc_enqueue_batch(volatile struct mpmcq* q, void** data, size_t n)
+{
+    size_t pos, seq, i;
+    intptr_t dif;
+    unsigned backoff = 1;
+
+    if (n == 0)
+        return 0;
+
+    pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        seq = __atomic_load_n(
+            &q->buffer[pos & q->buffer_mask].seq, __ATOMIC_ACQUIRE);
+        dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0)
+        {
+            /* Claim as many of the following cells as are free */
+            for (i = 1; i < n && i <= q->buffer_mask; i++)
+            {
+                seq = __atomic_load_n(
+                    &q->buffer[(pos + i) & q->buffer_mask].seq,
+                    __ATOMIC_ACQUIRE);
+                if (seq != pos + i)
+                    break;
+            }
+            if (__atomic_compare_exchange_n(
+                    &q->enqueue_pos,
+                    &pos,
+                    pos + i,
+                    1,
+                    __ATOMIC_RELAXED,
+                    __ATOMIC_RELAXED))
+            {
+                break;
+            }
+            _mpmc_backoff(&backoff);
+        }
+        else if (dif < 0)
+        {
+            return 0;
+        }
+        else
+        {
+            _mpmc_backoff(&backoff);
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    for (size_t j = 0; j < i; j++)
+    {
+        struct cell_t* cell = &q->buffer[(pos + j) & q->buffer_mask];
+        cell->data = data[j];
+        __atomic_store_n(&cell->seq, pos + j + 1, __ATOMIC_RELEASE);
+    }
+    return i;
+}
+
+size_t mpmc_size(volatile struct mpmcq* q)
+{
+    size_t dequeue_pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    size_t enqueue_pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
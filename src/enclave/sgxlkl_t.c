@@ -33,6 +33,7 @@ typedef struct _sgxlkl_ethread_init_args_t
 {
     oe_result_t _result;
     int _retval;
+    int ethread_id;
 } sgxlkl_ethread_init_args_t;
 
 typedef struct _sgxlkl_debug_dump_stack_traces_args_t
@@ -182,7 +183,7 @@ static void ecall_sgxlkl_ethread_init(
 
     /* Call user function. */
     pargs_out->_retval = sgxlkl_ethread_init(
-    );
+        pargs_in->ethread_id);
 
     /* Success. */
     _result = OE_OK;
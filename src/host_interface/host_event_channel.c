@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 #include <host/sgxlkl_u.h>
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
@@ -63,6 +64,43 @@ static inline int _vio_host_wait_for_enclave_event(
     return 0;
 }
 
+/*
+ * Function to busy-poll for an event from guest for the poll budget of the
+ * device. While the host polls, the waiter bit of the event channel remains
+ * clear, so the guest does not need to exit the enclave to notify the host.
+ * Returns true if an event was delivered.
+ */
+static inline bool _vio_host_poll_for_enclave_event(host_dev_config_t* cfg)
+{
+    evt_t* evt_chn = &cfg->host_evt_chn->host_evt_channel;
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (unsigned int i = 1;; i++)
+    {
+        evt_t cur = __atomic_load_n(evt_chn, __ATOMIC_SEQ_CST);
+        if (cur != cfg->evt_processed)
+        {
+            cfg->evt_processed = cur;
+            return true;
+        }
+
+        /* Reading the clock is more expensive than the event channel */
+        if (i % 128 == 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            uint64_t elapsed_ns =
+                (now.tv_sec - start.tv_sec) * NSEC_PER_SECOND + now.tv_nsec -
+                start.tv_nsec;
+            if (elapsed_ns >= cfg->poll_budget_ns)
+                return false;
+        }
+
+        __builtin_ia32_pause();
+    }
+}
+
 /*
  * Function to initialize the device event handler
  */
@@ -94,6 +132,13 @@ void vio_host_process_enclave_event(uint8_t dev_id, int timeout_ms)
     host_dev_config_t* dev_config = &_dev_cfg[dev_id];
     host_evt_channel_t* evt_chn = dev_config->host_evt_chn;
     evt_t* evt_processed = &dev_config->evt_processed;
+
+    /* Only fall back to sleeping once the poll budget is used up. Polling is
+     * skipped during shutdown to let the device task idle. */
+    if (dev_config->poll_budget_ns && !vio_host_check_guest_shutdown_evt() &&
+        _vio_host_poll_for_enclave_event(dev_config))
+        return;
+
     pthread_mutex_lock(&dev_config->lock);
 
     evt_t desired = *evt_processed + 1;
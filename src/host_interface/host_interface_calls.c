@@ -1,5 +1,6 @@
 #include <cpuid.h>
 #include <errno.h>
+#include <host/host_switchless.h>
 #include <host/sgxlkl_util.h>
 
 #include <host/vio_host_event_channel.h>
@@ -118,6 +119,7 @@ void sgxlkl_host_sw_register_signal_handler(void* signal_handler)
 
 int sgxlkl_host_syscall_mprotect(void* addr, size_t len, int prot)
 {
+    sgxlkl_switchless_wake();
     return mprotect(addr, len, prot);
 }
 
@@ -181,6 +183,7 @@ void sgxlkl_host_hw_rdtsc(uint32_t* eax, uint32_t* edx)
 
 void sgxlkl_host_device_request(int dev_id)
 {
+    sgxlkl_switchless_wake();
     sgxlkl_host_handle_device_request(dev_id);
 }
 
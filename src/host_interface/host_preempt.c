@@ -0,0 +1,68 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <host/host_preempt.h>
+#include <host/sgxlkl_util.h>
+
+typedef struct preempt_ticker_args
+{
+    pthread_t* ethreads;
+    size_t num_ethreads;
+    struct timespec period;
+} preempt_ticker_args_t;
+
+static preempt_ticker_args_t ticker_args;
+static pthread_t ticker_thread;
+
+/*
+ * Task run by an independent pthread that interrupts all ethreads once per
+ * time slice. The enclave only preempts an lthread if it is still running
+ * at the next tick, so a CPU-bound lthread runs for one to two time slices.
+ * Deadlines are absolute, so that the tick rate does not drift with the
+ * time it takes to signal the ethreads.
+ */
+static void* preempt_ticker_task(void* arg)
+{
+    preempt_ticker_args_t* args = arg;
+    struct timespec next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (;;)
+    {
+        next.tv_sec += args->period.tv_sec;
+        next.tv_nsec += args->period.tv_nsec;
+        if (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        for (size_t i = 0; i < args->num_ethreads; i++)
+            pthread_kill(args->ethreads[i], SGXLKL_PREEMPT_SIGNAL);
+    }
+
+    return NULL;
+}
+
+void sgxlkl_preempt_start(
+    pthread_t* ethreads,
+    size_t num_ethreads,
+    uint64_t quantum_us)
+{
+    if (quantum_us == 0 || quantum_us > SGXLKL_PREEMPT_MAX_QUANTUM_US)
+        sgxlkl_host_fail("Invalid preemption quantum: %lu\n", quantum_us);
+
+    ticker_args.ethreads = ethreads;
+    ticker_args.num_ethreads = num_ethreads;
+    ticker_args.period.tv_sec = quantum_us / 1000000;
+    ticker_args.period.tv_nsec = (quantum_us % 1000000) * 1000;
+
+    pthread_create(&ticker_thread, NULL, preempt_ticker_task, &ticker_args);
+    pthread_setname_np(ticker_thread, "HOST_PREEMPT");
+}
@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <host/host_profile.h>
+#include <host/sgxlkl_util.h>
+#include <shared/sgxlkl_profile.h>
+#include <shared/shared_memory.h>
+
+/* Maximum length of a folded stack line */
+#define PROFILE_LINE_MAX 4096
+
+typedef struct profile_ticker_args
+{
+    pthread_t* ethreads;
+    size_t num_ethreads;
+    int hz;
+} profile_ticker_args_t;
+
+typedef struct profile_symbol
+{
+    uint64_t addr;
+    uint64_t size;
+    const char* name;
+} profile_symbol_t;
+
+/* Profile ring buffer shared with the enclave (NULL if disabled) */
+static sgxlkl_profile_t* profile;
+
+/* Set once the samples are written to stop the ticker thread */
+static _Atomic(bool) profile_stopped = false;
+
+static profile_ticker_args_t ticker_args;
+static pthread_t ticker_thread;
+
+void sgxlkl_profile_init(sgxlkl_shared_memory_t* shared_memory, size_t samples)
+{
+    size_t size =
+        sizeof(sgxlkl_profile_t) + samples * sizeof(sgxlkl_profile_sample_t);
+
+    profile = mmap(
+        0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (profile == MAP_FAILED)
+        sgxlkl_host_fail("Profile shared memory alloc failed\n");
+
+    profile->version = SGXLKL_PROFILE_VERSION;
+    profile->capacity = samples;
+    profile->head = 0;
+
+    shared_memory->profile = profile;
+}
+
+/*
+ * Task run by an independent pthread that interrupts all ethreads at the
+ * sampling frequency. The SIGPROF handler forwards the interrupted context to
+ * the enclave, which records the sample.
+ */
+static void* profile_ticker_task(void* arg)
+{
+    profile_ticker_args_t* args = arg;
+    struct timespec ts;
+    uint64_t interval_ns = 1000000000ULL / args->hz;
+
+    ts.tv_sec = interval_ns / 1000000000ULL;
+    ts.tv_nsec = interval_ns % 1000000000ULL;
+
+    while (!profile_stopped)
+    {
+        int ret = clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+        if (ret != 0 && ret != EINTR)
+            sgxlkl_host_fail(
+                "Profile ticker clock_nanosleep failed: %s\n", strerror(ret));
+        for (size_t i = 0; i < args->num_ethreads; i++)
+            pthread_kill(args->ethreads[i], SIGPROF);
+    }
+
+    return NULL;
+}
+
+void sgxlkl_profile_start(pthread_t* ethreads, size_t num_ethreads, int hz)
+{
+    if (!profile)
+        return;
+
+    if (hz <= 0 || hz > 10000)
+        sgxlkl_host_fail("Invalid profiling frequency: %i\n", hz);
+
+    ticker_args.ethreads = ethreads;
+    ticker_args.num_ethreads = num_ethreads;
+    ticker_args.hz = hz;
+
+    pthread_create(&ticker_thread, NULL, profile_ticker_task, &ticker_args);
+    pthread_setname_np(ticker_thread, "HOST_PROFILER");
+}
+
+static int compare_symbols(const void* a, const void* b)
+{
+    const profile_symbol_t* x = a;
+    const profile_symbol_t* y = b;
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/*
+ * Loads the function symbols of the enclave image. The returned array is
+ * sorted by address. The image stays mapped as symbol names point into it.
+ */
+static profile_symbol_t* load_symbols(const char* image_path, size_t* count)
+{
+    struct stat st;
+    profile_symbol_t* syms = NULL;
+    size_t n = 0;
+
+    *count = 0;
+
+    int fd = open(image_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        sgxlkl_host_warn("Failed to open enclave image %s\n", image_path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    const uint8_t* image =
+        mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+    {
+        sgxlkl_host_warn("Failed to map enclave image %s\n", image_path);
+        return NULL;
+    }
+
+    const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)image;
+    if (st.st_size < sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+        ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > st.st_size)
+    {
+        sgxlkl_host_warn("Enclave image %s is not an ELF file\n", image_path);
+        return NULL;
+    }
+
+    const Elf64_Shdr* shdrs = (const Elf64_Shdr*)(image + ehdr->e_shoff);
+    for (size_t i = 0; i < ehdr->e_shnum; i++)
+    {
+        if (shdrs[i].sh_type != SHT_SYMTAB ||
+            shdrs[i].sh_link >= ehdr->e_shnum)
+            continue;
+
+        const Elf64_Sym* symtab =
+            (const Elf64_Sym*)(image + shdrs[i].sh_offset);
+        const char* strtab =
+            (const char*)(image + shdrs[shdrs[i].sh_link].sh_offset);
+        size_t nsyms = shdrs[i].sh_size / sizeof(Elf64_Sym);
+
+        syms = calloc(nsyms, sizeof(profile_symbol_t));
+        if (!syms)
+            sgxlkl_host_fail("Failed to allocate profile symbol table\n");
+
+        for (size_t j = 0; j < nsyms; j++)
+        {
+            if (ELF64_ST_TYPE(symtab[j].st_info) != STT_FUNC ||
+                symtab[j].st_value == 0)
+                continue;
+            syms[n].addr = symtab[j].st_value;
+            syms[n].size = symtab[j].st_size;
+            syms[n].name = strtab + symtab[j].st_name;
+            n++;
+        }
+        break;
+    }
+
+    if (!syms)
+        sgxlkl_host_warn("Enclave image %s has no symbol table\n", image_path);
+    else
+        qsort(syms, n, sizeof(profile_symbol_t), compare_symbols);
+
+    *count = n;
+    return syms;
+}
+
+static const char* lookup_symbol(
+    const profile_symbol_t* syms,
+    size_t count,
+    uint64_t addr)
+{
+    size_t lo = 0, hi = count;
+
+    /* Find the last symbol that starts at or before addr */
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (syms[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return NULL;
+
+    const profile_symbol_t* sym = &syms[lo - 1];
+    if (sym->size && addr >= sym->addr + sym->size)
+        return NULL;
+
+    return sym->name;
+}
+
+static int compare_lines(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+void sgxlkl_profile_write(const char* output_path, const char* image_path)
+{
+    if (!profile)
+        return;
+
+    profile_stopped = true;
+
+    uint64_t head = __atomic_load_n(&profile->head, __ATOMIC_ACQUIRE);
+    size_t num_samples = head < profile->capacity ? head : profile->capacity;
+
+    FILE* out = fopen(output_path, "w");
+    if (!out)
+    {
+        sgxlkl_host_warn("Failed to open profile output %s\n", output_path);
+        return;
+    }
+
+    size_t num_syms;
+    profile_symbol_t* syms = load_symbols(image_path, &num_syms);
+
+    char** lines = calloc(num_samples ? num_samples : 1, sizeof(char*));
+    if (!lines)
+        sgxlkl_host_fail("Failed to allocate profile output\n");
+
+    /* Build one folded stack per sample: ethread;lthread;outer;...;inner */
+    for (size_t i = 0; i < num_samples; i++)
+    {
+        const sgxlkl_profile_sample_t* s = &profile->samples[i];
+        char line[PROFILE_LINE_MAX];
+        size_t len = 0;
+        uint32_t depth =
+            s->depth < SGXLKL_PROFILE_MAX_DEPTH ? s->depth
+                                                : SGXLKL_PROFILE_MAX_DEPTH;
+
+        len += snprintf(
+            line,
+            sizeof(line),
+            "ethread-%u;%.*s",
+            s->ethread,
+            (int)sizeof(s->funcname),
+            s->funcname[0] ? s->funcname : "scheduler");
+
+        for (uint32_t d = depth; d > 0 && len < sizeof(line); d--)
+        {
+            uint64_t addr = s->frames[d - 1];
+            const char* name = lookup_symbol(syms, num_syms, addr);
+            if (name)
+                len += snprintf(line + len, sizeof(line) - len, ";%s", name);
+            else
+                len += snprintf(
+                    line + len,
+                    sizeof(line) - len,
+                    ";[enclave+0x%" PRIx64 "]",
+                    addr);
+        }
+
+        lines[i] = strdup(line);
+        if (!lines[i])
+            sgxlkl_host_fail("Failed to allocate profile output\n");
+    }
+
+    /* Aggregate identical stacks */
+    qsort(lines, num_samples, sizeof(char*), compare_lines);
+    for (size_t i = 0; i < num_samples;)
+    {
+        size_t j = i + 1;
+        while (j < num_samples && strcmp(lines[i], lines[j]) == 0)
+            j++;
+        fprintf(out, "%s %zu\n", lines[i], j - i);
+        i = j;
+    }
+
+    fclose(out);
+
+    sgxlkl_host_info(
+        "Wrote %zu profile samples to %s (%" PRIu64 " taken)\n",
+        num_samples,
+        output_path,
+        head);
+
+    for (size_t i = 0; i < num_samples; i++)
+        free(lines[i]);
+    free(lines);
+    free(syms);
+}
@@ -0,0 +1,260 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <host/host_stats.h>
+#include <host/sgxlkl_util.h>
+#include <shared/sgxlkl_stats.h>
+#include <shared/shared_memory.h>
+
+/* Statistics page shared with the enclave (NULL if disabled) */
+static sgxlkl_stats_t* stats;
+
+/* Ethread id of the calling host thread, -1 if it does not run an ethread */
+static __thread int stats_ethread_id = -1;
+
+/* Size of a bounce buffer slot (IO_TLB_SIZE in the LKL kernel) */
+#define SWIOTLB_SLOT_SIZE 2048
+
+#define STATS_MAX_DEVICES 16
+
+typedef struct device_stats
+{
+    struct virtio_dev* dev;
+    char name[16];
+
+    /* Number of times the host started to process a queue */
+    uint64_t scans;
+
+    /* Pending requests found when starting to process a queue */
+    uint64_t pending_sum;
+    uint64_t pending_max;
+
+    /* Number of times a queue was full, i.e. the guest had to hold back
+     * requests until the host completed some */
+    uint64_t queue_full;
+
+    /* Bounce buffer slots held by the pending requests */
+    uint64_t slots_sum;
+    uint64_t slots_max;
+} device_stats_t;
+
+static device_stats_t device_stats[STATS_MAX_DEVICES];
+static size_t num_device_stats;
+
+/* Bounce buffer shared with the enclave, if any */
+static uint64_t swiotlb_start;
+static uint64_t swiotlb_end;
+
+void sgxlkl_stats_init(sgxlkl_shared_memory_t* shared_memory, size_t ethreads)
+{
+    if (ethreads > SGXLKL_STATS_MAX_ETHREADS)
+        sgxlkl_host_warn(
+            "Statistics are only collected for the first %i ethreads\n",
+            SGXLKL_STATS_MAX_ETHREADS);
+
+    stats = mmap(
+        0,
+        sizeof(sgxlkl_stats_t),
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0);
+    if (stats == MAP_FAILED)
+        sgxlkl_host_fail("Statistics shared memory alloc failed\n");
+
+    stats->version = SGXLKL_STATS_VERSION;
+    stats->num_ethreads = ethreads < SGXLKL_STATS_MAX_ETHREADS
+                              ? ethreads
+                              : SGXLKL_STATS_MAX_ETHREADS;
+
+    swiotlb_start = (uint64_t)shared_memory->virtio_swiotlb;
+    swiotlb_end = swiotlb_start + shared_memory->virtio_swiotlb_size;
+
+    shared_memory->stats = stats;
+}
+
+void sgxlkl_stats_register_device(struct virtio_dev* dev, const char* name)
+{
+    if (num_device_stats == STATS_MAX_DEVICES)
+        return;
+
+    device_stats_t* d = &device_stats[num_device_stats++];
+    d->dev = dev;
+    strncpy(d->name, name, sizeof(d->name) - 1);
+}
+
+bool sgxlkl_stats_enabled(void)
+{
+    return stats != NULL;
+}
+
+uint64_t sgxlkl_stats_bounce_slots(uint64_t addr, uint32_t len)
+{
+    if (addr < swiotlb_start || addr >= swiotlb_end)
+        return 0;
+
+    return (len + SWIOTLB_SLOT_SIZE - 1) / SWIOTLB_SLOT_SIZE;
+}
+
+static void update_max(uint64_t* max, uint64_t val)
+{
+    uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (val > cur &&
+           !__atomic_compare_exchange_n(
+               max, &cur, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void sgxlkl_stats_count_queue(
+    struct virtio_dev* dev,
+    uint64_t pending,
+    bool full,
+    uint64_t slots)
+{
+    device_stats_t* d = NULL;
+
+    for (size_t i = 0; i < num_device_stats && !d; i++)
+        if (device_stats[i].dev == dev)
+            d = &device_stats[i];
+    if (!d)
+        return;
+
+    /* Queues of one device may be processed by different host threads */
+    __atomic_fetch_add(&d->scans, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->pending_sum, pending, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->slots_sum, slots, __ATOMIC_RELAXED);
+    if (full)
+        __atomic_fetch_add(&d->queue_full, 1, __ATOMIC_RELAXED);
+    update_max(&d->pending_max, pending);
+    update_max(&d->slots_max, slots);
+}
+
+static void device_stats_dump(void)
+{
+    if (!num_device_stats)
+        return;
+
+    sgxlkl_host_info(
+        "%-8s %12s %10s %10s %12s %10s %10s (bounce buffer: %" PRIu64
+        " slots)\n",
+        "device",
+        "scans",
+        "pend_avg",
+        "pend_max",
+        "queue_full",
+        "slots_avg",
+        "slots_max",
+        (swiotlb_end - swiotlb_start) / SWIOTLB_SLOT_SIZE);
+
+    for (size_t i = 0; i < num_device_stats; i++)
+    {
+        const device_stats_t* d = &device_stats[i];
+        uint64_t scans = d->scans ? d->scans : 1;
+
+        sgxlkl_host_info(
+            "%-8s %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64
+            " %10" PRIu64 " %10" PRIu64 "\n",
+            d->name,
+            d->scans,
+            d->pending_sum / scans,
+            d->pending_max,
+            d->queue_full,
+            d->slots_sum / scans,
+            d->slots_max);
+    }
+}
+
+void sgxlkl_stats_dump(void)
+{
+    if (!stats)
+        return;
+
+    sgxlkl_host_info(
+        "%-8s %12s %10s %14s %10s %12s %12s %8s %8s %10s %10s %10s %10s %8s "
+        "%8s %10s %10s\n",
+        "ethread",
+        "resumes",
+        "preempts",
+        "spins",
+        "sleeps",
+        "futex_wait",
+        "futex_wake",
+        "runq_avg",
+        "runq_max",
+        "oc_idle",
+        "oc_mprot",
+        "dev_notify",
+        "oc_devreq",
+        "oc_cpuid",
+        "oc_rdtsc",
+        "switchless",
+        "aex");
+
+    for (size_t i = 0; i < stats->num_ethreads; i++)
+    {
+        const sgxlkl_ethread_stats_t* s = &stats->ethreads[i];
+        uint64_t runq_avg =
+            s->runq_samples ? s->runq_depth_sum / s->runq_samples : 0;
+
+        sgxlkl_host_info(
+            "%-8zu %12" PRIu64 " %10" PRIu64 " %14" PRIu64 " %10" PRIu64
+            " %12" PRIu64 " %12" PRIu64 " %8" PRIu64 " %8" PRIu64
+            " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+            " %8" PRIu64 " %8" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+            i,
+            s->resumes,
+            s->preemptions,
+            s->spins,
+            s->idle_sleeps,
+            s->futex_waits,
+            s->futex_wakes,
+            runq_avg,
+            s->runq_depth_max,
+            s->ocalls[SGXLKL_STATS_OCALL_IDLE_ETHREAD],
+            s->ocalls[SGXLKL_STATS_OCALL_MPROTECT],
+            s->device_notifies,
+            s->ocalls[SGXLKL_STATS_OCALL_DEVICE_REQUEST],
+            s->ocalls[SGXLKL_STATS_OCALL_CPUID],
+            s->ocalls[SGXLKL_STATS_OCALL_RDTSC],
+            s->switchless_calls,
+            stats->aex[i]);
+    }
+
+    device_stats_dump();
+}
+
+/*
+ * Task run by an independent pthread to periodically print the statistics
+ * exported by the enclave.
+ */
+void* sgxlkl_stats_task(void* interval_ms)
+{
+    struct timespec ts;
+    uint64_t ms = (uint64_t)(uintptr_t)interval_ms;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+
+    for (;;)
+    {
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+        sgxlkl_stats_dump();
+    }
+
+    return NULL;
+}
+
+void sgxlkl_stats_set_ethread_id(int ethread_id)
+{
+    stats_ethread_id = ethread_id;
+}
+
+void sgxlkl_stats_count_aex(void)
+{
+    if (stats && stats_ethread_id >= 0 &&
+        stats_ethread_id < SGXLKL_STATS_MAX_ETHREADS)
+        stats->aex[stats_ethread_id]++;
+}
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <host/host_switchless.h>
+#include <host/sgxlkl_util.h>
+#include <host/vio_host_event_channel.h>
+#include <shared/sgxlkl_switchless.h>
+
+/* Call ring shared with the enclave (NULL if disabled) */
+static sgxlkl_switchless_t* ring;
+
+/* Sleeping workers wait for the wake generation to change */
+static pthread_mutex_t sleep_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t wake_gen;
+static int sleeping_workers;
+
+static void switchless_run(sgxlkl_switchless_call_t* call)
+{
+    switch (call->func)
+    {
+        case SGXLKL_SWITCHLESS_MPROTECT:
+            call->ret = mprotect(
+                (void*)call->args[0], call->args[1], (int)call->args[2]);
+            break;
+        case SGXLKL_SWITCHLESS_DEVICE_REQUEST:
+            sgxlkl_host_handle_device_request(call->args[0]);
+            /* Nobody waits for the result */
+            __atomic_store_n(
+                &call->state, SGXLKL_SWITCHLESS_FREE, __ATOMIC_RELEASE);
+            return;
+        default:
+            call->ret = -ENOSYS;
+    }
+
+    __atomic_store_n(&call->state, SGXLKL_SWITCHLESS_DONE, __ATOMIC_RELEASE);
+}
+
+/*
+ * Function to take and run one pending call. Returns false if no call was
+ * pending.
+ */
+static bool switchless_take(void)
+{
+    uint64_t pending = __atomic_load_n(&ring->pending, __ATOMIC_SEQ_CST);
+
+    while (pending)
+    {
+        uint64_t bit = pending & -pending;
+
+        /* Another worker (or the enclave) may have cleared the bit */
+        if (__atomic_fetch_and(&ring->pending, ~bit, __ATOMIC_SEQ_CST) & bit)
+        {
+            __atomic_fetch_sub(&ring->idle_workers, 1, __ATOMIC_SEQ_CST);
+            switchless_run(&ring->calls[__builtin_ctzll(bit)]);
+            __atomic_fetch_add(&ring->idle_workers, 1, __ATOMIC_SEQ_CST);
+            return true;
+        }
+
+        pending = __atomic_load_n(&ring->pending, __ATOMIC_SEQ_CST);
+    }
+
+    return false;
+}
+
+/*
+ * Function to busy-poll for calls until no call arrived for the poll budget
+ */
+static void switchless_poll(void)
+{
+    struct timespec start, now;
+
+    __atomic_fetch_add(&ring->idle_workers, 1, __ATOMIC_SEQ_CST);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (unsigned int i = 1;; i++)
+    {
+        if (switchless_take())
+        {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            i = 0;
+            continue;
+        }
+
+        /* Reading the clock is more expensive than the ring */
+        if (i % 128 == 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            uint64_t elapsed_ns =
+                (now.tv_sec - start.tv_sec) * NSEC_PER_SECOND + now.tv_nsec -
+                start.tv_nsec;
+            if (elapsed_ns >= SGXLKL_SWITCHLESS_POLL_BUDGET_NS)
+                break;
+        }
+
+        __builtin_ia32_pause();
+    }
+
+    /* The enclave takes back calls posted while no worker is idle, but a
+     * call posted before the decrement must be served by this worker. */
+    __atomic_fetch_sub(&ring->idle_workers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&ring->pending, __ATOMIC_SEQ_CST))
+    {
+        __atomic_fetch_add(&ring->idle_workers, 1, __ATOMIC_SEQ_CST);
+        switchless_take();
+        __atomic_fetch_sub(&ring->idle_workers, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/*
+ * Task run by each worker thread. Workers poll while the enclave keeps them
+ * busy and sleep until the enclave makes an OCALL otherwise.
+ */
+static void* switchless_worker_task(void* arg)
+{
+    (void)arg;
+
+    for (;;)
+    {
+        switchless_poll();
+
+        pthread_mutex_lock(&sleep_mtx);
+        uint64_t gen = wake_gen;
+        __atomic_fetch_add(&sleeping_workers, 1, __ATOMIC_SEQ_CST);
+        while (gen == wake_gen)
+            pthread_cond_wait(&sleep_cond, &sleep_mtx);
+        __atomic_fetch_sub(&sleeping_workers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&sleep_mtx);
+    }
+
+    return NULL;
+}
+
+void sgxlkl_switchless_wake(void)
+{
+    if (!__atomic_load_n(&sleeping_workers, __ATOMIC_SEQ_CST))
+        return;
+
+    pthread_mutex_lock(&sleep_mtx);
+    wake_gen++;
+    pthread_cond_broadcast(&sleep_cond);
+    pthread_mutex_unlock(&sleep_mtx);
+}
+
+void sgxlkl_switchless_init(
+    sgxlkl_shared_memory_t* shared_memory,
+    size_t num_workers)
+{
+    if (num_workers == 0 || num_workers > SGXLKL_SWITCHLESS_MAX_WORKERS)
+        sgxlkl_host_fail(
+            "Invalid number of switchless workers: %zu\n", num_workers);
+
+    ring = mmap(
+        0,
+        sizeof(sgxlkl_switchless_t),
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0);
+    if (ring == MAP_FAILED)
+        sgxlkl_host_fail("Switchless call ring alloc failed\n");
+
+    ring->version = SGXLKL_SWITCHLESS_VERSION;
+
+    for (size_t i = 0; i < num_workers; i++)
+    {
+        pthread_t worker;
+        char name[16];
+
+        pthread_create(&worker, NULL, switchless_worker_task, NULL);
+        snprintf(name, sizeof(name), "HOST_SWLESS_%zu", i);
+        pthread_setname_np(worker, name);
+    }
+
+    shared_memory->switchless = ring;
+}
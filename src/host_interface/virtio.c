@@ -1,6 +1,7 @@
 
 /* code reused from lkl/tools/lkl/lib/virtio.c */
 
+#include <host/host_stats.h>
 #include <host/sgxlkl_u.h>
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
@@ -266,6 +267,35 @@ void virtio_set_queue_max_merge_len(struct virtio_dev* dev, int q, int len)
     dev->queue[q].max_merge_len = len;
 }
 
+/*
+ * virtio_count_pending: record the requests pending in a queue and the
+ * bounce buffer slots they hold in the device statistics
+ * dev: virtio device structure pointer
+ * q: virtio queue
+ */
+static void virtio_count_pending(struct virtio_dev* dev, struct virtq* q)
+{
+    uint16_t avail_idx = q->avail->idx;
+    uint16_t pending = avail_idx - q->last_avail_idx;
+    uint64_t slots = 0;
+
+    for (uint16_t idx = q->last_avail_idx; idx != avail_idx; idx++)
+    {
+        struct virtq_desc* desc = vring_desc_at_avail_idx(q, idx);
+
+        /* Bound the walk, the descriptors are written by the guest */
+        for (uint32_t n = 0; desc && n < q->num; n++)
+        {
+            slots += sgxlkl_stats_bounce_slots(desc->addr, desc->len);
+            desc = desc->flags & LKL_VRING_DESC_F_NEXT
+                       ? &q->desc[desc->next & (q->num - 1)]
+                       : NULL;
+        }
+    }
+
+    sgxlkl_stats_count_queue(dev, pending, pending == q->num, slots);
+}
+
 /*
  * virtio_process_queue : process all the requests in the specific queue
  * dev: virtio device structure pointer
@@ -282,6 +312,9 @@ void virtio_process_queue(struct virtio_dev* dev, uint32_t qidx)
     if (dev->ops->acquire_queue)
         dev->ops->acquire_queue(dev, qidx);
 
+    if (sgxlkl_stats_enabled())
+        virtio_count_pending(dev, q);
+
     while (q->last_avail_idx != q->avail->idx)
     {
         /* Make sure following loads happens after loading q->avail->idx */
@@ -1,12 +1,14 @@
 #include <assert.h>
 #include <errno.h>
 #include <host/host_state.h>
+#include <host/host_stats.h>
 #include <host/sgxlkl_u.h>
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
 #include <host/virtio_blkdev.h>
 #include <host/virtio_debug.h>
 #include <shared/env.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
@@ -16,6 +18,9 @@
 #define HOST_BLK_DEV_NUM_QUEUES 1
 #define HOST_BLK_DEV_QUEUE_DEPTH 32
 
+/* Largest bounce buffer mapping supported by the guest (IO_TLB_SEGSIZE) */
+#define HOST_BLK_DEV_MAX_SEGMENT_SIZE (256 * 1024)
+
 extern sgxlkl_host_state_t sgxlkl_host_state;
 
 #if DEBUG && VIRTIO_TEST_HOOK
@@ -103,11 +108,14 @@ static struct virtio_dev_ops _host_blk_ops = {
 /*
  * blk_device_init: initialize block device
  * disk-- input disk structure to initialize block device
+ * swiotlb_share-- bytes of the bounce buffer the device may use, 0 if
+ * unlimited
  */
 int blk_device_init(
     sgxlkl_host_disk_state_t* disk,
     size_t disk_index,
-    int enable_swiotlb)
+    int enable_swiotlb,
+    size_t swiotlb_share)
 {
     void* vq_mem = NULL;
     struct virtio_blk_dev* host_blk_device = NULL;
@@ -161,11 +169,40 @@ int blk_device_init(
     if (enable_swiotlb)
         host_blk_device->dev.device_features |= BIT(VIRTIO_F_IOMMU_PLATFORM);
 
+    /* The guest reads direct disks from their mapping and cannot write them */
+    if (disk->direct)
+        host_blk_device->dev.device_features |= BIT(VIRTIO_BLK_F_RO);
+
+    /* The guest sends requests with a single data segment, so limiting the
+     * segment size bounds the bounce buffer used by all requests in the
+     * queue */
+    if (enable_swiotlb && swiotlb_share)
+    {
+        size_t size_max = swiotlb_share / HOST_BLK_DEV_QUEUE_DEPTH;
+        size_max = min_len(size_max, HOST_BLK_DEV_MAX_SEGMENT_SIZE);
+        size_max &= ~(PAGE_SIZE - 1);
+        if (size_max < PAGE_SIZE)
+        {
+            sgxlkl_host_warn(
+                "Bounce buffer share of disk %zu too small, using %i bytes\n",
+                disk_index,
+                PAGE_SIZE * HOST_BLK_DEV_QUEUE_DEPTH);
+            size_max = PAGE_SIZE;
+        }
+
+        host_blk_device->config.size_max = size_max;
+        host_blk_device->dev.device_features |= BIT(VIRTIO_BLK_F_SIZE_MAX);
+    }
+
     sgxlkl_host_state.shared_memory.virtio_blk_dev_mem[disk_index] =
         &host_blk_device->dev;
     sgxlkl_host_state.shared_memory.virtio_blk_dev_names[disk_index] =
         strdup(disk->root_config ? "/" : disk->mount_config->destination);
 
+    char name[16];
+    snprintf(name, sizeof(name), "blk%zu", disk_index);
+    sgxlkl_stats_register_device(&host_blk_device->dev, name);
+
     return 0;
 }
 
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <host/host_state.h>
+#include <host/host_stats.h>
 #include <host/sgxlkl_util.h>
 #include <host/vio_host_event_channel.h>
 #include <host/virtio_debug.h>
@@ -651,6 +652,7 @@ int netdev_init(sgxlkl_host_state_t* host_state)
      * currently one net device is supported, at somepoint when multiple devices
      * are supported then virtio_net_dev_mem should hold array of devices */
     host_state->shared_memory.virtio_net_dev_mem = &net_dev->dev;
+    sgxlkl_stats_register_device(&net_dev->dev, "net");
 
     /* return netdev index */
     return registered_dev_idx++;
@@ -0,0 +1,27 @@
+#ifndef ENCLAVE_ALLOC_H
+#define ENCLAVE_ALLOC_H
+
+#include <stddef.h>
+
+/*
+ * Allocator for the small, short-lived objects of the enclave runtime, such
+ * as lthreads, LKL semaphores and timers. Objects of up to 2 KiB come from
+ * per-ethread caches of size classes, which are refilled in batches from
+ * slabs of enclave_mmap memory. Larger objects, and all objects allocated
+ * before enclave_alloc_init, come from the Open Enclave heap. Memory freed
+ * with enclave_free must have been allocated with enclave_malloc or
+ * enclave_calloc, on any ethread.
+ */
+
+/**
+ * Set up the allocator. Must be called after enclave_mman_init.
+ */
+void enclave_alloc_init(void);
+
+void* enclave_malloc(size_t size);
+
+void* enclave_calloc(size_t nmemb, size_t size);
+
+void enclave_free(void* ptr);
+
+#endif /* ENCLAVE_ALLOC_H */
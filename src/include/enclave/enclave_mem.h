@@ -33,6 +33,8 @@ void* enclave_mmap(
 
 long enclave_munmap(void* addr, size_t length);
 
+long enclave_mmap_reserve(void* addr, size_t length);
+
 void* enclave_mremap(
     void* old_addr,
     size_t old_length,
@@ -49,6 +51,24 @@ extern int mmap_files; // Allow MAP_PRIVATE or MAP_SHARED?
  */
 void enclave_mem_info(size_t* total, size_t* free);
 
+/**
+ * Report the range of memory that enclave_mmap allocates pages from.
+ */
+void enclave_mem_range(void** base, size_t* length);
+
+/**
+ * Set a range of pages that enclave_mmap only hands out without an address if
+ * no other free area is large enough. NULL clears the range.
+ */
+void enclave_mem_set_fallback_range(void* addr, size_t length);
+
+/**
+ * Set a function that is called after enclave_mmap or enclave_munmap changed
+ * the number of free pages, or after enclave_mmap failed to find failed_pages
+ * free pages. It may be called with the LKL CPU held.
+ */
+void enclave_mem_set_pressure_handler(void (*handler)(size_t failed_pages));
+
 long syscall_SYS_munmap(void* addr, size_t length);
 
 long syscall_SYS_mremap(
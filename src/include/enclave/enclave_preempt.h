@@ -0,0 +1,17 @@
+#ifndef ENCLAVE_PREEMPT_H
+#define ENCLAVE_PREEMPT_H
+
+#include <openenclave/enclave.h>
+
+/**
+ * Handles a preemption tick forwarded by the host. If the interrupted
+ * context is application code of an lthread that has been running since the
+ * previous tick on this ethread, the context is redirected so that the
+ * lthread yields to the scheduler and later resumes at the interrupted
+ * instruction with all registers intact. Code of the enclave image (the
+ * scheduler, LKL and libc) is never preempted, as it may hold spinlocks or
+ * the LKL CPU lock.
+ */
+void sgxlkl_preempt_tick(oe_context_t* context);
+
+#endif /* ENCLAVE_PREEMPT_H */
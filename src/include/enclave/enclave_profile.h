@@ -0,0 +1,16 @@
+#ifndef ENCLAVE_PROFILE_H
+#define ENCLAVE_PROFILE_H
+
+#include <openenclave/enclave.h>
+
+#ifdef DEBUG
+/**
+ * Records a stack sample of the interrupted context in the profile ring
+ * buffer shared with the host. Called from the enclave signal handler when
+ * the host forwards a profiling tick. Does nothing if profiling is disabled
+ * or the context was not interrupted inside the enclave.
+ */
+void sgxlkl_profile_sample(const oe_context_t* context);
+#endif
+
+#endif /* ENCLAVE_PROFILE_H */
@@ -51,6 +51,9 @@ typedef struct sgxlkl_enclave_state
     /* Memory shared with the host */
     sgxlkl_shared_memory_t shared_memory;
 
+    /* Number of samples in shared_memory.profile (validated copy) */
+    size_t profile_capacity;
+
     /* This flag is used by the tracing macros */
     bool verbose;
 } sgxlkl_enclave_state_t;
@@ -0,0 +1,29 @@
+#ifndef ENCLAVE_STATS_H
+#define ENCLAVE_STATS_H
+
+#include "enclave/lthread.h"
+#include "enclave/lthread_int.h"
+#include "shared/sgxlkl_stats.h"
+
+/*
+ * Returns the statistics slot of the calling ethread, or NULL if the host did
+ * not enable statistics.
+ */
+static inline sgxlkl_ethread_stats_t* sgxlkl_stats_self(void)
+{
+    return __scheduler_self()->stats;
+}
+
+#define SGXLKL_STATS_ADD(field, n)                             \
+    do                                                         \
+    {                                                          \
+        sgxlkl_ethread_stats_t* _s = sgxlkl_stats_self();      \
+        if (_s)                                                \
+            _s->field += (n);                                  \
+    } while (0)
+
+#define SGXLKL_STATS_INC(field) SGXLKL_STATS_ADD(field, 1)
+
+#define SGXLKL_STATS_OCALL(type) SGXLKL_STATS_INC(ocalls[type])
+
+#endif /* ENCLAVE_STATS_H */
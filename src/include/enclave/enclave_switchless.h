@@ -0,0 +1,24 @@
+#ifndef ENCLAVE_SWITCHLESS_H
+#define ENCLAVE_SWITCHLESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Host calls on the hot paths of the enclave. Idling an ethread is not one
+ * of them: the ethread would spin until the sleep ends and keep a worker
+ * busy for the whole time, so it is always an OCALL. If the host provided a
+ * switchless call ring (see shared/sgxlkl_switchless.h) and one of its
+ * workers is idle, the call is handed to the worker and the calling ethread
+ * polls for the result inside the enclave. Otherwise, the call is made as a
+ * regular OCALL.
+ */
+
+/* Changes the host page protection of enclave pages */
+int enclave_host_mprotect(void* addr, size_t len, int prot);
+
+/* Notifies the host device task of dev_id of new requests, does not wait
+ * for the host to act on the notification */
+void enclave_host_device_request(uint8_t dev_id);
+
+#endif /* ENCLAVE_SWITCHLESS_H */
@@ -50,6 +50,8 @@
 #define DEFAULT_FUTEX_WAKE_SPINS 1
 
 struct mpmcq __scheduler_queue;
+/* Run queue for high-priority lthreads, drained before __scheduler_queue */
+struct mpmcq __scheduler_queue_high;
 
 typedef void* (*lthread_func)(void*);
 
@@ -82,6 +84,12 @@ enum lthread_st
     LT_ST_TERMINATE,       /* lthread that makes the ethread scheduler quit */
 };
 
+enum lthread_priority
+{
+    LTHREAD_PRIO_NORMAL, /* application threads */
+    LTHREAD_PRIO_HIGH    /* device, timer and LKL kernel threads */
+};
+
 enum lthread_type
 {
     USERSPACE_THREAD,
@@ -110,6 +118,7 @@ struct lthread_attr
     _Atomic(int) state; /* current lthread state */
     void* stack;        /* ptr to lthread_stack */
     int thread_type;    /* type of thread: usermode or lkl kernel */
+    int priority;       /* scheduling priority class (lthread_priority) */
     char funcname[64];  /* optional func name */
 };
 
@@ -154,6 +163,8 @@ struct lthread
     void (*yield_cb)(void*);
     void* yield_cbarg;
     struct futex_q fq;
+    uint32_t no_preempt;          /* time-slice preemption disabled if > 0 */
+    uint64_t preempt_rip;         /* interrupted instruction if preempted */
 #ifdef DEBUG
     LIST_ENTRY(lthread) entries;
 #endif
@@ -176,6 +187,13 @@ struct lthread_sched
     uint64_t default_timeout;
     /* convenience data maintained by lthread_resume */
     struct lthread* current_lthread;
+    /* number of lthreads resumed, maintained by lthread_resume */
+    uint64_t resumes;
+    /* lthread and resume count seen by the last preemption tick */
+    struct lthread* preempt_lt;
+    uint64_t preempt_resumes;
+    /* consecutive high-priority lthreads resumed, see lthread_run */
+    size_t high_prio_streak;
 };
 /**
  * lthread scheduler context. Pointer to this structure can be fetched by
@@ -185,7 +203,13 @@ struct lthread_sched
 struct schedctx {
 	struct schedctx *self;
 	int tid;
+	/* Ethread id assigned by the host, as passed to init_ethread_tp */
+	int ethread_id;
 	struct lthread_sched sched;
+	/* Statistics slot of this ethread (NULL if statistics are disabled) */
+	struct sgxlkl_ethread_stats *stats;
+	/* Allocator cache of this ethread (created on first use) */
+	struct enclave_alloc_cache *alloc_cache;
 };
 
 /* Thread Control Block (TCB) for lthreads and lthread scheduler */
@@ -211,7 +235,7 @@ extern "C"
     /**
      * Initialisation of ethread/lthread scheduler thread pointer (schedctx).
      */
-    void init_ethread_tp();
+    void init_ethread_tp(int ethread_id);
 
     void lthread_sched_global_init(
         size_t sleepspins,
@@ -331,6 +355,15 @@ extern "C"
         return lthread_setspecific_remote(lthread_current(), key, value);
     }
 
+    /**
+     * Returns the run queue for the priority class of an lthread.
+     */
+    static inline struct mpmcq* __scheduler_queue_of(struct lthread* lt)
+    {
+        return lt->attr.priority == LTHREAD_PRIO_HIGH ? &__scheduler_queue_high
+                                                      : &__scheduler_queue;
+    }
+
     static inline void __scheduler_enqueue(struct lthread* lt)
     {
 #ifndef NDEBUG
@@ -343,10 +376,38 @@ extern "C"
         {
             a_crash();
         }
-        for (; !mpmc_enqueue(&__scheduler_queue, lt);)
+        struct mpmcq* q = __scheduler_queue_of(lt);
+        for (; !mpmc_enqueue(q, lt);)
             a_spin();
     }
 
+    /**
+     * Make several lthreads runnable at once.  This claims consecutive slots
+     * of the scheduler queue with one CAS sequence instead of one per lthread,
+     * for each run of lthreads with the same priority.
+     */
+    static inline void __scheduler_enqueue_batch(struct lthread** lts, size_t n)
+    {
+#ifndef NDEBUG
+        for (size_t i = 0; i < n; i++)
+            if (lts[i]->attr.state & (1 << (LT_ST_EXITED)))
+                __builtin_trap();
+#endif
+        while (n > 0)
+        {
+            struct mpmcq* q = __scheduler_queue_of(lts[0]);
+            size_t run = 1;
+            while (run < n && __scheduler_queue_of(lts[run]) == q)
+                run++;
+
+            size_t enqueued = mpmc_enqueue_batch(q, (void**)lts, run);
+            if (enqueued == 0)
+                a_spin();
+            lts += enqueued;
+            n -= enqueued;
+        }
+    }
+
     /**
      * Remove a thread from the list blocking on a futex.
      */
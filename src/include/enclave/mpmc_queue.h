@@ -61,4 +61,11 @@ int newmpmcq(struct mpmcq* q, size_t buffer_bytesize, void* buffer);
 
 int mpmc_dequeue(volatile struct mpmcq* q, void** data);
 
+/* Enqueue up to n elements with one CAS on the enqueue position. Returns the
+ * number of elements enqueued, which is less than n if the queue fills up. */
+size_t mpmc_enqueue_batch(volatile struct mpmcq* q, void** data, size_t n);
+
+/* Approximate number of elements in the queue (for statistics only) */
+size_t mpmc_size(volatile struct mpmcq* q);
+
 #endif /* MPMC_QUEUE_H */
@@ -64,10 +64,9 @@ static inline void ticket_lock(struct ticketlock* t)
     // Wait until our ticket is called.
     while (t->s.ticket != me)
     {
-#ifdef __x86__
-        __builtin_ia32_pause()
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
 #endif
-            ;
     }
 
 #if DEBUG
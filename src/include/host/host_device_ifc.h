@@ -9,12 +9,15 @@
 
 /*
  * Function to initialize the block device configuration and setup the virtio
- * device and queue which is shared with guest for virtio processing
+ * device and queue which is shared with guest for virtio processing. If
+ * swiotlb_share is not 0, requests are limited in size so that the device
+ * uses at most swiotlb_share bytes of the bounce buffer.
  */
 int blk_device_init(
     sgxlkl_host_disk_state_t* disk,
     size_t disk_index,
-    int enable_swiotlb);
+    int enable_swiotlb,
+    size_t swiotlb_share);
 
 /*
  * Block device backend task which listens for the guest request using event
@@ -0,0 +1,26 @@
+#ifndef HOST_PREEMPT_H
+#define HOST_PREEMPT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared/sgxlkl_preempt.h"
+
+/* Signal used to interrupt ethreads for time-slice preemption */
+#define SGXLKL_PREEMPT_SIGNAL SIGURG
+
+/* Maximum time slice in microseconds */
+#define SGXLKL_PREEMPT_MAX_QUANTUM_US 1000000
+
+/*
+ * Starts a host thread that sends SGXLKL_PREEMPT_SIGNAL to each of the given
+ * ethreads every quantum_us microseconds. The signal must be forwarded to the
+ * enclave signal handler with the exception code SGXLKL_PREEMPT_TICK.
+ */
+void sgxlkl_preempt_start(
+    pthread_t* ethreads,
+    size_t num_ethreads,
+    uint64_t quantum_us);
+
+#endif /* HOST_PREEMPT_H */
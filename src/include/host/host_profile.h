@@ -0,0 +1,35 @@
+#ifndef HOST_PROFILE_H
+#define HOST_PROFILE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "shared/shared_memory.h"
+
+/* Default sampling frequency of the profiler */
+#define SGXLKL_PROFILE_DEFAULT_HZ 99
+
+/* Default number of samples kept in the profile ring buffer */
+#define SGXLKL_PROFILE_DEFAULT_SAMPLES (1UL << 16)
+
+/*
+ * Allocates the profile ring buffer shared with the enclave and publishes it
+ * in shared_memory. Must be called before the enclave is initialized.
+ */
+void sgxlkl_profile_init(sgxlkl_shared_memory_t* shared_memory, size_t samples);
+
+/*
+ * Starts a host thread that sends SIGPROF to each of the given ethreads hz
+ * times per second. The signal must be forwarded to the enclave signal handler
+ * with the exception code SGXLKL_PROFILE_TICK.
+ */
+void sgxlkl_profile_start(pthread_t* ethreads, size_t num_ethreads, int hz);
+
+/*
+ * Writes the collected samples in folded stack format to output_path.
+ * Frames are symbolized with the symbol table of the enclave image at
+ * image_path.
+ */
+void sgxlkl_profile_write(const char* output_path, const char* image_path);
+
+#endif /* HOST_PROFILE_H */
@@ -16,6 +16,7 @@ typedef struct sgxlkl_host_disk_state
     int fd;          /* File descriptor */
     char* mmap;      /* Memory map */
     size_t size;     /* Size of disk */
+    bool direct;     /* Read by the enclave straight from mmap */
 } sgxlkl_host_disk_state_t;
 
 typedef struct sgxlkl_host_state
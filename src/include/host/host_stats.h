@@ -0,0 +1,61 @@
+#ifndef HOST_STATS_H
+#define HOST_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared/shared_memory.h"
+
+/*
+ * Allocates the statistics page shared with the enclave and publishes it in
+ * shared_memory. Statistics are only collected by the enclave if this is
+ * called before the enclave is initialized.
+ */
+void sgxlkl_stats_init(sgxlkl_shared_memory_t* shared_memory, size_t ethreads);
+
+/*
+ * Task run by an independent pthread that prints the statistics page every
+ * interval_ms milliseconds.
+ */
+void* sgxlkl_stats_task(void* interval_ms);
+
+/* Prints the current contents of the statistics page */
+void sgxlkl_stats_dump(void);
+
+/* Associates the calling host thread with the given ethread id */
+void sgxlkl_stats_set_ethread_id(int ethread_id);
+
+/* Counts an asynchronous enclave exit of the calling ethread */
+void sgxlkl_stats_count_aex(void);
+
+/*
+ * Device statistics are kept by the host only. Devices are registered when
+ * they are initialized, which may be before sgxlkl_stats_init is called.
+ */
+struct virtio_dev;
+
+/* Registers a virtio device under the given name for device statistics */
+void sgxlkl_stats_register_device(struct virtio_dev* dev, const char* name);
+
+/* Returns true if statistics are collected */
+bool sgxlkl_stats_enabled(void);
+
+/*
+ * Returns the number of bounce buffer slots used by a descriptor, or 0 if
+ * the buffer is not in the bounce buffer
+ */
+uint64_t sgxlkl_stats_bounce_slots(uint64_t addr, uint32_t len);
+
+/*
+ * Records the state of a virtqueue of a device when the host starts to
+ * process it: the number of pending requests, whether the queue is full and
+ * the number of bounce buffer slots held by the pending requests
+ */
+void sgxlkl_stats_count_queue(
+    struct virtio_dev* dev,
+    uint64_t pending,
+    bool full,
+    uint64_t slots);
+
+#endif /* HOST_STATS_H */
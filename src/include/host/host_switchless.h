@@ -0,0 +1,27 @@
+#ifndef HOST_SWITCHLESS_H
+#define HOST_SWITCHLESS_H
+
+#include <stddef.h>
+
+#include "shared/shared_memory.h"
+
+/* Time in nanoseconds that a worker polls for calls before it sleeps */
+#define SGXLKL_SWITCHLESS_POLL_BUDGET_NS 1000000
+
+/*
+ * Allocates the switchless call ring shared with the enclave, publishes it in
+ * shared_memory and starts num_workers worker threads that serve it. Must be
+ * called before the enclave is initialized.
+ */
+void sgxlkl_switchless_init(
+    sgxlkl_shared_memory_t* shared_memory,
+    size_t num_workers);
+
+/*
+ * Wakes up sleeping workers. Called by OCALLs that the enclave could have
+ * made through the ring, as the enclave falls back to OCALLs while no worker
+ * polls for calls.
+ */
+void sgxlkl_switchless_wake(void);
+
+#endif /* HOST_SWITCHLESS_H */
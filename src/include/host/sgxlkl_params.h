@@ -16,15 +16,21 @@
 #define SGXLKL_HDS "SGXLKL_HDS"
 #define SGXLKL_HD_VERITY "SGXLKL_HD_VERITY"
 #define SGXLKL_HD_VERITY_OFFSET "SGXLKL_HD_VERITY_OFFSET"
+#define SGXLKL_HD_VERITY_BLOCK_SIZE "SGXLKL_HD_VERITY_BLOCK_SIZE"
 #define SGXLKL_HOSTNAME "SGXLKL_HOSTNAME"
 #define SGXLKL_HOSTNET "SGXLKL_HOSTNET"
 #define SGXLKL_IP4 "SGXLKL_IP4"
+#define SGXLKL_KERNEL_MIN_MEM "SGXLKL_KERNEL_MIN_MEM"
 #define SGXLKL_KERNEL_VERBOSE "SGXLKL_KERNEL_VERBOSE"
 #define SGXLKL_MASK4 "SGXLKL_MASK4"
 #define SGXLKL_MAX_USER_THREADS "SGXLKL_MAX_USER_THREADS"
 #define SGXLKL_MMAP_FILES "SGXLKL_MMAP_FILES"
+#define SGXLKL_PREEMPT_QUANTUM "SGXLKL_PREEMPT_QUANTUM"
 #define SGXLKL_PRINT_APP_RUNTIME "SGXLKL_PRINT_APP_RUNTIME"
+#define SGXLKL_PROFILE "SGXLKL_PROFILE"
+#define SGXLKL_PROFILE_HZ "SGXLKL_PROFILE_HZ"
 #define SGXLKL_STACK_SIZE "SGXLKL_STACK_SIZE"
+#define SGXLKL_SWITCHLESS_WORKERS "SGXLKL_SWITCHLESS_WORKERS"
 #define SGXLKL_SYSCTL "SGXLKL_SYSCTL"
 #define SGXLKL_TAP "SGXLKL_TAP"
 #define SGXLKL_TAP_MTU "SGXLKL_TAP_MTU"
@@ -43,9 +49,18 @@
 #define SGXLKL_WG_PORT "SGXLKL_WG_PORT"
 #define SGXLKL_WG_KEY "SGXLKL_WG_KEY"
 #define SGXLKL_WG_PEERS "SGXLKL_WG_PEERS"
+#define SGXLKL_ZRAM_COMP_ALGORITHM "SGXLKL_ZRAM_COMP_ALGORITHM"
+#define SGXLKL_ZRAM_SIZE "SGXLKL_ZRAM_SIZE"
 #define SGXLKL_OE_HEAP_PAGE_COUNT "SGXLKL_OE_HEAP_PAGE_COUNT"
 #define SGXLKL_ENABLE_SWIOTLB "SGXLKL_ENABLE_SWIOTLB"
+#define SGXLKL_SWIOTLB_SIZE "SGXLKL_SWIOTLB_SIZE"
+#define SGXLKL_SWIOTLB_PARTITION "SGXLKL_SWIOTLB_PARTITION"
 #define SGXLKL_HD_OVERLAY "SGXLKL_HD_OVERLAY"
+#define SGXLKL_HD_POLL "SGXLKL_HD_POLL"
+#define SGXLKL_HD_DIRECT "SGXLKL_HD_DIRECT"
+#define SGXLKL_TAP_POLL "SGXLKL_TAP_POLL"
+#define SGXLKL_VIRTIO_POLL_AFFINITY "SGXLKL_VIRTIO_POLL_AFFINITY"
+#define SGXLKL_VIRTIO_POLL_BUDGET "SGXLKL_VIRTIO_POLL_BUDGET"
 #define SGXLKL_HOST_IMPORT_ENV "SGXLKL_HOST_IMPORT_ENV"
 #define SGXSTEP_BASE "SGXSTEP_BASE"
 #define SGXSTEP_RANGE "SGXSTEP_RANGE"
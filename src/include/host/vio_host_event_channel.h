@@ -8,29 +8,44 @@
 #define HOST_NETWORK_DEV_COUNT 1
 #define HOST_CONSOLE_DEV_COUNT 1
 
+/* Cache-line aligned, see shared/vio_event_channel.h */
 typedef struct host_evt_channel
 {
     evt_t host_evt_channel;
     evt_t* enclave_evt_channel;
     uint32_t qidx_p;
-} host_evt_channel_t;
+} __attribute__((aligned(64))) host_evt_channel_t;
 
 typedef struct host_dev_config
 {
     uint8_t dev_id;
     host_evt_channel_t* host_evt_chn;
-    evt_t evt_processed;
+
+    /* Time to busy-poll for an event before sleeping, 0 to never poll */
+    uint64_t poll_budget_ns;
+
     pthread_mutex_t lock;
     pthread_cond_t cond;
-} host_dev_config_t;
+
+    /* Written by the device worker only, kept apart from the lock which is
+     * also taken by ethreads when they notify the worker */
+    evt_t evt_processed __attribute__((aligned(64)));
+} __attribute__((aligned(64))) host_dev_config_t;
+
+/*
+ * Function to return the size of the bounce buffer for virtio given the
+ * configured size (0 for the default).
+ */
+size_t host_swiotlb_buffer_size(size_t configured_size);
 
 /*
  * Function to initialize the host device configuration. This function
  * allocates the required memory for host & enclave event channel & setup
- * bounce buffer for virtio
+ * bounce buffer for virtio of swiotlb_size bytes (0 for the default)
  */
 int initialize_host_device_configuration(
     bool swiotlb,
+    size_t swiotlb_size,
     sgxlkl_shared_memory_t* cfg,
     host_dev_config_t** host_dev_cfg,
     enc_dev_config_t** enc_dev_config,
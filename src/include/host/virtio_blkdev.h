@@ -35,6 +35,9 @@ struct virtio_blk_req_trailer
     uint8_t status;
 };
 
+#define VIRTIO_BLK_F_SIZE_MAX 1
+#define VIRTIO_BLK_F_RO 5
+
 struct virtio_blk_config
 {
     /* The capacity (in 512-byte sectors). */
@@ -2,6 +2,7 @@
 #define _LKL_LIB_VIRTIO_H
 
 #include <lkl_host.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #define container_of(ptr, type, member) \
@@ -38,6 +39,47 @@ int lkl_virtio_dev_setup(
     int mmio_size,
     void* virtio_req_complete);
 
+struct virtq;
+
+/*
+ * Callback for queue notifications of a device that is served inside the
+ * enclave. dev_id is the id the device was registered with.
+ */
+typedef void (*lkl_virtio_dev_notify)(uint8_t dev_id, uint32_t qidx);
+
+/*
+ * Function to process queue notifications of the device inside the enclave
+ * instead of forwarding them to the host. The driver's queue setup is kept in
+ * queues, which must be in enclave memory, and queues are only made ready if
+ * their rings are in enclave memory. dev_id must be chosen by the enclave, as
+ * the device's vendor_id may be in host memory.
+ */
+int lkl_virtio_dev_set_notify(
+    struct virtio_dev* dev,
+    uint8_t dev_id,
+    struct virtq* queues,
+    uint32_t num_queues,
+    lkl_virtio_dev_notify notify_cb);
+
+/*
+ * Function to generate the irq for notifying the frontend driver about used
+ * buffers of a device that is served inside the enclave.
+ */
+void lkl_virtio_dev_trigger_irq(uint8_t dev_id);
+
+/*
+ * Function to return the buffer at the head of the avail ring of a device
+ * that is served inside the enclave to the driver, with len bytes written.
+ */
+void lkl_virtio_queue_add_used(struct virtq* q, uint16_t head, uint32_t len);
+
+/*
+ * Function to check whether the driver must be interrupted for the buffers
+ * used since old_used_idx, following its used event index, and to ask the
+ * driver for a notification of the next avail buffer.
+ */
+bool lkl_virtio_queue_needs_irq(struct virtq* q, uint16_t old_used_idx);
+
 /*
  * Function to generate the irq for notifying the frontend driver
  * about the request completion by host/backend driver.
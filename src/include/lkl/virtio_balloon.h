@@ -0,0 +1,24 @@
+#ifndef _LKL_VIRTIO_BALLOON_H
+#define _LKL_VIRTIO_BALLOON_H
+
+#include <stddef.h>
+
+/*
+ * Function to register the balloon device with the mmio drivers. The kernel
+ * keeps at least min_mem bytes of its memory. Must be called before LKL boots.
+ */
+int lkl_virtio_balloon_add(size_t min_mem);
+
+/*
+ * Function to tell the balloon device which memory the kernel runs in. Called
+ * when LKL allocates its memory during boot.
+ */
+void lkl_virtio_balloon_set_kernel_mem(void* mem, size_t size);
+
+/*
+ * Function to unmap the kernel memory when LKL frees it, skipping the pages
+ * that are in the balloon and therefore no longer belong to the kernel.
+ */
+void lkl_virtio_balloon_unmap_kernel_mem(void* mem, size_t size);
+
+#endif /* _LKL_VIRTIO_BALLOON_H */
@@ -0,0 +1,16 @@
+#ifndef SGXLKL_PREEMPT_H
+#define SGXLKL_PREEMPT_H
+
+/*
+ * Time-slice preemption of lthreads (software mode only). When enabled with
+ * SGXLKL_PREEMPT_QUANTUM, the host interrupts each ethread with SIGURG once
+ * per quantum and forwards the signal to the enclave signal handler with the
+ * exception code SGXLKL_PREEMPT_TICK. If the same lthread has been running
+ * application code on the ethread since the previous tick, the enclave makes
+ * it yield as soon as the signal handler returns.
+ */
+
+/* Exception code used to forward preemption ticks to the enclave */
+#define SGXLKL_PREEMPT_TICK 0x5052454d
+
+#endif /* SGXLKL_PREEMPT_H */
@@ -0,0 +1,57 @@
+#ifndef SGXLKL_PROFILE_H
+#define SGXLKL_PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * sgxlkl_profile is a ring buffer of stack samples shared between the host
+ * and the enclave (DEBUG builds in software mode only). The host periodically
+ * interrupts each ethread with SIGPROF and forwards the signal to the enclave
+ * signal handler with the exception code SGXLKL_PROFILE_TICK. If the ethread
+ * was interrupted inside the enclave, the enclave unwinds the stack of the
+ * running lthread and stores it in the next slot of the ring buffer. When the
+ * ring buffer is full, the oldest samples are overwritten.
+ *
+ * Frames are stored as offsets from the enclave base address, so that the
+ * host can symbolize them with the symbol table of the enclave image.
+ */
+
+/* Incremented any time the shape of sgxlkl_profile_t changes */
+#define SGXLKL_PROFILE_VERSION 1
+
+/* Exception code used to forward profiling ticks to the enclave */
+#define SGXLKL_PROFILE_TICK 0x50524f46
+
+/* Maximum number of frames recorded per sample */
+#define SGXLKL_PROFILE_MAX_DEPTH 32
+
+typedef struct sgxlkl_profile_sample
+{
+    /* Host ethread id of the ethread that took the sample */
+    uint32_t ethread;
+
+    /* Number of valid entries in frames */
+    uint32_t depth;
+
+    /* Name of the running lthread (empty if in the scheduler) */
+    char funcname[32];
+
+    /* Frame addresses relative to the enclave base, innermost first */
+    uint64_t frames[SGXLKL_PROFILE_MAX_DEPTH];
+} sgxlkl_profile_sample_t;
+
+typedef struct sgxlkl_profile
+{
+    /* Set to SGXLKL_PROFILE_VERSION by the host */
+    uint64_t version;
+
+    /* Number of entries in samples */
+    uint64_t capacity;
+
+    /* Total number of samples taken so far */
+    uint64_t head;
+
+    sgxlkl_profile_sample_t samples[];
+} sgxlkl_profile_t;
+
+#endif /* SGXLKL_PROFILE_H */
@@ -0,0 +1,92 @@
+#ifndef SGXLKL_STATS_H
+#define SGXLKL_STATS_H
+
+#include <stdint.h>
+
+/*
+ * sgxlkl_stats is a shared data structure used to export scheduler and
+ * enclave transition counters from the enclave to the host launcher. It is
+ * allocated by the host when statistics are enabled (--stats-interval) and
+ * is shared with the enclave through sgxlkl_shared_memory_t. If the host
+ * does not allocate it, the enclave does not collect any statistics.
+ *
+ * Every ethread owns one slot in the ethreads array, indexed by the ethread id
+ * that the host passes to sgxlkl_ethread_init (0 for the ethread that calls
+ * sgxlkl_enclave_init). A slot is only written by the
+ * ethread it belongs to, so the counters are updated without atomic
+ * read-modify-write operations. Slots are cache-line aligned to avoid false
+ * sharing between ethreads. The host only reads these counters and may
+ * observe values that are slightly out of date.
+ *
+ * Asynchronous enclave exits are only visible to the host. They are counted
+ * by the host in the aex array, which is indexed in the same way.
+ */
+
+/* Incremented any time the shape of sgxlkl_stats_t changes */
+#define SGXLKL_STATS_VERSION 4
+
+/* Maximum number of ethreads for which statistics are collected */
+#define SGXLKL_STATS_MAX_ETHREADS 64
+
+/* OCALLs that are counted individually */
+typedef enum sgxlkl_stats_ocall
+{
+    SGXLKL_STATS_OCALL_IDLE_ETHREAD = 0,
+    SGXLKL_STATS_OCALL_MPROTECT,
+    SGXLKL_STATS_OCALL_DEVICE_REQUEST,
+    SGXLKL_STATS_OCALL_CPUID,
+    SGXLKL_STATS_OCALL_RDTSC,
+    SGXLKL_STATS_OCALL_MAX
+} sgxlkl_stats_ocall_t;
+
+typedef struct sgxlkl_ethread_stats
+{
+    /* Number of lthreads resumed by the scheduler */
+    uint64_t resumes;
+
+    /* Number of scheduler loop iterations that found no work */
+    uint64_t spins;
+
+    /* Number of times the ethread left the enclave to sleep */
+    uint64_t idle_sleeps;
+
+    /* Number of futex wait and wake operations */
+    uint64_t futex_waits;
+    uint64_t futex_wakes;
+
+    /* Run queue depth observed when dequeuing an lthread */
+    uint64_t runq_samples;
+    uint64_t runq_depth_sum;
+    uint64_t runq_depth_max;
+
+    /* Number of virtio notifications sent to host devices. Together with
+     * SGXLKL_STATS_OCALL_DEVICE_REQUEST this gives the fraction of
+     * notifications that required an enclave exit. */
+    uint64_t device_notifies;
+
+    /* Number of lthreads preempted at the end of their time slice */
+    uint64_t preemptions;
+
+    /* Number of OCALLs by type, indexed by sgxlkl_stats_ocall_t. Host calls
+     * made through the switchless call ring are not included. */
+    uint64_t ocalls[SGXLKL_STATS_OCALL_MAX];
+
+    /* Number of host calls made through the switchless call ring */
+    uint64_t switchless_calls;
+} __attribute__((aligned(64))) sgxlkl_ethread_stats_t;
+
+typedef struct sgxlkl_stats
+{
+    /* Set to SGXLKL_STATS_VERSION by the host */
+    uint64_t version;
+
+    /* Number of valid entries in ethreads */
+    uint64_t num_ethreads;
+
+    sgxlkl_ethread_stats_t ethreads[SGXLKL_STATS_MAX_ETHREADS];
+
+    /* Number of asynchronous enclave exits per ethread (written by the host) */
+    uint64_t aex[SGXLKL_STATS_MAX_ETHREADS];
+} sgxlkl_stats_t;
+
+#endif /* SGXLKL_STATS_H */
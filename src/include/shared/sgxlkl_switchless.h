@@ -0,0 +1,69 @@
+#ifndef SGXLKL_SWITCHLESS_H
+#define SGXLKL_SWITCHLESS_H
+
+#include <stdint.h>
+
+/*
+ * sgxlkl_switchless is a ring of call slots in host memory through which the
+ * enclave hands frequent host calls to a pool of host worker threads instead
+ * of exiting the enclave. It is allocated by the host when workers are
+ * enabled (SGXLKL_SWITCHLESS_WORKERS) and is shared with the enclave through
+ * sgxlkl_shared_memory_t.
+ *
+ * To post a call, the enclave claims a free slot by changing its state from
+ * SGXLKL_SWITCHLESS_FREE to SGXLKL_SWITCHLESS_CLAIMED, fills in the call and
+ * sets the slot's bit in pending. A worker takes the call by clearing the
+ * bit, runs it and sets the state to SGXLKL_SWITCHLESS_DONE once ret is
+ * valid, or back to SGXLKL_SWITCHLESS_FREE for calls without a result. The
+ * enclave polls for completion and frees the slot after reading ret.
+ *
+ * The enclave only posts a call if there are more idle workers than pending
+ * calls, and otherwise falls back to a regular OCALL. The host wakes up
+ * sleeping workers when it receives such an OCALL.
+ */
+
+/* Incremented any time the shape of sgxlkl_switchless_t changes */
+#define SGXLKL_SWITCHLESS_VERSION 2
+
+/* Number of call slots, one bit each in pending */
+#define SGXLKL_SWITCHLESS_SLOTS 64
+
+/* Maximum number of host worker threads */
+#define SGXLKL_SWITCHLESS_MAX_WORKERS 64
+
+/* Host calls that can be made without an enclave exit */
+typedef enum sgxlkl_switchless_func
+{
+    SGXLKL_SWITCHLESS_MPROTECT = 0,   /* args: addr, len, prot */
+    SGXLKL_SWITCHLESS_DEVICE_REQUEST, /* args: dev_id, no result */
+    SGXLKL_SWITCHLESS_FUNC_MAX
+} sgxlkl_switchless_func_t;
+
+/* States of a call slot */
+#define SGXLKL_SWITCHLESS_FREE 0
+#define SGXLKL_SWITCHLESS_CLAIMED 1
+#define SGXLKL_SWITCHLESS_DONE 2
+
+typedef struct sgxlkl_switchless_call
+{
+    uint32_t state;
+    uint32_t func;
+    uint64_t args[3];
+    int64_t ret;
+} __attribute__((aligned(64))) sgxlkl_switchless_call_t;
+
+typedef struct sgxlkl_switchless
+{
+    /* Set to SGXLKL_SWITCHLESS_VERSION by the host */
+    uint64_t version;
+
+    /* Bit i is set while the call in slot i waits for a worker */
+    uint64_t pending __attribute__((aligned(64)));
+
+    /* Number of workers polling for calls (written by the host) */
+    uint64_t idle_workers __attribute__((aligned(64)));
+
+    sgxlkl_switchless_call_t calls[SGXLKL_SWITCHLESS_SLOTS];
+} sgxlkl_switchless_t;
+
+#endif /* SGXLKL_SWITCHLESS_H */
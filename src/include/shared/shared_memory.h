@@ -3,6 +3,9 @@
 
 #include "shared/oe_compat.h"
 
+#include <shared/sgxlkl_profile.h>
+#include <shared/sgxlkl_stats.h>
+#include <shared/sgxlkl_switchless.h>
 #include <shared/vio_event_channel.h>
 
 typedef struct sgxlkl_shared_memory
@@ -25,8 +28,22 @@ typedef struct sgxlkl_shared_memory
     void** virtio_blk_dev_mem;
     char** virtio_blk_dev_names;
 
+    /* Host mappings of read-only disks that the guest reads directly instead
+     * of through the virtio queue (NULL for all other disks) */
+    void** virtio_blk_dev_direct;
+    size_t* virtio_blk_dev_direct_size;
+
     /* Host environment variables for optional import */
     char* const* env;
+
+    /* Scheduler and transition statistics (NULL if disabled) */
+    sgxlkl_stats_t* stats;
+
+    /* Stack samples of the sampling profiler (NULL if disabled) */
+    sgxlkl_profile_t* profile;
+
+    /* Ring for host calls without enclave exits (NULL if disabled) */
+    sgxlkl_switchless_t* switchless;
 } sgxlkl_shared_memory_t;
 
 #endif /* SGXLKL_SHARED_MEMORY_H */
\ No newline at end of file
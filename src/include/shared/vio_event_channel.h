@@ -7,18 +7,26 @@
 
 typedef uint64_t evt_t;
 
+/*
+ * The event channels and device configurations of different devices are
+ * updated concurrently by different host threads and ethreads. Every entry is
+ * cache-line aligned, so that the arrays of them do not cause false sharing
+ * between devices.
+ */
 typedef struct enc_evt_channel
 {
     evt_t enclave_evt_channel;
     evt_t* host_evt_channel;
     uint32_t* qidx_p;
-} enc_evt_channel_t;
+} __attribute__((aligned(64))) enc_evt_channel_t;
 
 typedef struct enc_dev_config
 {
     uint8_t dev_id;
     enc_evt_channel_t* enc_evt_chn;
-    evt_t evt_processed;
-} enc_dev_config_t;
+
+    /* Written by the device task only, kept apart from the fields above */
+    evt_t evt_processed __attribute__((aligned(64)));
+} __attribute__((aligned(64))) enc_dev_config_t;
 
 #endif //_VIO_EVENT_CHANNEL_H
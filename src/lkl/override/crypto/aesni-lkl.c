@@ -0,0 +1,411 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * AES-NI accelerated AES and XTS-AES for the LKL architecture.
+ *
+ * LKL is its own architecture and does not build the x86 aesni-intel glue,
+ * so dm-crypt would otherwise fall back to the table-based generic AES
+ * implementation. This driver provides a single-block "aes" cipher, which
+ * the generic templates (e.g. gcm, ctr, cbc) pick up, and a dedicated
+ * "xts(aes)" skcipher for dm-crypt that processes four blocks at a time.
+ *
+ * The AES instructions are only used if CPUID reports them. Both algorithms
+ * are registered with a higher priority than the generic implementations.
+ *
+ * LKL does not preempt kernel code and the SSE registers are caller-saved,
+ * so no FPU state needs to be saved around the use of the SSE registers.
+ */
+
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/internal/skcipher.h>
+#include <crypto/xts.h>
+#include <linux/bitops.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <asm/unaligned.h>
+
+#define AESNI_TARGET __attribute__((target("sse2,aes")))
+
+#define AESNI_MAX_ROUNDS 14
+
+typedef long long v2di __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef char v16qi __attribute__((vector_size(16)));
+
+struct aesni_lkl_ctx {
+	u8 enc[AESNI_MAX_ROUNDS + 1][AES_BLOCK_SIZE];
+	u8 dec[AESNI_MAX_ROUNDS + 1][AES_BLOCK_SIZE];
+	int rounds;
+};
+
+struct aesni_lkl_xts_ctx {
+	struct aesni_lkl_ctx crypt;
+	struct aesni_lkl_ctx tweak;
+};
+
+/* Round keys loaded into registers for one request */
+struct aesni_lkl_keys {
+	v2di k[AESNI_MAX_ROUNDS + 1];
+	int rounds;
+};
+
+static AESNI_TARGET inline v2di aesni_load(const u8 *p)
+{
+	return (v2di)__builtin_ia32_loaddqu((const char *)p);
+}
+
+static AESNI_TARGET inline void aesni_store(u8 *p, v2di x)
+{
+	__builtin_ia32_storedqu((char *)p, (v16qi)x);
+}
+
+/* Returns SubWord(w), using the S-box of AESKEYGENASSIST */
+static AESNI_TARGET u32 aesni_subword(u32 w)
+{
+	v4si x = { 0, (int)w, 0, 0 };
+
+	x = (v4si)__builtin_ia32_aeskeygenassist128((v2di)x, 0);
+	return (u32)x[0];
+}
+
+static AESNI_TARGET int aesni_lkl_expand_key(struct aesni_lkl_ctx *ctx,
+					     const u8 *in_key,
+					     unsigned int key_len)
+{
+	u32 w[4 * (AESNI_MAX_ROUNDS + 1)];
+	unsigned int nk = key_len / 4;
+	unsigned int i;
+	u32 rcon = 1;
+
+	if (key_len != AES_KEYSIZE_128 && key_len != AES_KEYSIZE_192 &&
+	    key_len != AES_KEYSIZE_256)
+		return -EINVAL;
+
+	ctx->rounds = 6 + nk;
+
+	/* Key expansion as in FIPS-197, on little-endian words */
+	for (i = 0; i < nk; i++)
+		w[i] = get_unaligned_le32(in_key + 4 * i);
+
+	for (i = nk; i < 4 * (ctx->rounds + 1); i++) {
+		u32 t = w[i - 1];
+
+		if (i % nk == 0) {
+			t = aesni_subword(ror32(t, 8)) ^ rcon;
+			rcon = ((rcon << 1) ^ ((rcon >> 7) * 0x1b)) & 0xff;
+		} else if (nk > 6 && i % nk == 4) {
+			t = aesni_subword(t);
+		}
+		w[i] = w[i - nk] ^ t;
+	}
+
+	for (i = 0; i <= ctx->rounds; i++)
+		memcpy(ctx->enc[i], &w[4 * i], AES_BLOCK_SIZE);
+
+	/* Decryption keys for the equivalent inverse cipher */
+	memcpy(ctx->dec[0], ctx->enc[ctx->rounds], AES_BLOCK_SIZE);
+	for (i = 1; i < ctx->rounds; i++)
+		aesni_store(ctx->dec[i],
+			    __builtin_ia32_aesimc128(
+				    aesni_load(ctx->enc[ctx->rounds - i])));
+	memcpy(ctx->dec[ctx->rounds], ctx->enc[0], AES_BLOCK_SIZE);
+
+	memzero_explicit(w, sizeof(w));
+	return 0;
+}
+
+static AESNI_TARGET inline void aesni_load_keys(struct aesni_lkl_keys *keys,
+						u8 (*k)[AES_BLOCK_SIZE],
+						int rounds)
+{
+	int i;
+
+	keys->rounds = rounds;
+	for (i = 0; i <= rounds; i++)
+		keys->k[i] = aesni_load(k[i]);
+}
+
+static AESNI_TARGET inline v2di aesni_enc(const struct aesni_lkl_keys *keys,
+					  v2di x)
+{
+	int r;
+
+	x ^= keys->k[0];
+	for (r = 1; r < keys->rounds; r++)
+		x = __builtin_ia32_aesenc128(x, keys->k[r]);
+	return __builtin_ia32_aesenclast128(x, keys->k[keys->rounds]);
+}
+
+static AESNI_TARGET inline v2di aesni_dec(const struct aesni_lkl_keys *keys,
+					  v2di x)
+{
+	int r;
+
+	x ^= keys->k[0];
+	for (r = 1; r < keys->rounds; r++)
+		x = __builtin_ia32_aesdec128(x, keys->k[r]);
+	return __builtin_ia32_aesdeclast128(x, keys->k[keys->rounds]);
+}
+
+/* Four independent blocks at once to hide the latency of AESENC/AESDEC */
+static AESNI_TARGET inline void aesni_crypt4(const struct aesni_lkl_keys *keys,
+					     v2di x[4], bool enc)
+{
+	int r;
+
+	x[0] ^= keys->k[0];
+	x[1] ^= keys->k[0];
+	x[2] ^= keys->k[0];
+	x[3] ^= keys->k[0];
+
+	if (enc) {
+		for (r = 1; r < keys->rounds; r++) {
+			x[0] = __builtin_ia32_aesenc128(x[0], keys->k[r]);
+			x[1] = __builtin_ia32_aesenc128(x[1], keys->k[r]);
+			x[2] = __builtin_ia32_aesenc128(x[2], keys->k[r]);
+			x[3] = __builtin_ia32_aesenc128(x[3], keys->k[r]);
+		}
+		x[0] = __builtin_ia32_aesenclast128(x[0], keys->k[r]);
+		x[1] = __builtin_ia32_aesenclast128(x[1], keys->k[r]);
+		x[2] = __builtin_ia32_aesenclast128(x[2], keys->k[r]);
+		x[3] = __builtin_ia32_aesenclast128(x[3], keys->k[r]);
+	} else {
+		for (r = 1; r < keys->rounds; r++) {
+			x[0] = __builtin_ia32_aesdec128(x[0], keys->k[r]);
+			x[1] = __builtin_ia32_aesdec128(x[1], keys->k[r]);
+			x[2] = __builtin_ia32_aesdec128(x[2], keys->k[r]);
+			x[3] = __builtin_ia32_aesdec128(x[3], keys->k[r]);
+		}
+		x[0] = __builtin_ia32_aesdeclast128(x[0], keys->k[r]);
+		x[1] = __builtin_ia32_aesdeclast128(x[1], keys->k[r]);
+		x[2] = __builtin_ia32_aesdeclast128(x[2], keys->k[r]);
+		x[3] = __builtin_ia32_aesdeclast128(x[3], keys->k[r]);
+	}
+}
+
+/* Multiplies the tweak by x in GF(2^128), as defined for XTS */
+static AESNI_TARGET inline v2di aesni_xts_next_tweak(v2di t)
+{
+	u64 lo = (u64)t[0];
+	u64 hi = (u64)t[1];
+	u64 carry = hi >> 63;
+
+	hi = (hi << 1) | (lo >> 63);
+	lo = (lo << 1) ^ (carry * 0x87);
+	return (v2di){ (long long)lo, (long long)hi };
+}
+
+/* Single-block cipher */
+
+static int aesni_lkl_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	return aesni_lkl_expand_key(crypto_tfm_ctx(tfm), in_key, key_len);
+}
+
+static AESNI_TARGET void aesni_lkl_encrypt(struct crypto_tfm *tfm, u8 *dst,
+					   const u8 *src)
+{
+	struct aesni_lkl_ctx *ctx = crypto_tfm_ctx(tfm);
+	v2di x = aesni_load(src);
+	int r;
+
+	x ^= aesni_load(ctx->enc[0]);
+	for (r = 1; r < ctx->rounds; r++)
+		x = __builtin_ia32_aesenc128(x, aesni_load(ctx->enc[r]));
+	x = __builtin_ia32_aesenclast128(x, aesni_load(ctx->enc[r]));
+	aesni_store(dst, x);
+}
+
+static AESNI_TARGET void aesni_lkl_decrypt(struct crypto_tfm *tfm, u8 *dst,
+					   const u8 *src)
+{
+	struct aesni_lkl_ctx *ctx = crypto_tfm_ctx(tfm);
+	v2di x = aesni_load(src);
+	int r;
+
+	x ^= aesni_load(ctx->dec[0]);
+	for (r = 1; r < ctx->rounds; r++)
+		x = __builtin_ia32_aesdec128(x, aesni_load(ctx->dec[r]));
+	x = __builtin_ia32_aesdeclast128(x, aesni_load(ctx->dec[r]));
+	aesni_store(dst, x);
+}
+
+static struct crypto_alg aesni_lkl_alg = {
+	.cra_name		= "aes",
+	.cra_driver_name	= "aes-aesni-lkl",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_CIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesni_lkl_ctx),
+	.cra_module		= THIS_MODULE,
+	.cra_u	= {
+		.cipher	= {
+			.cia_min_keysize	= AES_MIN_KEY_SIZE,
+			.cia_max_keysize	= AES_MAX_KEY_SIZE,
+			.cia_setkey		= aesni_lkl_setkey,
+			.cia_encrypt		= aesni_lkl_encrypt,
+			.cia_decrypt		= aesni_lkl_decrypt
+		}
+	}
+};
+
+/* XTS */
+
+static int aesni_lkl_xts_setkey(struct crypto_skcipher *tfm, const u8 *key,
+				unsigned int keylen)
+{
+	struct aesni_lkl_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int err;
+
+	err = xts_verify_key(tfm, key, keylen);
+	if (err)
+		return err;
+
+	keylen /= 2;
+	err = aesni_lkl_expand_key(&ctx->crypt, key, keylen);
+	if (err)
+		return err;
+	return aesni_lkl_expand_key(&ctx->tweak, key + keylen, keylen);
+}
+
+static AESNI_TARGET int aesni_lkl_xts_crypt(struct skcipher_request *req,
+					    bool enc)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct aesni_lkl_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
+	struct aesni_lkl_keys keys;
+	struct skcipher_walk walk;
+	unsigned int nbytes;
+	v2di t;
+	int err;
+
+	/* Ciphertext stealing is not supported, dm-crypt never needs it */
+	if (req->cryptlen < AES_BLOCK_SIZE ||
+	    req->cryptlen % AES_BLOCK_SIZE)
+		return -EINVAL;
+
+	err = skcipher_walk_virt(&walk, req, false);
+	if (err)
+		return err;
+
+	aesni_load_keys(&keys, ctx->tweak.enc, ctx->tweak.rounds);
+	t = aesni_enc(&keys, aesni_load(walk.iv));
+
+	if (enc)
+		aesni_load_keys(&keys, ctx->crypt.enc, ctx->crypt.rounds);
+	else
+		aesni_load_keys(&keys, ctx->crypt.dec, ctx->crypt.rounds);
+
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		const u8 *src = walk.src.virt.addr;
+		u8 *dst = walk.dst.virt.addr;
+
+		while (nbytes >= 4 * AES_BLOCK_SIZE) {
+			v2di tw[4], x[4];
+			int i;
+
+			for (i = 0; i < 4; i++) {
+				tw[i] = t;
+				x[i] = aesni_load(src + i * AES_BLOCK_SIZE) ^ t;
+				t = aesni_xts_next_tweak(t);
+			}
+			aesni_crypt4(&keys, x, enc);
+			for (i = 0; i < 4; i++)
+				aesni_store(dst + i * AES_BLOCK_SIZE,
+					    x[i] ^ tw[i]);
+
+			src += 4 * AES_BLOCK_SIZE;
+			dst += 4 * AES_BLOCK_SIZE;
+			nbytes -= 4 * AES_BLOCK_SIZE;
+		}
+
+		while (nbytes >= AES_BLOCK_SIZE) {
+			v2di x = aesni_load(src) ^ t;
+
+			x = enc ? aesni_enc(&keys, x) : aesni_dec(&keys, x);
+			aesni_store(dst, x ^ t);
+			t = aesni_xts_next_tweak(t);
+
+			src += AES_BLOCK_SIZE;
+			dst += AES_BLOCK_SIZE;
+			nbytes -= AES_BLOCK_SIZE;
+		}
+
+		err = skcipher_walk_done(&walk, nbytes);
+	}
+
+	memzero_explicit(&keys, sizeof(keys));
+	return err;
+}
+
+static int aesni_lkl_xts_encrypt(struct skcipher_request *req)
+{
+	return aesni_lkl_xts_crypt(req, true);
+}
+
+static int aesni_lkl_xts_decrypt(struct skcipher_request *req)
+{
+	return aesni_lkl_xts_crypt(req, false);
+}
+
+static struct skcipher_alg aesni_lkl_xts_alg = {
+	.base.cra_name		= "xts(aes)",
+	.base.cra_driver_name	= "xts-aes-aesni-lkl",
+	.base.cra_priority	= 401,
+	.base.cra_blocksize	= AES_BLOCK_SIZE,
+	.base.cra_ctxsize	= sizeof(struct aesni_lkl_xts_ctx),
+	.base.cra_module	= THIS_MODULE,
+	.min_keysize		= 2 * AES_MIN_KEY_SIZE,
+	.max_keysize		= 2 * AES_MAX_KEY_SIZE,
+	.ivsize			= AES_BLOCK_SIZE,
+	.walksize		= 4 * AES_BLOCK_SIZE,
+	.setkey			= aesni_lkl_xts_setkey,
+	.encrypt		= aesni_lkl_xts_encrypt,
+	.decrypt		= aesni_lkl_xts_decrypt,
+};
+
+static bool __init aesni_lkl_cpu_supported(void)
+{
+	u32 eax = 1, ebx, ecx = 0, edx;
+
+	/* CPUID is emulated by SGX-LKL when running in an enclave */
+	asm volatile("cpuid"
+		     : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+	return ecx & (1 << 25);
+}
+
+static int __init aesni_lkl_init(void)
+{
+	int err;
+
+	if (!aesni_lkl_cpu_supported()) {
+		pr_info("aesni-lkl: AES-NI not supported by the CPU\n");
+		return -ENODEV;
+	}
+
+	err = crypto_register_alg(&aesni_lkl_alg);
+	if (err)
+		return err;
+
+	err = crypto_register_skcipher(&aesni_lkl_xts_alg);
+	if (err)
+		crypto_unregister_alg(&aesni_lkl_alg);
+
+	return err;
+}
+
+static void __exit aesni_lkl_exit(void)
+{
+	crypto_unregister_skcipher(&aesni_lkl_xts_alg);
+	crypto_unregister_alg(&aesni_lkl_alg);
+}
+
+module_init(aesni_lkl_init);
+module_exit(aesni_lkl_exit);
+
+MODULE_DESCRIPTION("AES and XTS-AES using AES-NI for LKL");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_CRYPTO("aes");
+MODULE_ALIAS_CRYPTO("xts(aes)");
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * SHA-224/SHA-256 using the SHA extensions (SHA-NI) for the LKL architecture.
+ *
+ * dm-verity and dm-integrity hash every block they read or write, and the
+ * generic C implementation dominates their cost. LKL does not build the x86
+ * sha256-ssse3 glue, so this driver provides an accelerated "sha256" and
+ * "sha224" shash with a higher priority than sha256-generic.
+ *
+ * The update function hands all complete blocks of a request to the block
+ * function at once, which keeps the state in registers across blocks.
+ *
+ * As for aesni-lkl, no FPU state needs to be saved as LKL does not preempt
+ * kernel code and the SSE registers are caller-saved.
+ */
+
+#include <crypto/internal/hash.h>
+#include <crypto/sha.h>
+#include <crypto/sha256_base.h>
+#include <linux/module.h>
+#include <linux/string.h>
+
+#define SHANI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+
+typedef long long v2di __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef short v8hi __attribute__((vector_size(16)));
+typedef char v16qi __attribute__((vector_size(16)));
+
+static const u32 sha256_ni_k[64] __aligned(16) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static SHANI_TARGET inline v4si shani_load(const void *p)
+{
+	return (v4si)__builtin_ia32_loaddqu((const char *)p);
+}
+
+static SHANI_TARGET inline void shani_store(void *p, v4si x)
+{
+	__builtin_ia32_storedqu((char *)p, (v16qi)x);
+}
+
+static SHANI_TARGET void sha256_ni_transform(struct sha256_state *sst,
+					     u8 const *src, int blocks)
+{
+	const v16qi bswap = { 3, 2, 1, 0, 7, 6, 5, 4,
+			      11, 10, 9, 8, 15, 14, 13, 12 };
+	v4si state0, state1, tmp;
+
+	/* Rearrange the state from ABCD EFGH into ABEF CDGH */
+	tmp = shani_load(&sst->state[0]);
+	state1 = shani_load(&sst->state[4]);
+	tmp = __builtin_ia32_pshufd(tmp, 0xb1);
+	state1 = __builtin_ia32_pshufd(state1, 0x1b);
+	state0 = (v4si)__builtin_ia32_palignr128((v2di)tmp, (v2di)state1, 64);
+	state1 = (v4si)__builtin_ia32_pblendw128((v8hi)state1, (v8hi)tmp,
+						 0xf0);
+
+	while (blocks--) {
+		v4si abef = state0, cdgh = state1;
+		v4si w[4], msg;
+		int i;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4) {
+				w[i] = (v4si)__builtin_ia32_pshufb128(
+					(v16qi)shani_load(src + 16 * i), bswap);
+			} else {
+				/* w[i] = sigma1/sigma0 schedule of the
+				 * previous 16 words */
+				tmp = (v4si)__builtin_ia32_palignr128(
+					(v2di)w[(i + 3) & 3],
+					(v2di)w[(i + 2) & 3], 32);
+				w[i & 3] = __builtin_ia32_sha256msg1(
+						   w[i & 3], w[(i + 1) & 3]) +
+					   tmp;
+				w[i & 3] = __builtin_ia32_sha256msg2(
+					w[i & 3], w[(i + 3) & 3]);
+			}
+
+			msg = w[i & 3] + shani_load(&sha256_ni_k[4 * i]);
+			state1 = __builtin_ia32_sha256rnds2(state1, state0,
+							    msg);
+			msg = __builtin_ia32_pshufd(msg, 0x0e);
+			state0 = __builtin_ia32_sha256rnds2(state0, state1,
+							    msg);
+		}
+
+		state0 += abef;
+		state1 += cdgh;
+		src += SHA256_BLOCK_SIZE;
+	}
+
+	/* Back to ABCD EFGH */
+	tmp = __builtin_ia32_pshufd(state0, 0x1b);
+	state1 = __builtin_ia32_pshufd(state1, 0xb1);
+	state0 = (v4si)__builtin_ia32_pblendw128((v8hi)tmp, (v8hi)state1,
+						 0xf0);
+	state1 = (v4si)__builtin_ia32_palignr128((v2di)state1, (v2di)tmp, 64);
+
+	shani_store(&sst->state[0], state0);
+	shani_store(&sst->state[4], state1);
+}
+
+static int sha256_ni_update(struct shash_desc *desc, const u8 *data,
+			    unsigned int len)
+{
+	return sha256_base_do_update(desc, data, len, sha256_ni_transform);
+}
+
+static int sha256_ni_finup(struct shash_desc *desc, const u8 *data,
+			   unsigned int len, u8 *out)
+{
+	if (len)
+		sha256_base_do_update(desc, data, len, sha256_ni_transform);
+	sha256_base_do_finalize(desc, sha256_ni_transform);
+	return sha256_base_finish(desc, out);
+}
+
+static int sha256_ni_final(struct shash_desc *desc, u8 *out)
+{
+	return sha256_ni_finup(desc, NULL, 0, out);
+}
+
+static struct shash_alg sha256_ni_algs[] = { {
+	.digestsize		= SHA256_DIGEST_SIZE,
+	.init			= sha256_base_init,
+	.update			= sha256_ni_update,
+	.final			= sha256_ni_final,
+	.finup			= sha256_ni_finup,
+	.descsize		= sizeof(struct sha256_state),
+	.base = {
+		.cra_name		= "sha256",
+		.cra_driver_name	= "sha256-ni-lkl",
+		.cra_priority		= 250,
+		.cra_blocksize		= SHA256_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	}
+}, {
+	.digestsize		= SHA224_DIGEST_SIZE,
+	.init			= sha224_base_init,
+	.update			= sha256_ni_update,
+	.final			= sha256_ni_final,
+	.finup			= sha256_ni_finup,
+	.descsize		= sizeof(struct sha256_state),
+	.base = {
+		.cra_name		= "sha224",
+		.cra_driver_name	= "sha224-ni-lkl",
+		.cra_priority		= 250,
+		.cra_blocksize		= SHA224_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	}
+} };
+
+static bool __init sha256_ni_cpu_supported(void)
+{
+	u32 eax, ebx, ecx, edx;
+
+	/* CPUID is emulated by SGX-LKL when running in an enclave */
+	eax = 1;
+	ecx = 0;
+	asm volatile("cpuid"
+		     : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+	if (!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+		return false; /* SSSE3, SSE4.1 */
+
+	eax = 7;
+	ecx = 0;
+	asm volatile("cpuid"
+		     : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+	return ebx & (1 << 29); /* SHA */
+}
+
+static int __init sha256_ni_init(void)
+{
+	if (!sha256_ni_cpu_supported()) {
+		pr_info("sha256-ni-lkl: SHA extensions not supported by the CPU\n");
+		return -ENODEV;
+	}
+
+	return crypto_register_shashes(sha256_ni_algs,
+				       ARRAY_SIZE(sha256_ni_algs));
+}
+
+static void __exit sha256_ni_exit(void)
+{
+	crypto_unregister_shashes(sha256_ni_algs, ARRAY_SIZE(sha256_ni_algs));
+}
+
+module_init(sha256_ni_init);
+module_exit(sha256_ni_exit);
+
+MODULE_DESCRIPTION("SHA-224 and SHA-256 using SHA-NI for LKL");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_CRYPTO("sha256");
+MODULE_ALIAS_CRYPTO("sha224");
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Minimal x86 CPU feature checks for WireGuard's zinc glue code on LKL.
+ *
+ * LKL has no cpuinfo_x86, so features are queried with CPUID when the glue
+ * code initialises. CPUID is emulated by SGX-LKL when running in an enclave.
+ */
+#ifndef _LKL_WG_ASM_CPUFEATURE_H
+#define _LKL_WG_ASM_CPUFEATURE_H
+
+#include <linux/types.h>
+
+#define LKL_X86_EBX 0
+#define LKL_X86_ECX 1
+#define LKL_X86_EDX 2
+
+#define LKL_X86_FEATURE(leaf, reg, bit) (((leaf) << 8) | ((reg) << 5) | (bit))
+
+#define X86_FEATURE_SSSE3	LKL_X86_FEATURE(1, LKL_X86_ECX, 9)
+#define X86_FEATURE_OSXSAVE	LKL_X86_FEATURE(1, LKL_X86_ECX, 27)
+#define X86_FEATURE_AVX		LKL_X86_FEATURE(1, LKL_X86_ECX, 28)
+#define X86_FEATURE_AVX2	LKL_X86_FEATURE(7, LKL_X86_EBX, 5)
+#define X86_FEATURE_BMI2	LKL_X86_FEATURE(7, LKL_X86_EBX, 8)
+#define X86_FEATURE_AVX512F	LKL_X86_FEATURE(7, LKL_X86_EBX, 16)
+#define X86_FEATURE_ADX		LKL_X86_FEATURE(7, LKL_X86_EBX, 19)
+#define X86_FEATURE_AVX512IFMA	LKL_X86_FEATURE(7, LKL_X86_EBX, 21)
+#define X86_FEATURE_AVX512BW	LKL_X86_FEATURE(7, LKL_X86_EBX, 30)
+#define X86_FEATURE_AVX512VL	LKL_X86_FEATURE(7, LKL_X86_EBX, 31)
+
+#define XFEATURE_MASK_SSE	(1ULL << 1)
+#define XFEATURE_MASK_YMM	(1ULL << 2)
+#define XFEATURE_MASK_OPMASK	(1ULL << 5)
+#define XFEATURE_MASK_ZMM_Hi256	(1ULL << 6)
+#define XFEATURE_MASK_Hi16_ZMM	(1ULL << 7)
+#define XFEATURE_MASK_AVX512                                                   \
+	(XFEATURE_MASK_OPMASK | XFEATURE_MASK_ZMM_Hi256 | XFEATURE_MASK_Hi16_ZMM)
+
+#define X86_VENDOR_INTEL	0
+#define X86_VENDOR_AMD		2
+#define X86_VENDOR_UNKNOWN	0xff
+
+struct lkl_cpuinfo_x86 {
+	u8 x86;
+	u8 x86_vendor;
+	u8 x86_model;
+};
+
+static inline void lkl_x86_cpuid(u32 leaf, u32 regs[4])
+{
+	u32 eax = leaf, ebx, ecx = 0, edx;
+
+	asm volatile("cpuid"
+		     : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+	regs[0] = eax;
+	regs[1] = ebx;
+	regs[2] = ecx;
+	regs[3] = edx;
+}
+
+static inline bool boot_cpu_has(unsigned int feature)
+{
+	u32 regs[4];
+
+	lkl_x86_cpuid(feature >> 8, regs);
+	return regs[1 + ((feature >> 5) & 3)] & (1U << (feature & 31));
+}
+
+static inline int cpu_has_xfeatures(u64 mask, const char **feature_name)
+{
+	u32 lo, hi;
+
+	if (feature_name)
+		*feature_name = NULL;
+
+	if (!boot_cpu_has(X86_FEATURE_OSXSAVE))
+		return 0;
+
+	asm volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((((u64)hi << 32) | lo) & mask) == mask;
+}
+
+static inline struct lkl_cpuinfo_x86 lkl_x86_boot_cpu_data(void)
+{
+	struct lkl_cpuinfo_x86 c;
+	u32 regs[4];
+
+	lkl_x86_cpuid(0, regs);
+	if (regs[1] == 0x756e6547 && regs[3] == 0x49656e69 &&
+	    regs[2] == 0x6c65746e) /* GenuineIntel */
+		c.x86_vendor = X86_VENDOR_INTEL;
+	else if (regs[1] == 0x68747541 && regs[3] == 0x69746e65 &&
+		 regs[2] == 0x444d4163) /* AuthenticAMD */
+		c.x86_vendor = X86_VENDOR_AMD;
+	else
+		c.x86_vendor = X86_VENDOR_UNKNOWN;
+
+	lkl_x86_cpuid(1, regs);
+	c.x86 = (regs[0] >> 8) & 0xf;
+	c.x86_model = (regs[0] >> 4) & 0xf;
+	if (c.x86 == 0xf)
+		c.x86 += (regs[0] >> 20) & 0xff;
+	if (c.x86 >= 0x6)
+		c.x86_model += ((regs[0] >> 16) & 0xf) << 4;
+
+	return c;
+}
+
+#define boot_cpu_data (lkl_x86_boot_cpu_data())
+
+#endif /* _LKL_WG_ASM_CPUFEATURE_H */
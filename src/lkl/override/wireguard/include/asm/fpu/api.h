@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * LKL does not preempt kernel code and the vector registers are
+ * caller-saved, so kernel code can use them without saving any state.
+ */
+#ifndef _LKL_WG_ASM_FPU_API_H
+#define _LKL_WG_ASM_FPU_API_H
+
+#include <linux/types.h>
+
+static inline void kernel_fpu_begin(void)
+{
+}
+
+static inline void kernel_fpu_end(void)
+{
+}
+
+static inline bool irq_fpu_usable(void)
+{
+	return true;
+}
+
+#endif /* _LKL_WG_ASM_FPU_API_H */
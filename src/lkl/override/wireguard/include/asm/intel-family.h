@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Intel model numbers used by WireGuard's zinc glue code on LKL.
+ */
+#ifndef _LKL_WG_ASM_INTEL_FAMILY_H
+#define _LKL_WG_ASM_INTEL_FAMILY_H
+
+#include <asm/cpufeature.h>
+
+#define INTEL_FAM6_SKYLAKE_X	0x55
+
+#endif /* _LKL_WG_ASM_INTEL_FAMILY_H */
@@ -21,7 +21,9 @@
 #include "lkl/jmp_buf.h"
 #include "lkl/posix-host.h"
 #include "lkl/setup.h"
+#include "lkl/virtio_balloon.h"
 
+#include "enclave/enclave_alloc.h"
 #include "enclave/lthread.h"
 #include "enclave/lthread_int.h"
 #include "enclave/enclave_state.h"
@@ -147,10 +149,15 @@ struct lkl_mutex
 struct lkl_sem
 {
     /**
-     * Semaphore count.  This is a naive implementation that assumes all
-     * semaphores have waiters.
+     * Semaphore count.
      */
     _Atomic(int) count;
+    /**
+     * The number of threads in `sem_down` that could not take a flag on
+     * their first attempt and may be sleeping.  `sem_up` only wakes a
+     * thread if this is non-zero.
+     */
+    _Atomic(int) waiters;
 };
 
 struct lkl_tls_key
@@ -186,7 +193,7 @@ static struct lkl_sem* sem_alloc(int count)
 #ifdef LKL_SEM_UAF_CHECKS
     sem = paranoid_alloc(sizeof(struct lkl_sem));
 #else
-    sem = oe_calloc(1, sizeof(*sem));
+    sem = enclave_calloc(1, sizeof(*sem));
     if (!sem)
         return NULL;
 #endif
@@ -201,7 +208,7 @@ static void sem_free(struct lkl_sem* sem)
 #if LKL_SEM_UAF_CHECKS
     paranoid_dealloc(sem, sizeof(struct lkl_sem));
 #else
-    oe_free(sem);
+    enclave_free(sem);
 #endif
 }
 
@@ -236,18 +243,22 @@ static void sem_free(struct lkl_sem* sem)
 * - maintain an atomic counter `count`
 * - increment the count when releasing during `sem_up`
 * - attempt to decrement the count to acquire during `sem_down`
-* - any waiters sleep using `enclave_futex_wait`
-* - when releasing, if there might be any waiters, wake them all using
+* - a thread that finds the count at 0 registers itself in `waiters` before
+*     checking the count again and sleeping via `enclave_futex_wait`
+* - when releasing, if `waiters` is non-zero, wake exactly one sleeper via
 *     `enclave_futex_wake`
-* - any waiter that succeeds in decrementing the count before it hits 0
-*     will acquire the semaphore and exit `sem_down`
-* - all others waiters will go back to sleep via `enclave_futex_wait`
 *
 * See `sem_up` and `sem_down` for more particulars.
 *
-* Within this implementation, sem_up must wake all waiters otherwise, we could
-* have a possible loss of a wake-up in some interleavings of sem_up and
-* sem_down.
+* No wake-up can be lost: both sides use sequentially-consistent atomics and
+* each writes its own variable before reading the other's. Either the waiter
+* sees the new count and does not sleep, or sem_up sees the waiter and wakes
+* one thread. If that wake arrives before the waiter has gone to sleep, the
+* futex value check in `enclave_futex_wait` fails because the count is no
+* longer 0. A woken thread may still find the flag taken by a thread that
+* was not sleeping; the flag was then not lost but consumed, and the woken
+* thread sleeps again. As every sem_up wakes one thread while there are
+* waiters, each flag added is matched by a wake-up.
 *
 * Every sem_up calls must be paired with a sem_down call, otherwise, all
 * guarantees are broken and "bad things will happen".
@@ -264,39 +275,57 @@ static void sem_free(struct lkl_sem* sem)
 */
 static void sem_up(struct lkl_sem* sem)
 {
-    // Increment the semaphore count.  If we are moving from 0 to non-zero,
-    // there may be waiters.  Wake one up.
-    if (atomic_fetch_add(&sem->count, 1) == 0)
+    // Increment the semaphore count.  If there are waiters, wake one of
+    // them up.  This must happen on every release, not only when moving
+    // from 0 to non-zero: several flags may be added before any of the
+    // woken threads runs.
+    atomic_fetch_add(&sem->count, 1);
+    if (sem->waiters > 0)
     {
-        enclave_futex_wake((int*)&sem->count, INT_MAX);
+        enclave_futex_wake((int*)&sem->count, 1);
     }
 }
 
-static void sem_down(struct lkl_sem* sem)
+static bool sem_try_down(struct lkl_sem* sem)
 {
     int count = sem->count;
-    // Loop if the count is 0 or if we try to decrement it but fail.
-    while ((count == 0) ||
-           !atomic_compare_exchange_weak(&sem->count, &count, count - 1))
+    // Retry if we lost a race with another thread changing the count
+    // (this could be avoided by doing an atomic decrement and handling
+    // the negative case, but this is the simplest possible
+    // implementation).
+    while (count > 0)
     {
-        // If the value is non-zero, we lost a race, so try again (this
-        // could be avoided by doing an atomic decrement and handling
-        // the negative case, but this is the simplest possible
-        // implementation).
-        // If the value is 0, we need to wait until another thread
-        // releases a value, so sleep and then reload the value of
-        // count.
-        if (count == 0)
+        if (atomic_compare_exchange_weak(&sem->count, &count, count - 1))
         {
-            enclave_futex_wait((int*)&sem->count, 0);
-            count = sem->count;
+            return true;
         }
     }
+    return false;
+}
+
+static void sem_down(struct lkl_sem* sem)
+{
+    if (sem_try_down(sem))
+    {
+        return;
+    }
+
+    // Register as a waiter before checking the count again, so that a
+    // concurrent sem_up either sees us or we see its flag.
+    atomic_fetch_add(&sem->waiters, 1);
+    while (!sem_try_down(sem))
+    {
+        // If the value is 0, we need to wait until another thread
+        // releases a value.  The wait returns immediately if the count
+        // has changed in the meantime.
+        enclave_futex_wait((int*)&sem->count, 0);
+    }
+    atomic_fetch_sub(&sem->waiters, 1);
 }
 
 static struct lkl_mutex* mutex_alloc(int recursive)
 {
-    struct lkl_mutex* mutex = oe_calloc(1, sizeof(struct lkl_mutex));
+    struct lkl_mutex* mutex = enclave_calloc(1, sizeof(struct lkl_mutex));
 
     if (!mutex)
         return NULL;
@@ -359,22 +388,26 @@ static void mutex_unlock(struct lkl_mutex* mutex)
     {
         // Implicitly sequentially-consistent atomic
         mutex->flag = 0;
-        // Wake up all waiting threads.  We could improve this to wake
-        // only one thread if we kept track of the number of waiters,
-        // though doing that in a non-racy way is non-trivial.
-        enclave_futex_wake((int*)&mutex->flag, INT_MAX);
+        // Wake up one waiting thread.  No wake-up is lost: a thread that
+        // acquires the mutex on the slow path sets the state back to
+        // locked_waiters, so the next unlock wakes the next waiter, and
+        // any thread that has not gone to sleep yet fails the futex value
+        // check and retries.
+        enclave_futex_wake((int*)&mutex->flag, 1);
     }
 }
 
 static void mutex_free(struct lkl_mutex* _mutex)
 {
-    oe_free(_mutex);
+    enclave_free(_mutex);
 }
 
 static lkl_thread_t thread_create(void (*fn)(void*), void* arg)
 {
     struct lthread* thread;
-    int ret = lthread_create(&thread, NULL, (void* (*)(void*))fn, arg);
+    // Kernel threads (softirqs, workqueues) run on behalf of I/O and timers
+    struct lthread_attr attr = {.priority = LTHREAD_PRIO_HIGH};
+    int ret = lthread_create(&thread, &attr, (void* (*)(void*))fn, arg);
     if (ret)
     {
         sgxlkl_fail("lthread_create failed: %s\n", lkl_strerror(ret));
@@ -481,11 +514,11 @@ static int thread_equal(lkl_thread_t a, lkl_thread_t b)
 static struct lkl_tls_key* tls_alloc(void (*destructor)(void*))
 {
     LKL_TRACE("enter (destructor=%p)\n", destructor);
-    struct lkl_tls_key* ret = oe_malloc(sizeof(struct lkl_tls_key));
+    struct lkl_tls_key* ret = enclave_malloc(sizeof(struct lkl_tls_key));
 
     if (WARN_PTHREAD(lthread_key_create(&ret->key, destructor)))
     {
-        oe_free(ret);
+        enclave_free(ret);
         return NULL;
     }
     return ret;
@@ -495,7 +528,7 @@ static void tls_free(struct lkl_tls_key* key)
 {
     LKL_TRACE("enter (key=%p)\n", key);
     WARN_PTHREAD(lthread_key_delete(key->key));
-    oe_free(key);
+    enclave_free(key);
 }
 
 static int tls_set(struct lkl_tls_key* key, void* data)
@@ -511,18 +544,49 @@ static void* tls_get(struct lkl_tls_key* key)
     return lthread_getspecific(key->key);
 }
 
+/*
+ * LKL timers
+ *
+ * All timers are served by a single timer service instead of an lthread per
+ * timer. Armed timers are kept in a binary min-heap ordered by their absolute
+ * deadline, and one lthread sleeps until the earliest deadline and then runs
+ * the callbacks of all expired timers. Re-arming a timer only moves it within
+ * the heap; the service thread is woken only if the new deadline comes before
+ * the one it is sleeping until.
+ */
+
+#define TIMER_NOT_QUEUED SIZE_MAX
+
 typedef struct sgxlkl_timer
 {
     void (*callback_fn)(void*);
     void* callback_arg;
-    unsigned long long delay_ns;
-    unsigned long long next_delay_ns;
-    struct lthread* thread;
+    /** Absolute expiry time in enclave_nanos(), valid while queued. */
+    uint64_t deadline_ns;
+    /** Index of the timer in the heap or TIMER_NOT_QUEUED. */
+    size_t heap_index;
+} sgxlkl_timer;
+
+static struct
+{
     /**
-     * Mutex used to protect access to this structure between threads setting
-     * the timer and the thread that handles the callback.
+     * Mutex used to protect the service state between threads setting
+     * timers and the service thread. It is not held while callbacks run.
      */
     struct lkl_mutex mtx;
+    /** Min-heap of armed timers. */
+    sgxlkl_timer** heap;
+    size_t len;
+    /**
+     * Capacity of the heap, kept at least as large as the number of
+     * allocated timers so that arming a timer never allocates.
+     */
+    size_t capacity;
+    size_t num_timers;
+    /** The service thread, NULL if it is not running. */
+    struct lthread* thread;
+    /** Deadline the service thread sleeps until, 0 if it is awake. */
+    uint64_t sleep_until_ns;
     /**
      * Free-running counter used as a futex for wakeups.  The sleeping thread
      * reads the value with `mtx` held, releases `mtx`, then sleeps with the
@@ -530,74 +594,153 @@ typedef struct sgxlkl_timer
      * counter with the `mtx` held before sending the futex wake.
      */
     _Atomic(int) wake;
-    /** Flag indicating that the timer is armed. */
-    _Atomic(bool) armed;
-} sgxlkl_timer;
+    /** Timer whose callback is running, if any. */
+    sgxlkl_timer* running;
+    /**
+     * Futex counter incremented whenever a callback returns while threads
+     * freeing its timer are waiting, using the same protocol as `wake`.
+     */
+    _Atomic(int) done;
+    int done_waiters;
+} timer_service;
 
-static void* timer_callback(void* _timer)
+static bool timer_before(size_t i, size_t j)
 {
-    sgxlkl_timer* timer = (sgxlkl_timer*)_timer;
-    struct timespec timeout;
+    return timer_service.heap[i]->deadline_ns <
+           timer_service.heap[j]->deadline_ns;
+}
+
+static void timer_heap_swap(size_t i, size_t j)
+{
+    sgxlkl_timer* tmp = timer_service.heap[i];
+    timer_service.heap[i] = timer_service.heap[j];
+    timer_service.heap[j] = tmp;
+    timer_service.heap[i]->heap_index = i;
+    timer_service.heap[j]->heap_index = j;
+}
 
-    if (timer == NULL || timer->callback_fn == NULL)
+static void timer_heap_sift_up(size_t i)
+{
+    while (i > 0 && timer_before(i, (i - 1) / 2))
     {
-        sgxlkl_fail("timer_callback() called with unitialised timer.\n");
+        timer_heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
     }
+}
+
+static void timer_heap_sift_down(size_t i)
+{
+    for (;;)
+    {
+        size_t min = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < timer_service.len && timer_before(left, min))
+            min = left;
+        if (right < timer_service.len && timer_before(right, min))
+            min = right;
+        if (min == i)
+            return;
+
+        timer_heap_swap(i, min);
+        i = min;
+    }
+}
+
+static void timer_heap_remove(sgxlkl_timer* timer)
+{
+    size_t i = timer->heap_index;
+    size_t last = --timer_service.len;
+
+    timer->heap_index = TIMER_NOT_QUEUED;
+    if (i == last)
+        return;
+
+    timer_service.heap[i] = timer_service.heap[last];
+    timer_service.heap[i]->heap_index = i;
+    timer_heap_sift_up(i);
+    timer_heap_sift_down(timer_service.heap[i]->heap_index);
+}
+
+static void* timer_service_thread(void* unused)
+{
+    struct lthread* self = lthread_self();
+    struct timespec timeout;
 
-    mutex_lock(&timer->mtx);
+    lthread_set_funcname(self, "lkl-timers");
+    mutex_lock(&timer_service.mtx);
 
-    do
+    // timer_free() clears `thread` when the last timer is freed
+    while (timer_service.thread == self)
     {
-        if (timer->delay_ns <= 0)
-        {
-            SGXLKL_VERBOSE("timer->delay_ns=%llu <= 0\n", timer->delay_ns);
-            break;
-        }
+        uint64_t now = enclave_nanos();
 
-        timeout.tv_sec = timer->delay_ns / NSEC_PER_SEC;
-        timeout.tv_nsec = timer->delay_ns % NSEC_PER_SEC;
-
-        // Record the initial wake flag to before releasing the mutex.  We will
-        // only ever be woken by a thread that holds the mutex, so this avoids a
-        // race: the waking side will increment the counter and then wake us
-        // with the mutex held, so `enclave_futex_timedwait` will return
-        // immediately if the other thread increments the counter before
-        // waking us.
-        int wake = timer->wake;
-        mutex_unlock(&timer->mtx);
-        bool did_timeout =
-            enclave_futex_timedwait((int*)&timer->wake, wake, &timeout) == -ETIMEDOUT;
-        mutex_lock(&timer->mtx);
-
-        // Check if the timer should shut down
-        if (!timer->armed)
+        while (timer_service.thread == self && timer_service.len > 0 &&
+               timer_service.heap[0]->deadline_ns <= now)
         {
-            break;
-        }
+            sgxlkl_timer* timer = timer_service.heap[0];
+            timer_heap_remove(timer);
 
-        // Check if the timer has triggered
-        if (did_timeout)
-        {
-            timer->next_delay_ns = 0;
+            // The callback may re-arm or free its own timer, and other
+            // timers may be set meanwhile, so it runs without the mutex.
+            timer_service.running = timer;
+            mutex_unlock(&timer_service.mtx);
             timer->callback_fn(timer->callback_arg);
-            // If the callback function itself resets the timer,
-            // timer->next_delay_ns will be non-zero.
-            if (timer->next_delay_ns)
+            mutex_lock(&timer_service.mtx);
+            timer_service.running = NULL;
+
+            if (timer_service.done_waiters)
             {
-                timer->delay_ns = timer->next_delay_ns;
-                timer->next_delay_ns = 0;
+                timer_service.done++;
+                enclave_futex_wake((int*)&timer_service.done, INT_MAX);
             }
+
+            now = enclave_nanos();
         }
 
-    } while (timer->armed);
-    mutex_unlock(&timer->mtx);
+        // A callback may have freed the last timer, and a new service thread
+        // may already have been started. Sleeping now would never end, or
+        // could take wakeups meant for the new thread.
+        if (timer_service.thread != self)
+            break;
+
+        // Record the wake counter before releasing the mutex, see `wake`.
+        int wake = timer_service.wake;
+        if (timer_service.len > 0)
+        {
+            uint64_t delay_ns = timer_service.heap[0]->deadline_ns - now;
+            timer_service.sleep_until_ns = timer_service.heap[0]->deadline_ns;
+            timeout.tv_sec = delay_ns / NSEC_PER_SEC;
+            timeout.tv_nsec = delay_ns % NSEC_PER_SEC;
+            mutex_unlock(&timer_service.mtx);
+            enclave_futex_timedwait((int*)&timer_service.wake, wake, &timeout);
+        }
+        else
+        {
+            timer_service.sleep_until_ns = UINT64_MAX;
+            mutex_unlock(&timer_service.mtx);
+            enclave_futex_wait((int*)&timer_service.wake, wake);
+        }
+        mutex_lock(&timer_service.mtx);
+        timer_service.sleep_until_ns = 0;
+    }
+
+    mutex_unlock(&timer_service.mtx);
 
     lthread_exit(NULL);
 }
 
+/* Must be called with timer_service.mtx held. */
+static void timer_service_wake(void)
+{
+    timer_service.wake++;
+    enclave_futex_wake((int*)&timer_service.wake, 1);
+}
+
 static void* timer_alloc(void (*fn)(void*), void* arg)
 {
-    sgxlkl_timer* timer = oe_calloc(sizeof(*timer), 1);
+    sgxlkl_timer* timer = enclave_calloc(1, sizeof(*timer));
 
     if (timer == NULL)
     {
@@ -605,9 +748,26 @@ static void* timer_alloc(void (*fn)(void*), void* arg)
     }
     timer->callback_fn = fn;
     timer->callback_arg = arg;
-    timer->armed = 0;
-    timer->delay_ns = 0;
-    timer->next_delay_ns = 0;
+    timer->heap_index = TIMER_NOT_QUEUED;
+
+    mutex_lock(&timer_service.mtx);
+
+    if (timer_service.num_timers == timer_service.capacity)
+    {
+        size_t capacity =
+            timer_service.capacity ? 2 * timer_service.capacity : 16;
+        sgxlkl_timer** heap =
+            oe_realloc(timer_service.heap, capacity * sizeof(*heap));
+        if (heap == NULL)
+        {
+            sgxlkl_fail("LKL host op: timer_alloc() failed. OOM\n");
+        }
+        timer_service.heap = heap;
+        timer_service.capacity = capacity;
+    }
+    timer_service.num_timers++;
+
+    mutex_unlock(&timer_service.mtx);
 
     return (void*)timer;
 }
@@ -615,92 +775,103 @@ static void* timer_alloc(void (*fn)(void*), void* arg)
 static int timer_set_oneshot(void* _timer, unsigned long ns)
 {
     sgxlkl_timer* timer = (sgxlkl_timer*)_timer;
+    uint64_t deadline_ns = enclave_nanos() + ns;
+
+    mutex_lock(&timer_service.mtx);
 
-    // timer_set_oneshot is executed as part of the current timer's
-    // callback. Do not try to acquire the lock we are already holding.
-    if (timer->thread == lthread_self())
+    if (timer_service.thread == NULL)
     {
-        // Fail if the timer is being destroyed
-        if (!timer->armed)
+        struct lthread_attr attr = {.priority = LTHREAD_PRIO_HIGH};
+        int res = lthread_create(
+            &timer_service.thread, &attr, &timer_service_thread, NULL);
+        if (res != 0)
         {
-            SGXLKL_VERBOSE("timer_set_oneshot() called on destroyed timer\n");
-            return -1;
+            sgxlkl_fail("pthread_create(timer_thread) returned %d\n", res);
         }
+    }
 
-        if (timer->next_delay_ns)
-        {
-            if (ns < timer->next_delay_ns)
-            {
-                timer->next_delay_ns = ns;
-            }
-        }
-        else
-        {
-            timer->next_delay_ns = ns;
-        }
+    // Are we updating an armed timer or arming a new timer?
+    timer->deadline_ns = deadline_ns;
+    if (timer->heap_index != TIMER_NOT_QUEUED)
+    {
+        timer_heap_sift_up(timer->heap_index);
+        timer_heap_sift_down(timer->heap_index);
     }
     else
     {
-        mutex_lock(&timer->mtx);
-
-        // Are we updating an armed timer or arming a new timer?
-        if (timer->armed)
-        {
-            timer->delay_ns = ns;
-            timer->wake++;
-            enclave_futex_wake((int*)&timer->wake, 1);
-        }
-        else
-        {
-            timer->armed = true;
-            timer->delay_ns = ns;
-            timer->next_delay_ns = 0;
-
-            int res = lthread_create(
-                &(timer->thread), NULL, &timer_callback, (void*)timer);
-            if (res != 0)
-            {
-                sgxlkl_fail("pthread_create(timer_thread) returned %d\n", res);
-            }
-        }
+        timer->heap_index = timer_service.len++;
+        timer_service.heap[timer->heap_index] = timer;
+        timer_heap_sift_up(timer->heap_index);
+    }
 
-        mutex_unlock(&timer->mtx);
+    // A later deadline only costs the service thread a spurious wakeup
+    if (deadline_ns < timer_service.sleep_until_ns)
+    {
+        timer_service_wake();
     }
 
+    mutex_unlock(&timer_service.mtx);
+
     return 0;
 }
 
 static void timer_free(void* _timer)
 {
     sgxlkl_timer* timer = (sgxlkl_timer*)_timer;
+    struct lthread* stopped = NULL;
+
     if (timer == NULL)
     {
         sgxlkl_fail("timer_free() called with NULL\n");
     }
 
-    mutex_lock(&timer->mtx);
+    mutex_lock(&timer_service.mtx);
+
+    if (timer->heap_index != TIMER_NOT_QUEUED)
+    {
+        timer_heap_remove(timer);
+    }
+
+    // Wait for a running callback of this timer to return, unless it is the
+    // callback itself that frees the timer.
+    if (timer_service.thread != lthread_self())
+    {
+        while (timer_service.running == timer)
+        {
+            int done = timer_service.done;
+            timer_service.done_waiters++;
+            mutex_unlock(&timer_service.mtx);
+            enclave_futex_wait((int*)&timer_service.done, done);
+            mutex_lock(&timer_service.mtx);
+            timer_service.done_waiters--;
+        }
+    }
 
-    bool current_value = true;
-    if (atomic_compare_exchange_strong(&timer->armed, &current_value, false))
+    // Stop the service thread with the last timer
+    if (--timer_service.num_timers == 0 && timer_service.thread)
     {
-        timer->wake++;
-        enclave_futex_wake((int*)&timer->wake, 1);
-        mutex_unlock(&timer->mtx);
+        stopped = timer_service.thread;
+        timer_service.thread = NULL;
+        timer_service_wake();
+    }
 
+    mutex_unlock(&timer_service.mtx);
+
+    if (stopped == lthread_self())
+    {
+        lthread_detach();
+    }
+    else if (stopped)
+    {
         void* exit_val = NULL;
-        int res = lthread_join(timer->thread, &exit_val, -1);
+        int res = lthread_join(stopped, &exit_val, -1);
         if (res != 0)
         {
             sgxlkl_warn("lthread_join(timer_thread) returned %d\n", res);
         }
     }
-    else
-    {
-        SGXLKL_VERBOSE("timer->thread not armed\n");
-        mutex_unlock(&timer->mtx);
-    }
 
-    oe_free(_timer);
+    enclave_free(_timer);
 }
 
 static long _gettid(void)
@@ -725,7 +896,7 @@ static size_t kernel_mem_size;
  * 2. Allocating buffers for lkl_vprintf to use printing debug messages.
  *
  * We allocate the former from the `enclave_mmap` space, but smaller buffers
- * from the OE heap.
+ * from the enclave allocator.
  */
 static void *host_malloc(size_t size)
 {
@@ -744,10 +915,11 @@ static void *host_malloc(size_t size)
             return NULL;
         }
         kernel_mem_size = size;
+        lkl_virtio_balloon_set_kernel_mem(kernel_mem, kernel_mem_size);
         return kernel_mem;
     }
 
-    return oe_malloc(size);
+    return enclave_malloc(size);
 }
 
 /**
@@ -757,12 +929,12 @@ static void host_free(void *ptr)
 {
     if (ptr == kernel_mem)
     {
-        enclave_munmap(kernel_mem, kernel_mem_size);
+        lkl_virtio_balloon_unmap_kernel_mem(kernel_mem, kernel_mem_size);
         kernel_mem = 0;
         kernel_mem_size = 0;
         return;
     }
-    oe_free(ptr);
+    enclave_free(ptr);
 }
 
 /**
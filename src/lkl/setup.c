@@ -39,6 +39,7 @@
 #include "lkl/posix-host.h"
 #include "lkl/setup.h"
 #include "lkl/syscall-overrides.h"
+#include "lkl/virtio_balloon.h"
 #include "lkl/virtio_device.h"
 #include "lkl/virtio_net.h"
 
@@ -71,6 +72,18 @@
 // as ratio of the original disk size.
 #define CREATED_DISK_ENCRYPTION_OVERHEAD 0.15
 
+// Superblock magic numbers of the read-only file systems that disks can have
+// instead of ext4, and their offsets on disk.
+#define EROFS_SUPER_OFFSET 1024
+#define EROFS_SUPER_MAGIC 0xe0f5e1e2
+#define SQUASHFS_SUPER_OFFSET 0
+#define SQUASHFS_MAGIC 0x73717368
+
+// The compressed RAM disk that backs /tmp if zram_size is set, and its
+// attributes in sysfs.
+#define ZRAM_DEV "/dev/zram0"
+#define ZRAM_SYSFS "/sys/block/zram0/"
+
 #define BOOTARGS_LEN 128
 
 /* Console argument for bootargs */
@@ -93,6 +106,8 @@ int sgxlkl_mtu = 0;
 
 extern struct timespec sgxlkl_app_starttime;
 
+struct timespec timespec_diff(struct timespec end, struct timespec start);
+
 /* Function to setup bounce buffer in LKL */
 extern void initialize_enclave_event_channel(
     enc_dev_config_t* enc_dev_config,
@@ -199,7 +214,22 @@ static void lkl_mount_shmtmpfs()
 
 static void lkl_mount_tmpfs()
 {
-    int err = lkl_sys_mount("tmpfs", "/tmp", "tmpfs", 0, "mode=1777");
+    int err;
+
+    if (sgxlkl_enclave_state.config->zram_size)
+    {
+        // Discard freed blocks so that zram releases their memory.
+        err = lkl_sys_mount(ZRAM_DEV, "/tmp", "ext4", 0, "discard");
+        if (err != 0)
+        {
+            sgxlkl_fail(
+                "lkl_sys_mount(%s) (/tmp): %s\n", ZRAM_DEV, lkl_strerror(err));
+        }
+        lkl_sys_chmod("/tmp", 01777);
+        return;
+    }
+
+    err = lkl_sys_mount("tmpfs", "/tmp", "tmpfs", 0, "mode=1777");
     if (err != 0)
     {
         sgxlkl_fail("lkl_sys_mount(tmpfs): %s\n", lkl_strerror(err));
@@ -362,6 +392,7 @@ typedef struct
     bool readonly;
     const char* roothash;
     size_t roothash_offset;
+    size_t verity_block_size;
     size_t size;
     bool overlay;
 } disk_config_t;
@@ -372,10 +403,17 @@ struct lkl_crypt_device
     int readonly;
     disk_config_t disk_config;
     char* crypt_name;
+    char* error;
+    size_t error_size;
 };
 
+/* Disks are activated concurrently, so the helpers below record why a disk
+ * could not be set up and leave it to the caller to fail. */
+#define DISK_ERROR(lkl_cd, ...) \
+    oe_snprintf((lkl_cd)->error, (lkl_cd)->error_size, __VA_ARGS__)
+
 #ifdef USE_CRYPT_SETUP
-static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
+static int lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
 {
     int err;
 
@@ -385,13 +423,15 @@ static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
     err = crypt_init(&cd, disk_path);
     if (err != 0)
     {
-        sgxlkl_fail("crypt_init(): %s (%d)\n", strerror(-err), err);
+        DISK_ERROR(lkl_cd, "crypt_init(): %s (%d)", strerror(-err), err);
+        return err;
     }
 
     err = crypt_load(cd, CRYPT_LUKS2, NULL);
     if (err != 0)
     {
-        sgxlkl_fail("crypt_load(): %s (%d)\n", strerror(-err), err);
+        DISK_ERROR(lkl_cd, "crypt_load(): %s (%d)", strerror(-err), err);
+        goto done;
     }
 
     err = crypt_activate_by_passphrase(
@@ -403,18 +443,22 @@ static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
         lkl_cd->readonly ? CRYPT_ACTIVATE_READONLY : 0);
     if (err == -1)
     {
-        sgxlkl_fail("Unable to activate encrypted disk. Please ensure you "
-                    "have provided the correct passphrase/keyfile!\n");
+        DISK_ERROR(
+            lkl_cd,
+            "Unable to activate encrypted disk. Please ensure you "
+            "have provided the correct passphrase/keyfile!");
     }
     else if (err != 0)
     {
-        sgxlkl_fail(
+        DISK_ERROR(
+            lkl_cd,
             "Unable to activate encrypted disk due to unknown error (error "
-            "code: %d, message: %s)\n",
+            "code: %d, message: %s)",
             err,
             strerror(-err));
     }
 
+done:
     crypt_free(cd);
 
     // The key is only needed during activation, so don't keep it around
@@ -424,7 +468,7 @@ static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
     lkl_cd->disk_config.key = NULL;
     lkl_cd->disk_config.key_len = 0;
 
-    return 0;
+    return err;
 }
 #endif
 
@@ -452,7 +496,7 @@ static void* lkl_activate_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
 // #define ENABLE_INTEGRITY
 
 #ifdef USE_CRYPT_SETUP
-static void* lkl_create_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
+static int lkl_create_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
 {
     int err;
     /* ATTN: vicsetup only supports 512 bytes sectors for integrity */
@@ -466,7 +510,10 @@ static void* lkl_create_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
     struct crypt_device* cd;
     err = crypt_init(&cd, disk_path);
     if (err != 0)
-        sgxlkl_fail("crypt_init(): %s (%d)\n", strerror(-err), err);
+    {
+        DISK_ERROR(lkl_cd, "crypt_init(): %s (%d)", strerror(-err), err);
+        return err;
+    }
 
     // As we generate our own key and don't use a simple "password" we use
     // the minimal kdf settings possible.
@@ -503,7 +550,10 @@ static void* lkl_create_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
         volume_key_size,
         &params);
     if (err != 0)
-        sgxlkl_fail("crypt_format(): %s (%d)\n", strerror(-err), err);
+    {
+        DISK_ERROR(lkl_cd, "crypt_format(): %s (%d)", strerror(-err), err);
+        goto done;
+    }
 
     err = crypt_keyslot_add_by_key(
         cd,
@@ -514,17 +564,24 @@ static void* lkl_create_crypto_disk_thread(struct lkl_crypt_device* lkl_cd)
         lkl_cd->disk_config.key_len,
         0);
     if (err != 0)
-        sgxlkl_fail(
-            "crypt_keyslot_add_by_key(): %s (%d)\n", strerror(-err), err);
+    {
+        DISK_ERROR(
+            lkl_cd,
+            "crypt_keyslot_add_by_key(): %s (%d)",
+            strerror(-err),
+            err);
+        goto done;
+    }
 
+done:
     crypt_free(cd);
 
-    return 0;
+    return err;
 }
 #endif
 
 #ifdef USE_CRYPT_SETUP
-static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd)
+static int lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd)
 {
     int err;
 
@@ -535,7 +592,8 @@ static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd)
     err = crypt_init(&cd, disk_path);
     if (err != 0)
     {
-        sgxlkl_fail("crypt_init(): %s (%d)\n", strerror(err), err);
+        DISK_ERROR(lkl_cd, "crypt_init(): %s (%d)", strerror(err), err);
+        return err;
     }
 
     /*
@@ -543,29 +601,38 @@ static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd)
      * stored on the disk image following the actual data blocks. The offset
      * that signifies both the end of the data region as well as the start of
      * the hash region has to be provided to SGX-LKL.
+     *
+     * Data and hash blocks have the same size. If it is not configured, it is
+     * taken from the dm-verity superblock at the start of the hash region.
      */
+    const size_t block_size = lkl_cd->disk_config.verity_block_size;
     struct crypt_params_verity verity_params = {
         .data_device = disk_path,
         .hash_device = disk_path,
         .hash_area_offset = lkl_cd->disk_config.roothash_offset,
-        .data_size = lkl_cd->disk_config.roothash_offset /
-                     512, // In blocks, divide by block size
-        .data_block_size = 512,
-        .hash_block_size = 512,
+        .data_size = block_size ? lkl_cd->disk_config.roothash_offset /
+                                      block_size
+                                : 0, // In blocks, divide by block size
+        .data_block_size = block_size,
+        .hash_block_size = block_size,
     };
 
+    uint8_t* volume_hash_bytes = NULL;
+
     err = crypt_load(cd, CRYPT_VERITY, &verity_params);
     if (err != 0)
     {
-        sgxlkl_fail("crypt_load(): %s (%d)\n", strerror(err), err);
+        DISK_ERROR(lkl_cd, "crypt_load(): %s (%d)", strerror(err), err);
+        goto done;
     }
 
-    uint8_t* volume_hash_bytes = NULL;
     ssize_t hash_size = crypt_get_volume_key_size(cd);
     if (hex_to_bytes(lkl_cd->disk_config.roothash, &volume_hash_bytes) !=
         hash_size)
     {
-        sgxlkl_fail("Invalid root hash string specified!\n");
+        DISK_ERROR(lkl_cd, "Invalid root hash string specified!");
+        err = -EINVAL;
+        goto done;
     }
 
     err = crypt_activate_by_volume_key(
@@ -576,15 +643,19 @@ static void* lkl_activate_verity_disk_thread(struct lkl_crypt_device* lkl_cd)
         lkl_cd->readonly ? CRYPT_ACTIVATE_READONLY : 0);
     if (err != 0)
     {
-        sgxlkl_fail(
-            "crypt_activate_by_volume_key(): %s (%d)\n", strerror(err), err);
+        DISK_ERROR(
+            lkl_cd,
+            "crypt_activate_by_volume_key(): %s (%d)",
+            strerror(err),
+            err);
     }
 
+done:
     // ATTN: This crashes!
     free(volume_hash_bytes);
     crypt_free(cd);
 
-    return NULL;
+    return err;
 }
 #endif
 
@@ -605,59 +676,121 @@ static void lkl_mount_virtual()
     lkl_mknods();
 }
 
-static void lkl_mount_disk(
-    disk_config_t* disk,
+typedef struct
+{
+    disk_config_t config;
+    char device;
+    const char* mnt_point;
+    size_t disk_index;
+    char dev_str[sizeof "/dev/mapper/verityX"];
+    struct lthread* thread;
+    int err;
+    char error[256];
+    struct timespec elapsed;
+} disk_job_t;
+
+static void lkl_init_disk_job(
+    disk_job_t* job,
+    const disk_config_t* disk,
     char device,
     const char* mnt_point,
     size_t disk_index)
 {
-    char dev_str_raw[] = {"/dev/vdX"};
-    char dev_str_enc[] = {"/dev/mapper/cryptX"};
-    char dev_str_verity[] = {"/dev/mapper/verityX"};
-    const size_t offset_dev_str_crypt_name = sizeof "/dev/mapper/" - 1;
-
-    dev_str_raw[sizeof dev_str_raw - 2] = device;
-    char* dev_str = dev_str_raw;
-
-    SGXLKL_VERBOSE(
-        "lkl_mount_disk(dev=\"%s\", mnt=\"%s\", ro=%i)\n",
-        dev_str,
-        mnt_point,
-        disk->readonly);
-
-    struct lkl_crypt_device lkl_cd;
-    lkl_cd.disk_path = dev_str;
-    lkl_cd.readonly = disk->readonly;
-    lkl_cd.disk_config = *disk;
-
-    (void)lkl_cd;
+    memset(job, 0, sizeof(*job));
+    job->config = *disk;
+    job->device = device;
+    job->mnt_point = mnt_point;
+    job->disk_index = disk_index;
 
     if (disk->create && disk->fresh_key)
     {
-        disk->key_len = CREATED_DISK_KEY_LENGTH / 8;
+        job->config.key_len = CREATED_DISK_KEY_LENGTH / 8;
         SGXLKL_VERBOSE("Generating random disk encryption key\n");
-        disk->key = malloc(disk->key_len);
-        if (disk->key == NULL)
+        job->config.key = malloc(job->config.key_len);
+        if (job->config.key == NULL)
             sgxlkl_fail("Could not allocate memory for disk encryption key\n");
-        for (size_t i = 0; i < disk->key_len; i++)
+        for (size_t i = 0; i < job->config.key_len; i++)
             /* TODO: keys should be set up prior to reaching this function.
              * Also, if we need fresh keys at all, they should be generated
              * properly, e.g. by using the DRNG instructions or mbedTLS for RSA
              * keys. */
-            disk->key[i] = rand();
+            job->config.key[i] = rand();
+    }
+}
+
+/* Syscall tracing is too noisy while dm-crypt/dm-verity targets are set up,
+ * so it is switched off for the whole batch of disks rather than per disk. */
+static void lkl_suspend_disk_tracing(
+    const disk_job_t* jobs,
+    size_t num_jobs,
+    int* lkl_trace_lkl_syscall_bak,
+    int* lkl_trace_internal_syscall_bak)
+{
+    bool protected_disks = false;
+
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        disk_config_t cfg = jobs[i].config;
+        if (cfg.roothash || is_encrypted_cfg(&cfg))
+            protected_disks = true;
     }
 
-    int lkl_trace_lkl_syscall_bak = sgxlkl_trace_lkl_syscall;
-    int lkl_trace_internal_syscall_bak = sgxlkl_trace_internal_syscall;
+    *lkl_trace_lkl_syscall_bak = sgxlkl_trace_lkl_syscall;
+    *lkl_trace_internal_syscall_bak = sgxlkl_trace_internal_syscall;
 
     if ((sgxlkl_trace_lkl_syscall || sgxlkl_trace_internal_syscall) &&
-        (disk->roothash || is_encrypted_cfg(disk)))
+        protected_disks)
     {
         sgxlkl_trace_lkl_syscall = 0;
         sgxlkl_trace_internal_syscall = 0;
         SGXLKL_VERBOSE("Disk encryption/integrity enabled: Temporarily "
                        "disabling tracing to reduce noise.\n");
     }
+}
+
+static void lkl_restore_disk_tracing(
+    int lkl_trace_lkl_syscall_bak,
+    int lkl_trace_internal_syscall_bak)
+{
+    if ((lkl_trace_lkl_syscall_bak && !sgxlkl_trace_lkl_syscall) ||
+        (lkl_trace_internal_syscall_bak && !sgxlkl_trace_internal_syscall))
+    {
+        SGXLKL_VERBOSE(
+            "Disk encryption/integrity enabled: Re-enabling tracing.\n");
+        sgxlkl_trace_lkl_syscall = lkl_trace_lkl_syscall_bak;
+        sgxlkl_trace_internal_syscall = lkl_trace_internal_syscall_bak;
+    }
+}
+
+/* Set up the device-mapper targets of a disk and create its file system if
+ * requested. On success, job->dev_str names the device to mount. */
+static int lkl_activate_disk(disk_job_t* job)
+{
+    disk_config_t* disk = &job->config;
+    char device = job->device;
+    char dev_str_raw[] = {"/dev/vdX"};
+    char dev_str_enc[] = {"/dev/mapper/cryptX"};
+    char dev_str_verity[] = {"/dev/mapper/verityX"};
+    const size_t offset_dev_str_crypt_name = sizeof "/dev/mapper/" - 1;
+    int err = 0;
+
+    dev_str_raw[sizeof dev_str_raw - 2] = device;
+    char* dev_str = dev_str_raw;
+
+    SGXLKL_VERBOSE(
+        "lkl_activate_disk(dev=\"%s\", mnt=\"%s\", ro=%i)\n",
+        dev_str,
+        job->mnt_point,
+        disk->readonly);
+
+    struct lkl_crypt_device lkl_cd;
+    lkl_cd.disk_path = dev_str;
+    lkl_cd.readonly = disk->readonly;
+    lkl_cd.disk_config = *disk;
+    lkl_cd.error = job->error;
+    lkl_cd.error_size = sizeof(job->error);
+
+    (void)lkl_cd;
 
     if (disk->roothash != NULL)
     {
@@ -665,7 +798,8 @@ static void lkl_mount_disk(
         dev_str_verity[sizeof dev_str_verity - 2] = device;
         lkl_cd.crypt_name = dev_str_verity + offset_dev_str_crypt_name;
 #ifdef USE_CRYPT_SETUP
-        lkl_activate_verity_disk_thread(&lkl_cd);
+        if ((err = lkl_activate_verity_disk_thread(&lkl_cd)) != 0)
+            return err;
 #endif
 
         // We now want to mount the verified volume
@@ -684,28 +818,21 @@ static void lkl_mount_disk(
         {
             SGXLKL_VERBOSE("Creating empty crypto disk\n");
 #ifdef USE_CRYPT_SETUP
-            lkl_create_crypto_disk_thread(&lkl_cd);
+            if ((err = lkl_create_crypto_disk_thread(&lkl_cd)) != 0)
+                return err;
 #endif
         }
 
         SGXLKL_VERBOSE("Activating crypto disk\n");
 #ifdef USE_CRYPT_SETUP
-        lkl_activate_crypto_disk_thread(&lkl_cd);
+        if ((err = lkl_activate_crypto_disk_thread(&lkl_cd)) != 0)
+            return err;
 #endif
 
         // We now want to mount the decrypted volume
         dev_str = dev_str_enc;
     }
 
-    if ((lkl_trace_lkl_syscall_bak && !sgxlkl_trace_lkl_syscall) ||
-        (lkl_trace_internal_syscall_bak && !sgxlkl_trace_internal_syscall))
-    {
-        SGXLKL_VERBOSE(
-            "Disk encryption/integrity enabled: Re-enabling tracing.\n");
-        sgxlkl_trace_lkl_syscall = lkl_trace_lkl_syscall_bak;
-        sgxlkl_trace_internal_syscall = lkl_trace_internal_syscall_bak;
-    }
-
     if (disk->create)
     {
         size_t fs_size = disk->size;
@@ -722,25 +849,215 @@ static void lkl_mount_disk(
                       CREATED_DISK_EXT4_BLOCK_SIZE;
         }
 
-        int result;
         unsigned long long num_blocks = fs_size / CREATED_DISK_EXT4_BLOCK_SIZE;
         SGXLKL_VERBOSE("Creating ext4 filesystem of size %ld\n", fs_size);
         SGXLKL_VERBOSE(
             "make_ext4_dev(block_size=\"%d\", num_blocks=\"%lld\")\n",
             CREATED_DISK_EXT4_BLOCK_SIZE,
             num_blocks);
-        result =
-            make_ext4_dev(dev_str, CREATED_DISK_EXT4_BLOCK_SIZE, num_blocks);
-        if (result != 0)
-            sgxlkl_fail("make_ext4_dev()=%s\n", result);
+        err = make_ext4_dev(dev_str, CREATED_DISK_EXT4_BLOCK_SIZE, num_blocks);
+        if (err != 0)
+        {
+            DISK_ERROR(&lkl_cd, "make_ext4_dev()=%d", err);
+            return err;
+        }
     }
 
+    oe_snprintf(job->dev_str, sizeof(job->dev_str), "%s", dev_str);
+
+    return 0;
+}
+
+static void* lkl_activate_disk_thread(disk_job_t* job)
+{
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    job->err = lkl_activate_disk(job);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    job->elapsed = timespec_diff(end, start);
+
+    return NULL;
+}
+
+/* Returns the file system type of a disk, based on its superblock. Disks that
+ * are neither EROFS nor SquashFS are assumed to be ext4. */
+static const char* lkl_disk_fs_type(const char* dev_str)
+{
+    uint32_t magic;
+
+    int fd = lkl_sys_open(dev_str, LKL_O_RDONLY, 0);
+    if (fd < 0)
+        return "ext4";
+
+    const char* fs_type = "ext4";
+    if (lkl_sys_pread64(fd, &magic, sizeof(magic), EROFS_SUPER_OFFSET) ==
+            sizeof(magic) &&
+        magic == EROFS_SUPER_MAGIC)
+        fs_type = "erofs";
+    else if (
+        lkl_sys_pread64(fd, &magic, sizeof(magic), SQUASHFS_SUPER_OFFSET) ==
+            sizeof(magic) &&
+        magic == SQUASHFS_MAGIC)
+        fs_type = "squashfs";
+
+    lkl_sys_close(fd);
+    return fs_type;
+}
+
+static int lkl_mount_activated_disk(disk_job_t* job)
+{
+    const char* fs_type = lkl_disk_fs_type(job->dev_str);
+
+    // EROFS and SquashFS are read-only file systems
+    if (strcmp(fs_type, "ext4") != 0)
+        job->config.readonly = 1;
+
+    SGXLKL_VERBOSE(
+        "Mounting %s (%s) at %s\n", job->dev_str, fs_type, job->mnt_point);
     const int err = lkl_mount_blockdev(
-        dev_str, mnt_point, "ext4", disk->readonly ? LKL_MS_RDONLY : 0, NULL);
+        job->dev_str,
+        job->mnt_point,
+        fs_type,
+        job->config.readonly ? LKL_MS_RDONLY : 0,
+        NULL);
     if (err < 0)
-        sgxlkl_fail("lkl_mount_blockdev()=%s (%d)\n", lkl_strerror(err), err);
+    {
+        oe_snprintf(
+            job->error,
+            sizeof(job->error),
+            "lkl_mount_blockdev()=%s (%d)",
+            lkl_strerror(err),
+            err);
+        return err;
+    }
+
+    sgxlkl_enclave_state.disk_state[job->disk_index].mounted = true;
+
+    return 0;
+}
+
+static void lkl_mount_disk(
+    disk_config_t* disk,
+    char device,
+    const char* mnt_point,
+    size_t disk_index)
+{
+    disk_job_t job;
+    int lkl_trace_lkl_syscall_bak;
+    int lkl_trace_internal_syscall_bak;
+
+    lkl_init_disk_job(&job, disk, device, mnt_point, disk_index);
+
+    lkl_suspend_disk_tracing(
+        &job, 1, &lkl_trace_lkl_syscall_bak, &lkl_trace_internal_syscall_bak);
+    lkl_activate_disk_thread(&job);
+    lkl_restore_disk_tracing(
+        lkl_trace_lkl_syscall_bak, lkl_trace_internal_syscall_bak);
+
+    if (job.err == 0)
+        job.err = lkl_mount_activated_disk(&job);
+
+    if (job.err != 0)
+        sgxlkl_fail("Failed to mount disk at %s: %s\n", mnt_point, job.error);
+
+    SGXLKL_VERBOSE(
+        "Disk %s activated in %ld.%03ld s\n",
+        job.dev_str,
+        job.elapsed.tv_sec,
+        job.elapsed.tv_nsec / 1000000);
+}
+
+/* Activate the secondary disks concurrently, one lthread each, since key
+ * derivation and device-mapper setup dominate startup with several encrypted
+ * disks. Mounting is cheap and happens afterwards in configuration order, so
+ * that disks mounted inside other disks' mount points still stack correctly.
+ * All failures are reported before giving up. */
+static void lkl_mount_disks_parallel(disk_job_t* jobs, size_t num_jobs)
+{
+    int lkl_trace_lkl_syscall_bak;
+    int lkl_trace_internal_syscall_bak;
+    size_t num_failed = 0;
+    struct timespec start, end, elapsed;
+
+    lkl_suspend_disk_tracing(
+        jobs,
+        num_jobs,
+        &lkl_trace_lkl_syscall_bak,
+        &lkl_trace_internal_syscall_bak);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        struct lthread_attr attr = {0};
+        oe_snprintf(
+            attr.funcname, sizeof(attr.funcname), "disk-vd%c", jobs[i].device);
+
+        // A single secondary disk gains nothing from a thread of its own; if
+        // no lthread can be created, activate the disk on this thread.
+        if (num_jobs == 1 ||
+            lthread_create(
+                &jobs[i].thread, &attr, lkl_activate_disk_thread, &jobs[i]) !=
+                0)
+        {
+            jobs[i].thread = NULL;
+            lkl_activate_disk_thread(&jobs[i]);
+        }
+    }
+
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        if (jobs[i].thread)
+        {
+            int ret = lthread_join(jobs[i].thread, NULL, -1);
+            if (ret != 0)
+                sgxlkl_fail("lthread_join failed: %s\n", lkl_strerror(ret));
+        }
+    }
 
-    sgxlkl_enclave_state.disk_state[disk_index].mounted = true;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = timespec_diff(end, start);
+
+    lkl_restore_disk_tracing(
+        lkl_trace_lkl_syscall_bak, lkl_trace_internal_syscall_bak);
+
+    for (size_t i = 0; i < num_jobs; i++)
+    {
+        disk_job_t* job = &jobs[i];
+
+        if (job->err == 0)
+        {
+            SGXLKL_VERBOSE(
+                "Disk %s activated in %ld.%03ld s\n",
+                job->dev_str,
+                job->elapsed.tv_sec,
+                job->elapsed.tv_nsec / 1000000);
+            job->err = lkl_mount_activated_disk(job);
+        }
+
+        if (job->err != 0)
+        {
+            sgxlkl_error(
+                "Failed to mount disk /dev/vd%c at %s: %s\n",
+                job->device,
+                job->mnt_point,
+                job->error);
+            num_failed++;
+        }
+    }
+
+    SGXLKL_VERBOSE(
+        "Activated %zu disks in %ld.%03ld s\n",
+        num_jobs,
+        elapsed.tv_sec,
+        elapsed.tv_nsec / 1000000);
+
+    if (num_failed)
+        sgxlkl_fail(
+            "%zu of %zu disks failed to mount. Aborting...\n",
+            num_failed,
+            num_jobs);
 }
 
 static void lkl_mount_root_disk(
@@ -786,6 +1103,7 @@ static void lkl_mount_root_disk(
                          .readonly = root->readonly,
                          .roothash = root->roothash,
                          .roothash_offset = root->roothash_offset,
+                         .verity_block_size = root->verity_block_size,
                          .size = 0,
                          .overlay = root->overlay};
     lkl_mount_disk(&cfg, 'a', mnt_point, 0);
@@ -868,25 +1186,19 @@ void lkl_mount_disks(
 
     lkl_mount_root_disk(root, 0);
 
-    for (size_t mnt_idx = 0; mnt_idx < num_mounts; mnt_idx++)
+    // We assign dev paths from /dev/vda to /dev/vdz, assuming we won't need
+    // support for more than 26 disks.
+    size_t num_jobs = num_mounts < 25 ? num_mounts : 25;
+    disk_job_t* jobs = num_jobs ? calloc(num_jobs, sizeof(disk_job_t)) : NULL;
+    if (num_jobs && !jobs)
+        sgxlkl_fail("Could not allocate memory for disk mounts\n");
+
+    for (size_t mnt_idx = 0; mnt_idx < num_jobs; mnt_idx++)
     {
         size_t dsk_idx = mnt_idx + 1;
 
         SGXLKL_ASSERT(strcmp(mounts[mnt_idx].destination, "/") != 0);
 
-        // We assign dev paths from /dev/vda to /dev/vdz, assuming we won't need
-        // support for more than 26 disks.
-        if ('a' + dsk_idx > 'z')
-        {
-            sgxlkl_warn(
-                "Too many disks (maximum is 26). Failed to mount disk %d at "
-                "%s.\n",
-                dsk_idx,
-                mounts[mnt_idx].destination);
-            // Adjust number to number of mounted disks.
-            num_mounts = 25;
-            return;
-        }
         disk_config_t cfg = {.create = mounts[mnt_idx].create,
                              .destination = mounts[mnt_idx].destination,
                              .key_len = mounts[mnt_idx].key_len,
@@ -896,9 +1208,27 @@ void lkl_mount_disks(
                              .readonly = mounts[mnt_idx].readonly,
                              .roothash = mounts[mnt_idx].roothash,
                              .roothash_offset = mounts[mnt_idx].roothash_offset,
+                             .verity_block_size =
+                                 mounts[mnt_idx].verity_block_size,
                              .size = mounts[mnt_idx].size,
                              .overlay = false};
-        lkl_mount_disk(&cfg, 'a' + dsk_idx, cfg.destination, dsk_idx);
+        lkl_init_disk_job(
+            &jobs[mnt_idx], &cfg, 'a' + dsk_idx, cfg.destination, dsk_idx);
+    }
+
+    if (num_jobs)
+        lkl_mount_disks_parallel(jobs, num_jobs);
+
+    free(jobs);
+
+    if (num_mounts > num_jobs)
+    {
+        sgxlkl_warn(
+            "Too many disks (maximum is 26). Failed to mount disk %zu at "
+            "%s.\n",
+            num_jobs + 1,
+            mounts[num_jobs].destination);
+        return;
     }
 
     if (cwd)
@@ -1010,6 +1340,66 @@ static void do_sysctl()
     free(sysctl_all);
 }
 
+static int lkl_write_sysfs(const char* path, const char* val)
+{
+    int fd = lkl_sys_open(path, LKL_O_WRONLY, 0);
+    if (fd < 0)
+        return fd;
+
+    long ret = lkl_sys_write(fd, val, strlen(val));
+    lkl_sys_close(fd);
+    return ret < 0 ? ret : 0;
+}
+
+/* Sets up the zram disk and creates the file system for /tmp on it. */
+static void init_zram()
+{
+    const sgxlkl_enclave_config_t* cfg = sgxlkl_enclave_state.config;
+    char disksize[32];
+    int err;
+
+    if (!cfg->zram_size)
+        return;
+
+    unsigned long long num_blocks =
+        cfg->zram_size / CREATED_DISK_EXT4_BLOCK_SIZE;
+    if (!num_blocks)
+        sgxlkl_fail("zram_size too small: %zu\n", cfg->zram_size);
+
+    // The compression algorithm can only be changed before the disk size is
+    // set.
+    err =
+        lkl_write_sysfs(ZRAM_SYSFS "comp_algorithm", cfg->zram_comp_algorithm);
+    if (err != 0)
+    {
+        sgxlkl_fail(
+            "Failed to set zram compression algorithm \"%s\": %s\n",
+            cfg->zram_comp_algorithm,
+            lkl_strerror(err));
+    }
+
+    snprintf(
+        disksize,
+        sizeof(disksize),
+        "%llu",
+        num_blocks * CREATED_DISK_EXT4_BLOCK_SIZE);
+    err = lkl_write_sysfs(ZRAM_SYSFS "disksize", disksize);
+    if (err != 0)
+    {
+        sgxlkl_fail(
+            "Failed to set zram disk size %s: %s\n", disksize, lkl_strerror(err));
+    }
+
+    SGXLKL_VERBOSE(
+        "Creating /tmp on %s (%s bytes, %s)\n",
+        ZRAM_DEV,
+        disksize,
+        cfg->zram_comp_algorithm);
+    err = make_ext4_dev(ZRAM_DEV, CREATED_DISK_EXT4_BLOCK_SIZE, num_blocks);
+    if (err != 0)
+        sgxlkl_fail("make_ext4_dev(%s)=%d\n", ZRAM_DEV, err);
+}
+
 static void init_wireguard()
 {
     const sgxlkl_enclave_config_t* cfg = sgxlkl_enclave_state.config;
@@ -1396,6 +1786,10 @@ void lkl_start_init()
     // Register console device
     lkl_virtio_console_add(shm->virtio_console_mem);
 
+    // Register the balloon device that lets the kernel memory shrink
+    if (cfg->kernel_min_mem && lkl_virtio_balloon_add(cfg->kernel_min_mem))
+        sgxlkl_warn("Failed to add balloon device, kernel memory is fixed\n");
+
     // Register network tap if given one
     int net_dev_id = -1;
     if (shm->virtio_net_dev_mem)
@@ -1495,6 +1889,9 @@ void lkl_start_init()
     // Sysctl
     do_sysctl();
 
+    // Compressed RAM disk for /tmp
+    init_zram();
+
     // Set interface status/IP/routes
     if (!sgxlkl_use_host_network)
         lkl_poststart_net(net_dev_id);
@@ -4,6 +4,7 @@
 #include <sys/mman.h>
 
 #include "enclave/enclave_mem.h"
+#include "enclave/enclave_switchless.h"
 #include "enclave/enclave_util.h"
 #include "enclave/lthread_int.h"
 #include "enclave/sgxlkl_t.h"
@@ -137,9 +138,7 @@ long syscall_SYS_msync(void* addr, size_t length, int flags)
 
 static long syscall_SYS_mprotect(void* addr, size_t len, int prot)
 {
-    long ret = 0;
-    sgxlkl_host_syscall_mprotect((void*)&ret, addr, len, prot);
-    return ret;
+    return enclave_host_mprotect(addr, len, prot);
 }
 
 #if SGXLKL_ENABLE_SYSCALL_TRACING
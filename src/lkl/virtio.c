@@ -3,6 +3,8 @@
  * to run some part of virtio interface inside enclave */
 
 #include <endian.h>
+#include <openenclave/enclave.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <lkl/iomem.h>
@@ -42,6 +44,88 @@ static uint32_t lkl_num_virtio_boot_devs;
 typedef void (*lkl_virtio_dev_deliver_irq)(uint64_t dev_id);
 static lkl_virtio_dev_deliver_irq virtio_deliver_irq[DEVICE_COUNT];
 
+/*
+ * Devices whose queues are served inside the enclave, indexed by the dev_id
+ * given to lkl_virtio_dev_set_notify(). The virtio_dev of such a device may
+ * be in host memory, so its id, irq and features, the queue setup written by
+ * the driver and the ring indices are kept in enclave memory instead, where
+ * the host cannot change them.
+ */
+struct enclave_dev
+{
+    struct virtio_dev* dev;
+    lkl_virtio_dev_notify notify;
+    uint64_t device_features;
+    struct virtq* queue;
+    uint32_t num_queues;
+    uint32_t queue_sel;
+    int irq;
+};
+
+static struct enclave_dev enclave_devs[DEVICE_COUNT];
+
+/*
+ * enclave_dev_find: Find a device that is served inside the enclave
+ * dev : pointer to device structure
+ * return the enclave device or NULL if the host serves the device
+ */
+static struct enclave_dev* enclave_dev_find(struct virtio_dev* dev)
+{
+    for (int i = 0; i < DEVICE_COUNT; i++)
+        if (enclave_devs[i].dev == dev)
+            return &enclave_devs[i];
+
+    return NULL;
+}
+
+/*
+ * enclave_queue_ok: Check that the rings of a queue of a device served inside
+ * the enclave are in enclave memory, so that the host can neither see nor
+ * change them
+ */
+static bool enclave_queue_ok(struct virtq* q)
+{
+    uint32_t num = q->num;
+
+    return num && num <= q->num_max && (num & (num - 1)) == 0 &&
+           oe_is_within_enclave(q->desc, num * sizeof(struct virtq_desc)) &&
+           oe_is_within_enclave(
+               q->avail,
+               sizeof(struct virtq_avail) + (num + 1) * sizeof(uint16_t)) &&
+           oe_is_within_enclave(
+               q->used,
+               sizeof(struct virtq_used) +
+                   num * sizeof(struct virtq_used_elem) + sizeof(uint16_t));
+}
+
+/*
+ * virtio_sel_queue: Get the queue selected by the driver
+ * dev : pointer to device structure
+ * edev : the enclave device or NULL
+ * return the queue
+ */
+static struct virtq* virtio_sel_queue(
+    struct virtio_dev* dev,
+    struct enclave_dev* edev)
+{
+    if (edev)
+        return &edev->queue[edev->queue_sel];
+
+    return &dev->queue[dev->queue_sel];
+}
+
+/*
+ * virtio_device_features: Get the features offered by the device
+ * dev : pointer to device structure
+ * return the device features
+ */
+static inline uint64_t virtio_device_features(struct virtio_dev* dev)
+{
+    struct enclave_dev* edev = enclave_dev_find(dev);
+
+    return edev ? edev->device_features : dev->device_features;
+}
+
 /*
  * virtio_read_device_features: Read Device Features
  * dev : pointer to device structure
@@ -50,9 +134,9 @@ static lkl_virtio_dev_deliver_irq virtio_deliver_irq[DEVICE_COUNT];
 static inline uint32_t virtio_read_device_features(struct virtio_dev* dev)
 {
     if (dev->device_features_sel)
-        return (uint32_t)(dev->device_features >> 32);
+        return (uint32_t)(virtio_device_features(dev) >> 32);
 
-    return (uint32_t)dev->device_features;
+    return (uint32_t)virtio_device_features(dev);
 }
 
 /*
@@ -123,10 +207,10 @@ static int virtio_read(void* data, int offset, void* res, int size)
          * host-write-once
          */
         case VIRTIO_MMIO_QUEUE_NUM_MAX:
-            val = dev->queue[dev->queue_sel].num_max;
+            val = virtio_sel_queue(dev, enclave_dev_find(dev))->num_max;
             break;
         case VIRTIO_MMIO_QUEUE_READY:
-            val = dev->queue[dev->queue_sel].ready;
+            val = virtio_sel_queue(dev, enclave_dev_find(dev))->ready;
             break;
         /* Security Review: dev->int_status is host-read-write */
         case VIRTIO_MMIO_INTERRUPT_STATUS:
@@ -180,7 +264,7 @@ static inline void virtio_write_driver_features(
  */
 static int blk_check_features(struct virtio_dev* dev)
 {
-    if (dev->driver_features == dev->device_features)
+    if (dev->driver_features == virtio_device_features(dev))
         return 0;
 
     return -LKL_EINVAL;
@@ -258,8 +342,9 @@ static int virtio_write(void* data, int offset, void* res, int size)
      * structure). virtq desc and avail ring address handling is a special case.
      */
     struct virtio_dev* dev = (struct virtio_dev*)data;
+    struct enclave_dev* edev = enclave_dev_find(dev);
     /* Security Review: dev->queue_sel should be host-read-only */
-    struct virtq* q = &dev->queue[dev->queue_sel];
+    struct virtq* q = virtio_sel_queue(dev, edev);
     uint32_t val;
     int ret = 0;
 
@@ -269,7 +354,7 @@ static int virtio_write(void* data, int offset, void* res, int size)
         /* Security Review: dev->config_data and dev->config_len should be
          * host-write-once
          */
-        if (offset + size >= dev->config_len)
+        if (offset + size > dev->config_len)
             return -LKL_EINVAL;
         memcpy(dev->config_data + offset, res, size);
         atomic_thread_fence(memory_order_seq_cst);
@@ -301,32 +386,63 @@ static int virtio_write(void* data, int offset, void* res, int size)
             break;
         /* Security Review: dev->queue_sel should be host-read-only */
         case VIRTIO_MMIO_QUEUE_SEL:
+            if (edev)
+            {
+                if (val >= edev->num_queues)
+                    return -LKL_EINVAL;
+                edev->queue_sel = val;
+            }
             dev->queue_sel = val;
             break;
         /* Security Review: dev->queue[dev->queue_sel].num should be
          * host-read-only
          */
         case VIRTIO_MMIO_QUEUE_NUM:
-            dev->queue[dev->queue_sel].num = val;
+            q->num = val;
             break;
         /* Security Review: is dev->queue[dev->queue_sel].ready host-read-only?
          */
         case VIRTIO_MMIO_QUEUE_READY:
-            dev->queue[dev->queue_sel].ready = val;
+            /* The enclave serves a queue from the rings set up here, so they
+             * are checked once, before the first notification */
+            if (edev && val)
+            {
+                if (!enclave_queue_ok(q))
+                {
+                    sgxlkl_warn(
+                        "Queue %u of virtio device %u is not in enclave "
+                        "memory\n",
+                        edev->queue_sel,
+                        (unsigned)(edev - enclave_devs));
+                    return -LKL_EINVAL;
+                }
+                q->last_avail_idx = 0;
+                q->last_used_idx_signaled = 0;
+            }
+            q->ready = val;
             break;
         /* Security Review: guest virtio driver(s) writes to virtq desc ring and
          * avail ring in guest memory. In queue notify flow, we need to copy the
          * update to desc ring and avail ring in host memory.
          */
         case VIRTIO_MMIO_QUEUE_NOTIFY:
-            virtio_notify_host_device(dev, val);
+            /* Devices served inside the enclave process the queue right
+             * away */
+            if (edev)
+                edev->notify(edev - enclave_devs, val);
+            else
+                virtio_notify_host_device(dev, val);
             break;
         /* Security Review: dev->int_status is host-read-write */
         case VIRTIO_MMIO_INTERRUPT_ACK:
-            dev->int_status = 0;
+            dev->int_status &= ~val;
             break;
         /* Security Review: dev->status is host-read-write */
         case VIRTIO_MMIO_STATUS:
+            /* A reset stops all queues */
+            if (edev && val == 0)
+                for (uint32_t i = 0; i < edev->num_queues; i++)
+                    edev->queue[i].ready = 0;
             set_status(dev, val);
             break;
         /* Security Review: For Split Queue, q->desc link list
@@ -409,6 +525,86 @@ void lkl_virtio_deliver_irq(uint8_t dev_id)
         virtio_deliver_irq[dev_id](dev_id);
 }
 
+/*
+ * lkl_virtio_dev_set_notify : Process queue notifications of a device with
+ * notify_cb inside the enclave instead of forwarding them to the host.
+ * Returns 0 on success, or -1 if dev_id is invalid or in use.
+ */
+int lkl_virtio_dev_set_notify(
+    struct virtio_dev* dev,
+    uint8_t dev_id,
+    struct virtq* queues,
+    uint32_t num_queues,
+    lkl_virtio_dev_notify notify_cb)
+{
+    struct enclave_dev* edev;
+
+    if (dev_id >= DEVICE_COUNT || enclave_devs[dev_id].dev || !num_queues)
+        return -1;
+
+    /* The driver must not use the DMA API, which would place the rings in
+     * the bounce buffer in shared memory */
+    edev = &enclave_devs[dev_id];
+    edev->device_features =
+        dev->device_features & ~BIT(LKL_VIRTIO_F_IOMMU_PLATFORM);
+    edev->queue = queues;
+    edev->num_queues = num_queues;
+    edev->queue_sel = 0;
+    edev->notify = notify_cb;
+    edev->dev = dev;
+
+    return 0;
+}
+
+/*
+ * lkl_virtio_dev_trigger_irq : Notify the driver of used buffers of a device
+ * served inside the enclave.
+ * dev_id : Device id given to lkl_virtio_dev_set_notify.
+ */
+void lkl_virtio_dev_trigger_irq(uint8_t dev_id)
+{
+    struct enclave_dev* edev = &enclave_devs[dev_id];
+
+    edev->dev->int_status |= VIRTIO_MMIO_INT_VRING;
+    lkl_trigger_irq(edev->irq);
+}
+
+/*
+ * lkl_virtio_queue_add_used : Return the buffer at the head of the avail ring
+ * of a device served inside the enclave to the driver.
+ * q : Queue whose rings are in enclave memory.
+ * head : Head of the buffer's descriptor chain.
+ * len : Number of bytes written to the buffer.
+ */
+void lkl_virtio_queue_add_used(struct virtq* q, uint16_t head, uint32_t len)
+{
+    uint16_t used_idx = q->used->idx & (q->num - 1);
+
+    q->used->ring[used_idx].id = head;
+    q->used->ring[used_idx].len = len;
+    /* Make the used entry visible before publishing it */
+    __sync_synchronize();
+    q->used->idx++;
+    q->last_avail_idx++;
+}
+
+/*
+ * lkl_virtio_queue_needs_irq : Check whether the driver wants an interrupt
+ * for the buffers used since old_used_idx, honouring its used event index
+ * (VIRTIO_RING_F_EVENT_IDX), and ask to be notified of the next avail buffer.
+ * Returns true if lkl_virtio_dev_trigger_irq() must be called.
+ */
+bool lkl_virtio_queue_needs_irq(struct virtq* q, uint16_t old_used_idx)
+{
+    uint16_t event_idx = q->avail->ring[q->num];
+    bool send_irq = (uint16_t)(q->used->idx - event_idx - 1) <
+                    (uint16_t)(q->used->idx - old_used_idx);
+
+    *((uint16_t*)&q->used->ring[q->num]) = q->avail->idx;
+
+    return send_irq;
+}
+
 /*
  * Function to setup the virtio device setting
  */
@@ -418,11 +614,15 @@ int lkl_virtio_dev_setup(
     void* deliver_irq_cb)
 {
     int avail = 0, num_bytes = 0, ret = 0;
+    struct enclave_dev* edev = enclave_dev_find(dev);
     dev->irq = lkl_get_free_irq("virtio");
     dev->int_status = 0;
     if (dev->irq < 0)
         return 1;
 
+    if (edev)
+        edev->irq = dev->irq;
+
     /* Security Review: dev-vendor_id might cause overflow in
      * virtio_deliver_irq[DEVICE_COUNT]
      */
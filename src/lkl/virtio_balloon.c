@@ -0,0 +1,582 @@
+#include <endian.h>
+#include <limits.h>
+#include <linux/virtio_balloon.h>
+#include <linux/virtio_ids.h>
+#include <linux/virtio_mmio.h>
+#include <openenclave/enclave.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "enclave/enclave_mem.h"
+#include "enclave/enclave_oe.h"
+#include "enclave/enclave_switchless.h"
+#include "enclave/enclave_util.h"
+#include "enclave/lthread.h"
+#include "enclave/sgxlkl_t.h"
+#include "enclave/ticketlock.h"
+#include "lkl/virtio.h"
+#include "lkl/virtio_balloon.h"
+#include "shared/virtio_ring_buff.h"
+
+/*
+ * The balloon device is served inside the enclave. It uses the last slot of
+ * the virtio device tables, as host devices are numbered from 0.
+ */
+#define BALLOON_DEV_ID 31
+
+#define BALLOON_NUM_QUEUES 2
+#define BALLOON_QUEUE_DEPTH 64
+#define BALLOON_INFLATE_QUEUE 0
+#define BALLOON_DEFLATE_QUEUE 1
+
+/*
+ * The balloon keeps between one and four times the reserve of enclave memory
+ * free for enclave_mmap. Below that, the kernel is asked for pages until twice
+ * the reserve is free; above it, pages are given back to the kernel until the
+ * same level is reached. The reserve is 1/32 of enclave memory, at least 4 MiB.
+ */
+#define BALLOON_RESERVE_SHIFT 5
+#define BALLOON_RESERVE_MIN_PAGES 1024
+
+#define DIV_ROUNDUP(x, y) (((x) + ((y)-1)) / (y))
+
+#undef BIT
+#define BIT(x) (1ULL << x)
+
+#if DEBUG
+extern int sgxlkl_trace_mmap;
+#endif
+
+int enclave_futex_wait(int* uaddr, int val);
+
+struct balloon
+{
+    struct virtio_dev dev;
+    struct virtq queue[BALLOON_NUM_QUEUES];
+    struct virtio_balloon_config config;
+    struct ticketlock lock;
+
+    /* Kernel memory that is never put into the balloon */
+    size_t min_mem;
+    /* Kernel memory, as allocated by host_malloc */
+    char* mem;
+    size_t mem_pages;
+    /* Largest number of pages the balloon may hold */
+    size_t max_pages;
+
+    /*
+     * Pages in the balloon, as indexes into the kernel memory, in the order
+     * in which they were inflated. The kernel deflates the most recently
+     * inflated pages first. The top num_reserved pages have already been
+     * reserved in enclave memory for a deflate that is still pending.
+     */
+    uint32_t* pages;
+    size_t num_pages;
+    size_t num_reserved;
+    /* Bitmap of the kernel memory pages that are in the balloon */
+    uint64_t* in_balloon;
+    size_t state_size;
+
+    /* Number of pages that the kernel has been asked to put in the balloon */
+    uint32_t target;
+    bool bad_request;
+
+    /*
+     * Set by balloon_pressure() to wake the balloon thread, which checks the
+     * free memory and tells the kernel about a new target. failed_pages is
+     * the largest failed allocation since the last check.
+     */
+    _Atomic(int) pressure;
+    _Atomic(size_t) failed_pages;
+    bool stop;
+};
+
+static struct balloon balloon;
+
+static void balloon_config_changed(void)
+{
+    balloon.dev.config_gen++;
+    balloon.dev.int_status |= VIRTIO_MMIO_INT_CONFIG;
+    lkl_trigger_irq(balloon.dev.irq);
+}
+
+static void balloon_bad_request(const char* what)
+{
+    if (!balloon.bad_request)
+        sgxlkl_warn("Ignoring invalid balloon request: %s\n", what);
+    balloon.bad_request = true;
+}
+
+static bool balloon_test_page(size_t i)
+{
+    return balloon.in_balloon[i / 64] & (1ULL << (i % 64));
+}
+
+static void balloon_set_page(size_t i, bool set)
+{
+    if (set)
+        balloon.in_balloon[i / 64] |= 1ULL << (i % 64);
+    else
+        balloon.in_balloon[i / 64] &= ~(1ULL << (i % 64));
+}
+
+static char* balloon_page_addr(size_t i)
+{
+    return balloon.mem + i * PAGE_SIZE;
+}
+
+/*
+ * Function to map a page frame number from the driver to an index into the
+ * kernel memory. LKL has no MMU, so physical addresses are enclave addresses.
+ * The driver passes the low 32 bits of the frame number, so the upper bits are
+ * taken from the kernel memory, which is much smaller than 2^32 pages.
+ */
+static bool balloon_page_index(uint32_t pfn, size_t* i)
+{
+    uint64_t base = (uintptr_t)balloon.mem >> VIRTIO_BALLOON_PFN_SHIFT;
+    uint64_t full_pfn = (base & ~(uint64_t)UINT32_MAX) | pfn;
+    uintptr_t addr;
+
+    if (full_pfn < base)
+        full_pfn += (uint64_t)UINT32_MAX + 1;
+    addr = full_pfn << VIRTIO_BALLOON_PFN_SHIFT;
+
+    if (addr < (uintptr_t)balloon.mem ||
+        addr >= (uintptr_t)balloon_page_addr(balloon.mem_pages))
+        return false;
+
+    *i = (addr - (uintptr_t)balloon.mem) / PAGE_SIZE;
+    return true;
+}
+
+/*
+ * Function to restore the protection of pages handed back to the kernel, as
+ * enclave_mmap users may have changed it while the pages were in the balloon
+ */
+static void balloon_make_writable(char* addr, size_t pages)
+{
+    if (pages == 0)
+        return;
+
+    enclave_host_mprotect(addr, pages * PAGE_SIZE, PROT_READ | PROT_WRITE);
+}
+
+/*
+ * Function to reserve up to n of the most recently inflated pages, which the
+ * kernel will deflate next. Stops at the first page that is in use. Must be
+ * called with the lock held.
+ */
+static size_t balloon_reserve(size_t n)
+{
+    char* run = NULL;
+    size_t run_pages = 0;
+    size_t reserved = 0;
+
+    while (reserved < n && balloon.num_reserved < balloon.num_pages)
+    {
+        size_t top = balloon.num_pages - balloon.num_reserved - 1;
+        char* page = balloon_page_addr(balloon.pages[top]);
+
+        if (enclave_mmap_reserve(page, PAGE_SIZE) != 0)
+            break;
+
+        balloon.num_reserved++;
+        reserved++;
+
+        /* Restore the protection of adjacent pages in one go */
+        if (run && page == run + run_pages * PAGE_SIZE)
+        {
+            run_pages++;
+        }
+        else if (run && page == run - PAGE_SIZE)
+        {
+            run = page;
+            run_pages++;
+        }
+        else
+        {
+            balloon_make_writable(run, run_pages);
+            run = page;
+            run_pages = 1;
+        }
+    }
+    balloon_make_writable(run, run_pages);
+
+    return reserved;
+}
+
+/*
+ * Function to choose the balloon size from the free enclave memory. After a
+ * failed allocation, the reserve grows by the failed_pages that were asked
+ * for. Returns true if the kernel must be told about a new size. Must be
+ * called with the lock held.
+ */
+static bool balloon_adjust(size_t failed_pages)
+{
+    size_t total, free, reserve, low;
+    size_t target = balloon.target;
+
+    /* Wait for reserved pages to be deflated before changing course */
+    if (balloon.max_pages == 0 || balloon.num_reserved)
+        return false;
+
+    enclave_mem_info(&total, &free);
+    total /= PAGE_SIZE;
+    free /= PAGE_SIZE;
+    reserve = total >> BALLOON_RESERVE_SHIFT;
+    if (reserve < BALLOON_RESERVE_MIN_PAGES)
+        reserve = BALLOON_RESERVE_MIN_PAGES;
+    low = reserve + failed_pages;
+
+    if (target > balloon.num_pages)
+    {
+        /* Pages still to be inflated will become free soon */
+        size_t pending = target - balloon.num_pages;
+        if (free + pending < low)
+            target += low + reserve - free - pending;
+        else if (free >= 2 * reserve && !failed_pages)
+            target = balloon.num_pages;
+    }
+    else if (free < low)
+    {
+        target = balloon.num_pages + low + reserve - free;
+    }
+    else if (free > 4 * reserve && balloon.num_pages)
+    {
+        target = balloon.num_pages - balloon_reserve(free - 2 * reserve);
+    }
+
+    if (target > balloon.max_pages)
+        target = balloon.max_pages;
+    if (target == balloon.target)
+        return false;
+
+#if DEBUG
+    SGXLKL_TRACE_MMAP(
+        "balloon: FREE: %8zuKB, BALLOON: %8zuKB, TARGET: %8zuKB\n",
+        free * PAGE_SIZE / 1024,
+        balloon.num_pages * PAGE_SIZE / 1024,
+        target * PAGE_SIZE / 1024);
+#endif
+
+    balloon.target = target;
+    balloon.config.num_pages = htole32(target);
+    return true;
+}
+
+/*
+ * Function called by enclave_mmap and enclave_munmap whenever the amount of
+ * free enclave memory changes. Their callers include the scheduler and the
+ * runtime allocator, which must not be switched out, so the check is left to
+ * the balloon thread.
+ */
+static void balloon_pressure(size_t failed_pages)
+{
+    size_t failed = balloon.failed_pages;
+
+    while (failed < failed_pages &&
+           !__atomic_compare_exchange_n(
+               &balloon.failed_pages,
+               &failed,
+               failed_pages,
+               false,
+               __ATOMIC_RELAXED,
+               __ATOMIC_RELAXED))
+        ;
+
+    if (__atomic_exchange_n(&balloon.pressure, 1, __ATOMIC_SEQ_CST) == 0)
+        enclave_futex_wake((int*)&balloon.pressure, 1);
+}
+
+/*
+ * Balloon thread, which adjusts the balloon size after balloon_pressure().
+ * Skips the check if the balloon is busy, as it is checked again when the
+ * busy request completes.
+ */
+static void* balloon_thread(void* unused)
+{
+    lthread_detach();
+
+    while (!balloon.stop)
+    {
+        enclave_futex_wait((int*)&balloon.pressure, 0);
+        if (__atomic_exchange_n(&balloon.pressure, 0, __ATOMIC_SEQ_CST) == 0)
+            continue;
+
+        size_t failed_pages =
+            __atomic_exchange_n(&balloon.failed_pages, 0, __ATOMIC_RELAXED);
+        if (!(balloon.dev.status & LKL_VIRTIO_CONFIG_S_DRIVER_OK) ||
+            ticket_trylock(&balloon.lock) != 0)
+            continue;
+
+        bool changed = balloon_adjust(failed_pages);
+        ticket_unlock(&balloon.lock);
+
+        if (changed)
+            balloon_config_changed();
+    }
+
+    return NULL;
+}
+
+/*
+ * Function to take a page from the kernel and make it available to
+ * enclave_mmap
+ */
+static void balloon_inflate_page(uint32_t pfn)
+{
+    size_t i;
+
+    if (!balloon_page_index(pfn, &i) || balloon_test_page(i) ||
+        balloon.num_pages == balloon.max_pages)
+    {
+        balloon_bad_request("inflate of a page not owned by the kernel");
+        return;
+    }
+
+    balloon_set_page(i, true);
+    balloon.pages[balloon.num_pages++] = i;
+    enclave_munmap(balloon_page_addr(i), PAGE_SIZE);
+}
+
+/*
+ * Function to give a page back to the kernel. Pages are normally reserved
+ * before the kernel is asked to deflate them, but the kernel may choose
+ * different pages, which must then be free.
+ */
+static void balloon_deflate_page(uint32_t pfn)
+{
+    size_t i, pos;
+
+    if (!balloon_page_index(pfn, &i) || !balloon_test_page(i))
+    {
+        balloon_bad_request("deflate of a page not in the balloon");
+        return;
+    }
+
+    pos = balloon.num_pages;
+    while (balloon.pages[--pos] != i)
+        ;
+
+    if (pos < balloon.num_pages - balloon.num_reserved)
+    {
+        char* page = balloon_page_addr(i);
+        if (enclave_mmap_reserve(page, PAGE_SIZE) != 0)
+            sgxlkl_fail("Kernel reclaimed balloon page %p in use\n", page);
+        balloon_make_writable(page, 1);
+    }
+    else
+    {
+        balloon.num_reserved--;
+    }
+
+    memmove(
+        &balloon.pages[pos],
+        &balloon.pages[pos + 1],
+        (balloon.num_pages - pos - 1) * sizeof(balloon.pages[0]));
+    balloon.num_pages--;
+    balloon_set_page(i, false);
+}
+
+/*
+ * Function to complete the request at the head of the avail ring. Each
+ * request is a single buffer with an array of page frame numbers.
+ */
+static void balloon_process_one(struct virtq* q, bool inflate)
+{
+    uint16_t head = q->avail->ring[q->last_avail_idx & (q->num - 1)];
+    struct virtq_desc desc = q->desc[head & (q->num - 1)];
+
+    if (!(desc.flags & (LKL_VRING_DESC_F_WRITE | LKL_VRING_DESC_F_NEXT)) &&
+        oe_is_within_enclave((void*)(uintptr_t)desc.addr, desc.len))
+    {
+        const uint32_t* pfns = (const uint32_t*)(uintptr_t)desc.addr;
+        for (size_t n = 0; n < desc.len / sizeof(uint32_t); n++)
+        {
+            if (inflate)
+                balloon_inflate_page(le32toh(pfns[n]));
+            else
+                balloon_deflate_page(le32toh(pfns[n]));
+        }
+    }
+    else
+    {
+        balloon_bad_request("malformed buffer");
+    }
+
+    lkl_virtio_queue_add_used(q, head, 0);
+}
+
+/*
+ * Function to process a queue notification inside the enclave. It runs in
+ * the driver's context; lkl_trigger_irq() defers the interrupt until the
+ * driver has left the kernel.
+ */
+static void balloon_notify(uint8_t dev_id, uint32_t qidx)
+{
+    struct virtq* q;
+    uint16_t old_used_idx;
+    bool send_irq, changed;
+
+    if (qidx >= BALLOON_NUM_QUEUES || !balloon.queue[qidx].ready)
+        return;
+
+    q = &balloon.queue[qidx];
+
+    ticket_lock(&balloon.lock);
+
+    old_used_idx = q->used->idx;
+    while (q->last_avail_idx != q->avail->idx)
+        balloon_process_one(q, qidx == BALLOON_INFLATE_QUEUE);
+
+    send_irq = lkl_virtio_queue_needs_irq(q, old_used_idx);
+
+    /* Pressure checks are skipped while the lock is held */
+    changed = balloon_adjust(0);
+
+    ticket_unlock(&balloon.lock);
+
+    if (send_irq)
+        lkl_virtio_dev_trigger_irq(BALLOON_DEV_ID);
+    if (changed)
+        balloon_config_changed();
+}
+
+void lkl_virtio_balloon_set_kernel_mem(void* mem, size_t size)
+{
+    size_t mem_pages = size / PAGE_SIZE;
+    size_t min_pages = DIV_ROUNDUP(balloon.min_mem, PAGE_SIZE);
+
+    if (balloon.dev.device_id != VIRTIO_ID_BALLOON)
+        return;
+
+    if (mem_pages <= min_pages)
+    {
+        sgxlkl_warn(
+            "Kernel memory (%zu bytes) does not exceed kernel_min_mem (%zu "
+            "bytes), not lending kernel memory to the enclave\n",
+            size,
+            balloon.min_mem);
+        return;
+    }
+
+    size_t max_pages = mem_pages - min_pages;
+    size_t pages_size =
+        DIV_ROUNDUP(max_pages * sizeof(uint32_t), sizeof(uint64_t)) *
+        sizeof(uint64_t);
+    size_t state_size =
+        pages_size + DIV_ROUNDUP(mem_pages, 64) * sizeof(uint64_t);
+    void* state =
+        enclave_mmap(NULL, state_size, 0, PROT_READ | PROT_WRITE, 1);
+    if ((intptr_t)state < 0)
+    {
+        sgxlkl_warn("Could not allocate balloon state\n");
+        return;
+    }
+
+    ticket_lock(&balloon.lock);
+    balloon.pages = state;
+    balloon.in_balloon = (uint64_t*)((char*)state + pages_size);
+    balloon.state_size = state_size;
+    balloon.mem = mem;
+    balloon.mem_pages = mem_pages;
+    balloon.max_pages = max_pages;
+    ticket_unlock(&balloon.lock);
+
+    struct lthread* thread;
+    struct lthread_attr attr = {.funcname = "lkl-balloon"};
+    if (lthread_create(&thread, &attr, balloon_thread, NULL) != 0)
+    {
+        sgxlkl_warn("Could not start balloon thread\n");
+        return;
+    }
+
+    /* Pages in the balloon are used last, so that they can be given back */
+    enclave_mem_set_fallback_range(mem, size);
+    enclave_mem_set_pressure_handler(balloon_pressure);
+
+    SGXLKL_VERBOSE(
+        "Kernel memory can shrink from %zu to %zu bytes\n",
+        size,
+        min_pages * PAGE_SIZE);
+}
+
+void lkl_virtio_balloon_unmap_kernel_mem(void* mem, size_t size)
+{
+    size_t start, end;
+
+    if (mem != balloon.mem)
+    {
+        enclave_munmap(mem, size);
+        return;
+    }
+
+    enclave_mem_set_pressure_handler(NULL);
+    enclave_mem_set_fallback_range(NULL, 0);
+
+    balloon.stop = true;
+    __atomic_store_n(&balloon.pressure, 1, __ATOMIC_SEQ_CST);
+    enclave_futex_wake((int*)&balloon.pressure, 1);
+
+    ticket_lock(&balloon.lock);
+
+    /* Reserved pages are in use again */
+    for (size_t i = balloon.num_pages - balloon.num_reserved;
+         i < balloon.num_pages;
+         i++)
+        balloon_set_page(balloon.pages[i], false);
+
+    /* Unmap the runs of pages that are not in the balloon */
+    for (start = 0; start < balloon.mem_pages; start = end)
+    {
+        while (start < balloon.mem_pages && balloon_test_page(start))
+            start++;
+        for (end = start; end < balloon.mem_pages && !balloon_test_page(end);
+             end++)
+            ;
+        if (end > start)
+            enclave_munmap(
+                balloon_page_addr(start), (end - start) * PAGE_SIZE);
+    }
+
+    enclave_munmap(balloon.pages, balloon.state_size);
+    balloon.mem = NULL;
+    balloon.max_pages = 0;
+    balloon.num_pages = 0;
+    balloon.num_reserved = 0;
+
+    ticket_unlock(&balloon.lock);
+}
+
+/*
+ * Function to add the balloon device, which lends the kernel memory that is
+ * not needed for the page cache to enclave_mmap
+ */
+int lkl_virtio_balloon_add(size_t min_mem)
+{
+    struct virtio_dev* dev = &balloon.dev;
+
+    balloon.min_mem = min_mem;
+
+    for (int i = 0; i < BALLOON_NUM_QUEUES; i++)
+        balloon.queue[i].num_max = BALLOON_QUEUE_DEPTH;
+
+    dev->device_id = VIRTIO_ID_BALLOON;
+    dev->vendor_id = BALLOON_DEV_ID;
+    dev->device_features = BIT(LKL_VIRTIO_F_VERSION_1) |
+                           BIT(LKL_VIRTIO_RING_F_EVENT_IDX) |
+                           BIT(VIRTIO_BALLOON_F_MUST_TELL_HOST);
+    dev->queue = balloon.queue;
+    dev->config_data = &balloon.config;
+    dev->config_len = sizeof(balloon.config);
+
+    if (lkl_virtio_dev_set_notify(
+            dev,
+            BALLOON_DEV_ID,
+            balloon.queue,
+            BALLOON_NUM_QUEUES,
+            balloon_notify) != 0)
+        return -1;
+
+    return lkl_virtio_dev_setup(
+        dev, VIRTIO_MMIO_CONFIG + dev->config_len, lkl_virtio_dev_trigger_irq);
+}
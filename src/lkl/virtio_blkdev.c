@@ -1,5 +1,7 @@
 #include <errno.h>
+#include <linux/virtio_blk.h>
 #include <linux/virtio_mmio.h>
+#include <openenclave/enclave.h>
 #include <string.h>
 #include "enclave/enclave_oe.h"
 #include "enclave/enclave_util.h"
@@ -7,6 +9,27 @@
 #include "enclave/ticketlock.h"
 #include "enclave/vio_enclave_event_channel.h"
 #include "lkl/virtio.h"
+#include "shared/virtio_ring_buff.h"
+
+#define BLK_DIRECT_MAX_DEVS 32
+#define BLK_DIRECT_MAX_BUFS 32
+#define BLK_DIRECT_QUEUE_DEPTH 32
+#define BLK_DIRECT_SECTOR_SIZE 512
+
+/*
+ * Disk image that the host has mapped read-only and that the guest reads
+ * directly, without the virtio queue being seen by the host. The queue is in
+ * enclave memory and is set up by the driver through virtio.c.
+ */
+struct blk_direct_dev
+{
+    const uint8_t* mem;
+    size_t size;
+    struct ticketlock lock;
+    struct virtq queue[1];
+};
+
+static struct blk_direct_dev blk_direct_devs[BLK_DIRECT_MAX_DEVS];
 
 /*
  * Function to trigger block dev irq to notify front end driver
@@ -21,6 +44,155 @@ static void lkl_deliver_irq(uint8_t dev_id)
     lkl_trigger_irq(dev->irq);
 }
 
+/*
+ * Function to serve a request of a direct disk by copying from the host
+ * mapping. Blocks are verified above the driver (e.g. by dm-verity) once they
+ * are in enclave memory.
+ */
+static uint8_t blk_direct_serve(
+    struct blk_direct_dev* bd,
+    const struct virtio_blk_outhdr* h,
+    const struct virtq_desc* data,
+    size_t count,
+    uint32_t* written)
+{
+    size_t offset;
+
+    switch (h->type)
+    {
+        case VIRTIO_BLK_T_IN:
+            if (h->sector > bd->size / BLK_DIRECT_SECTOR_SIZE)
+                return VIRTIO_BLK_S_IOERR;
+
+            offset = h->sector * BLK_DIRECT_SECTOR_SIZE;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (!(data[i].flags & LKL_VRING_DESC_F_WRITE) ||
+                    data[i].len > bd->size - offset)
+                    return VIRTIO_BLK_S_IOERR;
+
+                memcpy(
+                    (void*)(uintptr_t)data[i].addr,
+                    bd->mem + offset,
+                    data[i].len);
+                offset += data[i].len;
+                *written += data[i].len;
+            }
+            return VIRTIO_BLK_S_OK;
+        case VIRTIO_BLK_T_FLUSH:
+            return VIRTIO_BLK_S_OK;
+        case VIRTIO_BLK_T_OUT:
+            return VIRTIO_BLK_S_IOERR;
+        default:
+            return VIRTIO_BLK_S_UNSUPP;
+    }
+}
+
+/*
+ * Function to complete the request at the head of the avail ring of a direct
+ * disk. The rings are in enclave memory (see lkl_virtio_dev_set_notify), so
+ * descriptors are only written by the driver.
+ */
+static void blk_direct_process_one(struct blk_direct_dev* bd, struct virtq* q)
+{
+    uint16_t head = q->avail->ring[q->last_avail_idx & (q->num - 1)];
+    struct virtq_desc bufs[BLK_DIRECT_MAX_BUFS];
+    size_t n = 0;
+    uint32_t written = 0;
+
+    struct virtq_desc* desc = &q->desc[head & (q->num - 1)];
+    for (;;)
+    {
+        bufs[n++] = *desc;
+        if (!(bufs[n - 1].flags & LKL_VRING_DESC_F_NEXT) ||
+            n == BLK_DIRECT_MAX_BUFS)
+            break;
+        desc = &q->desc[bufs[n - 1].next & (q->num - 1)];
+    }
+
+    /* A request is a header, optional data buffers and a status byte */
+    const struct virtq_desc* hdr = &bufs[0];
+    const struct virtq_desc* trailer = &bufs[n - 1];
+    if (n >= 2 && hdr->len == sizeof(struct virtio_blk_outhdr) &&
+        trailer->len == sizeof(uint8_t) &&
+        (trailer->flags & LKL_VRING_DESC_F_WRITE))
+    {
+        struct virtio_blk_outhdr h =
+            *(struct virtio_blk_outhdr*)(uintptr_t)hdr->addr;
+        uint8_t status =
+            blk_direct_serve(bd, &h, &bufs[1], n - 2, &written);
+        *(uint8_t*)(uintptr_t)trailer->addr = status;
+        written += sizeof(status);
+    }
+
+    lkl_virtio_queue_add_used(q, head, written);
+}
+
+/*
+ * Function to process a queue notification of a direct disk inside the
+ * enclave. It runs in the driver's context; lkl_trigger_irq() defers the
+ * interrupt until the driver has left the kernel.
+ */
+static void blk_direct_notify(uint8_t dev_id, uint32_t qidx)
+{
+    struct blk_direct_dev* bd = &blk_direct_devs[dev_id];
+    struct virtq* q = &bd->queue[0];
+    uint16_t old_used_idx;
+    bool send_irq;
+
+    if (qidx != 0 || !q->ready)
+        return;
+
+    ticket_lock(&bd->lock);
+
+    old_used_idx = q->used->idx;
+    while (q->last_avail_idx != q->avail->idx)
+        blk_direct_process_one(bd, q);
+
+    send_irq = lkl_virtio_queue_needs_irq(q, old_used_idx);
+
+    ticket_unlock(&bd->lock);
+
+    if (send_irq)
+        lkl_virtio_dev_trigger_irq(dev_id);
+}
+
+/*
+ * Function to read direct disks inside the enclave, see
+ * virtio_blk_dev_direct in the shared memory. The disk index doubles as the
+ * device id, as the vendor_id in the host's virtio_dev cannot be trusted.
+ */
+static void blk_direct_setup(struct virtio_dev* dev, size_t host_disk_index)
+{
+    sgxlkl_shared_memory_t* shm = &sgxlkl_enclave_state.shared_memory;
+
+    if (!shm->virtio_blk_dev_direct ||
+        !shm->virtio_blk_dev_direct[host_disk_index])
+        return;
+
+    if (host_disk_index < BLK_DIRECT_MAX_DEVS)
+    {
+        struct blk_direct_dev* bd = &blk_direct_devs[host_disk_index];
+
+        bd->mem = shm->virtio_blk_dev_direct[host_disk_index];
+        bd->size = shm->virtio_blk_dev_direct_size[host_disk_index];
+        bd->queue[0].num_max = BLK_DIRECT_QUEUE_DEPTH;
+        if (lkl_virtio_dev_set_notify(
+                dev, host_disk_index, bd->queue, 1, blk_direct_notify) == 0)
+        {
+            SGXLKL_VERBOSE(
+                "Reading disk %zu directly from host memory (%zu bytes)\n",
+                host_disk_index,
+                bd->size);
+            return;
+        }
+    }
+
+    sgxlkl_warn(
+        "Disk %zu cannot be read directly, using the host device\n",
+        host_disk_index);
+}
+
 /*
  * Function to perform virtio device setup
  */
@@ -29,19 +201,21 @@ int lkl_add_disks(
     const sgxlkl_enclave_mount_config_t* mounts,
     size_t num_mounts)
 {
+    size_t root_index = sgxlkl_enclave_state.disk_state[0].host_disk_index;
     struct virtio_dev* root_dev =
-        sgxlkl_enclave_state.shared_memory.virtio_blk_dev_mem
-            [sgxlkl_enclave_state.disk_state[0].host_disk_index];
+        sgxlkl_enclave_state.shared_memory.virtio_blk_dev_mem[root_index];
     int mmio_size = VIRTIO_MMIO_CONFIG + root_dev->config_len;
+    blk_direct_setup(root_dev, root_index);
     if (lkl_virtio_dev_setup(root_dev, mmio_size, lkl_deliver_irq) != 0)
         return -1;
 
     for (size_t i = 0; i < num_mounts; ++i)
     {
+        size_t index = sgxlkl_enclave_state.disk_state[i + 1].host_disk_index;
         struct virtio_dev* dev =
-            sgxlkl_enclave_state.shared_memory.virtio_blk_dev_mem
-                [sgxlkl_enclave_state.disk_state[i + 1].host_disk_index];
+            sgxlkl_enclave_state.shared_memory.virtio_blk_dev_mem[index];
         int mmio_size = VIRTIO_MMIO_CONFIG + dev->config_len;
+        blk_direct_setup(dev, index);
         if (lkl_virtio_dev_setup(dev, mmio_size, lkl_deliver_irq) != 0)
             return -1;
     }
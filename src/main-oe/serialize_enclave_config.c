@@ -155,16 +155,18 @@ static json_obj_t* encode_root(
     const sgxlkl_enclave_root_config_t* root)
 {
     _Static_assert(
-        sizeof(sgxlkl_enclave_root_config_t) == 48,
+        sizeof(sgxlkl_enclave_root_config_t) == 56,
         "sgxlkl_enclave_root_config_t size has changed");
 
-    json_obj_t* r = create_json_objects(key, 6);
+    json_obj_t* r = create_json_objects(key, 7);
     r->objects[0] = encode_hex_string("key", root->key, root->key_len);
     r->objects[1] = create_json_string("key_id", root->key_id);
     r->objects[2] = create_json_string("roothash", root->roothash);
     r->objects[3] = encode_uint64("roothash_offset", root->roothash_offset);
-    r->objects[4] = encode_boolean("readonly", root->readonly);
-    r->objects[5] = encode_boolean("overlay", root->overlay);
+    r->objects[4] =
+        encode_uint64("verity_block_size", root->verity_block_size);
+    r->objects[5] = encode_boolean("readonly", root->readonly);
+    r->objects[6] = encode_boolean("overlay", root->overlay);
     return r;
 }
 
@@ -177,10 +179,10 @@ static json_obj_t* encode_mounts(
     for (size_t i = 0; i < num_mounts; i++)
     {
         _Static_assert(
-            sizeof(sgxlkl_enclave_mount_config_t) == 320,
+            sizeof(sgxlkl_enclave_mount_config_t) == 328,
             "sgxlkl_enclave_disk_config_t size has changed");
 
-        r->array[i] = create_json_objects(NULL, 9);
+        r->array[i] = create_json_objects(NULL, 10);
         r->array[i]->objects[0] =
             create_json_string("destination", mounts[i].destination);
         r->array[i]->objects[1] =
@@ -193,10 +195,12 @@ static json_obj_t* encode_mounts(
             create_json_string("roothash", mounts[i].roothash);
         r->array[i]->objects[5] =
             encode_uint64("roothash_offset", mounts[i].roothash_offset);
-        r->array[i]->objects[6] =
+        r->array[i]->objects[6] = encode_uint64(
+            "verity_block_size", mounts[i].verity_block_size);
+        r->array[i]->objects[7] =
             encode_boolean("readonly", mounts[i].readonly);
-        r->array[i]->objects[7] = encode_boolean("create", mounts[i].create);
-        r->array[i]->objects[8] = encode_uint64("size", mounts[i].size);
+        r->array[i]->objects[8] = encode_boolean("create", mounts[i].create);
+        r->array[i]->objects[9] = encode_uint64("size", mounts[i].size);
     }
     return r;
 }
@@ -449,7 +453,7 @@ void serialize_enclave_config(
     // Catch modifications to sgxlkl_enclave_config_t early. If this fails,
     // the code above/below needs adjusting for the added/removed settings.
     _Static_assert(
-        sizeof(sgxlkl_enclave_config_t) == 480,
+        sizeof(sgxlkl_enclave_config_t) == 512,
         "sgxlkl_enclave_config_t size has changed");
 
 #define FPFBOOL(N) root->objects[cnt++] = encode_boolean(#N, config->N)
@@ -493,6 +497,9 @@ void serialize_enclave_config(
     FPFBOOL(verbose);
     FPFBOOL(kernel_verbose);
     FPFS(kernel_cmd);
+    FPFU64(kernel_min_mem);
+    FPFU64(zram_size);
+    FPFS(zram_comp_algorithm);
     FPFS(sysctl);
     FPFBOOL(swiotlb);
 
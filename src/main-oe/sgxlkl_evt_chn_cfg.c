@@ -3,10 +3,12 @@
 #include <host/vio_host_event_channel.h>
 #include <shared/vio_event_channel.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 
-#define SWIOTLB_BUFFER_SIZE (64UL << 20)
-#define SWIOTLB_SIZE SWIOTLB_BUFFER_SIZE + (8UL << 20)
+#define SWIOTLB_DEFAULT_BUFFER_SIZE (64UL << 20)
+#define SWIOTLB_BUFFER_ALIGN (2UL << 20)
+#define SWIOTLB_EXTRA_SIZE (8UL << 20)
 
 /*
  * Function to configure software io tlb (bounce buffer) for virtio.
@@ -14,7 +16,7 @@
  * enclave memory directly and hence bounce buffer needs to be setup
  * to exchange the data between host and enclave.
  */
-static inline void* configure_software_io_tlb(uint32_t size)
+static inline void* configure_software_io_tlb(size_t size)
 {
     void* bounce_buffer = NULL;
 
@@ -28,6 +30,25 @@ static inline void* configure_software_io_tlb(uint32_t size)
     return bounce_buffer;
 }
 
+/*
+ * Function to allocate a zeroed array whose entries are cache-line aligned.
+ * calloc only guarantees 16-byte alignment, which would let the first entry
+ * share a cache line with unrelated heap data.
+ * @size : size of an entry (a multiple of the alignment)
+ * @align : alignment of an entry
+ * @count : number of entries
+ */
+static void* alloc_aligned_array(size_t size, size_t align, size_t count)
+{
+    void* ptr = NULL;
+
+    if (posix_memalign(&ptr, align, size * count))
+        return NULL;
+
+    memset(ptr, 0, size * count);
+    return ptr;
+}
+
 /*
  * Function to allocate memory for host & guest event channel and initialize
  * it with default values.
@@ -41,13 +62,17 @@ static void host_dev_event_channel_init(
     int evt_channel_num)
 {
     /* Allocate memory for host event channel */
-    host_evt_channel_t* host_evt_channel = (host_evt_channel_t*)calloc(
-        sizeof(host_evt_channel_t), evt_channel_num);
+    host_evt_channel_t* host_evt_channel = alloc_aligned_array(
+        sizeof(host_evt_channel_t),
+        _Alignof(host_evt_channel_t),
+        evt_channel_num);
     if (!host_evt_channel)
         sgxlkl_host_fail("host evt channel allocation failed: %d \n", errno);
 
-    enc_evt_channel_t* enc_evt_channel =
-        (enc_evt_channel_t*)calloc(sizeof(enc_evt_channel_t), evt_channel_num);
+    enc_evt_channel_t* enc_evt_channel = alloc_aligned_array(
+        sizeof(enc_evt_channel_t),
+        _Alignof(enc_evt_channel_t),
+        evt_channel_num);
     if (!enc_evt_channel)
         sgxlkl_host_fail("guest evt channel allocation failed: %d \n", errno);
 
@@ -84,14 +109,16 @@ static void host_dev_cfg_init(
     enc_evt_channel_t* enc_evt_channel = NULL;
 
     /* Allocate host device configuration memory */
-    host_dev_config_t* host_dev_cfg =
-        (host_dev_config_t*)calloc(sizeof(host_dev_config_t), evt_channel_num);
+    host_dev_config_t* host_dev_cfg = alloc_aligned_array(
+        sizeof(host_dev_config_t),
+        _Alignof(host_dev_config_t),
+        evt_channel_num);
 
     if (!host_dev_cfg)
         sgxlkl_host_fail("Failed to allocate memory (host): %d\n", errno);
 
-    enc_dev_config_t* enc_dev_cfg =
-        (enc_dev_config_t*)calloc(sizeof(enc_dev_config_t), evt_channel_num);
+    enc_dev_config_t* enc_dev_cfg = alloc_aligned_array(
+        sizeof(enc_dev_config_t), _Alignof(enc_dev_config_t), evt_channel_num);
 
     if (!enc_dev_cfg)
         sgxlkl_host_fail("Failed to allocate memory (enclave): %d \n", errno);
@@ -127,11 +154,24 @@ static void host_dev_cfg_init(
     return;
 }
 
+/*
+ * Function to return the size of the bounce buffer used by virtio devices.
+ */
+size_t host_swiotlb_buffer_size(size_t configured_size)
+{
+    if (!configured_size)
+        return SWIOTLB_DEFAULT_BUFFER_SIZE;
+
+    return (configured_size + SWIOTLB_BUFFER_ALIGN - 1) &
+           ~(SWIOTLB_BUFFER_ALIGN - 1);
+}
+
 /*
  * Function to initialize the device configuration and event channels.
  */
 int initialize_host_device_configuration(
     bool swiotlb,
+    size_t swiotlb_size,
     sgxlkl_shared_memory_t* shm,
     host_dev_config_t** host_dev_cfg,
     enc_dev_config_t** enc_dev_config,
@@ -139,8 +179,10 @@ int initialize_host_device_configuration(
 {
     if (swiotlb)
     {
-        shm->virtio_swiotlb = configure_software_io_tlb(SWIOTLB_SIZE);
-        shm->virtio_swiotlb_size = SWIOTLB_SIZE;
+        size_t size =
+            host_swiotlb_buffer_size(swiotlb_size) + SWIOTLB_EXTRA_SIZE;
+        shm->virtio_swiotlb = configure_software_io_tlb(size);
+        shm->virtio_swiotlb_size = size;
     }
 
     host_dev_cfg_init(host_dev_cfg, enc_dev_config, evt_chn_number);
@@ -127,6 +127,24 @@ static char* make_path(json_parser_t* parser)
 #define JBOOL(PATH, DEST) \
     JPATHT(PATH, JSON_TYPE_BOOLEAN, (DEST) = un->boolean;);
 
+#define JSIZE(PATH, DEST)                                   \
+    JPATH2T(PATH, JSON_TYPE_STRING, JSON_TYPE_INTEGER, {    \
+        if (type == JSON_TYPE_INTEGER)                      \
+        {                                                   \
+            if (un->integer < 0)                            \
+                FAIL("Invalid value for '%s'.\n", PATH);    \
+            DEST = un->integer;                             \
+        }                                                   \
+        else                                                \
+        {                                                   \
+            char* end = NULL;                               \
+            errno = 0;                                      \
+            DEST = strtoull(un->string, &end, 10);          \
+            if (errno != 0 || !*un->string || *end != '\0') \
+                FAIL("Invalid value for '%s'.\n", PATH);    \
+        }                                                   \
+    });
+
 #define ALLOC_ARRAY(N, A, T)                              \
     do                                                    \
     {                                                     \
@@ -179,16 +197,25 @@ static json_result_t parse_host_config_entry(
             JBOOL("root.readonly", cfg->root.readonly);
             JSTRING("root.verity", cfg->root.verity);
             JSTRING("root.verity_offset", cfg->root.verity_offset);
+            JSIZE("root.verity_block_size", cfg->root.verity_block_size);
+            JBOOL("root.poll", cfg->root.poll);
+            JBOOL("root.direct", cfg->root.direct);
 
 #define MOUNT() _mount(data->config, parser)
             JSTRING("mounts.image_path", MOUNT()->image_path);
             JSTRING("mounts.destination", MOUNT()->destination);
             JBOOL("mounts.readonly", MOUNT()->readonly);
+            JBOOL("mounts.poll", MOUNT()->poll);
+            JBOOL("mounts.direct", MOUNT()->direct);
 
             JBOOL("verbose", cfg->verbose);
             JSTRING("ethreads_affinity", cfg->ethreads_affinity);
             JSTRING("tap_device", cfg->tap_device);
             JBOOL("tap_offload", cfg->tap_offload);
+            JBOOL("tap_poll", cfg->tap_poll);
+            JSTRING("virtio_poll_affinity", cfg->virtio_poll_affinity);
+            JSIZE("swiotlb_size", cfg->swiotlb_size);
+            JBOOL("swiotlb_partition", cfg->swiotlb_partition);
 
             sgxlkl_host_warn("Unknown json path: %s.\n", make_path(parser));
             break;
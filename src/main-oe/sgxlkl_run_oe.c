@@ -28,7 +28,11 @@
 #include <arpa/inet.h>
 #include <netinet/ip.h>
 
+#include "host/host_preempt.h"
+#include "host/host_profile.h"
 #include "host/host_state.h"
+#include "host/host_stats.h"
+#include "host/host_switchless.h"
 #include "host/serialize_enclave_config.h"
 #include "host/sgxlkl_host_config.h"
 #include "host/sgxlkl_params.h"
@@ -110,6 +114,13 @@ static int enclave_return_status = INT_MAX;
 // Counts the number of exited ethreads
 static _Atomic(int) exited_ethread_count = 0;
 
+// Default time in microseconds that polling device tasks poll before sleeping
+#define VIRTIO_POLL_DEFAULT_BUDGET_US 1000
+
+// Cores to pin polling device tasks to
+static int* virtio_poll_cores;
+static size_t virtio_poll_cores_len;
+
 /**************************************************************************************************************************/
 
 #ifdef DEBUG
@@ -172,6 +183,8 @@ extern int __sgx_step_app_terminated;
 
 void aep_cb_func(void)
 {
+    sgxlkl_stats_count_aex();
+
     // Read the pdf "Exception Handling in Intel® Software Guard Extensions (Intel® SGX) Applications" 
     uint8_t bytes[SSA_XSAVE_XMM0_SIZE] = {0};
     uint64_t ossa = 0x0;
@@ -257,6 +270,11 @@ static void usage()
         "%-35s %s",
         "  --enclave-config={enclave config file}",
         "JSON configuration file with enclave configuration\n");
+    printf(
+        "%-35s %s",
+        "  --stats-interval={ms}",
+        "Print enclave scheduler and transition statistics every {ms} "
+        "milliseconds and on exit\n");
     printf("\n");
     printf(
         "%-35s %s",
@@ -298,6 +316,24 @@ static void help_config()
         "Override mounts: comma-separated list of the format: "
         "disk1path:disk1mntpoint:disk1mode,"
         "disk2path:disk2mntpoint:disk2mode,[...].\n");
+    printf(
+        "  %-35s %s",
+        "SGXLKL_VIRTIO_POLL_BUDGET",
+        "Time in microseconds that polling device threads (see root.poll, "
+        "mounts.poll and tap_poll) poll for requests before they sleep "
+        "(default: 1000).\n");
+    printf(
+        "  %-35s %s",
+        "SGXLKL_PREEMPT_QUANTUM",
+        "Time slice in microseconds after which an lthread that keeps running "
+        "application code is preempted (default: 0 = no preemption, software "
+        "mode only).\n");
+    printf(
+        "  %-35s %s",
+        "SGXLKL_SWITCHLESS_WORKERS",
+        "Number of host threads that serve mprotect and device "
+        "notification calls from the enclave without enclave exits "
+        "(default: 0 = always exit the enclave).\n");
 
     size_t n = sizeof(sgxlkl_host_config_settings) /
                sizeof(sgxlkl_host_config_setting_t);
@@ -392,6 +428,15 @@ static void help_config()
         "  SGXLKL_PRINT_APP_RUNTIME",
         "Print total runtime of the application excluding the enclave and "
         "SGX-LKL startup/shutdown time.\n");
+    printf(
+        "%-35s %s",
+        "  SGXLKL_PROFILE",
+        "Sample the stacks of enclave threads and write them in folded stack "
+        "format to the given file on exit (software mode only).\n");
+    printf(
+        "%-35s %s",
+        "  SGXLKL_PROFILE_HZ",
+        "Sampling frequency for SGXLKL_PROFILE (default: 99).\n");
 #if VIRTIO_TEST_HOOK
     virtio_debug_help();
 #endif // VIRTIO_TEST_HOOK
@@ -663,6 +708,10 @@ void override_disk_config(const char* root_disk_path)
         sgxlkl_config_str(SGXLKL_HD_VERITY),
         sgxlkl_config_str(SGXLKL_HD_VERITY_OFFSET));
 
+    if (sgxlkl_config_overridden(SGXLKL_HD_VERITY_BLOCK_SIZE))
+        root_disk->verity_block_size =
+            sgxlkl_config_uint64(SGXLKL_HD_VERITY_BLOCK_SIZE);
+
     if (hds_str)
     {
         char* tmp = strdup(hds_str);
@@ -1037,6 +1086,7 @@ static void register_hd(
     const char* image_path,
     const char* destination,
     bool readonly,
+    bool direct,
     size_t idx)
 {
     sgxlkl_host_verbose(
@@ -1094,7 +1144,31 @@ static void register_hd(
     disk->mmap = disk_mmap;
     disk->size = size;
 
-    blk_device_init(disk, idx, sgxlkl_host_state.enclave_config.swiotlb);
+    /* The guest can only read direct disks, so writable disks keep going
+     * through the host device thread */
+    if (direct && !readonly)
+    {
+        sgxlkl_host_warn(
+            "Disk %lu is not read-only, ignoring direct access\n", idx);
+        direct = false;
+    }
+    disk->direct = direct;
+    if (direct)
+    {
+        sgxlkl_host_state.shared_memory.virtio_blk_dev_direct[idx] = disk_mmap;
+        sgxlkl_host_state.shared_memory.virtio_blk_dev_direct_size[idx] = size;
+    }
+
+    /* With a partitioned bounce buffer, the disks share three quarters of
+     * it equally and the rest is left to the network device */
+    size_t swiotlb_share = 0;
+    if (sgxlkl_host_state.config.swiotlb_partition)
+        swiotlb_share =
+            host_swiotlb_buffer_size(sgxlkl_host_state.config.swiotlb_size) /
+            4 * 3 / sgxlkl_host_state.num_disks;
+
+    blk_device_init(
+        disk, idx, sgxlkl_host_state.enclave_config.swiotlb, swiotlb_share);
 }
 
 static void register_hds(char* root_hd)
@@ -1109,8 +1183,13 @@ static void register_hds(char* root_hd)
         calloc(sgxlkl_host_state.num_disks, sizeof(void*));
     shm->virtio_blk_dev_names =
         calloc(sgxlkl_host_state.num_disks, sizeof(char*));
+    shm->virtio_blk_dev_direct =
+        calloc(sgxlkl_host_state.num_disks, sizeof(void*));
+    shm->virtio_blk_dev_direct_size =
+        calloc(sgxlkl_host_state.num_disks, sizeof(size_t));
 
-    if (!shm->virtio_blk_dev_mem || !shm->virtio_blk_dev_names)
+    if (!shm->virtio_blk_dev_mem || !shm->virtio_blk_dev_names ||
+        !shm->virtio_blk_dev_direct || !shm->virtio_blk_dev_direct_size)
         sgxlkl_host_fail("out of memory\n");
 
     for (size_t i = 0; i < num_disks; i++)
@@ -1125,6 +1204,7 @@ static void register_hds(char* root_hd)
                 disk->root_config->image_path,
                 dest,
                 disk->root_config->readonly,
+                disk->root_config->direct,
                 i);
         }
         else
@@ -1135,6 +1215,7 @@ static void register_hds(char* root_hd)
                 disk->mount_config->image_path,
                 disk->mount_config->destination,
                 disk->mount_config->readonly,
+                disk->mount_config->direct,
                 i);
             strcpy(shm->virtio_blk_dev_names[i], dest);
         }
@@ -1277,6 +1358,19 @@ static void sgxlkl_sw_mode_signal_handler(
         case SIGTRAP:
             oe_code = OE_EXCEPTION_BREAKPOINT;
             break;
+#ifdef DEBUG
+        case SIGPROF:
+            /* Profiling ticks may arrive before the enclave is initialized */
+            if (!_sgxlkl_sw_signal_handler)
+                return;
+            oe_code = SGXLKL_PROFILE_TICK;
+            break;
+#endif
+        case SGXLKL_PREEMPT_SIGNAL:
+            if (!_sgxlkl_sw_signal_handler)
+                return;
+            oe_code = SGXLKL_PREEMPT_TICK;
+            break;
     }
 
     oe_exception_record.code = oe_code;
@@ -1318,6 +1412,18 @@ static void setup_sw_mode_signal_handlers(void)
 
     if (sigaction(SIGTRAP, &sa, NULL) == -1)
         sgxlkl_host_fail("Failed to register SIGTRAP handler\n");
+
+#ifdef DEBUG
+    /* Profiling ticks interrupt ethreads that may be blocked on the host */
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    if (sigaction(SIGPROF, &sa, NULL) == -1)
+        sgxlkl_host_fail("Failed to register SIGPROF handler\n");
+#endif
+
+    /* Preemption ticks, too */
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    if (sigaction(SGXLKL_PREEMPT_SIGNAL, &sa, NULL) == -1)
+        sgxlkl_host_fail("Failed to register SIGURG handler\n");
 }
 
 /* Parses the string provided as config for CPU affinity specifications. The
@@ -1417,7 +1523,9 @@ static void handle_ethread_exit(int exit_status)
 void* ethread_init(ethread_args_t* args)
 {
     int exit_status = 0;
-    oe_result_t result = sgxlkl_ethread_init(args->oe_enclave, &exit_status);
+    sgxlkl_stats_set_ethread_id(args->ethread_id);
+    oe_result_t result = sgxlkl_ethread_init(
+        args->oe_enclave, &exit_status, args->ethread_id);
     if (result != OE_OK)
     {
         sgxlkl_host_fail(
@@ -1437,6 +1545,7 @@ void* enclave_init(ethread_args_t* args)
         "sgxlkl_enclave_init(ethread_id=%i)\n", args->ethread_id);
 
     int exit_status = 0;
+    sgxlkl_stats_set_ethread_id(args->ethread_id);
     oe_result_t result =
         sgxlkl_enclave_init(args->oe_enclave, &exit_status, args->shm);
     if (result != OE_OK)
@@ -1605,6 +1714,16 @@ void override_enclave_config(
     if (sgxlkl_config_overridden(SGXLKL_CMDLINE))
         econf->kernel_cmd = sgxlkl_config_str(SGXLKL_CMDLINE);
 
+    if (sgxlkl_config_overridden(SGXLKL_KERNEL_MIN_MEM))
+        econf->kernel_min_mem = sgxlkl_config_uint64(SGXLKL_KERNEL_MIN_MEM);
+
+    if (sgxlkl_config_overridden(SGXLKL_ZRAM_SIZE))
+        econf->zram_size = sgxlkl_config_uint64(SGXLKL_ZRAM_SIZE);
+
+    if (sgxlkl_config_overridden(SGXLKL_ZRAM_COMP_ALGORITHM))
+        econf->zram_comp_algorithm =
+            sgxlkl_config_str(SGXLKL_ZRAM_COMP_ALGORITHM);
+
     if (sgxlkl_config_overridden(SGXLKL_SYSCTL))
         econf->sysctl = sgxlkl_config_str(SGXLKL_SYSCTL);
 
@@ -1649,7 +1768,8 @@ void override_enclave_config(
         sgxlkl_config_overridden(SGXLKL_HD_OVERLAY) ||
         sgxlkl_config_overridden(SGXLKL_HD_KEY) ||
         sgxlkl_config_overridden(SGXLKL_HD_VERITY) ||
-        sgxlkl_config_overridden(SGXLKL_HD_VERITY_OFFSET))
+        sgxlkl_config_overridden(SGXLKL_HD_VERITY_OFFSET) ||
+        sgxlkl_config_overridden(SGXLKL_HD_VERITY_BLOCK_SIZE))
         override_disk_config(root_disk_file);
 
     if (argv && argc > 0)
@@ -1736,6 +1856,13 @@ void override_host_config(char* root_disk_path)
         cfg->root.verity = sgxlkl_config_str(SGXLKL_HD_VERITY);
     if (sgxlkl_config_overridden(SGXLKL_HD_VERITY_OFFSET))
         cfg->root.verity_offset = sgxlkl_config_str(SGXLKL_HD_VERITY_OFFSET);
+    if (sgxlkl_config_overridden(SGXLKL_HD_VERITY_BLOCK_SIZE))
+        cfg->root.verity_block_size =
+            sgxlkl_config_uint64(SGXLKL_HD_VERITY_BLOCK_SIZE);
+    if (sgxlkl_config_overridden(SGXLKL_HD_POLL))
+        cfg->root.poll = sgxlkl_config_bool(SGXLKL_HD_POLL);
+    if (sgxlkl_config_overridden(SGXLKL_HD_DIRECT))
+        cfg->root.direct = sgxlkl_config_bool(SGXLKL_HD_DIRECT);
 
     if (sgxlkl_config_overridden(SGXLKL_HDS))
     {
@@ -1764,6 +1891,8 @@ void override_host_config(char* root_disk_path)
             cfg->mounts[i].image_path = hd_path;
             cfg->mounts[i].destination = hd_mnt;
             cfg->mounts[i].readonly = hd_ro;
+            if (sgxlkl_config_overridden(SGXLKL_HD_POLL))
+                cfg->mounts[i].poll = sgxlkl_config_bool(SGXLKL_HD_POLL);
 
             tmp = strchrnul(hd_mnt_end + 1, ',');
             while (*tmp == ' ' || *tmp == ',')
@@ -1779,6 +1908,52 @@ void override_host_config(char* root_disk_path)
         cfg->tap_device = sgxlkl_config_str(SGXLKL_TAP);
     if (sgxlkl_config_overridden(SGXLKL_TAP_OFFLOAD))
         cfg->tap_offload = sgxlkl_config_bool(SGXLKL_TAP_OFFLOAD);
+    if (sgxlkl_config_overridden(SGXLKL_TAP_POLL))
+        cfg->tap_poll = sgxlkl_config_bool(SGXLKL_TAP_POLL);
+    if (sgxlkl_config_overridden(SGXLKL_VIRTIO_POLL_AFFINITY))
+        cfg->virtio_poll_affinity =
+            sgxlkl_config_str(SGXLKL_VIRTIO_POLL_AFFINITY);
+    if (sgxlkl_config_overridden(SGXLKL_SWIOTLB_SIZE))
+        cfg->swiotlb_size = sgxlkl_config_uint64(SGXLKL_SWIOTLB_SIZE);
+    if (sgxlkl_config_overridden(SGXLKL_SWIOTLB_PARTITION))
+        cfg->swiotlb_partition = sgxlkl_config_bool(SGXLKL_SWIOTLB_PARTITION);
+}
+
+/*
+ * Creates the host task of a virtio device. If the device polls its event
+ * channel, the task is pinned to the next core in virtio_poll_affinity, so
+ * that it does not compete with ethreads or other polling tasks.
+ */
+static void create_device_task(
+    pthread_t* thread,
+    void* (*task)(void*),
+    host_dev_config_t* cfg,
+    bool poll,
+    const char* name)
+{
+    static size_t next_poll_core = 0;
+    pthread_attr_t attr;
+    cpu_set_t set;
+
+    if (poll)
+    {
+        uint64_t budget_us = getenv_uint64(
+            SGXLKL_VIRTIO_POLL_BUDGET, VIRTIO_POLL_DEFAULT_BUDGET_US, 1000000);
+        cfg->poll_budget_ns = budget_us * 1000;
+    }
+
+    pthread_attr_init(&attr);
+    if (poll && virtio_poll_cores_len)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(
+            virtio_poll_cores[next_poll_core++ % virtio_poll_cores_len], &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+
+    pthread_create(thread, &attr, task, cfg);
+    pthread_setname_np(*thread, name);
+    pthread_attr_destroy(&attr);
 }
 
 void host_config_from_file(char* filename)
@@ -1803,6 +1978,11 @@ int main(int argc, char* argv[], char* envp[])
     pthread_t* host_netdev_task;
     pthread_t* host_console_task;
     pthread_t* host_timerdev_task;
+    pthread_t host_stats_task;
+    unsigned long stats_interval_ms = 0;
+    char* profile_path = NULL;
+    uint64_t preempt_quantum_us;
+    uint64_t switchless_workers;
     int* ethreads_cores;
     size_t ethreads_cores_len;
     pthread_attr_t eattr;
@@ -1839,6 +2019,7 @@ int main(int argc, char* argv[], char* envp[])
         {"isolated-image", required_argument, 0, 'i'},
         {"host-config", required_argument, 0, 'H'},
         {"enclave-config", required_argument, 0, 'c'},
+        {"stats-interval", required_argument, 0, 's'},
         {0, 0, 0, 0}};
 
     sgxlkl_host_state.enclave_config = sgxlkl_enclave_config_default;
@@ -1883,6 +2064,12 @@ int main(int argc, char* argv[], char* envp[])
             case 'c':
                 enclave_config_path = optarg;
                 break;
+            case 's':
+                stats_interval_ms = strtoul(optarg, NULL, 10);
+                if (stats_interval_ms == 0)
+                    sgxlkl_host_fail(
+                        "Invalid statistics interval: %s\n", optarg);
+                break;
             default:
                 sgxlkl_host_fail(
                     "Unexpected command line option: %s\n", argv[optind - 1]);
@@ -1973,6 +2160,34 @@ int main(int argc, char* argv[], char* envp[])
     if (enclave_mode == SW_DEBUG_MODE)
         setup_sw_mode_signal_handlers();
 
+#ifdef DEBUG
+    /* The profiler needs to forward signals into the enclave, which is only
+     * possible in SW mode. */
+    profile_path = getenv_str(SGXLKL_PROFILE, NULL);
+    if (profile_path && enclave_mode != SW_DEBUG_MODE)
+    {
+        sgxlkl_host_warn(
+            "%s is only supported in software mode. Ignoring.\n",
+            SGXLKL_PROFILE);
+        free(profile_path);
+        profile_path = NULL;
+    }
+#endif
+
+    /* Preemption ticks are forwarded into the enclave like profiling ticks */
+    preempt_quantum_us = getenv_uint64(
+        SGXLKL_PREEMPT_QUANTUM, 0, SGXLKL_PREEMPT_MAX_QUANTUM_US);
+    if (preempt_quantum_us && enclave_mode != SW_DEBUG_MODE)
+    {
+        sgxlkl_host_warn(
+            "%s is only supported in software mode. Ignoring.\n",
+            SGXLKL_PREEMPT_QUANTUM);
+        preempt_quantum_us = 0;
+    }
+
+    switchless_workers = getenv_uint64(
+        SGXLKL_SWITCHLESS_WORKERS, 0, SGXLKL_SWITCHLESS_MAX_WORKERS);
+
     atexit(sgxlkl_cleanup);
 
     sgxlkl_host_verbose("get_signed_libsgxlkl_path... ");
@@ -1994,6 +2209,11 @@ int main(int argc, char* argv[], char* envp[])
         &ethreads_cores,
         &ethreads_cores_len);
 
+    parse_cpu_affinity_params(
+        sgxlkl_host_state.config.virtio_poll_affinity,
+        &virtio_poll_cores,
+        &virtio_poll_cores_len);
+
     sgxlkl_threads = calloc(sizeof(*sgxlkl_threads), econf->ethreads);
     if (sgxlkl_threads == 0)
     {
@@ -2049,6 +2269,7 @@ int main(int argc, char* argv[], char* envp[])
 
     initialize_host_device_configuration(
         econf->swiotlb,
+        sgxlkl_host_state.config.swiotlb_size,
         &sgxlkl_host_state.shared_memory,
         &host_dev_cfg,
         &enc_dev_config,
@@ -2063,12 +2284,19 @@ int main(int argc, char* argv[], char* envp[])
     /* Launch block device host tasks */
     for (; dev_index < sgxlkl_host_state.num_disks; dev_index++)
     {
-        pthread_create(
+        sgxlkl_host_disk_state_t* disk = &sgxlkl_host_state.disks[dev_index];
+
+        /* The enclave serves direct disks itself and never notifies them */
+        if (disk->direct)
+            continue;
+
+        create_device_task(
             &host_vdisk_task[dev_index],
-            NULL,
             blkdevice_thread,
-            &host_dev_cfg[dev_index]);
-        pthread_setname_np(host_vdisk_task[dev_index], "HOST_BLKDEVICE");
+            &host_dev_cfg[dev_index],
+            disk->root_config ? disk->root_config->poll
+                              : disk->mount_config->poll,
+            "HOST_BLKDEVICE");
     }
 
     /* Pass the enclave dev configuration in enclave event handler */
@@ -2084,12 +2312,12 @@ int main(int argc, char* argv[], char* envp[])
         }
         else
         {
-            pthread_create(
+            create_device_task(
                 host_netdev_task,
-                NULL,
                 netdev_task,
-                &host_dev_cfg[dev_index++]);
-            pthread_setname_np(*host_netdev_task, "HOST_NETDEV");
+                &host_dev_cfg[dev_index++],
+                sgxlkl_host_state.config.tap_poll,
+                "HOST_NETDEV");
         }
     }
 
@@ -2113,6 +2341,29 @@ int main(int argc, char* argv[], char* envp[])
         pthread_setname_np(*host_timerdev_task, "HOST_TIMER_DEVICE");
     }
 
+    /* Statistics must be set up before the enclave is initialized */
+    if (stats_interval_ms)
+    {
+        sgxlkl_stats_init(&sgxlkl_host_state.shared_memory, econf->ethreads);
+        pthread_create(
+            &host_stats_task,
+            NULL,
+            sgxlkl_stats_task,
+            (void*)(uintptr_t)stats_interval_ms);
+        pthread_setname_np(host_stats_task, "HOST_STATS");
+    }
+
+    /* The switchless call ring must be set up before the enclave is
+     * initialized */
+    if (switchless_workers)
+        sgxlkl_switchless_init(
+            &sgxlkl_host_state.shared_memory, switchless_workers);
+
+    /* The profile buffer must be set up before the enclave is initialized */
+    if (profile_path)
+        sgxlkl_profile_init(
+            &sgxlkl_host_state.shared_memory, SGXLKL_PROFILE_DEFAULT_SAMPLES);
+
 #ifdef DEBUG
     /* Need base address for GDB to work */
     _oe_enclave_partial* oe_enclave_content = (_oe_enclave_partial*)oe_enclave;
@@ -2172,6 +2423,16 @@ int main(int argc, char* argv[], char* envp[])
         pthread_setname_np(sgxlkl_threads[i], "ENCLAVE");
     }
 
+    if (profile_path)
+        sgxlkl_profile_start(
+            sgxlkl_threads,
+            econf->ethreads,
+            getenv_uint64(SGXLKL_PROFILE_HZ, SGXLKL_PROFILE_DEFAULT_HZ, 10000));
+
+    if (preempt_quantum_us)
+        sgxlkl_preempt_start(
+            sgxlkl_threads, econf->ethreads, preempt_quantum_us);
+
     // Wait for the terminating ethread to exit the enclave
     pthread_mutex_lock(&terminating_ethread_exited_mtx);
     // Only wait if the enclave has not exited yet
@@ -2212,5 +2473,11 @@ int main(int argc, char* argv[], char* envp[])
     sgx_lkl_print_app_main_aex_count(); 
     sgx_step_print_aex_count();
 
+    if (stats_interval_ms)
+        sgxlkl_stats_dump();
+
+    if (profile_path)
+        sgxlkl_profile_write(profile_path, libsgxlkl);
+
     return exit_status;
 }
@@ -33,6 +33,7 @@ typedef struct _sgxlkl_ethread_init_args_t
 {
     oe_result_t _result;
     int _retval;
+    int ethread_id;
 } sgxlkl_ethread_init_args_t;
 
 typedef struct _sgxlkl_debug_dump_stack_traces_args_t
@@ -189,7 +190,8 @@ done:
 
 oe_result_t sgxlkl_ethread_init(
     oe_enclave_t* enclave,
-    int* _retval)
+    int* _retval,
+    int ethread_id)
 {
     oe_result_t _result = OE_FAILURE;
 
@@ -212,7 +214,7 @@ oe_result_t sgxlkl_ethread_init(
 
     /* Fill marshalling struct. */
     memset(&_args, 0, sizeof(_args));
-    
+    _args.ethread_id = ethread_id;
 
     /* Compute input buffer size. Include in and in-out parameters. */
     OE_ADD_SIZE(_input_buffer_size, sizeof(sgxlkl_ethread_init_args_t));
@@ -8,6 +8,7 @@
 #include <enclave/lthread.h>
 #include <enclave/lthread_int.h>
 #include <enclave/ticketlock.h>
+#include "enclave/enclave_stats.h"
 #include "enclave/enclave_util.h"
 #include "enclave/sgxlkl_t.h"
 #include "enclave/enclave_timer.h"
@@ -22,6 +23,9 @@ static struct ticketlock futex_q_lock;
 /* number of threads sleeping on a futex, protected by futex_q_lock */
 static volatile int futex_sleepers;
 
+/* number of woken lthreads that are made runnable together */
+#define FUTEX_WAKE_BATCH 16
+
 /* wake-up reasons */
 #define FUTEX_NONE 0    /* no extraordinary happened */
 #define FUTEX_EXPIRED 1 /* timeout expired */
@@ -81,6 +85,8 @@ void futex_tick()
     struct futex_q *fq, *tmp;
     uint64_t usecs;
     int local_futex_sleepers;
+    struct lthread* woken[FUTEX_WAKE_BATCH];
+    size_t num_woken = 0;
 
     /* if there are no sleepers, we can bail quickly */
     local_futex_sleepers = a_fetch_add(&futex_sleepers, 0);
@@ -103,9 +109,15 @@ void futex_tick()
             a_fetch_add(&futex_sleepers, -1);
             SLIST_REMOVE(&futex_queues, fq, futex_q, entries);
             lt->err = FUTEX_EXPIRED;
-            __scheduler_enqueue(lt);
+            woken[num_woken++] = lt;
+            if (num_woken == FUTEX_WAKE_BATCH)
+            {
+                __scheduler_enqueue_batch(woken, num_woken);
+                num_woken = 0;
+            }
         }
     }
+    __scheduler_enqueue_batch(woken, num_woken);
 
     ticket_unlock(&futex_q_lock);
 }
@@ -232,6 +244,8 @@ static int futex_wake(int* uaddr, unsigned int num)
     uint32_t futex_key;
     struct futex_q *fq, *tmp;
     unsigned int w = 0;
+    struct lthread* woken[FUTEX_WAKE_BATCH];
+    size_t num_woken = 0;
 
     futex_key = to_futex_key(uaddr);
 
@@ -251,9 +265,15 @@ static int futex_wake(int* uaddr, unsigned int num)
             a_fetch_add(&futex_sleepers, -1);
             SLIST_REMOVE(&futex_queues, fq, futex_q, entries);
             lt->err = FUTEX_NONE;
-            __scheduler_enqueue(lt);
+            woken[num_woken++] = lt;
+            if (num_woken == FUTEX_WAKE_BATCH)
+            {
+                __scheduler_enqueue_batch(woken, num_woken);
+                num_woken = 0;
+            }
         }
     }
+    __scheduler_enqueue_batch(woken, num_woken);
 
     FUTEX_SGXLKL_VERBOSE(
         "FUTEX_WAKE in tid %d with key: 0x%x, woke %d\n",
@@ -269,6 +289,8 @@ int enclave_futex_timedwait(
     int val,
     const struct timespec* timeout)
 {
+    SGXLKL_STATS_INC(futex_waits);
+
     ticket_lock(&futex_q_lock);
 
     assert(lthread_self());
@@ -302,6 +324,8 @@ int enclave_futex_wait(int* uaddr, int val)
 
 int enclave_futex_wake(int* uaddr, int val)
 {
+    SGXLKL_STATS_INC(futex_wakes);
+
     ticket_lock(&futex_q_lock);
 
     int rc = futex_wake(uaddr, val);
@@ -38,8 +38,10 @@
 
 #include "stdio_impl.h"
 
+#include <enclave/enclave_alloc.h>
 #include <enclave/enclave_mem.h>
 #include <enclave/enclave_oe.h>
+#include <enclave/enclave_stats.h>
 #include <enclave/enclave_util.h>
 #include <enclave/lthread.h>
 #include "enclave/lthread_int.h"
@@ -70,15 +72,27 @@ static void lthread_rundestructors(struct lthread* lt);
 
 #define TLS_ALIGN 16
 
+/* Number of high-priority lthreads that may run in a row before a normal
+ * lthread gets a turn */
+#define LTHREAD_HIGH_PRIO_BURST 16
+
 static int spawned_ethreads = 1;
 
-void init_ethread_tp()
+void init_ethread_tp(int ethread_id)
 {
 	struct schedctx *td = __scheduler_self();
 	td->self = td;
 	// Prevent collisions with lthread TIDs which are assigned to newly spawned
 	// lthreads incrementally, starting from one.
 	td->tid = INT_MAX - a_fetch_add(&spawned_ethreads, 1);
+	td->ethread_id = ethread_id;
+
+	// Use the host's ethread id to select this ethread's statistics slot, so
+	// that the slot matches the row in which the host counts its AEXs.
+	sgxlkl_stats_t* stats = sgxlkl_enclave_state.shared_memory.stats;
+	td->stats = NULL;
+	if (stats && ethread_id >= 0 && ethread_id < SGXLKL_STATS_MAX_ETHREADS)
+		td->stats = &stats->ethreads[ethread_id];
 }
 
 static inline int _lthread_sleep_cmp(struct lthread* l1, struct lthread* l2);
@@ -168,7 +182,7 @@ static inline struct lthread* lthread_alloc()
 #ifdef LTHREAD_UAF_CHECKS
     return paranoid_alloc(sizeof(struct lthread));
 #else
-    return oe_calloc(sizeof(struct lthread), 1);
+    return enclave_calloc(1, sizeof(struct lthread));
 #endif
 }
 
@@ -177,7 +191,7 @@ static inline void lthread_dealloc(struct lthread* lt)
 #ifdef LTHREAD_UAF_CHECKS
     return paranoid_dealloc(lt, sizeof(struct lthread));
 #else
-    return oe_free(lt);
+    enclave_free(lt);
 #endif
 }
 
@@ -232,9 +246,59 @@ int support_avx(){
 }
 
 
+/*
+ * Records a resume and the number of lthreads that are still runnable in the
+ * statistics slot of the current ethread.
+ */
+static inline void _lthread_stats_sample_runq(void)
+{
+    sgxlkl_ethread_stats_t* stats = sgxlkl_stats_self();
+    if (!stats)
+        return;
+
+    size_t depth =
+        mpmc_size(&__scheduler_queue) + mpmc_size(&__scheduler_queue_high);
+
+    stats->resumes++;
+    stats->runq_samples++;
+    stats->runq_depth_sum += depth;
+    if (depth > stats->runq_depth_max)
+        stats->runq_depth_max = depth;
+}
+
+/*
+ * Dequeues the next lthread to run. High-priority lthreads run first, but
+ * after LTHREAD_HIGH_PRIO_BURST of them in a row, the normal queue gets a
+ * turn, so that a steady stream of device or kernel work cannot starve the
+ * application.
+ */
+static inline int _lthread_dequeue(
+    struct lthread_sched* sched,
+    struct lthread** lt)
+{
+    if (sched->high_prio_streak < LTHREAD_HIGH_PRIO_BURST &&
+        mpmc_dequeue(&__scheduler_queue_high, (void**)lt))
+    {
+        sched->high_prio_streak++;
+        return 1;
+    }
+
+    sched->high_prio_streak = 0;
+    if (mpmc_dequeue(&__scheduler_queue, (void**)lt))
+        return 1;
+
+    if (mpmc_dequeue(&__scheduler_queue_high, (void**)lt))
+    {
+        sched->high_prio_streak = 1;
+        return 1;
+    }
+
+    return 0;
+}
+
 int lthread_run(void)
 {
-    const struct lthread_sched* const sched = lthread_get_sched();
+    struct lthread_sched* const sched = lthread_get_sched();
     struct lthread* lt = NULL;
     size_t pauses = sleepspins;
     int spins = futex_wake_spins;
@@ -321,13 +385,14 @@ int lthread_run(void)
         do
         {
             dequeued = 0;
-            if (mpmc_dequeue(&__scheduler_queue, (void**)&lt))
+            if (_lthread_dequeue(sched, &lt))
             {
                 SGXLKL_ASSERT(!(lt->attr.state & BIT(LT_ST_EXITED)));
                 SGXLKL_ASSERT(!(lt->attr.state & BIT(LT_ST_TERMINATE)));
 
                 dequeued++;
                 pauses = sleepspins;
+                _lthread_stats_sample_runq();
                 SGXLKL_TRACE_THREAD(
                     "[%4d] lthread_run(): lthread_resume (dequeue)\n",
                     lt ? lt->tid : -1);
@@ -368,12 +433,15 @@ int lthread_run(void)
             }
         } while (dequeued);
 
+        SGXLKL_STATS_INC(spins);
         pauses--;
         if (pauses == 0)
         {
             pauses = sleepspins;
             spins = 0;
             /* sleep outside the enclave */
+            SGXLKL_STATS_INC(idle_sleeps);
+            SGXLKL_STATS_OCALL(SGXLKL_STATS_OCALL_IDLE_ETHREAD);
             sgxlkl_host_idle_ethread(sleeptime_ns);
         }
     }
@@ -456,7 +524,7 @@ void _lthread_free(struct lthread* lt)
     // lthread only manages tls region for lkl kernel threads
     if (lt->attr.thread_type == LKL_KERNEL_THREAD && lt->itls != 0)
     {
-        enclave_munmap(lt->itls, lt->itlssz);
+        enclave_free(lt->itls);
     }
 
     if (lt->attr.stack)
@@ -537,6 +605,7 @@ int _lthread_resume(struct lthread* lt)
     lt->yield_cbarg = 0;
 
     sched->current_lthread = lt;
+    sched->resumes++;
 
     set_tls_tp(lt);
     _switch(&lt->ctx, &sched->ctx);
@@ -627,6 +696,11 @@ int _lthread_sched_init(size_t stack_size)
 
     sched->default_timeout = 3000000u;
 
+    sched->resumes = 0;
+    sched->preempt_lt = NULL;
+    sched->preempt_resumes = 0;
+    sched->high_prio_streak = 0;
+
     oe_memset_s(
         &sched->ctx, sizeof(struct cpu_ctx), 0, sizeof(struct cpu_ctx));
 
@@ -641,7 +715,7 @@ int lthread_create_primitive(
 {
     struct lthread* lt;
 
-    if ((lt = oe_calloc(1, sizeof(struct lthread))) == NULL)
+    if ((lt = lthread_alloc()) == NULL)
     {
         return -1;
     }
@@ -701,7 +775,7 @@ int lthread_create(
     size_t stack_size;
     struct lthread_sched* sched = lthread_get_sched();
 
-    if ((lt = oe_calloc(1, sizeof(struct lthread))) == NULL)
+    if ((lt = lthread_alloc()) == NULL)
     {
         return -1;
     }
@@ -722,24 +796,22 @@ int lthread_create(
     }
     lt->attr.stack_size = stack_size;
 
-    /* mmap tls image */
+    /* allocate tls image */
     // To maintain tls alignment, calculates
     // closest multiple of TLS_ALIGN > sizeof(struct lthread_tcb_base)
     lt->itlssz = (sizeof(struct lthread_tcb_base) + TLS_ALIGN - 1) & -TLS_ALIGN;
-    if ((lt->itls = (uint8_t*)enclave_mmap(
-                 0,
-                 lt->itlssz,
-                 0, /* map_fixed */
-                 PROT_READ | PROT_WRITE,
-                 1 /* zero_pages */)) == MAP_FAILED)
+    if ((lt->itls = enclave_calloc(1, lt->itlssz)) == NULL)
     {
-        oe_free(lt);
+        if (!attrp || !attrp->stack)
+            enclave_munmap(lt->attr.stack, stack_size);
+        lthread_dealloc(lt);
         return -1;
     }
     init_tp(lt, lt->itls, lt->itlssz);
 
     lt->attr.state = BIT(LT_ST_NEW) | (attrp ? attrp->state : 0);
     lt->attr.thread_type = LKL_KERNEL_THREAD;
+    lt->attr.priority = attrp ? attrp->priority : LTHREAD_PRIO_NORMAL;
     lt->attr.funcname[0] = '\0';
     lt->tid = a_fetch_add(&spawned_lthreads, 1);
     lt->fun = fun;
@@ -748,7 +820,7 @@ int lthread_create(
     LIST_INIT(&lt->tls);
 
     // Did we get a thread name?
-    if (attrp && attrp->funcname)
+    if (attrp && attrp->funcname[0])
     {
         lthread_set_funcname(lt, attrp->funcname);
     }
@@ -964,7 +1036,7 @@ static struct lthread_tls* lthread_findtlsslot(struct lthread* lt, long key)
 static int lthread_addtlsslot(struct lthread* lt, long key, void* data)
 {
     struct lthread_tls* d;
-    d = oe_calloc(1, sizeof(struct lthread_tls));
+    d = enclave_calloc(1, sizeof(struct lthread_tls));
     if (d == NULL)
     {
         return ENOMEM;
@@ -1062,7 +1134,7 @@ static void lthread_rundestructors(struct lthread* lt)
             }
         }
         LIST_REMOVE(d, tls_next);
-        oe_free(d);
+        enclave_free(d);
     }
 }
 
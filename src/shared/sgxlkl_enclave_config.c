@@ -379,6 +379,9 @@ static json_result_t json_read_callback(
             JBOOL("verbose", cfg->verbose);
             JBOOL("kernel_verbose", cfg->kernel_verbose);
             JSTRING("kernel_cmd", cfg->kernel_cmd);
+            JU64("kernel_min_mem", cfg->kernel_min_mem);
+            JU64("zram_size", cfg->zram_size);
+            JSTRING("zram_comp_algorithm", cfg->zram_comp_algorithm);
             JSTRING("sysctl", cfg->sysctl);
             JBOOL("swiotlb", cfg->swiotlb);
 
@@ -403,6 +406,9 @@ static json_result_t json_read_callback(
             JBOOL("root.readonly", data->config->root.readonly);
             JSTRING("root.roothash", data->config->root.roothash);
             JU64("root.roothash_offset", data->config->root.roothash_offset);
+            JU64(
+                "root.verity_block_size",
+                data->config->root.verity_block_size);
             JBOOL("root.overlay", data->config->root.overlay);
 
 #define MOUNT() _mount(data->config, parser)
@@ -422,6 +428,7 @@ static json_result_t json_read_callback(
             JBOOL("mounts.readonly", MOUNT()->readonly);
             JSTRING("mounts.roothash", MOUNT()->roothash);
             JU64("mounts.roothash_offset", MOUNT()->roothash_offset);
+            JU64("mounts.verity_block_size", MOUNT()->verity_block_size);
             JU64("mounts.size", MOUNT()->size);
 
             sgxlkl_image_sizes_config_t* sizes = &cfg->image_sizes;
@@ -443,6 +450,13 @@ static json_result_t json_read_callback(
     return JSON_OK;
 }
 
+/* dm-verity supports power-of-two block sizes from 512 bytes to the page
+ * size, 0 means that the block size is read from the verity superblock */
+static bool valid_verity_block_size(size_t size)
+{
+    return size == 0 || (size >= 512 && size <= 4096 && !(size & (size - 1)));
+}
+
 void check_config(const sgxlkl_enclave_config_t* cfg)
 {
 #define CC(C, M) \
@@ -461,6 +475,12 @@ void check_config(const sgxlkl_enclave_config_t* cfg)
     CC(cfg->num_env > INT32_MAX, "size of env out of range");
     CC(cfg->num_host_import_env > INT32_MAX,
        "size of host_import_env out of range");
+
+    CC(!valid_verity_block_size(cfg->root.verity_block_size),
+       "invalid root verity_block_size");
+    for (size_t i = 0; i < cfg->num_mounts; i++)
+        CC(!valid_verity_block_size(cfg->mounts[i].verity_block_size),
+           "invalid mount verity_block_size");
 }
 
 void check_required_elements(string_list_t* seen)
@@ -483,7 +503,7 @@ void sgxlkl_read_enclave_config(
     // Catch modifications to sgxlkl_enclave_config_t early. If this fails,
     // the code above/below needs adjusting for the added/removed settings.
     _Static_assert(
-        sizeof(sgxlkl_enclave_config_t) == 480,
+        sizeof(sgxlkl_enclave_config_t) == 512,
         "sgxlkl_enclave_config_t size has changed");
 
     if (!from)
@@ -559,6 +579,7 @@ void sgxlkl_free_enclave_config(sgxlkl_enclave_config_t* config)
     NONDEFAULT_FREE(wg.peers);
 
     NONDEFAULT_FREE(kernel_cmd);
+    NONDEFAULT_FREE(zram_comp_algorithm);
     NONDEFAULT_FREE(sysctl);
     NONDEFAULT_FREE(cwd);
 
@@ -1,20 +1,36 @@
+#define _GNU_SOURCE
 #include <vic.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <sys/mount.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 #include "strings.h"
 #include "raise.h"
 
+#ifndef BLKZEROOUT
+#define BLKZEROOUT _IO(0x12, 127)
+#endif
+
 /* A magic number for blockdev_t.magic used to verify valid blockdev structs */
 #define MAGIC 0xf3fcef718ce744bd
 
 #define DEFAULT_BLOCK_SIZE 512
 
+/* Buffer alignment required by O_DIRECT */
+#define DIRECT_ALIGNMENT 4096
+
+/* Maximum number of iovecs passed to a single preadv()/pwritev() */
+#define MAX_IOVCNT 64
+
+/* Size of the zero buffer used to wipe blocks by writing them */
+#define WIPE_CHUNK_SIZE (1024 * 1024)
+
 typedef struct _blockdev
 {
     vic_blockdev_t base;
@@ -258,6 +274,223 @@ done:
     return result;
 }
 
+/* Check that [blkno, blkno + size) is within the device and return its
+ * byte offset in the underlying file */
+static vic_result_t _get_io_range(
+    const blockdev_t* bd,
+    uint64_t blkno,
+    size_t size,
+    bool write,
+    off_t* off_out)
+{
+    vic_result_t result = VIC_OK;
+    const off_t off = (blkno * bd->block_size) + bd->offset;
+
+    if (size % bd->block_size)
+        RAISE(VIC_NOT_BLOCK_MULTIPLE);
+
+    /* Files opened with VIC_CREATE grow when written beyond their end */
+    if (!(write && (bd->flags & VIC_CREATE)) && off + size > bd->size)
+        RAISE(VIC_SEEK_FAILED);
+
+    *off_out = off;
+
+done:
+    return result;
+}
+
+static bool _range_aligned(off_t off, size_t size)
+{
+    return off % DIRECT_ALIGNMENT == 0 && size % DIRECT_ALIGNMENT == 0;
+}
+
+static bool _io_aligned(
+    off_t off,
+    size_t size,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    if (!_range_aligned(off, size))
+        return false;
+
+    for (size_t i = 0; i < iovcnt; i++)
+    {
+        if ((uintptr_t)iov[i].iov_base % DIRECT_ALIGNMENT ||
+            iov[i].iov_len % DIRECT_ALIGNMENT)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Transfer all the iov buffers, retrying short reads and writes */
+static vic_result_t _rw_full(
+    blockdev_t* bd,
+    bool write,
+    off_t off,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    vic_result_t result = VIC_OK;
+
+    while (iovcnt)
+    {
+        struct iovec vec[MAX_IOVCNT];
+        const size_t n = iovcnt < MAX_IOVCNT ? iovcnt : MAX_IOVCNT;
+        size_t first = 0;
+
+        memcpy(vec, iov, n * sizeof(struct iovec));
+
+        while (first < n)
+        {
+            ssize_t r;
+
+            if (write)
+                r = pwritev(bd->fd, &vec[first], n - first, off);
+            else
+                r = preadv(bd->fd, &vec[first], n - first, off);
+
+            if (r < 0 && errno == EINTR)
+                continue;
+
+            if (r <= 0)
+                RAISE(write ? VIC_WRITE_FAILED : VIC_READ_FAILED);
+
+            off += r;
+
+            /* Skip over the buffers that were transferred completely */
+            while (first < n && (size_t)r >= vec[first].iov_len)
+                r -= vec[first++].iov_len;
+
+            if (r)
+            {
+                vec[first].iov_base = (uint8_t*)vec[first].iov_base + r;
+                vec[first].iov_len -= r;
+            }
+        }
+
+        iov += n;
+        iovcnt -= n;
+    }
+
+done:
+    return result;
+}
+
+/* Transfer size bytes at off. O_DIRECT also needs an aligned file range,
+ * which no buffer can provide, so unaligned ranges of a file opened with
+ * VIC_DIRECT go through the page cache. */
+static vic_result_t _rw_range(
+    blockdev_t* bd,
+    bool write,
+    off_t off,
+    size_t size,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    vic_result_t result = VIC_OK;
+    int fl = -1;
+
+    if ((bd->flags & VIC_DIRECT) && !_range_aligned(off, size))
+    {
+        if ((fl = fcntl(bd->fd, F_GETFL)) < 0 ||
+            fcntl(bd->fd, F_SETFL, fl & ~O_DIRECT) != 0)
+        {
+            RAISE(write ? VIC_WRITE_FAILED : VIC_READ_FAILED);
+        }
+    }
+
+    CHECK(_rw_full(bd, write, off, iov, iovcnt));
+
+done:
+
+    if (fl >= 0)
+        fcntl(bd->fd, F_SETFL, fl);
+
+    return result;
+}
+
+static vic_result_t _bd_rw(
+    blockdev_t* bd,
+    bool write,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    vic_result_t result = VIC_OK;
+    size_t size = 0;
+    off_t off;
+    uint8_t* bounce = NULL;
+
+    if (!_valid_blockdev(bd))
+        RAISE(VIC_BAD_BLOCK_DEVICE);
+
+    if (!iov && iovcnt)
+        RAISE(VIC_BAD_PARAMETER);
+
+    for (size_t i = 0; i < iovcnt; i++)
+    {
+        if (!iov[i].iov_base && iov[i].iov_len)
+            RAISE(VIC_BAD_PARAMETER);
+
+        size += iov[i].iov_len;
+    }
+
+    CHECK(_get_io_range(bd, blkno, size, write, &off));
+
+    if (size == 0)
+        goto done;
+
+    /* O_DIRECT needs aligned buffers, so bounce the data if necessary */
+    if ((bd->flags & VIC_DIRECT) && !_io_aligned(off, size, iov, iovcnt))
+    {
+        struct iovec vec;
+        size_t pos = 0;
+
+        if (posix_memalign((void**)&bounce, DIRECT_ALIGNMENT, size) != 0)
+            RAISE(VIC_OUT_OF_MEMORY);
+
+        vec.iov_base = bounce;
+        vec.iov_len = size;
+
+        if (write)
+        {
+            for (size_t i = 0; i < iovcnt; i++)
+            {
+                memcpy(bounce + pos, iov[i].iov_base, iov[i].iov_len);
+                pos += iov[i].iov_len;
+            }
+        }
+
+        CHECK(_rw_range(bd, write, off, size, &vec, 1));
+
+        if (!write)
+        {
+            for (size_t i = 0; i < iovcnt; i++)
+            {
+                memcpy(iov[i].iov_base, bounce + pos, iov[i].iov_len);
+                pos += iov[i].iov_len;
+            }
+        }
+    }
+    else
+    {
+        CHECK(_rw_range(bd, write, off, size, iov, iovcnt));
+    }
+
+    if (write && (bd->flags & VIC_CREATE) && (size_t)off + size > bd->size)
+        bd->size = off + size;
+
+done:
+
+    if (bounce)
+        free(bounce);
+
+    return result;
+}
+
 static vic_result_t _bd_get(
     vic_blockdev_t* bd_,
     uint64_t blkno,
@@ -266,8 +499,7 @@ static vic_result_t _bd_get(
 {
     vic_result_t result = VIC_OK;
     blockdev_t* bd = (blockdev_t*)bd_;
-    off_t off;
-    size_t size;
+    struct iovec iov;
 
     if (!_valid_blockdev(bd))
         RAISE(VIC_BAD_BLOCK_DEVICE);
@@ -275,17 +507,10 @@ static vic_result_t _bd_get(
     if (!blocks)
         RAISE(VIC_BAD_PARAMETER);
 
-    off = (blkno * bd->block_size) + bd->offset;;
-    size = nblocks * bd->block_size;
+    iov.iov_base = blocks;
+    iov.iov_len = nblocks * bd->block_size;
 
-    if (off + size > bd->size)
-        RAISE(VIC_SEEK_FAILED);
-
-    if (lseek(bd->fd, off, SEEK_SET) != off)
-        RAISE(VIC_SEEK_FAILED);
-
-    if (read(bd->fd, blocks, size) != (ssize_t)size)
-        RAISE(VIC_READ_FAILED);
+    CHECK(_bd_rw(bd, false, blkno, &iov, 1));
 
 done:
     return result;
@@ -299,8 +524,7 @@ static vic_result_t _bd_put(
 {
     vic_result_t result = VIC_OK;
     blockdev_t* bd = (blockdev_t*)bd_;
-    off_t off;
-    size_t size;
+    struct iovec iov;
 
     if (!_valid_blockdev(bd))
         RAISE(VIC_BAD_BLOCK_DEVICE);
@@ -308,20 +532,111 @@ static vic_result_t _bd_put(
     if (!blocks)
         RAISE(VIC_BAD_PARAMETER);
 
-    off = (blkno * bd->block_size) + bd->offset;;
-    size = nblocks * bd->block_size;
+    iov.iov_base = (void*)blocks;
+    iov.iov_len = nblocks * bd->block_size;
 
-    if (!(bd->flags & VIC_CREATE) && (off + size) > bd->size)
-        RAISE(VIC_SEEK_FAILED);
+    CHECK(_bd_rw(bd, true, blkno, &iov, 1));
 
-    if (lseek(bd->fd, off, SEEK_SET) != off)
-        RAISE(VIC_SEEK_FAILED);
+done:
+    return result;
+}
 
-    if (write(bd->fd, blocks, size) != (ssize_t)size)
-        RAISE(VIC_READ_FAILED);
+static vic_result_t _bd_getv(
+    vic_blockdev_t* bd_,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    return _bd_rw((blockdev_t*)bd_, false, blkno, iov, iovcnt);
+}
 
-    if ((bd->flags & VIC_CREATE) && (off + size) > bd->size)
-        bd->size = off + size;
+static vic_result_t _bd_putv(
+    vic_blockdev_t* bd_,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    return _bd_rw((blockdev_t*)bd_, true, blkno, iov, iovcnt);
+}
+
+static vic_result_t _write_zeros(blockdev_t* bd, off_t off, size_t size)
+{
+    vic_result_t result = VIC_OK;
+    const size_t chunk = size < WIPE_CHUNK_SIZE ? size : WIPE_CHUNK_SIZE;
+    void* zeros = NULL;
+
+    if (posix_memalign(&zeros, DIRECT_ALIGNMENT, chunk) != 0)
+        RAISE(VIC_OUT_OF_MEMORY);
+
+    memset(zeros, 0, chunk);
+
+    while (size)
+    {
+        struct iovec iov;
+
+        iov.iov_base = zeros;
+        iov.iov_len = size < chunk ? size : chunk;
+
+        CHECK(_rw_range(bd, true, off, iov.iov_len, &iov, 1));
+
+        off += iov.iov_len;
+        size -= iov.iov_len;
+    }
+
+done:
+
+    if (zeros)
+        free(zeros);
+
+    return result;
+}
+
+static vic_result_t _bd_wipe(
+    vic_blockdev_t* bd_,
+    uint64_t blkno,
+    size_t nblocks)
+{
+    vic_result_t result = VIC_OK;
+    blockdev_t* bd = (blockdev_t*)bd_;
+    const size_t size = nblocks * bd->block_size;
+    struct stat st;
+    off_t off;
+    bool zeroed = false;
+
+    if (!_valid_blockdev(bd))
+        RAISE(VIC_BAD_BLOCK_DEVICE);
+
+    CHECK(_get_io_range(bd, blkno, size, false, &off));
+
+    if (size == 0)
+        goto done;
+
+    if (fstat(bd->fd, &st) != 0)
+        RAISE(VIC_STAT_FAILED);
+
+    /* Let the device or the file system zero the range. Discarding the
+     * blocks is not enough as they are not guaranteed to read back as zeros,
+     * and device-mapper targets such as dm-integrity need the blocks to be
+     * written to initialize their metadata. The kernel falls back to writing
+     * zero pages itself if the device has no write-zeroes support. */
+    if (S_ISBLK(st.st_mode))
+    {
+        uint64_t range[2] = { (uint64_t)off, size };
+
+        zeroed = ioctl(bd->fd, BLKZEROOUT, range) == 0;
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+        zeroed = fallocate(bd->fd, FALLOC_FL_ZERO_RANGE, off, size) == 0;
+    }
+
+    if (!zeroed)
+        CHECK(_write_zeros(bd, off, size));
+
+    /* Make sure that the zeros reached the device, whichever way they were
+     * written */
+    if (fsync(bd->fd) != 0)
+        RAISE(VIC_WRITE_FAILED);
 
 done:
     return result;
@@ -430,11 +745,23 @@ vic_result_t vic_blockdev_open(
         RAISE(VIC_OUT_OF_MEMORY);
 
     bd->magic = MAGIC;
+    bd->fd = -1;
 
     if (vic_strlcpy(bd->path, path, PATH_MAX) >= PATH_MAX)
         RAISE(VIC_UNEXPECTED);
 
-    if ((bd->fd = open(path, open_flags, mode)) < 0)
+    if (flags & VIC_DIRECT)
+    {
+        /* Fall back to buffered I/O if O_DIRECT is not supported */
+        if ((bd->fd = open(path, open_flags | O_DIRECT, mode)) >= 0)
+            open_flags |= O_DIRECT;
+        else if (errno == EINVAL)
+            flags &= ~VIC_DIRECT;
+        else
+            RAISE(VIC_OPEN_FAILED);
+    }
+
+    if (bd->fd < 0 && (bd->fd = open(path, open_flags, mode)) < 0)
         RAISE(VIC_OPEN_FAILED);
 
     CHECK(_get_full_size(bd->fd, &bd->full_size));
@@ -457,6 +784,9 @@ vic_result_t vic_blockdev_open(
     bd->base.bd_set_block_size = _bd_set_block_size;
     bd->base.bd_same = _bd_same;
     bd->base.bd_close = _bd_close;
+    bd->base.bd_getv = _bd_getv;
+    bd->base.bd_putv = _bd_putv;
+    bd->base.bd_wipe = _bd_wipe;
 
     CHECK(_check_block_multiple(bd, block_size));
 
@@ -580,6 +910,56 @@ done:
     return result;
 }
 
+vic_result_t vic_blockdev_getv(
+    vic_blockdev_t* bd,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    vic_result_t result = VIC_OK;
+
+    if (!bd || !bd->bd_getv)
+        RAISE(VIC_BAD_PARAMETER);
+
+    CHECK(bd->bd_getv(bd, blkno, iov, iovcnt));
+
+done:
+    return result;
+}
+
+vic_result_t vic_blockdev_putv(
+    vic_blockdev_t* bd,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    vic_result_t result = VIC_OK;
+
+    if (!bd || !bd->bd_putv)
+        RAISE(VIC_BAD_PARAMETER);
+
+    CHECK(bd->bd_putv(bd, blkno, iov, iovcnt));
+
+done:
+    return result;
+}
+
+vic_result_t vic_blockdev_wipe(
+    vic_blockdev_t* bd,
+    uint64_t blkno,
+    size_t nblocks)
+{
+    vic_result_t result = VIC_OK;
+
+    if (!bd || !bd->bd_wipe)
+        RAISE(VIC_BAD_PARAMETER);
+
+    CHECK(bd->bd_wipe(bd, blkno, nblocks));
+
+done:
+    return result;
+}
+
 vic_result_t vic_blockdev_close(vic_blockdev_t* bd)
 {
     vic_result_t result = VIC_OK;
@@ -24,6 +24,7 @@
 static mbedtls_ctr_drbg_context _drbg;
 static mbedtls_entropy_context _entropy;
 static pthread_once_t _once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t _drbg_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void _seed_entropy_source(void)
 {
@@ -48,6 +49,7 @@ void vic_random(void* data, size_t size)
     size_t N = 256;
 
     pthread_once(&_once, _seed_entropy_source);
+    pthread_mutex_lock(&_drbg_lock);
 
     while (r > 0)
     {
@@ -62,6 +64,8 @@ void vic_random(void* data, size_t size)
         p += n;
         r -= n;
     }
+
+    pthread_mutex_unlock(&_drbg_lock);
 }
 
 int vic_pbkdf2(
@@ -1,5 +1,6 @@
 #include <libdevmapper.h>
 #include <limits.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <time.h>
@@ -16,6 +17,10 @@
 #include "trace.h"
 #include "uuid.h"
 
+/* libdevmapper keeps the control descriptor in global state that each call
+ * below releases when done, so device-mapper tasks may not overlap. */
+static pthread_mutex_t _dm_lock = PTHREAD_MUTEX_INITIALIZER;
+
 #define DM_UUID_LEN 129
 
 // Uncomment to enable debug tracing (stdout) for dm-ioctl() create targets.
@@ -79,6 +84,8 @@ vic_result_t vic_dm_create_crypt(
     uint32_t cookie = 0;
 #endif
 
+    pthread_mutex_lock(&_dm_lock);
+
     /* Reject invalid parameters */
     if (!name || !path || !uuid || !integrity || !cipher || !key || !key_bytes)
         RAISE(VIC_BAD_PARAMETER);
@@ -221,6 +228,8 @@ done:
 
     dm_lib_release();
 
+    pthread_mutex_unlock(&_dm_lock);
+
     return result;
 }
 
@@ -243,6 +252,8 @@ vic_result_t vic_dm_create_integrity(
     uint32_t cookie = 0;
 #endif
 
+    pthread_mutex_lock(&_dm_lock);
+
     /* Reject invalid parameters */
     if (!name || !path)
         RAISE(VIC_BAD_PARAMETER);
@@ -349,6 +360,8 @@ done:
 
     dm_lib_release();
 
+    pthread_mutex_unlock(&_dm_lock);
+
     return result;
 }
 
@@ -378,6 +391,8 @@ vic_result_t vic_dm_create_verity(
     size_t size;
     const char target[] = "verity";
 
+    pthread_mutex_lock(&_dm_lock);
+
     /* Reject invalid parameters */
     if (!dm_name || !data_dev || !hash_dev || !data_block_size ||
         !hash_block_size || !num_blocks || !hash_alg || !root_digest ||
@@ -484,6 +499,8 @@ done:
 
     dm_lib_release();
 
+    pthread_mutex_unlock(&_dm_lock);
+
     return result;
 }
 
@@ -497,6 +514,8 @@ vic_result_t vic_dm_remove(const char* name)
     uint32_t cookie = 0;
 #endif
 
+    pthread_mutex_lock(&_dm_lock);
+
     if (!name)
         RAISE(VIC_BAD_PARAMETER);
 
@@ -546,5 +565,7 @@ done:
 
     dm_lib_release();
 
+    pthread_mutex_unlock(&_dm_lock);
+
     return result;
 }
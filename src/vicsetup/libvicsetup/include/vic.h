@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <sys/uio.h>
 
 /*
 **==============================================================================
@@ -145,6 +146,23 @@ typedef struct _vic_blockdev
         bool* same);
 
     vic_result_t (*bd_close)(vic_blockdev_t* dev);
+
+    vic_result_t (*bd_getv)(
+        vic_blockdev_t* dev,
+        uint64_t blkno,
+        const struct iovec* iov,
+        size_t iovcnt);
+
+    vic_result_t (*bd_putv)(
+        vic_blockdev_t* dev,
+        uint64_t blkno,
+        const struct iovec* iov,
+        size_t iovcnt);
+
+    vic_result_t (*bd_wipe)(
+        vic_blockdev_t* dev,
+        uint64_t blkno,
+        size_t nblocks);
 }
 vic_blockdev_t;
 
@@ -153,6 +171,7 @@ vic_blockdev_t;
 #define VIC_RDWR   4
 #define VIC_CREATE 8
 #define VIC_TRUNC  16
+#define VIC_DIRECT 32 /* bypass the page cache if the file system supports it */
 
 vic_result_t vic_blockdev_open(
     const char* path,
@@ -204,6 +223,27 @@ vic_result_t vic_blockdev_put(
     const void* blocks,
     size_t nblocks);
 
+/* Read blocks into the iov buffers (total length is a block multiple) */
+vic_result_t vic_blockdev_getv(
+    vic_blockdev_t* dev,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt);
+
+/* Write blocks from the iov buffers (total length is a block multiple) */
+vic_result_t vic_blockdev_putv(
+    vic_blockdev_t* dev,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt);
+
+/* Zero out blocks, offloading to the device or file system if possible, and
+ * sync them to the device */
+vic_result_t vic_blockdev_wipe(
+    vic_blockdev_t* dev,
+    uint64_t blkno,
+    size_t nblocks);
+
 vic_result_t vic_blockdev_same(
     vic_blockdev_t* bd1,
     vic_blockdev_t* bd2,
@@ -337,6 +377,17 @@ vic_result_t vic_luks_open(
 
 vic_result_t vic_luks_close(const char* name);
 
+/* Open a read-only block device over a formatted LUKS2 device that copies the
+ * plaintext read from fd into the payload as its blocks are read in order.
+ * Blocks read back as the device's final (encrypted) contents. The device
+ * must stay open until the writer is closed. */
+vic_result_t vic_luks_open_payload_writer(
+    vic_blockdev_t* device,
+    const vic_key_t* master_key,
+    size_t master_key_bytes,
+    int fd,
+    vic_blockdev_t** writer);
+
 vic_result_t vic_verity_dump(vic_blockdev_t* hash_dev);
 
 vic_result_t vic_verity_format(
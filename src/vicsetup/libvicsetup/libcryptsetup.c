@@ -530,30 +530,23 @@ static int _crypt_load_verity(
     if (p->fec_device)
         ERAISE(ENOTSUP);
 
-    /* Handle the data device */
-    {
-        if (strcmp(p->data_device, cd->path) != 0)
-            ERAISE(EINVAL);
-
-        if (vic_blockdev_set_block_size(cd->bd, p->data_block_size) != VIC_OK)
-            ERAISE(EINVAL);
-
-        if (p->data_size)
-        {
-            const size_t size = p->data_size * p->data_block_size;
-
-            if (vic_blockdev_set_size(cd->bd, size) != VIC_OK)
-                ERAISE(EIO);
-        }
-    }
+    if (strcmp(p->data_device, cd->path) != 0)
+        ERAISE(EINVAL);
 
     /* Handle the hash device */
     {
         if (vic_blockdev_open(p->hash_device, VIC_RDONLY, 0, &hbd) != VIC_OK)
             ERAISE(ENOENT);
 
-        if (vic_blockdev_set_block_size(hbd, p->hash_block_size) != VIC_OK)
+        /* Block sizes of zero are read from the superblock, which fits into
+         * the smallest block size */
+        if (vic_blockdev_set_block_size(
+                hbd,
+                p->hash_block_size ? p->hash_block_size : VIC_SECTOR_SIZE) !=
+            VIC_OK)
+        {
             ERAISE(EINVAL);
+        }
 
         if (p->hash_area_offset)
         {
@@ -564,15 +557,37 @@ static int _crypt_load_verity(
         if (vic_verity_read_superblock(hbd, &sb) != VIC_OK)
             ERAISE(EIO);
 
-        if (sb.data_block_size != p->hash_block_size)
+        if (sb.data_block_size != sb.hash_block_size)
             ERAISE(ENOTSUP);
 
         if (p->hash_block_size && p->hash_block_size != sb.hash_block_size)
             ERAISE(EINVAL);
 
+        if (p->data_block_size && p->data_block_size != sb.data_block_size)
+            ERAISE(EINVAL);
+
+        if (vic_blockdev_set_block_size(hbd, sb.hash_block_size) != VIC_OK)
+            ERAISE(EINVAL);
+
         cd->verity.sb = sb;
     }
 
+    /* Handle the data device */
+    {
+        const size_t data_blocks = p->data_size ? p->data_size : sb.data_blocks;
+
+        if (vic_blockdev_set_block_size(cd->bd, sb.data_block_size) != VIC_OK)
+            ERAISE(EINVAL);
+
+        if (data_blocks)
+        {
+            const size_t size = data_blocks * sb.data_block_size;
+
+            if (vic_blockdev_set_size(cd->bd, size) != VIC_OK)
+                ERAISE(EIO);
+        }
+    }
+
     cd->hbd = hbd;
     hbd = NULL;
 
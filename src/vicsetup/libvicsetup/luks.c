@@ -530,6 +530,40 @@ done:
     return result;
 }
 
+vic_result_t vic_luks_open_payload_writer(
+    vic_blockdev_t* device,
+    const vic_key_t* master_key,
+    size_t master_key_bytes,
+    int fd,
+    vic_blockdev_t** writer)
+{
+    vic_result_t result = VIC_OK;
+    vic_luks_hdr_t hdr;
+
+    if (!_is_valid_device(device))
+        RAISE(VIC_BAD_PARAMETER);
+
+    if (vic_luks_read_hdr(device, &hdr) != 0)
+        RAISE(VIC_FAILED);
+
+    if (hdr.version == LUKS_VERSION_2)
+    {
+        CHECK(luks2_open_payload_writer(
+            device, master_key, master_key_bytes, fd, writer));
+    }
+    else if (hdr.version == LUKS_VERSION_1)
+    {
+        RAISE(VIC_UNSUPPORTED);
+    }
+    else
+    {
+        RAISE(VIC_BAD_VERSION);
+    }
+
+done:
+    return result;
+}
+
 
 vic_result_t vic_luks_add_key_by_master_key(
     vic_blockdev_t* device,
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <pthread.h>
 #include <json.h>
 
 #include "luks2.h"
@@ -1704,33 +1705,6 @@ done:
     return ret;
 }
 
-static int _write_binary_hdr(
-    vic_blockdev_t* dev,
-    const luks2_hdr_t* hdr,
-    bool primary)
-{
-    int ret = -1;
-    uint8_t blocks[sizeof(luks2_hdr_t)];
-    size_t nblocks = sizeof(blocks) / VIC_SECTOR_SIZE;
-    luks2_hdr_t buf;
-    size_t blkno = primary ? 0 : hdr->hdr_size / VIC_SECTOR_SIZE;
-
-    assert(sizeof(blocks) == sizeof(luks2_hdr_t));
-
-    buf = *hdr;
-    _fix_luks2_hdr_byte_order(&buf);
-    memset(blocks, 0, sizeof(blocks));
-    memcpy(blocks, &buf, sizeof(luks2_hdr_t));
-
-    if (vic_blockdev_put(dev, blkno, blocks, nblocks) != VIC_OK)
-        GOTO(done);
-
-    ret = 0;
-
-done:
-    return ret;
-}
-
 static int _read_json_area(
     vic_blockdev_t* dev,
     const luks2_hdr_t* hdr,
@@ -1751,18 +1725,27 @@ done:
     return ret;
 }
 
-static int _write_json_area(
+/* Write the binary header and the JSON area that follows it in one go */
+static int _write_hdr_area(
     vic_blockdev_t* dev,
     const luks2_hdr_t* hdr,
     const char* json_data,
     size_t json_size)
 {
     int ret = -1;
-    size_t blkno = (sizeof(luks2_hdr_t) + hdr->hdr_offset) / VIC_SECTOR_SIZE;
-    const void* blocks = json_data;
-    const size_t nblocks = json_size / VIC_SECTOR_SIZE;
+    const size_t blkno = hdr->hdr_offset / VIC_SECTOR_SIZE;
+    luks2_hdr_t buf;
+    struct iovec iov[2];
+
+    buf = *hdr;
+    _fix_luks2_hdr_byte_order(&buf);
+
+    iov[0].iov_base = &buf;
+    iov[0].iov_len = sizeof(buf);
+    iov[1].iov_base = (void*)json_data;
+    iov[1].iov_len = json_size;
 
-    if (vic_blockdev_put(dev, blkno, blocks, nblocks) != 0)
+    if (vic_blockdev_putv(dev, blkno, iov, VIC_COUNTOF(iov)) != VIC_OK)
         GOTO(done);
 
     ret = 0;
@@ -2309,176 +2292,335 @@ static const luks2_digest_t* _find_digest(
     return NULL;
 }
 
-static vic_result_t _find_key_by_pwd(
+/* Derive the keyslot key from the password, unlock the keyslot and check the
+ * resulting master key against its digest. Sets *match if it is correct. */
+static vic_result_t _try_keyslot(
     vic_blockdev_t* dev,
     luks2_ext_hdr_t* ext,
+    size_t index,
     const char* pwd,
     size_t pwd_size,
-    vic_key_t* key,
-    size_t* key_size,
-    size_t* index)
+    pthread_mutex_t* argon2_lock,
+    vic_key_t* mk,
+    bool* match)
 {
     vic_result_t result = VIC_OK;
-    bool found = false;
+    const luks2_keyslot_t* ks = &ext->keyslots[index];
     void* cipher = NULL;
     void* plain = NULL;
+    vic_key_t pbkdf2_key;
+    size_t size;
+    uint8_t mk_digest[LUKS2_DIGEST_SIZE];
+    size_t digest_size;
+    const luks2_digest_t* digest;
+    bool argon2;
 
-    if (index)
-        *index = (size_t)-1;
-
-    if (key)
-        memset(key, 0, sizeof(vic_key_t));
+    *match = false;
 
-    for (size_t i = 0; i < VIC_COUNTOF(ext->keyslots); i++)
-    {
-        luks2_keyslot_t* ks = &ext->keyslots[i];
-        vic_key_t pbkdf2_key;
-        size_t size;
-        vic_key_t mk;
-        uint8_t mk_digest[LUKS2_DIGEST_SIZE];
-        size_t digest_size;
-        const luks2_digest_t* digest;
+    if (strcmp(ks->type, "luks2") != 0)
+        RAISE(VIC_UNKNOWN_KEYSLOT_TYPE);
 
-        if (*ks->type == '\0')
-            continue;
+    /* Argon2 uses ks->kdf.cpus threads for its lanes already and its memory
+     * cost is per derivation, so only run one at a time */
+    argon2 = strncmp(ks->kdf.type, "argon2", 6) == 0;
 
-        if (strcmp(ks->type, "luks2") != 0)
-            RAISE(VIC_UNKNOWN_KEYSLOT_TYPE);
+    if (argon2 && argon2_lock)
+        pthread_mutex_lock(argon2_lock);
 
-        if (strcmp(ks->kdf.type, "pbkdf2") == 0)
+    if (strcmp(ks->kdf.type, "pbkdf2") == 0)
+    {
+        if (vic_pbkdf2(
+            pwd,
+            pwd_size,
+            ks->kdf.salt,
+            sizeof(ks->kdf.salt),
+            ks->kdf.iterations,
+            ks->kdf.hash,
+            &pbkdf2_key,
+            ks->area.key_size) != 0)
         {
-            if (vic_pbkdf2(
-                pwd,
-                pwd_size,
-                ks->kdf.salt,
-                sizeof(ks->kdf.salt),
-                ks->kdf.iterations,
-                ks->kdf.hash,
-                &pbkdf2_key,
-                ks->area.key_size) != 0)
-            {
-                RAISE(VIC_PBKDF2_FAILED);
-            }
+            RAISE(VIC_PBKDF2_FAILED);
         }
-        else if (strcmp(ks->kdf.type, "argon2i") == 0)
+    }
+    else if (strcmp(ks->kdf.type, "argon2i") == 0)
+    {
+        if (vic_argon2i(
+            pwd,
+            pwd_size,
+            ks->kdf.salt,
+            sizeof(ks->kdf.salt),
+            ks->kdf.time,
+            ks->kdf.memory,
+            ks->kdf.cpus,
+            &pbkdf2_key,
+            ks->area.key_size) != 0)
         {
-            if (vic_argon2i(
-                pwd,
-                pwd_size,
-                ks->kdf.salt,
-                sizeof(ks->kdf.salt),
-                ks->kdf.time,
-                ks->kdf.memory,
-                ks->kdf.cpus,
-                &pbkdf2_key,
-                ks->area.key_size) != 0)
-            {
-                RAISE(VIC_ARGON2I_FAILED);
-            }
+            RAISE(VIC_ARGON2I_FAILED);
         }
-        else if (strcmp(ks->kdf.type, "argon2id") == 0)
+    }
+    else if (strcmp(ks->kdf.type, "argon2id") == 0)
+    {
+        if (vic_argon2id(
+            pwd,
+            pwd_size,
+            ks->kdf.salt,
+            sizeof(ks->kdf.salt),
+            ks->kdf.time,
+            ks->kdf.memory,
+            ks->kdf.cpus,
+            &pbkdf2_key,
+            ks->area.key_size) != 0)
         {
-            if (vic_argon2id(
-                pwd,
-                pwd_size,
-                ks->kdf.salt,
-                sizeof(ks->kdf.salt),
-                ks->kdf.time,
-                ks->kdf.memory,
-                ks->kdf.cpus,
-                &pbkdf2_key,
-                ks->area.key_size) != 0)
-            {
-                RAISE(VIC_ARGON2I_FAILED);
-            }
+            RAISE(VIC_ARGON2I_FAILED);
         }
+    }
+    else
+    {
+        RAISE(VIC_UNKNOWN_KDF_TYPE);
+    }
 
-        size = ks->area.size;
+    if (argon2 && argon2_lock)
+    {
+        pthread_mutex_unlock(argon2_lock);
+        argon2 = false;
+    }
 
-        if (!(cipher = calloc(size, 1)))
-            RAISE(VIC_OUT_OF_MEMORY);
+    size = ks->area.size;
 
-        if (_read_key_material(
-            dev,
-            ks->area.offset,
-            ks->area.size,
-            cipher) != 0)
-        {
-            RAISE(VIC_KEY_MATERIAL_READ_FAILED);
-        }
+    if (!(cipher = calloc(size, 1)))
+        RAISE(VIC_OUT_OF_MEMORY);
 
-        if (!(plain = calloc(size, 1)))
-            RAISE(VIC_OUT_OF_MEMORY);
+    if (_read_key_material(
+        dev,
+        ks->area.offset,
+        ks->area.size,
+        cipher) != 0)
+    {
+        RAISE(VIC_KEY_MATERIAL_READ_FAILED);
+    }
 
-        if (_decrypt(
-            ks->area.encryption,
-            ks->area.key_size,
-            &pbkdf2_key,
-            cipher,
-            plain,
-            size,
-            0) != 0)
-        {
-            RAISE(VIC_DECRYPT_FAILED);
-        }
+    if (!(plain = calloc(size, 1)))
+        RAISE(VIC_OUT_OF_MEMORY);
+
+    if (_decrypt(
+        ks->area.encryption,
+        ks->area.key_size,
+        &pbkdf2_key,
+        cipher,
+        plain,
+        size,
+        0) != 0)
+    {
+        RAISE(VIC_DECRYPT_FAILED);
+    }
+
+    if (vic_afmerge(
+        ks->key_size,
+        ks->af.stripes,
+        ks->af.hash,
+        plain,
+        mk) != 0)
+    {
+        RAISE(VIC_AFMERGE_FAILED);
+    }
+
+    if (!(digest = _find_digest(ext, index)))
+        RAISE(VIC_DIGEST_NOT_FOUND);
 
-        if (vic_afmerge(
+    if ((digest_size = vic_hash_size(digest->hash)) == (size_t)-1)
+        RAISE(VIC_UNEXPECTED);
+
+    if (strcmp(digest->type, "pbkdf2") == 0)
+    {
+        if (vic_pbkdf2(
+            mk,
             ks->key_size,
-            ks->af.stripes,
-            ks->af.hash,
-            plain,
-            &mk) != 0)
+            digest->salt,
+            sizeof(digest->salt),
+            digest->iterations,
+            digest->hash,
+            mk_digest,
+            digest_size) != 0)
         {
-            RAISE(VIC_AFMERGE_FAILED);
+            RAISE(VIC_PBKDF2_FAILED);
         }
+    }
+    else
+    {
+        RAISE(VIC_UNSUPPORTED);
+    }
 
-        if (!(digest = _find_digest(ext, i)))
-            RAISE(VIC_DIGEST_NOT_FOUND);
+    if (memcmp(digest->digest, mk_digest, digest_size) == 0)
+        *match = true;
 
-        if ((digest_size = vic_hash_size(digest->hash)) == (size_t)-1)
-            RAISE(VIC_UNEXPECTED);
+done:
 
-        if (strcmp(digest->type, "pbkdf2") == 0)
-        {
-            if (vic_pbkdf2(
-                &mk,
-                ks->key_size,
-                digest->salt,
-                sizeof(digest->salt),
-                digest->iterations,
-                digest->hash,
-                mk_digest,
-                digest_size) != 0)
-            {
-                RAISE(VIC_PBKDF2_FAILED);
-            }
-        }
-        else
+    if (argon2 && argon2_lock)
+        pthread_mutex_unlock(argon2_lock);
+
+    if (cipher)
+        free(cipher);
+
+    if (plain)
+        free(plain);
+
+    return result;
+}
+
+/* Maximum number of keyslots tried concurrently by _find_key_by_pwd() */
+#define MAX_KEYSLOT_THREADS 8
+
+typedef struct _keyslot_trials
+{
+    pthread_mutex_t lock;
+    pthread_mutex_t argon2_lock;
+    vic_blockdev_t* dev;
+    luks2_ext_hdr_t* ext;
+    const char* pwd;
+    size_t pwd_size;
+
+    /* Indices of the keyslots in use, in increasing order */
+    size_t slots[LUKS2_NUM_KEYSLOTS];
+    size_t nslots;
+
+    /* Next entry of slots[] to try */
+    size_t next;
+
+    /* Lowest entry of slots[] that matched or failed so far */
+    size_t decided;
+
+    /* Outcome of the trial of each entry of slots[] */
+    vic_result_t results[LUKS2_NUM_KEYSLOTS];
+    bool matches[LUKS2_NUM_KEYSLOTS];
+    vic_key_t keys[LUKS2_NUM_KEYSLOTS];
+}
+keyslot_trials_t;
+
+static void* _keyslot_trial_thread(void* arg)
+{
+    keyslot_trials_t* t = (keyslot_trials_t*)arg;
+
+    for (;;)
+    {
+        size_t i;
+        vic_result_t r;
+        bool match;
+
+        /* Stop once a lower keyslot decided the outcome */
+        pthread_mutex_lock(&t->lock);
+
+        if (t->next == t->nslots || t->next > t->decided)
         {
-            RAISE(VIC_UNSUPPORTED);
+            pthread_mutex_unlock(&t->lock);
+            break;
         }
 
-        if (memcmp(digest->digest, mk_digest, digest_size) == 0)
-        {
-            found = true;
+        i = t->next++;
+        pthread_mutex_unlock(&t->lock);
 
-            if (key)
-                memcpy(key, &mk, ks->key_size);
+        r = _try_keyslot(
+            t->dev,
+            t->ext,
+            t->slots[i],
+            t->pwd,
+            t->pwd_size,
+            &t->argon2_lock,
+            &t->keys[i],
+            &match);
 
-            if (key_size)
-                *key_size = ks->key_size;
+        pthread_mutex_lock(&t->lock);
 
-            if (index)
-                *index = i;
+        t->results[i] = r;
+        t->matches[i] = match;
+
+        if ((r != VIC_OK || match) && i < t->decided)
+            t->decided = i;
+
+        pthread_mutex_unlock(&t->lock);
+    }
+
+    return NULL;
+}
+
+/*
+ * Find the keyslot unlocked by the password. The keyslots are tried
+ * concurrently, each trial being a full key derivation. The outcome is the
+ * same as when trying them in order: the lowest keyslot that either matches
+ * or fails to be tried decides the result.
+ */
+static vic_result_t _find_key_by_pwd(
+    vic_blockdev_t* dev,
+    luks2_ext_hdr_t* ext,
+    const char* pwd,
+    size_t pwd_size,
+    vic_key_t* key,
+    size_t* key_size,
+    size_t* index)
+{
+    vic_result_t result = VIC_OK;
+    keyslot_trials_t* t = NULL;
+    pthread_t threads[MAX_KEYSLOT_THREADS];
+    size_t nthreads = 0;
+    bool found = false;
+
+    if (index)
+        *index = (size_t)-1;
+
+    if (key)
+        memset(key, 0, sizeof(vic_key_t));
+
+    if (!(t = calloc(1, sizeof(keyslot_trials_t))))
+        RAISE(VIC_OUT_OF_MEMORY);
 
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_mutex_init(&t->argon2_lock, NULL);
+    t->dev = dev;
+    t->ext = ext;
+    t->pwd = pwd;
+    t->pwd_size = pwd_size;
+
+    for (size_t i = 0; i < VIC_COUNTOF(ext->keyslots); i++)
+    {
+        if (*ext->keyslots[i].type != '\0')
+            t->slots[t->nslots++] = i;
+    }
+
+    t->decided = t->nslots;
+
+    /* The calling thread takes part in the trials */
+    while (nthreads + 1 < t->nslots && nthreads + 1 < MAX_KEYSLOT_THREADS)
+    {
+        if (pthread_create(
+            &threads[nthreads], NULL, _keyslot_trial_thread, t) != 0)
+        {
             break;
         }
 
-        free(cipher);
-        cipher = NULL;
+        nthreads++;
+    }
 
-        free(plain);
-        plain = NULL;
+    _keyslot_trial_thread(t);
+
+    for (size_t i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    if (t->decided < t->nslots)
+    {
+        const size_t i = t->decided;
+        const luks2_keyslot_t* ks = &ext->keyslots[t->slots[i]];
+
+        CHECK(t->results[i]);
+
+        found = true;
+
+        if (key)
+            memcpy(key, &t->keys[i], ks->key_size);
+
+        if (key_size)
+            *key_size = ks->key_size;
+
+        if (index)
+            *index = t->slots[i];
     }
 
     if (!found)
@@ -2486,11 +2628,13 @@ static vic_result_t _find_key_by_pwd(
 
 done:
 
-    if (cipher)
-        free(cipher);
-
-    if (plain)
-        free(plain);
+    if (t)
+    {
+        pthread_mutex_destroy(&t->argon2_lock);
+        pthread_mutex_destroy(&t->lock);
+        memset(t->keys, 0, sizeof(t->keys));
+        free(t);
+    }
 
     return result;
 }
@@ -3116,61 +3260,26 @@ done:
 static vic_result_t _wipe_device(const char* path)
 {
     vic_result_t result = VIC_OK;
-    size_t size;
-    int fd = -1;
-    void* blk = NULL;
-    const size_t blksz = 4096;
+    vic_blockdev_t* dev = NULL;
     size_t nblks;
 
     if (!path)
         RAISE(VIC_BAD_PARAMETER);
 
     /* Open the device to wiped */
-    if ((fd = open(path, O_RDWR)) < 0)
-        RAISE(VIC_FAILED);
-
-    /* Allocate a zero-filled aligned block */
-    {
-        if (posix_memalign(&blk, blksz, blksz) != 0)
-            goto done;
-
-        memset(blk, 0, blksz);
-    }
-
-    /* Get the device size in bytes */
-    if ((size = vic_blockdev_get_size_from_path(path)) == (size_t)-1)
-        RAISE(VIC_FAILED);
+    CHECK(vic_blockdev_open(path, VIC_RDWR, VIC_SECTOR_SIZE, &dev));
 
     /* Determine the number of blocks */
-    nblks = size / blksz;
+    CHECK(vic_blockdev_get_num_blocks(dev, &nblks));
 
-    /* Zero out all the blocks */
-    for (size_t i = 0; i < nblks; i++)
-    {
-        ssize_t n;
-        size_t offset = i * blksz;
-
-        if (lseek(fd, offset, SEEK_SET) != (ssize_t)offset)
-            RAISE(VIC_FAILED);
-
-        if ((n = write(fd, blk, blksz)) != (ssize_t)blksz)
-            RAISE(VIC_WRITE_FAILED);
-    }
-
-    /* Fail if any bytes remain */
-    if (size % blksz)
-        RAISE(VIC_UNEXPECTED);
-
-    /* Sync this device, else dm-remove will fail with device busy */
-    fsync(fd);
+    /* Zero out all the blocks (this also syncs the device, else dm-remove
+     * will fail with device busy) */
+    CHECK(vic_blockdev_wipe(dev, 0, nblks));
 
 done:
 
-    if (fd >= 0)
-        close(fd);
-
-    if (blk)
-        free(blk);
+    if (dev)
+        vic_blockdev_close(dev);
 
     return result;
 }
@@ -3262,12 +3371,8 @@ vic_result_t luks2_format(
             RAISE(VIC_DEVICE_TOO_SMALL);
     }
 
-    /* Write the primary binary header */
-    if (_write_binary_hdr(dev, &ext->phdr, true) != 0)
-        RAISE(VIC_FAILED);
-
-    /* Write the primary JSON area */
-    if (_write_json_area(
+    /* Write the primary binary header and JSON area */
+    if (_write_hdr_area(
         dev,
         &ext->phdr,
         ext->json_data,
@@ -3276,7 +3381,7 @@ vic_result_t luks2_format(
         RAISE(VIC_FAILED);
     }
 
-    /* Initialize and write the secondary binary header */
+    /* Initialize the secondary binary header */
     {
         /* Copy the primary header onto the secondary header */
         memcpy(&ext->shdr, &ext->phdr, sizeof(ext->shdr));
@@ -3305,14 +3410,10 @@ vic_result_t luks2_format(
             memset(ext->shdr.csum, 0, sizeof(ext->shdr.csum));
             memcpy(ext->shdr.csum, hash.u.buf, hash_size);
         }
-
-        /* Write the secondary binary header */
-        if (_write_binary_hdr(dev, &ext->shdr, false) != 0)
-            RAISE(VIC_FAILED);
     }
 
-    /* Write the secondary JSON area (identical to the first) */
-    if (_write_json_area(
+    /* Write the secondary binary header and JSON area */
+    if (_write_hdr_area(
         dev,
         &ext->shdr,
         ext->json_data,
@@ -3355,7 +3456,8 @@ vic_result_t luks2_format(
 
         snprintf(dmpath, sizeof(dmpath), "/dev/mapper/%s", name);
 
-        /* ATTN-B: This wipes the whole file (is there a cheaper way?) */
+        /* Zero the whole device through dm-integrity to initialize the
+         * integrity tags (offloaded to the kernel where possible) */
         CHECK(_wipe_device(dmpath));
         CHECK(vic_dm_remove(name));
         CHECK(vic_dm_remove(name_dif));
@@ -3426,14 +3528,10 @@ static vic_result_t _write_hdr(vic_blockdev_t* dev, luks2_ext_hdr_t* ext)
             memset(ext->phdr.csum, 0, sizeof(ext->phdr.csum));
             memcpy(ext->phdr.csum, hash.u.buf, hash_size);
         }
-
-        /* Write the primary binary header */
-        if (_write_binary_hdr(dev, &ext->phdr, true) != 0)
-            RAISE(VIC_FAILED);
     }
 
-    /* Write the primary JSON area */
-    if (_write_json_area(
+    /* Write the primary binary header and JSON area */
+    if (_write_hdr_area(
         dev,
         &ext->phdr,
         ext->json_data,
@@ -3465,14 +3563,10 @@ static vic_result_t _write_hdr(vic_blockdev_t* dev, luks2_ext_hdr_t* ext)
             memset(ext->shdr.csum, 0, sizeof(ext->shdr.csum));
             memcpy(ext->shdr.csum, hash.u.buf, hash_size);
         }
-
-        /* Write the secondary binary header */
-        if (_write_binary_hdr(dev, &ext->shdr, false) != 0)
-            RAISE(VIC_FAILED);
     }
 
-    /* Write the secondary JSON area (identical to the first) */
-    if (_write_json_area(
+    /* Write the secondary binary header and JSON area */
+    if (_write_hdr_area(
         dev,
         &ext->shdr,
         ext->json_data,
@@ -3980,3 +4074,345 @@ done:
 
     return result;
 }
+
+/*
+**==============================================================================
+**
+** Payload writer:
+**
+** A read-only block device that fills the payload of a freshly formatted
+** LUKS2 device from a plaintext stream. Reading a block returns what the
+** device holds once the block is written: blocks in front of the payload are
+** read from the device, payload blocks are read from the stream, encrypted as
+** dm-crypt would encrypt them, written to the device and returned. Blocks must
+** be read in order as the stream cannot seek. Reading the whole device thus
+** copies the stream into the payload, and a consumer such as
+** vic_verity_format() sees the ciphertext in the same pass.
+**
+**==============================================================================
+*/
+
+typedef struct _payload_writer
+{
+    vic_blockdev_t base;
+    vic_blockdev_t* dev;
+    int fd;
+    bool eof;
+    vic_key_t key;
+    size_t key_bytes;
+    char encryption[LUKS2_ENCRYPTION_SIZE];
+    size_t payload_offset;
+    size_t size;
+    size_t block_size;
+    size_t next; /* byte offset of the next block to be read */
+}
+payload_writer_t;
+
+static vic_result_t _pw_unsupported(vic_blockdev_t* bd)
+{
+    (void)bd;
+    return VIC_UNSUPPORTED;
+}
+
+static vic_result_t _pw_set_size_or_offset(vic_blockdev_t* bd, size_t n)
+{
+    (void)bd;
+    (void)n;
+    return VIC_UNSUPPORTED;
+}
+
+static vic_result_t _pw_get_offset(vic_blockdev_t* bd, size_t* offset)
+{
+    (void)bd;
+    *offset = 0;
+    return VIC_OK;
+}
+
+static vic_result_t _pw_get_path(const vic_blockdev_t* bd, char path[PATH_MAX])
+{
+    const payload_writer_t* pw = (const payload_writer_t*)bd;
+    return vic_blockdev_get_path(pw->dev, path);
+}
+
+static vic_result_t _pw_get_block_size(
+    const vic_blockdev_t* bd,
+    size_t* block_size)
+{
+    *block_size = ((const payload_writer_t*)bd)->block_size;
+    return VIC_OK;
+}
+
+static vic_result_t _pw_set_block_size(vic_blockdev_t* bd, size_t block_size)
+{
+    vic_result_t result = VIC_OK;
+    payload_writer_t* pw = (payload_writer_t*)bd;
+
+    /* The payload must start and end on a block boundary */
+    if (block_size < VIC_SECTOR_SIZE || (block_size & (block_size - 1)) ||
+        pw->payload_offset % block_size || pw->size % block_size)
+    {
+        RAISE(VIC_BAD_BLOCK_SIZE);
+    }
+
+    /* Reads must remain in order */
+    if (pw->next % block_size)
+        RAISE(VIC_BAD_BLOCK_SIZE);
+
+    pw->block_size = block_size;
+
+done:
+    return result;
+}
+
+static vic_result_t _pw_get_size(const vic_blockdev_t* bd, size_t* size)
+{
+    *size = ((const payload_writer_t*)bd)->size;
+    return VIC_OK;
+}
+
+static vic_result_t _pw_get_num_blocks(
+    const vic_blockdev_t* bd,
+    size_t* num_blocks)
+{
+    const payload_writer_t* pw = (const payload_writer_t*)bd;
+    *num_blocks = pw->size / pw->block_size;
+    return VIC_OK;
+}
+
+/* Fill the buffer from the stream, zero-filling it past the end */
+static vic_result_t _pw_read_stream(
+    payload_writer_t* pw,
+    uint8_t* buf,
+    size_t size)
+{
+    vic_result_t result = VIC_OK;
+    size_t pos = 0;
+
+    while (!pw->eof && pos < size)
+    {
+        ssize_t n = read(pw->fd, buf + pos, size - pos);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            RAISE(VIC_READ_FAILED);
+        }
+
+        if (n == 0)
+            pw->eof = true;
+
+        pos += (size_t)n;
+    }
+
+    memset(buf + pos, 0, size - pos);
+
+done:
+    return result;
+}
+
+static vic_result_t _pw_get(
+    vic_blockdev_t* bd,
+    uint64_t blkno,
+    void* blocks,
+    size_t nblocks)
+{
+    vic_result_t result = VIC_OK;
+    payload_writer_t* pw = (payload_writer_t*)bd;
+    uint8_t* buf = (uint8_t*)blocks;
+    const size_t off = blkno * pw->block_size;
+    size_t size = nblocks * pw->block_size;
+
+    if (off != pw->next)
+        RAISE(VIC_UNSUPPORTED);
+
+    if (off + size > pw->size)
+        RAISE(VIC_OUT_OF_BOUNDS);
+
+    pw->next += size;
+
+    /* The header area was written by luks2_format() */
+    if (off < pw->payload_offset)
+    {
+        size_t n = pw->payload_offset - off;
+
+        if (n > size)
+            n = size;
+
+        CHECK(vic_blockdev_get(
+            pw->dev, off / VIC_SECTOR_SIZE, buf, n / VIC_SECTOR_SIZE));
+
+        buf += n;
+        size -= n;
+    }
+
+    if (size)
+    {
+        const size_t pos = pw->next - size;
+        const uint64_t sector = (pos - pw->payload_offset) / VIC_SECTOR_SIZE;
+
+        CHECK(_pw_read_stream(pw, buf, size));
+
+        /* The IV is the sector number relative to the payload (iv_tweak 0) */
+        if (_encrypt(
+            pw->encryption,
+            pw->key_bytes,
+            &pw->key,
+            buf,
+            buf,
+            size,
+            sector) != 0)
+        {
+            RAISE(VIC_ENCRYPT_FAILED);
+        }
+
+        CHECK(vic_blockdev_put(
+            pw->dev, pos / VIC_SECTOR_SIZE, buf, size / VIC_SECTOR_SIZE));
+    }
+
+done:
+    return result;
+}
+
+static vic_result_t _pw_put(
+    vic_blockdev_t* bd,
+    uint64_t blkno,
+    const void* blocks,
+    size_t nblocks)
+{
+    (void)bd;
+    (void)blkno;
+    (void)blocks;
+    (void)nblocks;
+    return VIC_UNSUPPORTED;
+}
+
+static vic_result_t _pw_iov_unsupported(
+    vic_blockdev_t* bd,
+    uint64_t blkno,
+    const struct iovec* iov,
+    size_t iovcnt)
+{
+    (void)bd;
+    (void)blkno;
+    (void)iov;
+    (void)iovcnt;
+    return VIC_UNSUPPORTED;
+}
+
+static vic_result_t _pw_wipe(vic_blockdev_t* bd, uint64_t blkno, size_t n)
+{
+    (void)bd;
+    (void)blkno;
+    (void)n;
+    return VIC_UNSUPPORTED;
+}
+
+static vic_result_t _pw_same(
+    vic_blockdev_t* bd1,
+    vic_blockdev_t* bd2,
+    bool* same)
+{
+    *same = (bd1 == bd2);
+    return VIC_OK;
+}
+
+static vic_result_t _pw_close(vic_blockdev_t* bd)
+{
+    payload_writer_t* pw = (payload_writer_t*)bd;
+
+    memset(&pw->key, 0, sizeof(pw->key));
+    free(pw);
+
+    return VIC_OK;
+}
+
+vic_result_t luks2_open_payload_writer(
+    vic_blockdev_t* dev,
+    const vic_key_t* master_key,
+    size_t master_key_bytes,
+    int fd,
+    vic_blockdev_t** writer_out)
+{
+    vic_result_t result = VIC_OK;
+    luks2_hdr_t* hdr = NULL;
+    luks2_ext_hdr_t* ext;
+    payload_writer_t* pw = NULL;
+    size_t nblocks;
+
+    if (writer_out)
+        *writer_out = NULL;
+
+    if (!_is_valid_device(dev) || !master_key || !master_key_bytes ||
+        master_key_bytes > sizeof(vic_key_t) || fd < 0 || !writer_out)
+    {
+        RAISE(VIC_BAD_PARAMETER);
+    }
+
+    if (luks2_read_hdr(dev, &hdr) != 0)
+        RAISE(VIC_HEADER_READ_FAILED);
+
+    ext = (luks2_ext_hdr_t*)hdr;
+
+    /* Integrity tags are interleaved with the payload by dm-integrity */
+    if (*_get_integrity_type(ext))
+        RAISE(VIC_UNSUPPORTED);
+
+    if (ext->segments[0].sector_size != VIC_SECTOR_SIZE ||
+        ext->segments[0].iv_tweak != 0)
+    {
+        RAISE(VIC_UNSUPPORTED);
+    }
+
+    if (!_get_cipher_info(_get_encryption(ext), master_key_bytes))
+        RAISE(VIC_UNSUPPORTED_CIPHER);
+
+    CHECK(vic_blockdev_get_num_blocks(dev, &nblocks));
+
+    if (!(pw = calloc(1, sizeof(payload_writer_t))))
+        RAISE(VIC_OUT_OF_MEMORY);
+
+    pw->base.bd_partial_close = _pw_unsupported;
+    pw->base.bd_reopen = _pw_unsupported;
+    pw->base.bd_set_size = _pw_set_size_or_offset;
+    pw->base.bd_set_offset = _pw_set_size_or_offset;
+    pw->base.bd_get_offset = _pw_get_offset;
+    pw->base.bd_get_path = _pw_get_path;
+    pw->base.bd_get_block_size = _pw_get_block_size;
+    pw->base.bd_set_block_size = _pw_set_block_size;
+    pw->base.bd_get_size = _pw_get_size;
+    pw->base.bd_get_num_blocks = _pw_get_num_blocks;
+    pw->base.bd_get = _pw_get;
+    pw->base.bd_put = _pw_put;
+    pw->base.bd_same = _pw_same;
+    pw->base.bd_close = _pw_close;
+    pw->base.bd_getv = _pw_iov_unsupported;
+    pw->base.bd_putv = _pw_iov_unsupported;
+    pw->base.bd_wipe = _pw_wipe;
+
+    pw->dev = dev;
+    pw->fd = fd;
+    memcpy(&pw->key, master_key, master_key_bytes);
+    pw->key_bytes = master_key_bytes;
+    vic_strlcpy(pw->encryption, _get_encryption(ext), sizeof(pw->encryption));
+    pw->payload_offset = ext->segments[0].offset;
+    pw->size = nblocks * VIC_SECTOR_SIZE;
+    pw->block_size = VIC_SECTOR_SIZE;
+
+    if (pw->payload_offset >= pw->size)
+        RAISE(VIC_DEVICE_TOO_SMALL);
+
+    *writer_out = &pw->base;
+    pw = NULL;
+
+done:
+
+    if (pw)
+        _pw_close(&pw->base);
+
+    if (hdr)
+        free(hdr);
+
+    return result;
+}
@@ -239,4 +239,11 @@ vic_result_t luks2_open_by_passphrase(
     const char* pwd,
     size_t pwd_size);
 
+vic_result_t luks2_open_payload_writer(
+    vic_blockdev_t* dev,
+    const vic_key_t* master_key,
+    size_t master_key_bytes,
+    int fd,
+    vic_blockdev_t** writer);
+
 #endif /* _VIC_LUKS2_H */
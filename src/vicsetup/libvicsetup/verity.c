@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "vic.h"
 #include "uuid.h"
@@ -23,6 +24,12 @@
 #define MAX_BLKSZ 4096
 #define DEFAULT_BLKSZ 4096
 
+/* Data read from the data device per step of vic_verity_format() */
+#define FORMAT_CHUNK_SIZE (16 * 1024 * 1024)
+
+/* Maximum number of threads hashing data blocks in vic_verity_format() */
+#define FORMAT_MAX_THREADS 16
+
 void vic_verity_dump_sb(vic_verity_sb_t* sb)
 {
     if (sb)
@@ -43,6 +50,246 @@ void vic_verity_dump_sb(vic_verity_sb_t* sb)
     }
 }
 
+/*
+**==============================================================================
+**
+** Leaf hashing for vic_verity_format():
+**
+** The data device is read in chunks of FORMAT_CHUNK_SIZE bytes (rounded down
+** to whole leaf nodes). While the workers hash one chunk, the calling thread
+** reads the next chunk and writes the leaf nodes of the previous one, so that
+** each block of the hash device is written exactly once. The workers also
+** hash every leaf node they fill, which yields the first interior level
+** without reading the leaf nodes back.
+**
+**==============================================================================
+*/
+
+typedef struct _format_pool format_pool_t;
+
+typedef struct _format_worker
+{
+    format_pool_t* pool;
+    size_t index;
+    pthread_t thread;
+}
+format_worker_t;
+
+struct _format_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finish;
+    format_worker_t workers[FORMAT_MAX_THREADS];
+    size_t nworkers;
+    uint64_t generation;
+    size_t pending;
+    bool exit;
+
+    /* Parameters of the tree */
+    vic_hash_type_t htype;
+    const uint8_t* salt;
+    size_t salt_size;
+    size_t blksz;
+    size_t hsize;
+    size_t digests_per_blk;
+
+    /* First interior level (NULL if the tree has a single leaf node) */
+    uint8_t* level1;
+
+    /* The current chunk */
+    const uint8_t* data;
+    size_t nblks;
+    uint8_t* leaves;
+    size_t first_leaf;
+    bool failed;
+};
+
+/* Hash the leaf nodes [begin, end) of the current chunk */
+static bool _hash_leaves(format_pool_t* pool, size_t begin, size_t end)
+{
+    const size_t blksz = pool->blksz;
+    const size_t hsize = pool->hsize;
+    const size_t dpb = pool->digests_per_blk;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        uint8_t* node = pool->leaves + i * blksz;
+        size_t first = i * dpb;
+        size_t last = first + dpb;
+
+        if (last > pool->nblks)
+            last = pool->nblks;
+
+        memset(node, 0, blksz);
+
+        for (size_t j = first; j < last; j++)
+        {
+            vic_hash_t h;
+            const uint8_t* blk = pool->data + j * blksz;
+
+            if (vic_hash2(pool->htype, pool->salt, pool->salt_size,
+                blk, blksz, &h) != 0)
+            {
+                return false;
+            }
+
+            memcpy(node + (j - first) * hsize, h.u.buf, hsize);
+        }
+
+        if (pool->level1)
+        {
+            const size_t leaf = pool->first_leaf + i;
+            uint8_t* parent = pool->level1 + (leaf / dpb) * blksz;
+            vic_hash_t h;
+
+            if (vic_hash2(pool->htype, pool->salt, pool->salt_size,
+                node, blksz, &h) != 0)
+            {
+                return false;
+            }
+
+            memcpy(parent + (leaf % dpb) * hsize, h.u.buf, hsize);
+        }
+    }
+
+    return true;
+}
+
+static void* _format_worker(void* arg)
+{
+    format_worker_t* worker = (format_worker_t*)arg;
+    format_pool_t* pool = worker->pool;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;)
+    {
+        while (!pool->exit && pool->generation == generation)
+            pthread_cond_wait(&pool->start, &pool->lock);
+
+        if (pool->exit)
+            break;
+
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        /* Each worker takes a contiguous range of leaf nodes */
+        {
+            const size_t nnodes =
+                vic_round_up(pool->nblks, pool->digests_per_blk) /
+                pool->digests_per_blk;
+            const size_t begin = nnodes * worker->index / pool->nworkers;
+            const size_t end = nnodes * (worker->index + 1) / pool->nworkers;
+            const bool ok = _hash_leaves(pool, begin, end);
+
+            pthread_mutex_lock(&pool->lock);
+
+            if (!ok)
+                pool->failed = true;
+        }
+
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->finish);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static size_t _format_num_workers(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+        return 1;
+
+    if (n > FORMAT_MAX_THREADS)
+        return FORMAT_MAX_THREADS;
+
+    return (size_t)n;
+}
+
+static vic_result_t _format_pool_start(format_pool_t* pool)
+{
+    vic_result_t result = VIC_OK;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finish, NULL);
+
+    for (size_t i = 0; i < _format_num_workers(); i++)
+    {
+        format_worker_t* worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->index = i;
+
+        if (pthread_create(&worker->thread, NULL, _format_worker, worker) != 0)
+            break;
+
+        pool->nworkers++;
+    }
+
+    if (pool->nworkers == 0)
+        RAISE(VIC_FAILED);
+
+done:
+    return result;
+}
+
+static void _format_pool_stop(format_pool_t* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->exit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->nworkers; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_cond_destroy(&pool->finish);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+/* Start hashing a chunk of nblks data blocks */
+static void _format_pool_submit(
+    format_pool_t* pool,
+    const uint8_t* data,
+    size_t nblks,
+    uint8_t* leaves,
+    size_t first_leaf)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->data = data;
+    pool->nblks = nblks;
+    pool->leaves = leaves;
+    pool->first_leaf = first_leaf;
+    pool->pending = pool->nworkers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Wait for the submitted chunk, returns false if hashing failed */
+static bool _format_pool_wait(format_pool_t* pool)
+{
+    bool ok;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->pending)
+        pthread_cond_wait(&pool->finish, &pool->lock);
+
+    ok = !pool->failed;
+    pthread_mutex_unlock(&pool->lock);
+
+    return ok;
+}
+
 vic_result_t vic_verity_format(
     vic_blockdev_t* data_dev,
     vic_blockdev_t* hash_dev,
@@ -70,6 +317,13 @@ vic_result_t vic_verity_format(
     vic_hash_type_t htype;
     const size_t min_data_file_size = blksz * 2;
     uint8_t last_node[blksz];
+    format_pool_t pool;
+    bool pool_started = false;
+    uint8_t* data[2] = { NULL, NULL };
+    uint8_t* leaves[2] = { NULL, NULL };
+    uint8_t* tree = NULL;
+
+    memset(&pool, 0, sizeof(pool));
 
     if (!data_dev || !hash_dev || !root_hash || !root_hash_size)
         RAISE(VIC_BAD_PARAMETER);
@@ -171,161 +425,184 @@ vic_result_t vic_verity_format(
     for (size_t i = 0; i < levels; i++)
         total_nodes += nnodes[i];
 
-    /* Fill the hash file with zero blocks */
+    /* Hash the data blocks and write the leaf nodes */
     {
-        uint8_t zeros[blksz];
-        size_t nblks = total_nodes;
-        size_t hash_file_size;
-
-        if (need_superblock)
-            nblks++;
-
-        memset(zeros, 0, blksz);
+        const size_t leaf_span = digests_per_blk * blksz;
+        size_t chunk_nodes = FORMAT_CHUNK_SIZE / leaf_span;
+        size_t chunk_blks;
+        size_t leaf_blkno;
+        size_t pending_nodes = 0;
 
-        for (size_t i = 0; i < nblks; i++)
-            CHECK(vic_blockdev_put(hash_dev, i, zeros, 1));
+        if (chunk_nodes == 0)
+            chunk_nodes = 1;
 
-        hash_file_size = nblks * blksz;
+        chunk_blks = chunk_nodes * digests_per_blk;
 
-        /* Pad hash file out to MIN_HASH_FILE_SIZE */
-        if (hash_file_size < MIN_HASH_FILE_SIZE)
+        if (!(data[0] = malloc(chunk_blks * blksz)) ||
+            !(data[1] = malloc(chunk_blks * blksz)) ||
+            !(leaves[0] = malloc(chunk_nodes * blksz)) ||
+            !(leaves[1] = malloc(chunk_nodes * blksz)))
         {
-            size_t extra_bytes = MIN_HASH_FILE_SIZE - hash_file_size;
-            size_t extra_blocks = extra_bytes / blksz;
+            RAISE(VIC_OUT_OF_MEMORY);
+        }
 
-            for (size_t i = nblks; i < nblks + extra_blocks; i++)
-                CHECK(vic_blockdev_put(hash_dev, i, zeros, 1));
+        /* The interior levels are kept in memory in hash device order */
+        if (levels > 1)
+        {
+            if (!(tree = calloc(total_nodes - nleaves, blksz)))
+                RAISE(VIC_OUT_OF_MEMORY);
         }
-    }
 
-    /* Write the leaf nodes */
-    {
-        uint8_t blk[blksz];
-        uint8_t node[blksz];
-        size_t node_offset = 0;
-        size_t offset;
-        size_t nblocks;
+        pool.htype = htype;
+        pool.salt = salt;
+        pool.salt_size = salt_size;
+        pool.blksz = blksz;
+        pool.hsize = hsize;
+        pool.digests_per_blk = digests_per_blk;
+        pool.level1 = tree ? tree + (total_nodes - nleaves - nnodes[1]) * blksz
+                           : NULL;
 
-        CHECK(vic_blockdev_get_num_blocks(data_dev, &nblocks));
+        CHECK(_format_pool_start(&pool));
+        pool_started = true;
 
-        /* Calculate the hash file offset to the first leaf node block */
-        offset = (total_nodes - nleaves) * blksz;
+        /* Calculate the hash device block of the first leaf node */
+        leaf_blkno = total_nodes - nleaves;
 
         if (need_superblock)
-            offset += blksz;
+            leaf_blkno++;
 
-        /* Zero out the node */
-        memset(node, 0, blksz);
+        /* Read the first chunk */
+        {
+            const size_t n = nblks < chunk_blks ? nblks : chunk_blks;
+            CHECK(vic_blockdev_get(data_dev, 0, data[0], n));
+        }
 
-        /* For each block in the file */
-        for (size_t i = 0; i < nblocks; i++)
+        for (size_t i = 0, blkno = 0; blkno < nblks; i++)
         {
-            vic_hash_t h;
+            const size_t n = (nblks - blkno) < chunk_blks ?
+                (nblks - blkno) : chunk_blks;
+            const size_t next = blkno + n;
+
+            _format_pool_submit(
+                &pool,
+                data[i % 2],
+                n,
+                leaves[i % 2],
+                blkno / digests_per_blk);
+
+            /* Write the leaf nodes of the previous chunk */
+            if (pending_nodes)
+            {
+                vic_result_t r = vic_blockdev_put(
+                    hash_dev, leaf_blkno, leaves[(i + 1) % 2], pending_nodes);
 
-            /* Read the next block */
-            CHECK(vic_blockdev_get(data_dev, i, blk, 1));
+                leaf_blkno += pending_nodes;
 
-            /* Compute the hash of the current block */
-            if (vic_hash2(htype, salt, salt_size, &blk, blksz, &h) != 0)
+                if (r != VIC_OK)
+                {
+                    _format_pool_wait(&pool);
+                    RAISE(r);
+                }
+            }
+
+            /* Read the next chunk */
+            if (next < nblks)
+            {
+                const size_t m = (nblks - next) < chunk_blks ?
+                    (nblks - next) : chunk_blks;
+                vic_result_t r = vic_blockdev_get(
+                    data_dev, next, data[(i + 1) % 2], m);
+
+                if (r != VIC_OK)
+                {
+                    _format_pool_wait(&pool);
+                    RAISE(r);
+                }
+            }
+
+            if (!_format_pool_wait(&pool))
                 RAISE(VIC_UNEXPECTED);
 
-            /* Write out the node if full */
-            if (node_offset + hsize > blksz)
+            pending_nodes = vic_round_up(n, digests_per_blk) / digests_per_blk;
+
+            /* Keep the leaf node in case it is the only one */
+            if (next == nblks)
             {
-                assert((offset % blksz) == 0);
-                const size_t blkno = offset / blksz;
-                CHECK(vic_blockdev_put(hash_dev, blkno, node, 1));
-                memcpy(last_node, node, blksz);
-                offset += blksz;
-                memset(node, 0, blksz);
-                node_offset = 0;
+                memcpy(last_node,
+                    leaves[i % 2] + (pending_nodes - 1) * blksz, blksz);
             }
 
-            memcpy(node + node_offset, h.u.buf, hsize);
-            node_offset += hsize;
+            blkno = next;
         }
 
-        /* Write the final hash file block if any */
-        if (node_offset > 0)
+        /* Write the leaf nodes of the last chunk */
         {
-            assert((offset % blksz) == 0);
-            const size_t blkno = offset / blksz;
-            CHECK(vic_blockdev_put(hash_dev, blkno, node, 1));
-            memcpy(last_node, node, blksz);
+            const size_t i = vic_round_up(nblks, chunk_blks) / chunk_blks - 1;
+            CHECK(vic_blockdev_put(
+                hash_dev, leaf_blkno, leaves[i % 2], pending_nodes));
         }
     }
 
-    /* Write the interior nodes */
-    for (size_t i = 1; i < levels; i++)
+    /* Compute the remaining interior levels and write them in one go */
+    if (levels > 1)
     {
-        size_t write_offset = 0;
-        size_t read_offset = 0;
-        size_t num_to_read;
-        size_t num_to_write;
+        /* Offset of level 1 within the in-memory tree (in blocks) */
+        size_t offset = total_nodes - nleaves - nnodes[1];
 
-        /* Compute the hash file read offset */
-        for (size_t j = i; j < levels; j++)
-            read_offset += nnodes[j] * blksz;
-
-        if (need_superblock)
-            read_offset += blksz;
-
-        /* Compute the hash file write offset */
-        for (size_t j = i + 1; j < levels; j++)
-            write_offset += nnodes[j] * blksz;
-
-        if (need_superblock)
-            write_offset += blksz;
-
-        num_to_read = nnodes[i-1];
-        num_to_write = nnodes[i];
-
-        /* For each interior node at this level */
-        for (size_t j = 0; j < num_to_write; j++)
+        for (size_t i = 2; i < levels; i++)
         {
-            uint8_t node[blksz];
-            size_t node_offset = 0;
+            const uint8_t* child = tree + offset * blksz;
+            uint8_t* parent;
 
-            /* Zero out the next interior node */
-            memset(node, 0, blksz);
+            offset -= nnodes[i];
+            parent = tree + offset * blksz;
 
-            /* Fill the interior node with hashes */
-            while (num_to_read && (node_offset + hsize) <= blksz)
+            for (size_t j = 0; j < nnodes[i - 1]; j++)
             {
-                char blk[blksz];
+                uint8_t* node = parent + (j / digests_per_blk) * blksz;
                 vic_hash_t h;
 
-                /* Read the next block */
+                if (vic_hash2(htype, salt, salt_size,
+                    child + j * blksz, blksz, &h) != 0)
                 {
-                    assert((read_offset % blksz) == 0);
-                    const size_t blkno = read_offset / blksz;
-                    CHECK(vic_blockdev_get(hash_dev, blkno, blk, 1));
-                    read_offset += blksz;
+                    RAISE(VIC_UNEXPECTED);
                 }
 
-                /* Compute the hash of this block */
-                if (vic_hash2(htype, salt, salt_size, &blk, blksz, &h) != 0)
-                    RAISE(VIC_UNEXPECTED);
+                memcpy(node + (j % digests_per_blk) * hsize, h.u.buf, hsize);
+            }
+        }
 
-                /* Copy this hash to the new node */
-                memcpy(node + node_offset, h.u.buf, hsize);
-                node_offset += hsize;
+        CHECK(vic_blockdev_put(
+            hash_dev,
+            need_superblock ? 1 : 0,
+            tree,
+            total_nodes - nleaves));
 
-                num_to_read--;
-            }
+        /* The top level is a single node */
+        memcpy(last_node, tree, blksz);
+    }
 
-            /* Write out this interior node */
-            {
-                assert((write_offset % blksz) == 0);
-                const size_t blkno = write_offset / blksz;
-                CHECK(vic_blockdev_put(hash_dev, blkno, node, 1));
-                memcpy(last_node, node, blksz);
-                write_offset += blksz;
-            }
+    /* Pad hash file out to MIN_HASH_FILE_SIZE */
+    {
+        size_t nblks = total_nodes;
+
+        if (need_superblock)
+            nblks++;
+
+        if (nblks * blksz < MIN_HASH_FILE_SIZE)
+        {
+            uint8_t zeros[blksz];
+            const size_t extra_blocks =
+                (MIN_HASH_FILE_SIZE - nblks * blksz) / blksz;
+
+            memset(zeros, 0, blksz);
+
+            for (size_t i = nblks; i < nblks + extra_blocks; i++)
+                CHECK(vic_blockdev_put(hash_dev, i, zeros, 1));
         }
     }
 
-    /* Compute the root hash (from the last block written) */
+    /* Compute the root hash (from the top level node) */
     {
         vic_hash_t h;
 
@@ -370,6 +647,16 @@ vic_result_t vic_verity_format(
     }
 
 done:
+
+    if (pool_started)
+        _format_pool_stop(&pool);
+
+    free(data[0]);
+    free(data[1]);
+    free(leaves[0]);
+    free(leaves[1]);
+    free(tree);
+
     return result;
 }
 
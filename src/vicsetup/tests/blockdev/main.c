@@ -160,6 +160,81 @@ int main(int argc, const char* argv[])
     vic_blockdev_close(bd1);
     vic_blockdev_close(bd2);
 
+    /* Vectored I/O and wiping, with direct I/O if supported */
+    {
+        vic_blockdev_t* bd3;
+        uint8_t tmp[nblocks][blksz];
+        struct iovec iov[3];
+
+        assert(vic_blockdev_open(
+            path, VIC_RDWR | VIC_DIRECT, blksz, &bd3) == VIC_OK);
+
+        /* Read the device into three unevenly sized buffers */
+        memset(tmp, 0, sizeof(tmp));
+        iov[0].iov_base = tmp[0];
+        iov[0].iov_len = blksz / 2;
+        iov[1].iov_base = (uint8_t*)tmp[0] + blksz / 2;
+        iov[1].iov_len = blksz / 2 + 2 * blksz;
+        iov[2].iov_base = tmp[3];
+        iov[2].iov_len = (nblocks - 3) * blksz;
+        assert(vic_blockdev_getv(bd3, 0, iov, 3) == VIC_OK);
+        assert(memcmp(blocks, tmp, sizeof(blocks)) == 0);
+
+        /* The total length must be a block multiple */
+        iov[0].iov_len = blksz / 2;
+        assert(vic_blockdev_getv(bd3, 0, iov, 1) != VIC_OK);
+
+        /* Swap blocks 1 and 2 with a vectored write */
+        iov[0].iov_base = blocks[2];
+        iov[0].iov_len = blksz;
+        iov[1].iov_base = blocks[1];
+        iov[1].iov_len = blksz;
+        assert(vic_blockdev_putv(bd3, 1, iov, 2) == VIC_OK);
+        assert(vic_blockdev_get(bd3, 1, tmp[1], 2) == VIC_OK);
+        assert(memcmp(tmp[1], blocks[2], blksz) == 0);
+        assert(memcmp(tmp[2], blocks[1], blksz) == 0);
+
+        /* Wipe blocks 3..5 and check that the others are unchanged */
+        assert(vic_blockdev_wipe(bd3, 3, 3) == VIC_OK);
+        assert(vic_blockdev_get(bd3, 0, tmp, nblocks) == VIC_OK);
+        memcpy(blocks[1], tmp[1], blksz);
+        memcpy(blocks[2], tmp[2], blksz);
+        memset(blocks[3], 0, 3 * blksz);
+        assert(memcmp(blocks, tmp, sizeof(blocks)) == 0);
+
+        /* Writes and wipes beyond the end fail */
+        assert(vic_blockdev_wipe(bd3, nblocks - 1, 2) != VIC_OK);
+        assert(vic_blockdev_putv(bd3, nblocks, iov, 1) != VIC_OK);
+
+        vic_blockdev_close(bd3);
+    }
+
+    /* Direct I/O of sectors that are not aligned to the direct I/O size */
+    {
+        vic_blockdev_t* bd4;
+        const size_t secsz = 512;
+        uint8_t sec[secsz];
+        uint8_t buf[3 * secsz];
+
+        assert(vic_blockdev_open(
+            path, VIC_RDWR | VIC_DIRECT, secsz, &bd4) == VIC_OK);
+
+        /* Read sectors 1..3 into a buffer that is not aligned either */
+        assert(vic_blockdev_get(bd4, 1, buf + 1, 2) == VIC_OK);
+        assert(memcmp(buf + 1, (uint8_t*)blocks + secsz, 2 * secsz) == 0);
+
+        /* Overwrite sector 9 and read it back */
+        memset(sec, 0xab, secsz);
+        assert(vic_blockdev_put(bd4, 9, sec, 1) == VIC_OK);
+        memset(buf, 0, sizeof(buf));
+        assert(vic_blockdev_get(bd4, 8, buf, 3) == VIC_OK);
+        assert(memcmp(buf, (uint8_t*)blocks + 8 * secsz, secsz) == 0);
+        assert(memcmp(buf + secsz, sec, secsz) == 0);
+        assert(memcmp(buf + 2 * secsz, (uint8_t*)blocks + 10 * secsz, secsz) == 0);
+
+        vic_blockdev_close(bd4);
+    }
+
     printf("=== passed test (%s)\n", argv[0]);
     return 0;
 }
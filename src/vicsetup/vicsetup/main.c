@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include "../libvicsetup/hexdump.h"
 #include "../libvicsetup/verity.h"
@@ -19,6 +21,7 @@
     "actions:\n" \
     "    luksDump\n" \
     "    luksFormat\n" \
+    "    luksFormatImage\n" \
     "    luksGetMasterKey\n" \
     "    luksAddKey\n" \
     "    luksChangeKey\n" \
@@ -35,6 +38,12 @@
 
 static const char* arg0;
 
+/* Bytes read from the source at a time by luksFormatImage */
+#define IMAGE_CHUNK_SIZE (16 * 1024 * 1024)
+
+/* Room for the LUKS2 headers while formatting (they take 16 MiB) */
+#define IMAGE_HEADER_RESERVE (32 * 1024 * 1024)
+
 void vic_hexdump_formatted(const void* data, size_t size);
 
 void vic_hexdump_indent(const void* data, size_t size, size_t indent);
@@ -357,6 +366,317 @@ static int luksFormat(int argc, const char* argv[])
     return 0;
 }
 
+static void* _load_file(const char* path, size_t* size_out)
+{
+    FILE* is;
+    struct stat st;
+    void* data;
+
+    if (!(is = fopen(path, "rb")) || fstat(fileno(is), &st) != 0)
+        err("failed to open %s", path);
+
+    if (st.st_size == 0 || !(data = malloc(st.st_size)))
+        err("failed to load %s", path);
+
+    if (fread(data, 1, st.st_size, is) != (size_t)st.st_size)
+        err("failed to read %s", path);
+
+    fclose(is);
+
+    *size_out = st.st_size;
+    return data;
+}
+
+/* Build a LUKS2 image from a plaintext filesystem image in one pass: format
+ * the header, then encrypt the source into the payload while (optionally)
+ * hashing the result into a dm-verity tree appended to the image. */
+static int luksFormatImage(int argc, const char* argv[])
+{
+    vic_blockdev_t* dev;
+    vic_blockdev_t* writer;
+    const char* cipher = NULL;
+    const char* uuid = NULL;
+    const char* hash = NULL;
+    const char* pwd_file = NULL;
+    const char* verity_hash = NULL;
+    bool verity = false;
+    uint64_t key_bits = 512;
+    uint64_t mk_iterations = 0;
+    uint64_t slot_iterations = 0;
+    uint64_t payload_size = 0;
+    uint64_t blksz = 4096;
+    vic_key_t key;
+    void* pwd;
+    size_t pwd_size;
+    vic_luks_stat_t stat_buf;
+    size_t image_size;
+    int fd;
+    vic_result_t r;
+
+    /* Get --cipher option */
+    get_opt(&argc, argv, "--cipher", &cipher);
+
+    /* Get --uuid option */
+    get_opt(&argc, argv, "--uuid", &uuid);
+
+    /* Get --hash option */
+    get_opt(&argc, argv, "--hash", &hash);
+
+    if (!hash)
+        hash = "sha256";
+
+    /* Get --key-size option */
+    get_opt_u64(&argc, argv, "--key-size", &key_bits);
+
+    /* Get --mk-iterations option */
+    get_opt_u64(&argc, argv, "--mk-iterations", &mk_iterations);
+
+    /* Get --slot-iterations option */
+    get_opt_u64(&argc, argv, "--slot-iterations", &slot_iterations);
+
+    /* Get --pwd-file option */
+    get_opt(&argc, argv, "--pwd-file", &pwd_file);
+
+    /* Get --size option */
+    get_opt_u64(&argc, argv, "--size", &payload_size);
+
+    /* Get --verity option */
+    if (get_opt(&argc, argv, "--verity", NULL) == 0)
+        verity = true;
+
+    /* Get --verity-hash option */
+    get_opt(&argc, argv, "--verity-hash", &verity_hash);
+
+    /* Get --verity-block-size option */
+    get_opt_u64(&argc, argv, "--verity-block-size", &blksz);
+
+    /* Check usage */
+    if (argc != (pwd_file ? 4 : 5))
+    {
+        fprintf(stderr,
+            "Usage: %s %s [OPTIONS] <source> <imagefile> <pwd>\n"
+            "       %s %s [OPTIONS] --pwd-file <file> <source> <imagefile>\n"
+            "\n"
+            "Writes <source> (a filesystem image, or - for stdin) encrypted\n"
+            "into a new LUKS2 image without root privileges or loop devices.\n"
+            "\n"
+            "OPTIONS:\n"
+            "    --cipher <cipher>\n"
+            "    --uuid <uuid>\n"
+            "    --hash <type>\n"
+            "    --key-size <bits>\n"
+            "    --mk-iterations <count>\n"
+            "    --slot-iterations <count>\n"
+            "    --pwd-file <file>\n"
+            "    --size <bytes> (payload size, required for stdin)\n"
+            "    --verity (append a dm-verity hash tree)\n"
+            "    --verity-hash <type>\n"
+            "    --verity-block-size <bytes>\n"
+            "\n",
+            argv[0],
+            argv[1],
+            argv[0],
+            argv[1]);
+        exit(1);
+    }
+
+    const char* source = argv[2];
+    const char* imagefile = argv[3];
+
+    if (pwd_file)
+    {
+        pwd = _load_file(pwd_file, &pwd_size);
+    }
+    else
+    {
+        pwd = strdup(argv[4]);
+        pwd_size = strlen(argv[4]);
+    }
+
+    if (key_bits == 0 || key_bits % 8 || key_bits / 8 > sizeof(key))
+        err("bad --key-size option: %lu", key_bits);
+
+    if (blksz < VIC_SECTOR_SIZE || blksz > 4096 || (blksz & (blksz - 1)))
+        err("bad --verity-block-size option: %lu", blksz);
+
+    /* Open the source and determine the payload size */
+    {
+        struct stat st;
+
+        if (strcmp(source, "-") == 0)
+            fd = STDIN_FILENO;
+        else if ((fd = open(source, O_RDONLY)) < 0)
+            err("cannot open %s", source);
+
+        if (fstat(fd, &st) != 0)
+            err("cannot stat %s", source);
+
+        if (S_ISREG(st.st_mode))
+        {
+            if (payload_size == 0)
+                payload_size = st.st_size;
+            else if ((uint64_t)st.st_size > payload_size)
+                err("%s is larger than --size", source);
+        }
+
+        if (payload_size == 0)
+            err("--size is required unless <source> is a regular file");
+
+        /* Keep the payload (and the verity data) block aligned */
+        payload_size = (payload_size + blksz - 1) / blksz * blksz;
+    }
+
+    /* Create a sparse image that is large enough for the headers */
+    {
+        int image_fd = open(imagefile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (image_fd < 0)
+            err("cannot create %s", imagefile);
+
+        if (ftruncate(image_fd, payload_size + IMAGE_HEADER_RESERVE) != 0)
+            err("cannot resize %s", imagefile);
+
+        close(image_fd);
+    }
+
+    if (vic_blockdev_open(imagefile, VIC_RDWR, 0, &dev) != VIC_OK)
+        err("cannot open %s\n", imagefile);
+
+    vic_random(&key, sizeof(key));
+
+    if ((r = vic_luks_format(
+        dev,
+        LUKS_VERSION_2,
+        cipher,
+        uuid,
+        hash,
+        mk_iterations,
+        &key,
+        key_bits / 8,
+        NULL)) != VIC_OK)
+    {
+        err("%s() failed: %s\n", argv[1], vic_result_string(r));
+    }
+
+    vic_kdf_t kdf =
+    {
+        .iterations = slot_iterations,
+    };
+
+    if ((r = vic_luks_add_key_by_master_key(
+        dev,
+        LUKS_DEFAULT_CIPHER,
+        "pbkdf2",
+        &kdf,
+        &key,
+        key_bits / 8,
+        pwd,
+        pwd_size)) != VIC_OK)
+    {
+        err("%s() failed: %s\n", argv[1], vic_result_string(r));
+    }
+
+    /* Trim the image to the headers plus the payload */
+    if ((r = vic_luks_stat(dev, &stat_buf)) != VIC_OK)
+        err("%s() failed: %s\n", argv[1], vic_result_string(r));
+
+    vic_blockdev_close(dev);
+
+    image_size = stat_buf.payload_offset + payload_size;
+
+    if (truncate(imagefile, image_size) != 0)
+        err("cannot resize %s", imagefile);
+
+    if (vic_blockdev_open(imagefile, VIC_RDWR, 0, &dev) != VIC_OK)
+        err("cannot open %s\n", imagefile);
+
+    if ((r = vic_luks_open_payload_writer(
+        dev, &key, key_bits / 8, fd, &writer)) != VIC_OK)
+    {
+        err("%s() failed: %s\n", argv[1], vic_result_string(r));
+    }
+
+    if (verity)
+    {
+        vic_blockdev_t* hash_dev;
+        uint8_t root_hash[256];
+        size_t root_hash_size = sizeof(root_hash);
+        const int hash_flags = VIC_RDWR | VIC_CREATE;
+
+        /* The hash tree follows the LUKS2 device in the same file */
+        if (vic_blockdev_open(imagefile, hash_flags, blksz, &hash_dev) != 0 ||
+            vic_blockdev_set_offset(hash_dev, image_size) != VIC_OK)
+        {
+            err("cannot open %s\n", imagefile);
+        }
+
+        /* Reading the writer fills the payload as the tree is hashed */
+        if ((r = vic_verity_format(
+            writer,
+            hash_dev,
+            verity_hash,
+            NULL, /* uuid */
+            NULL, /* salt */
+            0, /* salt_size */
+            true, /* need_superblock */
+            blksz,
+            blksz,
+            root_hash,
+            &root_hash_size)) != VIC_OK)
+        {
+            err("%s() failed: %s\n", argv[1], vic_result_string(r));
+        }
+
+        vic_blockdev_close(hash_dev);
+
+        printf("Root hash:\t");
+        vic_hexdump_flat(root_hash, root_hash_size);
+        printf("\n");
+        printf("Hash offset:\t%zu\n", image_size);
+    }
+    else
+    {
+        const size_t chunk_blocks = IMAGE_CHUNK_SIZE / VIC_SECTOR_SIZE;
+        const size_t nblocks = image_size / VIC_SECTOR_SIZE;
+        uint8_t* buf;
+
+        if (!(buf = malloc(IMAGE_CHUNK_SIZE)))
+            err("out of memory");
+
+        for (size_t i = 0; i < nblocks; i += chunk_blocks)
+        {
+            size_t n = nblocks - i < chunk_blocks ? nblocks - i : chunk_blocks;
+
+            if ((r = vic_blockdev_get(writer, i, buf, n)) != VIC_OK)
+                err("%s() failed: %s\n", argv[1], vic_result_string(r));
+        }
+
+        free(buf);
+    }
+
+    /* Everything must have fit into the payload */
+    {
+        uint8_t byte;
+
+        if (read(fd, &byte, sizeof(byte)) > 0)
+            err("%s is larger than --size", source);
+    }
+
+    printf("Payload offset:\t%zu\n", stat_buf.payload_offset);
+
+    vic_blockdev_close(writer);
+    vic_blockdev_close(dev);
+
+    if (fd != STDIN_FILENO)
+        close(fd);
+
+    memset(&key, 0, sizeof(key));
+    memset(pwd, 0, pwd_size);
+    free(pwd);
+
+    return 0;
+}
+
 static int cryptsetupLuksFormat(int argc, const char* argv[])
 {
     struct crypt_device* cd;
@@ -1228,6 +1548,10 @@ int main(int argc, const char* argv[])
     {
         return luksFormat(argc, argv);
     }
+    else if (strcmp(argv[1], "luksFormatImage") == 0)
+    {
+        return luksFormatImage(argc, argv);
+    }
     else if (strcmp(argv[1], "luksGetMasterKey") == 0)
     {
         return luksGetMasterKey(argc, argv);
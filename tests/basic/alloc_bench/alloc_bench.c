@@ -0,0 +1,124 @@
+/*
+ * Benchmark for allocation-heavy paths of the enclave runtime.
+ *
+ * threads: a number of workers concurrently create and join short-lived
+ *          threads, each of which needs a new lthread, its TLS image and
+ *          slots, and LKL task and semaphore objects.
+ * timers:  a number of workers concurrently sleep for a microsecond in a
+ *          loop, which arms LKL timers and wakes up the sleepers through
+ *          LKL semaphores.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static unsigned long workers = 8;
+static unsigned long thread_iterations = 2000;
+static unsigned long sleep_iterations = 5000;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void* child(void* arg)
+{
+    return arg;
+}
+
+static void* thread_worker(void* arg)
+{
+    (void)arg;
+
+    for (unsigned long i = 0; i < thread_iterations; i++)
+    {
+        pthread_t t;
+        int ret = pthread_create(&t, NULL, child, NULL);
+        if (ret)
+        {
+            fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+            exit(1);
+        }
+        pthread_join(t, NULL);
+    }
+
+    return NULL;
+}
+
+static void* sleep_worker(void* arg)
+{
+    struct timespec ts = {0, 1000};
+
+    (void)arg;
+
+    for (unsigned long i = 0; i < sleep_iterations; i++)
+        nanosleep(&ts, NULL);
+
+    return NULL;
+}
+
+static void run(const char* name, void* (*fn)(void*), unsigned long ops)
+{
+    pthread_t* threads = calloc(workers, sizeof(*threads));
+    if (!threads)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < workers; i++)
+    {
+        int ret = pthread_create(&threads[i], NULL, fn, NULL);
+        if (ret)
+        {
+            fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+            exit(1);
+        }
+    }
+    for (unsigned long i = 0; i < workers; i++)
+        pthread_join(threads[i], NULL);
+    uint64_t elapsed = now_ns() - start;
+
+    printf(
+        "%s: %lu workers, %lu ops in %.3f s, %.0f ops/s\n",
+        name,
+        workers,
+        workers * ops,
+        (double)elapsed / NSEC_PER_SEC,
+        (double)(workers * ops) * NSEC_PER_SEC / elapsed);
+
+    free(threads);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        workers = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        thread_iterations = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        sleep_iterations = strtoul(argv[3], NULL, 0);
+
+    if (!workers || !thread_iterations || !sleep_iterations)
+    {
+        fprintf(
+            stderr,
+            "usage: %s [workers] [thread_iterations] [sleep_iterations]\n",
+            argv[0]);
+        return 1;
+    }
+
+    run("threads", thread_worker, thread_iterations);
+    run("timers", sleep_worker, sleep_iterations);
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * alloc_churn.c
+ *
+ * Stress test for the enclave runtime's object allocator. Every application
+ * thread needs an lthread, its TLS image and TLS slots, and LKL semaphores,
+ * and every sleep arms the LKL timer. The allocator keeps free objects in
+ * per-ethread caches, so run with several ethreads, objects allocated on one
+ * ethread are freed on another and move between the caches.
+ *
+ * Creator threads start short-lived children and hand them to reaper
+ * threads, which join them, so that children are created and reaped by
+ * different threads. Every fourth child is detached instead and freed when
+ * it exits. Each child fills a thread-local and an on-stack buffer with a
+ * pattern of its own, sleeps and yields so that it can migrate between
+ * ethreads, checks both buffers and returns a value derived from its id.
+ *
+ * An object that is handed out twice or reused while still in use shows up
+ * as a child that sees another child's pattern or returns the wrong value,
+ * as a crash, or as a hang that the test timeout catches.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_CREATORS 4
+#define NUM_REAPERS 2
+#define CHILDREN_PER_CREATOR 500
+#define BUF_SIZE 256
+#define QUEUE_SIZE 64
+
+typedef struct
+{
+    pthread_t thread;
+    unsigned id;
+} child_t;
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    child_t children[QUEUE_SIZE];
+    size_t head;
+    size_t tail;
+} queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread unsigned char tls_buf[BUF_SIZE];
+
+static atomic_uint detached_done;
+static atomic_uint errors;
+
+static void fail(const char* msg)
+{
+    printf("%s\n", msg);
+    printf("TEST FAILED\n");
+    exit(-1);
+}
+
+static void fill(unsigned char* buf, unsigned id)
+{
+    for (size_t i = 0; i < BUF_SIZE; i++)
+        buf[i] = (unsigned char)(id * 7 + i);
+}
+
+static int check(const unsigned char* buf, unsigned id)
+{
+    for (size_t i = 0; i < BUF_SIZE; i++)
+        if (buf[i] != (unsigned char)(id * 7 + i))
+            return 0;
+    return 1;
+}
+
+static void* child_thread(void* arg)
+{
+    unsigned id = (unsigned)(uintptr_t)arg;
+    unsigned char stack_buf[BUF_SIZE];
+    struct timespec ts = {0, 1000 * (id % 50 + 1)};
+
+    fill(tls_buf, id);
+    fill(stack_buf, id);
+
+    nanosleep(&ts, NULL);
+    sched_yield();
+
+    if (!check(tls_buf, id) || !check(stack_buf, id))
+    {
+        printf("child %u: buffer corrupted\n", id);
+        atomic_fetch_add(&errors, 1);
+    }
+
+    if (id % 4 == 3)
+        atomic_fetch_add(&detached_done, 1);
+
+    return (void*)(uintptr_t)(id * 2 + 1);
+}
+
+static void queue_push(const child_t* c)
+{
+    pthread_mutex_lock(&queue.lock);
+    while (queue.tail - queue.head == QUEUE_SIZE)
+        pthread_cond_wait(&queue.cond, &queue.lock);
+    queue.children[queue.tail++ % QUEUE_SIZE] = *c;
+    pthread_cond_broadcast(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+static void queue_pop(child_t* c)
+{
+    pthread_mutex_lock(&queue.lock);
+    while (queue.tail == queue.head)
+        pthread_cond_wait(&queue.cond, &queue.lock);
+    *c = queue.children[queue.head++ % QUEUE_SIZE];
+    pthread_cond_broadcast(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+static void* creator_thread(void* arg)
+{
+    unsigned creator = (unsigned)(uintptr_t)arg;
+
+    for (unsigned i = 0; i < CHILDREN_PER_CREATOR; i++)
+    {
+        child_t c;
+        c.id = creator * CHILDREN_PER_CREATOR + i;
+
+        if (pthread_create(
+                &c.thread, NULL, child_thread, (void*)(uintptr_t)c.id) != 0)
+            fail("pthread_create failed");
+
+        if (c.id % 4 == 3)
+            pthread_detach(c.thread);
+        else
+            queue_push(&c);
+    }
+
+    return NULL;
+}
+
+static void* reaper_thread(void* arg)
+{
+    unsigned num = (unsigned)(uintptr_t)arg;
+
+    for (unsigned i = 0; i < num; i++)
+    {
+        child_t c;
+        void* ret;
+
+        queue_pop(&c);
+        if (pthread_join(c.thread, &ret) != 0)
+            fail("pthread_join failed");
+        if (ret != (void*)(uintptr_t)(c.id * 2 + 1))
+        {
+            printf("child %u: wrong return value %p\n", c.id, ret);
+            atomic_fetch_add(&errors, 1);
+        }
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    const unsigned total = NUM_CREATORS * CHILDREN_PER_CREATOR;
+    const unsigned detached = total / 4;
+    const unsigned joined = total - detached;
+    pthread_t creators[NUM_CREATORS];
+    pthread_t reapers[NUM_REAPERS];
+    struct timespec ts = {0, 1000000};
+
+    for (unsigned i = 0; i < NUM_REAPERS; i++)
+    {
+        unsigned num = joined / NUM_REAPERS;
+        if (i == 0)
+            num += joined % NUM_REAPERS;
+        if (pthread_create(
+                &reapers[i], NULL, reaper_thread, (void*)(uintptr_t)num) != 0)
+            fail("pthread_create failed");
+    }
+
+    for (unsigned i = 0; i < NUM_CREATORS; i++)
+        if (pthread_create(
+                &creators[i], NULL, creator_thread, (void*)(uintptr_t)i) != 0)
+            fail("pthread_create failed");
+
+    for (unsigned i = 0; i < NUM_CREATORS; i++)
+        pthread_join(creators[i], NULL);
+    for (unsigned i = 0; i < NUM_REAPERS; i++)
+        pthread_join(reapers[i], NULL);
+
+    while (atomic_load(&detached_done) < detached)
+        nanosleep(&ts, NULL);
+
+    if (atomic_load(&errors))
+    {
+        printf("%u errors in %u threads\n", atomic_load(&errors), total);
+        fail("threads saw corrupted state");
+    }
+
+    printf("%u threads created and freed\n", total);
+    printf("TEST PASSED\n");
+    return 0;
+}
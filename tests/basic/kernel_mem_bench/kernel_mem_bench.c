@@ -0,0 +1,154 @@
+/*
+ * Benchmark for elastic LKL kernel memory.
+ *
+ * Each round reads a file twice, so that the second read is served from the
+ * page cache if the kernel has enough memory to keep the file, and then maps
+ * and touches anonymous memory in 1 MiB chunks. With elastic kernel memory,
+ * the allocations take memory back from the page cache; an allocation that
+ * fails while the kernel is still giving up memory is retried after a short
+ * sleep. The memory is unmapped again before the next round.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+#define CHUNK_SIZE (1024 * 1024)
+#define READ_BUF_SIZE (256 * 1024)
+#define ALLOC_RETRIES 100
+#define ALLOC_RETRY_US 10000
+
+static unsigned long alloc_mb = 256;
+static unsigned long rounds = 3;
+static const char* read_path = "/data.bin";
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_us(unsigned long us)
+{
+    struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts))
+        ;
+}
+
+static void bench_read(const char* name, char* buf)
+{
+    size_t total = 0;
+    ssize_t ret;
+
+    int fd = open(read_path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(read_path);
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    while ((ret = read(fd, buf, READ_BUF_SIZE)) > 0)
+        total += ret;
+    uint64_t elapsed = now_ns() - start;
+
+    if (ret < 0)
+    {
+        perror("read");
+        exit(1);
+    }
+    close(fd);
+
+    printf(
+        "%s: %zu MiB in %.3f s, %.1f MiB/s\n",
+        name,
+        total / CHUNK_SIZE,
+        (double)elapsed / NSEC_PER_SEC,
+        (double)total / CHUNK_SIZE * NSEC_PER_SEC / elapsed);
+}
+
+static void bench_alloc(void** chunks)
+{
+    unsigned long n, retries = 0;
+
+    uint64_t start = now_ns();
+    for (n = 0; n < alloc_mb; n++)
+    {
+        void* p;
+        unsigned long tries = 0;
+
+        while ((p = mmap(
+                    NULL,
+                    CHUNK_SIZE,
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1,
+                    0)) == MAP_FAILED &&
+               errno == ENOMEM && tries++ < ALLOC_RETRIES)
+            sleep_us(ALLOC_RETRY_US);
+
+        if (p == MAP_FAILED)
+            break;
+
+        retries += tries;
+        memset(p, (int)n, CHUNK_SIZE);
+        chunks[n] = p;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    printf(
+        "alloc: %lu of %lu MiB in %.3f s, %lu retries\n",
+        n,
+        alloc_mb,
+        (double)elapsed / NSEC_PER_SEC,
+        retries);
+
+    while (n-- > 0)
+        munmap(chunks[n], CHUNK_SIZE);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        alloc_mb = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        rounds = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        read_path = argv[3];
+
+    if (!alloc_mb || !rounds)
+    {
+        fprintf(stderr, "usage: %s [alloc_mb] [rounds] [read_path]\n", argv[0]);
+        return 1;
+    }
+
+    char* buf = malloc(READ_BUF_SIZE);
+    void** chunks = calloc(alloc_mb, sizeof(*chunks));
+    if (!buf || !chunks)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (unsigned long i = 0; i < rounds; i++)
+    {
+        printf("round %lu\n", i);
+        bench_read("read", buf);
+        bench_read("reread", buf);
+        bench_alloc(chunks);
+    }
+
+    free(chunks);
+    free(buf);
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * lkl_sem_contention-test.c
+ *
+ * Stress test and contention benchmark for the semaphores and mutexes that
+ * the LKL host interface provides to the kernel. Every system call takes the
+ * LKL CPU lock and every blocking system call hands the CPU over to another
+ * kernel thread via its semaphore, so the test runs:
+ *
+ * - pairs of threads that bounce a token through two pipes (blocking
+ *   hand-over between kernel threads), and
+ * - threads that issue non-blocking system calls in a tight loop (contention
+ *   on the CPU lock).
+ *
+ * A lost wake-up leaves a thread blocked forever, so the test hangs and is
+ * killed by the test timeout. At the end, each pair checks that all tokens
+ * arrived in order.
+ *
+ * Usage: lkl_sem_contention-test [pairs] [round trips] [spinners] [syscalls]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long num_pairs = 8;
+static unsigned long round_trips = 20000;
+static unsigned long num_spinners = 4;
+static unsigned long spinner_syscalls = 200000;
+
+typedef struct
+{
+    int ping[2];
+    int pong[2];
+    pthread_t threads[2];
+    unsigned long errors;
+} pair_t;
+
+static void fail(const char* msg)
+{
+    printf("%s\n", msg);
+    printf("TEST FAILED\n");
+    exit(-1);
+}
+
+static void* ping_thread(void* arg)
+{
+    pair_t* p = arg;
+
+    for (unsigned long i = 0; i < round_trips; i++)
+    {
+        unsigned long token;
+        if (write(p->ping[1], &i, sizeof(i)) != sizeof(i) ||
+            read(p->pong[0], &token, sizeof(token)) != sizeof(token))
+            fail("ping: pipe I/O failed");
+        if (token != i)
+            p->errors++;
+    }
+
+    return NULL;
+}
+
+static void* pong_thread(void* arg)
+{
+    pair_t* p = arg;
+
+    for (unsigned long i = 0; i < round_trips; i++)
+    {
+        unsigned long token;
+        if (read(p->ping[0], &token, sizeof(token)) != sizeof(token) ||
+            write(p->pong[1], &token, sizeof(token)) != sizeof(token))
+            fail("pong: pipe I/O failed");
+    }
+
+    return NULL;
+}
+
+static void* spinner_thread(void* arg)
+{
+    for (unsigned long i = 0; i < spinner_syscalls; i++)
+    {
+        if (getppid() < 0)
+            fail("getppid failed");
+    }
+
+    return NULL;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        num_pairs = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        round_trips = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        num_spinners = strtoul(argv[3], NULL, 0);
+    if (argc > 4)
+        spinner_syscalls = strtoul(argv[4], NULL, 0);
+
+    pair_t* pairs = calloc(num_pairs, sizeof(*pairs));
+    pthread_t* spinners = calloc(num_spinners, sizeof(*spinners));
+    if ((num_pairs && !pairs) || (num_spinners && !spinners))
+        fail("Out of memory");
+
+    double start = now();
+
+    for (unsigned long i = 0; i < num_pairs; i++)
+    {
+        pair_t* p = &pairs[i];
+        if (pipe(p->ping) != 0 || pipe(p->pong) != 0)
+            fail("Failed to create pipes");
+        if (pthread_create(&p->threads[0], NULL, ping_thread, p) != 0 ||
+            pthread_create(&p->threads[1], NULL, pong_thread, p) != 0)
+            fail("Failed to create pipe threads");
+    }
+
+    for (unsigned long i = 0; i < num_spinners; i++)
+    {
+        if (pthread_create(&spinners[i], NULL, spinner_thread, NULL) != 0)
+            fail("Failed to create spinner thread");
+    }
+
+    for (unsigned long i = 0; i < num_pairs; i++)
+    {
+        pthread_join(pairs[i].threads[0], NULL);
+        pthread_join(pairs[i].threads[1], NULL);
+    }
+    for (unsigned long i = 0; i < num_spinners; i++)
+        pthread_join(spinners[i], NULL);
+
+    double elapsed = now() - start;
+    unsigned long hand_overs = 2 * num_pairs * round_trips;
+    unsigned long syscalls = num_spinners * spinner_syscalls;
+
+    printf(
+        "%lu pipe hand-overs between %lu thread pairs, %lu system calls from "
+        "%lu spinning threads in %.3f s (%.0f hand-overs/s)\n",
+        hand_overs,
+        num_pairs,
+        syscalls,
+        num_spinners,
+        elapsed,
+        hand_overs / elapsed);
+
+    for (unsigned long i = 0; i < num_pairs; i++)
+    {
+        if (pairs[i].errors)
+            fail("Tokens were received out of order");
+        close(pairs[i].ping[0]);
+        close(pairs[i].ping[1]);
+        close(pairs[i].pong[0]);
+        close(pairs[i].pong[1]);
+    }
+
+    free(spinners);
+    free(pairs);
+
+    printf("TEST PASSED (lkl_sem_contention)\n");
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Latency benchmark for time-slice preemption of lthreads.
+ *
+ * A TCP echo server and a client that sends small requests to it over the
+ * loopback interface run next to a number of spinning threads. Spinners burn
+ * the CPU in long bursts and only yield between bursts, so without
+ * preemption an echo request that arrives during a burst waits for the burst
+ * to end. The benchmark reports the round-trip time of the requests.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+#define ECHO_PORT 7007
+#define ECHO_MSG_SIZE 64
+
+static unsigned long requests = 2000;
+static unsigned long spinners = 1;
+static unsigned long burst_ms = 50;
+static unsigned long interval_us = 1000;
+
+static atomic_int done;
+static volatile uint64_t spin_sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_us(unsigned long us)
+{
+    struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts))
+        ;
+}
+
+static void fail(const char* msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+static int xfer_all(int fd, char* buf, size_t len, int is_send)
+{
+    size_t off = 0;
+
+    while (off < len)
+    {
+        ssize_t ret = is_send ? send(fd, buf + off, len - off, 0)
+                              : recv(fd, buf + off, len - off, 0);
+        if (ret <= 0)
+            return -1;
+        off += ret;
+    }
+
+    return 0;
+}
+
+static void* spin_thread(void* arg)
+{
+    uint64_t x = (uintptr_t)arg;
+
+    while (!atomic_load(&done))
+    {
+        uint64_t end = now_ns() + burst_ms * 1000000;
+        while (now_ns() < end)
+        {
+            for (int i = 0; i < 1000; i++)
+                x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        spin_sink = x;
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+static void* echo_thread(void* arg)
+{
+    int lfd = (int)(intptr_t)arg;
+    char buf[ECHO_MSG_SIZE];
+
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0)
+        fail("accept");
+
+    while (xfer_all(fd, buf, sizeof(buf), 0) == 0)
+    {
+        if (xfer_all(fd, buf, sizeof(buf), 1) != 0)
+            break;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char** argv)
+{
+    struct sockaddr_in addr;
+    char buf[ECHO_MSG_SIZE];
+    pthread_t server;
+    pthread_t* threads;
+    uint64_t* rtt;
+    uint64_t sum = 0;
+    int one = 1;
+
+    if (argc > 1)
+        requests = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        spinners = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        burst_ms = strtoul(argv[3], NULL, 0);
+    if (argc > 4)
+        interval_us = strtoul(argv[4], NULL, 0);
+
+    if (!requests || !burst_ms)
+    {
+        fprintf(
+            stderr,
+            "usage: %s [requests] [spinners] [burst_ms] [interval_us]\n",
+            argv[0]);
+        return 1;
+    }
+
+    rtt = calloc(requests, sizeof(*rtt));
+    threads = calloc(spinners + 1, sizeof(*threads));
+    if (!rtt || !threads)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(ECHO_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0)
+        fail("socket");
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        fail("bind");
+    if (listen(lfd, 1) != 0)
+        fail("listen");
+    if (pthread_create(&server, NULL, echo_thread, (void*)(intptr_t)lfd))
+        fail("pthread_create");
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        fail("socket");
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        fail("connect");
+
+    for (unsigned long i = 0; i < spinners; i++)
+    {
+        if (pthread_create(&threads[i], NULL, spin_thread, (void*)(i + 1)))
+            fail("pthread_create");
+    }
+
+    memset(buf, 'x', sizeof(buf));
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < requests; i++)
+    {
+        uint64_t t = now_ns();
+        if (xfer_all(fd, buf, sizeof(buf), 1) != 0 ||
+            xfer_all(fd, buf, sizeof(buf), 0) != 0)
+            fail("echo");
+        rtt[i] = now_ns() - t;
+
+        if (interval_us)
+            sleep_us(interval_us);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    atomic_store(&done, 1);
+    for (unsigned long i = 0; i < spinners; i++)
+        pthread_join(threads[i], NULL);
+    close(fd);
+    pthread_join(server, NULL);
+    close(lfd);
+
+    qsort(rtt, requests, sizeof(*rtt), compare_u64);
+    for (unsigned long i = 0; i < requests; i++)
+        sum += rtt[i];
+
+    printf(
+        "echo: %lu requests, %lu spinners, %lu ms bursts in %.3f s: "
+        "avg %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        requests,
+        spinners,
+        burst_ms,
+        (double)elapsed / NSEC_PER_SEC,
+        (double)sum / requests / 1000,
+        (double)rtt[requests / 2] / 1000,
+        (double)rtt[requests * 99 / 100] / 1000,
+        (double)rtt[requests - 1] / 1000);
+
+    free(threads);
+    free(rtt);
+
+    return 0;
+}
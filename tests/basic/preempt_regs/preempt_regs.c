@@ -0,0 +1,238 @@
+/*
+ * preempt_regs.c
+ *
+ * This test is supposed to run with SGXLKL_ETHREADS=1 and time-slice
+ * preemption enabled (SGXLKL_PREEMPT_QUANTUM). Several threads spin with
+ * known values in all general purpose, SSE and (if available) AVX registers
+ * and in the red zone below the stack pointer, so that they are preempted
+ * while spinning, and check that the values survive.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_THREADS 3
+#define NUM_GPRS 14
+#define NUM_XMMS 16
+#define RED_ZONE_WORDS 16
+
+/* Values seen by spin_check() after spinning, see the layout below */
+struct regs
+{
+    uint64_t gpr[NUM_GPRS]; /* rax, rbx, rcx, rdx, rbp, rdi, r8-r15 */
+    uint64_t xmm[NUM_XMMS][2];
+    uint64_t red_zone[RED_ZONE_WORDS];
+    uint64_t ymm_upper[NUM_XMMS][2];
+};
+
+/*
+ * Loads values derived from seed into the registers and the red zone, spins
+ * for iters iterations and stores what is left of them in out. With avx set,
+ * the upper halves of the AVX registers are checked, too.
+ */
+void spin_check(uint64_t seed, uint64_t iters, struct regs* out, int avx);
+
+__asm__(".text\n"
+        ".globl spin_check\n"
+        "spin_check:\n"
+        "    pushq %rbx\n"
+        "    pushq %rbp\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    pushq %rdx\n"
+        "    pushq %rcx\n"
+        "    # red zone below the stack pointer\n"
+        "    .irp i,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16\n"
+        "    leaq 200+\\i(%rdi), %rax\n"
+        "    movq %rax, -8*\\i(%rsp)\n"
+        "    .endr\n"
+        "    # upper halves of the AVX registers\n"
+        "    testq %rcx, %rcx\n"
+        "    jz 1f\n"
+        "    .irp n,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+        "    leaq 300+2*\\n(%rdi), %rax\n"
+        "    movq %rax, %xmm\\n\n"
+        "    leaq 301+2*\\n(%rdi), %rax\n"
+        "    pinsrq $1, %rax, %xmm\\n\n"
+        "    vinsertf128 $1, %xmm\\n, %ymm\\n, %ymm\\n\n"
+        "    .endr\n"
+        "1:\n"
+        "    # SSE registers, keeping the upper halves\n"
+        "    .irp n,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+        "    leaq 100+2*\\n(%rdi), %rax\n"
+        "    movq %rax, %xmm\\n\n"
+        "    leaq 101+2*\\n(%rdi), %rax\n"
+        "    pinsrq $1, %rax, %xmm\\n\n"
+        "    .endr\n"
+        "    # general purpose registers\n"
+        "    leaq 0(%rdi), %rax\n"
+        "    leaq 1(%rdi), %rbx\n"
+        "    leaq 2(%rdi), %rcx\n"
+        "    leaq 3(%rdi), %rdx\n"
+        "    leaq 4(%rdi), %rbp\n"
+        "    leaq 6(%rdi), %r8\n"
+        "    leaq 7(%rdi), %r9\n"
+        "    leaq 8(%rdi), %r10\n"
+        "    leaq 9(%rdi), %r11\n"
+        "    leaq 10(%rdi), %r12\n"
+        "    leaq 11(%rdi), %r13\n"
+        "    leaq 12(%rdi), %r14\n"
+        "    leaq 13(%rdi), %r15\n"
+        "    addq $5, %rdi\n"
+        "2:\n"
+        "    decq %rsi\n"
+        "    jnz 2b\n"
+        "    movq 8(%rsp), %rsi\n"
+        "    movq %rax, 0(%rsi)\n"
+        "    movq %rbx, 8(%rsi)\n"
+        "    movq %rcx, 16(%rsi)\n"
+        "    movq %rdx, 24(%rsi)\n"
+        "    movq %rbp, 32(%rsi)\n"
+        "    movq %rdi, 40(%rsi)\n"
+        "    movq %r8, 48(%rsi)\n"
+        "    movq %r9, 56(%rsi)\n"
+        "    movq %r10, 64(%rsi)\n"
+        "    movq %r11, 72(%rsi)\n"
+        "    movq %r12, 80(%rsi)\n"
+        "    movq %r13, 88(%rsi)\n"
+        "    movq %r14, 96(%rsi)\n"
+        "    movq %r15, 104(%rsi)\n"
+        "    .irp n,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+        "    movdqu %xmm\\n, 112+16*\\n(%rsi)\n"
+        "    .endr\n"
+        "    .irp i,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16\n"
+        "    movq -8*\\i(%rsp), %rax\n"
+        "    movq %rax, 368+8*(\\i-1)(%rsi)\n"
+        "    .endr\n"
+        "    cmpq $0, (%rsp)\n"
+        "    jz 3f\n"
+        "    .irp n,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+        "    vextractf128 $1, %ymm\\n, 496+16*\\n(%rsi)\n"
+        "    .endr\n"
+        "    vzeroupper\n"
+        "3:\n"
+        "    popq %rcx\n"
+        "    popq %rdx\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbp\n"
+        "    popq %rbx\n"
+        "    ret\n");
+
+static uint64_t iters = 20000000;
+static int rounds = 100;
+static int use_avx;
+
+static volatile uint64_t progress[NUM_THREADS];
+static int preempted[NUM_THREADS];
+static int errors[NUM_THREADS];
+
+static void check(int t, const char* what, int i, uint64_t val, uint64_t exp)
+{
+    if (val != exp && errors[t]++ < 10)
+        printf(
+            "Thread %d: %s %d is 0x%lx, expected 0x%lx\n",
+            t,
+            what,
+            i,
+            (unsigned long)val,
+            (unsigned long)exp);
+}
+
+static uint64_t others(int t)
+{
+    uint64_t sum = 0;
+
+    for (int i = 0; i < NUM_THREADS; i++)
+        if (i != t)
+            sum += progress[i];
+
+    return sum;
+}
+
+static void* spin_thread(void* arg)
+{
+    int t = (int)(intptr_t)arg;
+    struct regs out;
+
+    for (int r = 0; r < rounds; r++)
+    {
+        uint64_t seed = ((uint64_t)(t + 1) << 32) | ((uint64_t)r << 12);
+        uint64_t before = others(t);
+
+        memset(&out, 0, sizeof(out));
+        spin_check(seed, iters, &out, use_avx);
+
+        // With a single ethread, other threads only make progress while
+        // this one spins if it is preempted
+        if (others(t) != before)
+            preempted[t]++;
+        progress[t]++;
+
+        for (int i = 0; i < NUM_GPRS; i++)
+            check(t, "gpr", i, out.gpr[i], seed + i);
+        for (int i = 0; i < NUM_XMMS; i++)
+        {
+            check(t, "xmm lo", i, out.xmm[i][0], seed + 100 + 2 * i);
+            check(t, "xmm hi", i, out.xmm[i][1], seed + 101 + 2 * i);
+        }
+        for (int i = 0; i < RED_ZONE_WORDS; i++)
+            check(t, "red zone", i, out.red_zone[i], seed + 201 + i);
+        for (int i = 0; use_avx && i < NUM_XMMS; i++)
+        {
+            check(t, "ymm lo", i, out.ymm_upper[i][0], seed + 300 + 2 * i);
+            check(t, "ymm hi", i, out.ymm_upper[i][1], seed + 301 + 2 * i);
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t threads[NUM_THREADS];
+    int total_preempted = 0, total_errors = 0;
+
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+    if (argc > 2)
+        iters = strtoull(argv[2], NULL, 10);
+
+    __builtin_cpu_init();
+    use_avx = __builtin_cpu_supports("avx");
+
+    for (int t = 0; t < NUM_THREADS; t++)
+        pthread_create(&threads[t], NULL, spin_thread, (void*)(intptr_t)t);
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+        total_preempted += preempted[t];
+        total_errors += errors[t];
+    }
+
+    printf(
+        "%d rounds preempted, %d registers corrupted (AVX: %s)\n",
+        total_preempted,
+        total_errors,
+        use_avx ? "yes" : "no");
+
+    if (total_errors)
+    {
+        printf("TEST FAILED: registers corrupted by preemption\n");
+        return 1;
+    }
+    if (!total_preempted)
+    {
+        printf("TEST FAILED: no thread was preempted\n");
+        return 1;
+    }
+
+    printf("TEST PASSED\n");
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * sched_prio.c
+ *
+ * Checks that timer and block device completions, which are delivered by
+ * high-priority lthreads, keep working while application threads keep the
+ * normal scheduler queue full, and that the application threads are not
+ * starved in turn.
+ *
+ * Load threads call sched_yield() in a loop and count their iterations.
+ * Meanwhile, the main thread
+ *
+ * sleep: sleeps repeatedly and checks that no sleep ends late by more than
+ *        MAX_LATE_NS, and
+ * disk:  writes a file with O_DIRECT, reads it back block by block and
+ *        checks its contents.
+ *
+ * Afterwards, every load thread must have made progress.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+#define NUM_LOAD_THREADS 64
+#define NUM_SLEEPS 200
+#define SLEEP_NS 1000000ULL
+#define MAX_LATE_NS 500000000ULL
+
+#define BLOCK_SIZE 4096
+#define NUM_BLOCKS 256
+
+static const char* path = "/sched_prio.dat";
+
+static atomic_int done;
+static atomic_ulong progress[NUM_LOAD_THREADS];
+
+static void fail(const char* msg)
+{
+    printf("%s\n", msg);
+    printf("TEST FAILED\n");
+    exit(-1);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void* load_thread(void* arg)
+{
+    atomic_ulong* count = arg;
+
+    while (!atomic_load(&done))
+    {
+        sched_yield();
+        atomic_fetch_add(count, 1);
+    }
+
+    return NULL;
+}
+
+static void check_sleep(void)
+{
+    struct timespec ts = {0, SLEEP_NS};
+    uint64_t max_late = 0;
+
+    for (int i = 0; i < NUM_SLEEPS; i++)
+    {
+        uint64_t start = now_ns();
+        nanosleep(&ts, NULL);
+        uint64_t elapsed = now_ns() - start;
+        uint64_t late = elapsed > SLEEP_NS ? elapsed - SLEEP_NS : 0;
+        if (late > max_late)
+            max_late = late;
+    }
+
+    printf(
+        "sleep: %d sleeps, at most %llu us late\n",
+        NUM_SLEEPS,
+        (unsigned long long)max_late / 1000);
+    if (max_late > MAX_LATE_NS)
+        fail("sleep: timer expiry delayed too long");
+}
+
+static void fill_block(unsigned char* buf, int block)
+{
+    for (int i = 0; i < BLOCK_SIZE; i++)
+        buf[i] = (unsigned char)(block * 31 + i);
+}
+
+static void check_disk(void)
+{
+    unsigned char* buf;
+    unsigned char expected[BLOCK_SIZE];
+
+    if (posix_memalign((void**)&buf, BLOCK_SIZE, BLOCK_SIZE) != 0)
+        fail("out of memory");
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0600);
+    if (fd < 0)
+    {
+        perror(path);
+        fail("disk: open failed");
+    }
+
+    for (int i = 0; i < NUM_BLOCKS; i++)
+    {
+        fill_block(buf, i);
+        if (pwrite(fd, buf, BLOCK_SIZE, (off_t)i * BLOCK_SIZE) != BLOCK_SIZE)
+            fail("disk: pwrite failed");
+    }
+    if (fsync(fd) != 0)
+        fail("disk: fsync failed");
+
+    for (int i = NUM_BLOCKS - 1; i >= 0; i--)
+    {
+        memset(buf, 0, BLOCK_SIZE);
+        if (pread(fd, buf, BLOCK_SIZE, (off_t)i * BLOCK_SIZE) != BLOCK_SIZE)
+            fail("disk: pread failed");
+        fill_block(expected, i);
+        if (memcmp(buf, expected, BLOCK_SIZE) != 0)
+            fail("disk: read back wrong data");
+    }
+
+    close(fd);
+    unlink(path);
+    free(buf);
+
+    printf("disk: %d blocks written and read back\n", NUM_BLOCKS);
+}
+
+int main(void)
+{
+    pthread_t threads[NUM_LOAD_THREADS];
+
+    for (int i = 0; i < NUM_LOAD_THREADS; i++)
+        if (pthread_create(&threads[i], NULL, load_thread, &progress[i]) != 0)
+            fail("pthread_create failed");
+
+    check_sleep();
+    check_disk();
+
+    atomic_store(&done, 1);
+    for (int i = 0; i < NUM_LOAD_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < NUM_LOAD_THREADS; i++)
+    {
+        if (atomic_load(&progress[i]) == 0)
+        {
+            printf("load thread %d never ran\n", i);
+            fail("load threads starved");
+        }
+    }
+
+    printf("TEST PASSED\n");
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * Latency-under-load benchmark for the lthread scheduler priorities.
+ *
+ * A number of load threads call sched_yield() in a loop, which keeps the
+ * normal scheduler queue full of runnable application lthreads. Meanwhile,
+ * two probes measure how long work that depends on device and timer lthreads
+ * takes to complete:
+ *
+ * sleep: sleeps for a fixed period and records how late it wakes up. The
+ *        wake-up is delivered by the LKL timer lthread.
+ * read:  reads random blocks of a file with O_DIRECT and records the time per
+ *        read. Completions are delivered by the block device's event lthread.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+#define READ_BLOCK_SIZE 4096
+
+static unsigned long load_threads = 64;
+static unsigned long samples = 2000;
+static unsigned long sleep_us = 1000;
+static const char* read_path = "/data.bin";
+
+static atomic_int done;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void* load_thread(void* arg)
+{
+    while (!atomic_load(&done))
+        sched_yield();
+
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char* name, uint64_t* lat, size_t n)
+{
+    uint64_t sum = 0;
+
+    qsort(lat, n, sizeof(*lat), compare_u64);
+    for (size_t i = 0; i < n; i++)
+        sum += lat[i];
+
+    printf(
+        "%s: %lu load threads, %zu samples: "
+        "avg %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        name,
+        load_threads,
+        n,
+        (double)sum / n / 1000,
+        (double)lat[n / 2] / 1000,
+        (double)lat[n * 99 / 100] / 1000,
+        (double)lat[n - 1] / 1000);
+}
+
+static void bench_sleep(uint64_t* lat)
+{
+    struct timespec ts = {sleep_us / 1000000, (sleep_us % 1000000) * 1000};
+
+    for (unsigned long i = 0; i < samples; i++)
+    {
+        uint64_t start = now_ns();
+        nanosleep(&ts, NULL);
+        lat[i] = now_ns() - start - sleep_us * 1000;
+    }
+
+    report("sleep", lat, samples);
+}
+
+static void bench_read(uint64_t* lat)
+{
+    struct stat st;
+    void* buf;
+
+    int fd = open(read_path, O_RDONLY | O_DIRECT);
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < READ_BLOCK_SIZE)
+    {
+        perror(read_path);
+        exit(1);
+    }
+    if (posix_memalign(&buf, READ_BLOCK_SIZE, READ_BLOCK_SIZE) != 0)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    size_t blocks = st.st_size / READ_BLOCK_SIZE;
+    srand(1);
+    for (unsigned long i = 0; i < samples; i++)
+    {
+        off_t off = (off_t)(rand() % blocks) * READ_BLOCK_SIZE;
+        uint64_t start = now_ns();
+        if (pread(fd, buf, READ_BLOCK_SIZE, off) != READ_BLOCK_SIZE)
+        {
+            perror("pread");
+            exit(1);
+        }
+        lat[i] = now_ns() - start;
+    }
+
+    free(buf);
+    close(fd);
+
+    report("read", lat, samples);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        load_threads = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        samples = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        sleep_us = strtoul(argv[3], NULL, 0);
+    if (argc > 4)
+        read_path = argv[4];
+
+    if (!samples || !sleep_us)
+    {
+        fprintf(
+            stderr,
+            "usage: %s [load_threads] [samples] [sleep_us] [read_path]\n",
+            argv[0]);
+        return 1;
+    }
+
+    uint64_t* lat = calloc(samples, sizeof(*lat));
+    pthread_t* threads = calloc(load_threads + 1, sizeof(*threads));
+    if (!lat || !threads)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (unsigned long i = 0; i < load_threads; i++)
+    {
+        if (pthread_create(&threads[i], NULL, load_thread, NULL) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+
+    bench_sleep(lat);
+    bench_read(lat);
+
+    atomic_store(&done, 1);
+    for (unsigned long i = 0; i < load_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(lat);
+
+    return 0;
+}
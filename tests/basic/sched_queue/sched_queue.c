@@ -0,0 +1,120 @@
+/*
+ * sched_queue.c
+ *
+ * Stress test for the lthread scheduler queue, which all ethreads share.
+ *
+ * yield:   threads call sched_yield() in a loop, so that all ethreads
+ *          enqueue and dequeue lthreads concurrently and often lose the race
+ *          for a queue position.
+ * barrier: threads meet at a barrier twice per round. In between, each
+ *          thread increments a shared counter and one thread checks that
+ *          every thread has done so exactly once per round. The barrier wakes
+ *          many threads at once, which makes them runnable in batches.
+ *
+ * An lthread that is lost by the queue never runs again and the test hangs
+ * until the test timeout. An lthread that is dequeued twice runs on two
+ * ethreads at once, which corrupts its stack or shows up as a wrong count.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_THREADS 32
+#define NUM_YIELDS 5000
+#define NUM_ROUNDS 2000
+
+static pthread_barrier_t barrier;
+static atomic_ulong arrivals;
+static atomic_ulong yields_done;
+static atomic_int errors;
+
+static void fail(const char* msg)
+{
+    printf("%s\n", msg);
+    printf("TEST FAILED\n");
+    exit(-1);
+}
+
+static void* yield_thread(void* arg)
+{
+    volatile unsigned long count = 0;
+
+    for (unsigned long i = 0; i < NUM_YIELDS; i++)
+    {
+        sched_yield();
+        count++;
+    }
+
+    if (count != NUM_YIELDS)
+        atomic_fetch_add(&errors, 1);
+    atomic_fetch_add(&yields_done, count);
+
+    return arg;
+}
+
+static void* barrier_thread(void* arg)
+{
+    for (unsigned long round = 1; round <= NUM_ROUNDS; round++)
+    {
+        atomic_fetch_add(&arrivals, 1);
+
+        if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            unsigned long n = atomic_load(&arrivals);
+            if (n != round * NUM_THREADS)
+            {
+                printf(
+                    "round %lu: %lu arrivals, expected %lu\n",
+                    round,
+                    n,
+                    round * NUM_THREADS);
+                atomic_fetch_add(&errors, 1);
+            }
+        }
+
+        pthread_barrier_wait(&barrier);
+    }
+
+    return arg;
+}
+
+static void run(void* (*fn)(void*))
+{
+    pthread_t threads[NUM_THREADS];
+
+    for (uintptr_t i = 0; i < NUM_THREADS; i++)
+        if (pthread_create(&threads[i], NULL, fn, (void*)i) != 0)
+            fail("pthread_create failed");
+
+    for (uintptr_t i = 0; i < NUM_THREADS; i++)
+    {
+        void* ret;
+        if (pthread_join(threads[i], &ret) != 0)
+            fail("pthread_join failed");
+        if (ret != (void*)i)
+            fail("thread returned a wrong value");
+    }
+}
+
+int main(void)
+{
+    run(yield_thread);
+    if (atomic_load(&yields_done) != (unsigned long)NUM_THREADS * NUM_YIELDS)
+        fail("yield: wrong number of yields");
+    printf("yield: %d threads, %d yields each\n", NUM_THREADS, NUM_YIELDS);
+
+    pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+    run(barrier_thread);
+    pthread_barrier_destroy(&barrier);
+    printf("barrier: %d threads, %d rounds\n", NUM_THREADS, NUM_ROUNDS);
+
+    if (atomic_load(&errors))
+        fail("threads saw inconsistent state");
+
+    printf("TEST PASSED\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Contention benchmark for the lthread scheduler queue.
+ *
+ * yield:   threads call sched_yield() in a loop. Each call puts the calling
+ *          lthread back on the shared scheduler queue and dequeues the next
+ *          one, so all ethreads contend on the queue positions.
+ * barrier: threads meet at a pthread barrier in a loop. The last thread to
+ *          arrive wakes all others with one futex wake, which makes them
+ *          runnable in batches.
+ *
+ * Run it with different numbers of ethreads (SGXLKL_ETHREADS) to see how the
+ * queue scales, see Makefile.misc.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+static unsigned long num_threads = 32;
+static unsigned long yields = 100000;
+static unsigned long rounds = 10000;
+
+static pthread_barrier_t barrier;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* yield_thread(void* arg)
+{
+    for (unsigned long i = 0; i < yields; i++)
+        sched_yield();
+
+    return NULL;
+}
+
+static void* barrier_thread(void* arg)
+{
+    for (unsigned long i = 0; i < rounds; i++)
+        pthread_barrier_wait(&barrier);
+
+    return NULL;
+}
+
+static double run(void* (*fn)(void*))
+{
+    pthread_t* threads = calloc(num_threads, sizeof(*threads));
+    if (!threads)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    double start = now();
+    for (unsigned long i = 0; i < num_threads; i++)
+    {
+        if (pthread_create(&threads[i], NULL, fn, NULL) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (unsigned long i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    double elapsed = now() - start;
+
+    free(threads);
+    return elapsed;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        num_threads = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        yields = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        rounds = strtoul(argv[3], NULL, 0);
+
+    if (!num_threads || !yields || !rounds)
+    {
+        fprintf(stderr, "usage: %s [threads] [yields] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    double elapsed = run(yield_thread);
+    printf(
+        "yield: %lu threads, %lu yields in %.3f s, %.0f yields/s\n",
+        num_threads,
+        num_threads * yields,
+        elapsed,
+        num_threads * yields / elapsed);
+
+    pthread_barrier_init(&barrier, NULL, num_threads);
+    elapsed = run(barrier_thread);
+    pthread_barrier_destroy(&barrier);
+    printf(
+        "barrier: %lu threads, %lu rounds in %.3f s, %.0f wake-ups/s\n",
+        num_threads,
+        rounds,
+        elapsed,
+        num_threads * rounds / elapsed);
+
+    return 0;
+}
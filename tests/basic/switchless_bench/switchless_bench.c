@@ -0,0 +1,121 @@
+/*
+ * Per-call latency of the host calls that can be made without enclave exits.
+ *
+ * mprotect: changes the protection of a page back and forth, which is one
+ *           synchronous host call per mprotect.
+ * fsync:    writes and syncs a block of a file on the root disk, which
+ *           notifies the host disk device (one in ten iterations).
+ *
+ * Run it with and without SGXLKL_SWITCHLESS_WORKERS to compare switchless
+ * calls with OCALLs.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+#define BLOCK_SIZE 4096
+
+static unsigned long iterations = 100000;
+static const char* fsync_path = "/switchless_bench.dat";
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void report(const char* name, unsigned long n, uint64_t elapsed)
+{
+    printf(
+        "%s: %lu calls in %.3f s, %.0f ns/call\n",
+        name,
+        n,
+        (double)elapsed / NSEC_PER_SEC,
+        (double)elapsed / n);
+}
+
+static void bench_mprotect(void)
+{
+    char* page = mmap(
+        NULL,
+        BLOCK_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0);
+    if (page == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        int prot = i & 1 ? PROT_READ | PROT_WRITE : PROT_READ;
+        if (mprotect(page, BLOCK_SIZE, prot))
+        {
+            perror("mprotect");
+            exit(1);
+        }
+    }
+    report("mprotect", iterations, now_ns() - start);
+
+    munmap(page, BLOCK_SIZE);
+}
+
+static void bench_fsync(void)
+{
+    static char buf[BLOCK_SIZE];
+    unsigned long n = iterations / 10;
+
+    int fd = open(fsync_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        perror(fsync_path);
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < n; i++)
+    {
+        memset(buf, (int)i, sizeof(buf));
+        if (pwrite(fd, buf, sizeof(buf), 0) != sizeof(buf) || fsync(fd))
+        {
+            perror("write");
+            exit(1);
+        }
+    }
+    report("fsync", n, now_ns() - start);
+
+    close(fd);
+    unlink(fsync_path);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        iterations = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        fsync_path = argv[2];
+
+    if (iterations < 10)
+    {
+        fprintf(stderr, "usage: %s [iterations] [fsync_path]\n", argv[0]);
+        return 1;
+    }
+
+    bench_mprotect();
+    bench_fsync();
+
+    return 0;
+}
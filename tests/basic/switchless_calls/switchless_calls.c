@@ -0,0 +1,127 @@
+/*
+ * switchless_calls.c
+ *
+ * This test is supposed to run with more threads than ethreads and with a
+ * single switchless worker (SGXLKL_SWITCHLESS_WORKERS=1). Threads make
+ * bursts of mprotect calls and disk writes with fsync, so that the worker is
+ * often busy and calls fall back to OCALLs. Between bursts, they pause for
+ * about as long as the worker polls before it goes to sleep, so that calls
+ * are also posted while the worker is going to sleep and have to be taken
+ * back.
+ *
+ * Each mprotect call randomly uses a valid or an invalid protection, so a
+ * call that returns the result of another one is noticed. A device
+ * notification that is lost makes fsync hang.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define NUM_THREADS 8
+#define NUM_ROUNDS 200
+#define BURST 16
+#define PAGE_SIZE 4096
+
+/* Not a valid protection, so mprotect fails */
+#define BAD_PROT 0x7ff00000
+
+static int errors;
+
+static void error(int t, const char* msg, int i)
+{
+    if (__atomic_fetch_add(&errors, 1, __ATOMIC_SEQ_CST) < 10)
+        printf("Thread %d: %s (%d)\n", t, msg, i);
+}
+
+static void* call_thread(void* arg)
+{
+    int t = (int)(intptr_t)arg;
+    unsigned int seed = t + 1;
+    char path[64];
+    static __thread char block[PAGE_SIZE];
+
+    char* page = mmap(
+        NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    if (page == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    snprintf(path, sizeof(path), "/switchless_calls.%d", t);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    for (int r = 0; r < NUM_ROUNDS; r++)
+    {
+        for (int i = 0; i < BURST; i++)
+        {
+            int bad = rand_r(&seed) & 1;
+            int ret = mprotect(page, PAGE_SIZE, bad ? BAD_PROT : PROT_READ);
+
+            if (bad && ret != -1)
+                error(t, "invalid mprotect succeeded", r);
+            else if (!bad && ret != 0)
+                error(t, "mprotect failed", r);
+        }
+
+        if (mprotect(page, PAGE_SIZE, PROT_READ | PROT_WRITE) != 0)
+            error(t, "mprotect failed", r);
+        memset(page, r, PAGE_SIZE);
+        if (page[PAGE_SIZE - 1] != (char)r)
+            error(t, "page contents lost", r);
+
+        memset(block, t * NUM_ROUNDS + r, sizeof(block));
+        if (pwrite(fd, block, sizeof(block), (off_t)r * PAGE_SIZE) !=
+                sizeof(block) ||
+            fsync(fd) != 0)
+            error(t, "write failed", r);
+
+        // Around the 1 ms that the worker polls before sleeping
+        usleep(200 + rand_r(&seed) % 2000);
+    }
+
+    for (int r = 0; r < NUM_ROUNDS; r++)
+    {
+        if (pread(fd, block, sizeof(block), (off_t)r * PAGE_SIZE) !=
+                sizeof(block) ||
+            block[0] != (char)(t * NUM_ROUNDS + r) ||
+            block[PAGE_SIZE - 1] != (char)(t * NUM_ROUNDS + r))
+            error(t, "read back wrong data", r);
+    }
+
+    close(fd);
+    unlink(path);
+    munmap(page, PAGE_SIZE);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t threads[NUM_THREADS];
+
+    for (int t = 0; t < NUM_THREADS; t++)
+        pthread_create(&threads[t], NULL, call_thread, (void*)(intptr_t)t);
+    for (int t = 0; t < NUM_THREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    if (errors)
+    {
+        printf("TEST FAILED: %d errors\n", errors);
+        return 1;
+    }
+
+    printf("TEST PASSED\n");
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * Microbenchmark for the LKL host timers.
+ *
+ * rearm:  re-arms a timerfd in a loop, which reprograms the LKL clock event
+ *         device and therefore the host timer on every call, and reports the
+ *         cost per re-arm.
+ * jitter: runs a number of threads that sleep until periodic absolute
+ *         deadlines and reports how late they wake up.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static unsigned long rearm_iterations = 1000000;
+static unsigned long jitter_threads = 4;
+static unsigned long jitter_period_us = 1000;
+static unsigned long jitter_samples = 2000;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void ns_to_timespec(uint64_t ns, struct timespec* ts)
+{
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static void bench_rearm(void)
+{
+    struct itimerspec its;
+    int fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (fd < 0)
+    {
+        perror("timerfd_create");
+        exit(1);
+    }
+
+    memset(&its, 0, sizeof(its));
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < rearm_iterations; i++)
+    {
+        // Alternate between two deadlines so that each call moves the
+        // earliest expiry and the clock event device is reprogrammed.
+        ns_to_timespec(10000000 + (i & 1) * 1000000, &its.it_value);
+        if (timerfd_settime(fd, 0, &its, NULL) != 0)
+        {
+            perror("timerfd_settime");
+            exit(1);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(fd, 0, &its, NULL);
+    close(fd);
+
+    printf(
+        "rearm: %lu iterations in %.3f s, %.1f ns/rearm\n",
+        rearm_iterations,
+        (double)elapsed / NSEC_PER_SEC,
+        (double)elapsed / rearm_iterations);
+}
+
+static void* jitter_thread(void* arg)
+{
+    uint64_t* lateness = arg;
+    uint64_t period = jitter_period_us * 1000;
+    uint64_t deadline = now_ns() + period;
+    struct timespec ts;
+
+    for (unsigned long i = 0; i < jitter_samples; i++)
+    {
+        ns_to_timespec(deadline, &ts);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+            ;
+        lateness[i] = now_ns() - deadline;
+        deadline += period;
+    }
+
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_jitter(void)
+{
+    size_t n = jitter_threads * jitter_samples;
+    uint64_t* lateness = calloc(n, sizeof(*lateness));
+    pthread_t* threads = calloc(jitter_threads, sizeof(*threads));
+    uint64_t sum = 0;
+
+    if (!lateness || !threads)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (unsigned long i = 0; i < jitter_threads; i++)
+    {
+        if (pthread_create(
+                &threads[i],
+                NULL,
+                jitter_thread,
+                &lateness[i * jitter_samples]) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (unsigned long i = 0; i < jitter_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    qsort(lateness, n, sizeof(*lateness), compare_u64);
+    for (size_t i = 0; i < n; i++)
+        sum += lateness[i];
+
+    printf(
+        "jitter: %lu threads, %lu us period, %zu samples: "
+        "avg %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        jitter_threads,
+        jitter_period_us,
+        n,
+        (double)sum / n / 1000,
+        (double)lateness[n / 2] / 1000,
+        (double)lateness[n * 99 / 100] / 1000,
+        (double)lateness[n - 1] / 1000);
+
+    free(threads);
+    free(lateness);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        rearm_iterations = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        jitter_threads = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        jitter_period_us = strtoul(argv[3], NULL, 0);
+    if (argc > 4)
+        jitter_samples = strtoul(argv[4], NULL, 0);
+
+    if (!rearm_iterations || !jitter_threads || !jitter_period_us ||
+        !jitter_samples)
+    {
+        fprintf(
+            stderr,
+            "usage: %s [rearm_iterations] [jitter_threads] "
+            "[jitter_period_us] [jitter_samples]\n",
+            argv[0]);
+        return 1;
+    }
+
+    bench_rearm();
+    bench_jitter();
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * timer_rearm.c
+ *
+ * Checks that timers keep firing when they are re-armed or freed from their
+ * own expiry handlers, which reprograms the LKL clock event device, and
+ * hence the LKL host timer, from within the host timer's callback.
+ *
+ * rearm:    threads re-arm a timerfd right after each expiry.
+ * recreate: chains of POSIX timers, where each timer's notification deletes
+ *           the timer and creates and arms the next one.
+ *
+ * A lost wakeup shows up as an expiry that is late by more than MAX_LATE_NS,
+ * or as a chain that stops.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+#define NUM_THREADS 4
+#define NUM_REARMS 2000
+#define NUM_CHAINS 4
+#define CHAIN_LENGTH 500
+#define PERIOD_NS 200000ULL
+#define MAX_LATE_NS 500000000ULL
+
+static int failed;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void* rearm_thread(void* arg)
+{
+    int t = (int)(intptr_t)arg;
+    struct itimerspec its;
+    uint64_t expirations;
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (fd < 0)
+    {
+        perror("timerfd_create");
+        exit(1);
+    }
+
+    memset(&its, 0, sizeof(its));
+    for (int i = 0; i < NUM_REARMS; i++)
+    {
+        // Vary the deadline so that the threads' timers take turns in
+        // being the earliest one
+        uint64_t delay = PERIOD_NS + (i + t) % NUM_THREADS * 50000;
+        its.it_value.tv_nsec = delay;
+
+        uint64_t start = now_ns();
+        if (timerfd_settime(fd, 0, &its, NULL) != 0)
+        {
+            perror("timerfd_settime");
+            exit(1);
+        }
+        if (read(fd, &expirations, sizeof(expirations)) !=
+            sizeof(expirations))
+        {
+            perror("read");
+            exit(1);
+        }
+
+        uint64_t late = now_ns() - start - delay;
+        if (late > MAX_LATE_NS)
+        {
+            printf("Thread %d: timer %d fired %lu ms late\n",
+                   t, i, (unsigned long)(late / 1000000));
+            __atomic_store_n(&failed, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+struct chain
+{
+    int remaining;
+    timer_t timer;
+    sem_t done;
+};
+
+static void arm_next(struct chain* c);
+
+static void chain_notify(union sigval sv)
+{
+    struct chain* c = sv.sival_ptr;
+
+    // Free the timer that just fired and continue with a new one
+    timer_delete(c->timer);
+    if (--c->remaining > 0)
+        arm_next(c);
+    else
+        sem_post(&c->done);
+}
+
+static void arm_next(struct chain* c)
+{
+    struct sigevent sev;
+    struct itimerspec its;
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD;
+    sev.sigev_notify_function = chain_notify;
+    sev.sigev_value.sival_ptr = c;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &c->timer) != 0)
+    {
+        perror("timer_create");
+        exit(1);
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = PERIOD_NS;
+    if (timer_settime(c->timer, 0, &its, NULL) != 0)
+    {
+        perror("timer_settime");
+        exit(1);
+    }
+}
+
+static void test_rearm(void)
+{
+    pthread_t threads[NUM_THREADS];
+
+    for (int t = 0; t < NUM_THREADS; t++)
+        pthread_create(&threads[t], NULL, rearm_thread, (void*)(intptr_t)t);
+    for (int t = 0; t < NUM_THREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    printf("rearm: %d threads re-armed their timer %d times\n",
+           NUM_THREADS, NUM_REARMS);
+}
+
+static void test_recreate(void)
+{
+    static struct chain chains[NUM_CHAINS];
+    struct timespec deadline;
+
+    for (int i = 0; i < NUM_CHAINS; i++)
+    {
+        chains[i].remaining = CHAIN_LENGTH;
+        sem_init(&chains[i].done, 0, 0);
+        arm_next(&chains[i]);
+    }
+
+    // A chain takes CHAIN_LENGTH * PERIOD_NS if no expiry is lost
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 30;
+    for (int i = 0; i < NUM_CHAINS; i++)
+    {
+        if (sem_timedwait(&chains[i].done, &deadline) != 0)
+        {
+            printf("recreate: chain %d stopped with %d timers left\n",
+                   i, __atomic_load_n(&chains[i].remaining, __ATOMIC_SEQ_CST));
+            failed = 1;
+            return;
+        }
+    }
+
+    printf("recreate: %d chains of %d timers completed\n",
+           NUM_CHAINS, CHAIN_LENGTH);
+}
+
+int main(int argc, char** argv)
+{
+    test_rearm();
+    test_recreate();
+
+    if (failed)
+    {
+        printf("TEST FAILED\n");
+        return 1;
+    }
+
+    printf("TEST PASSED\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Benchmark for /tmp on a compressed RAM disk (zram).
+ *
+ * Each round writes scratch files to a directory, reads them back and checks
+ * their contents, and removes them again. A quarter of each 4 KiB block is
+ * random and the rest is text, so that the data compresses roughly 3:1. With
+ * tmpfs, the files are kept uncompressed in kernel memory, and writing more
+ * scratch data than fits fails. With zram, the kernel writes the data back to
+ * the compressed disk and can drop it from the page cache.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+#define CHUNK_SIZE (1024 * 1024)
+#define BLOCK_SIZE 4096
+#define RANDOM_SIZE (BLOCK_SIZE / 4)
+#define FILE_MB 16
+
+static unsigned long scratch_mb = 96;
+static unsigned long rounds = 3;
+static const char* scratch_dir = "/tmp";
+
+static const char text[] =
+    "The quick brown fox jumps over the lazy dog while the enclave runs out "
+    "of memory for its scratch files. ";
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Fills a chunk with data that depends only on its index. */
+static void fill_chunk(char* buf, unsigned long index)
+{
+    uint64_t x = index * 0x9e3779b97f4a7c15ULL + 1;
+
+    for (size_t off = 0; off < CHUNK_SIZE; off += BLOCK_SIZE)
+    {
+        for (size_t i = 0; i < RANDOM_SIZE; i += sizeof(x))
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            memcpy(buf + off + i, &x, sizeof(x));
+        }
+        for (size_t i = RANDOM_SIZE; i < BLOCK_SIZE; i++)
+            buf[off + i] = text[(off / BLOCK_SIZE + i) % (sizeof(text) - 1)];
+    }
+}
+
+static void file_path(char* path, size_t size, unsigned long file)
+{
+    snprintf(path, size, "%s/zram_bench.%lu", scratch_dir, file);
+}
+
+static void report(const char* name, unsigned long mb, uint64_t elapsed)
+{
+    printf(
+        "%s: %lu of %lu MiB in %.3f s, %.1f MiB/s\n",
+        name,
+        mb,
+        scratch_mb,
+        (double)elapsed / NSEC_PER_SEC,
+        (double)mb * NSEC_PER_SEC / elapsed);
+}
+
+/* Returns the number of MiB written before the first error. */
+static unsigned long bench_write(char* buf)
+{
+    char path[256];
+    unsigned long n = 0;
+    int fd = -1;
+
+    uint64_t start = now_ns();
+    for (; n < scratch_mb; n++)
+    {
+        if (n % FILE_MB == 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            file_path(path, sizeof(path), n / FILE_MB);
+            fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0)
+            {
+                perror(path);
+                break;
+            }
+        }
+
+        fill_chunk(buf, n);
+        if (write(fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+        {
+            printf("write: %s after %lu MiB\n", strerror(errno), n);
+            break;
+        }
+    }
+    if (fd >= 0 && fsync(fd) != 0)
+        printf("fsync: %s\n", strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    uint64_t elapsed = now_ns() - start;
+
+    report("write", n, elapsed);
+    return n;
+}
+
+static void bench_read(char* buf, char* expected, unsigned long written)
+{
+    char path[256];
+    unsigned long n = 0;
+    int fd = -1;
+
+    uint64_t start = now_ns();
+    for (; n < written; n++)
+    {
+        if (n % FILE_MB == 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            file_path(path, sizeof(path), n / FILE_MB);
+            fd = open(path, O_RDONLY);
+            if (fd < 0)
+            {
+                perror(path);
+                exit(1);
+            }
+        }
+
+        if (read(fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+        {
+            perror("read");
+            exit(1);
+        }
+        fill_chunk(expected, n);
+        if (memcmp(buf, expected, CHUNK_SIZE) != 0)
+        {
+            fprintf(stderr, "data mismatch in MiB %lu\n", n);
+            exit(1);
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+    uint64_t elapsed = now_ns() - start;
+
+    report("read", n, elapsed);
+}
+
+static void remove_files(void)
+{
+    char path[256];
+
+    for (unsigned long i = 0; i < (scratch_mb + FILE_MB - 1) / FILE_MB; i++)
+    {
+        file_path(path, sizeof(path), i);
+        unlink(path);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        scratch_mb = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        rounds = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        scratch_dir = argv[3];
+
+    if (!scratch_mb || !rounds)
+    {
+        fprintf(
+            stderr, "usage: %s [scratch_mb] [rounds] [scratch_dir]\n", argv[0]);
+        return 1;
+    }
+
+    char* buf = malloc(CHUNK_SIZE);
+    char* expected = malloc(CHUNK_SIZE);
+    if (!buf || !expected)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    int ret = 0;
+    for (unsigned long i = 0; i < rounds; i++)
+    {
+        printf("round %lu\n", i);
+        unsigned long written = bench_write(buf);
+        bench_read(buf, expected, written);
+        remove_files();
+        if (written < scratch_mb)
+            ret = 1;
+    }
+
+    free(expected);
+    free(buf);
+
+    return ret;
+}
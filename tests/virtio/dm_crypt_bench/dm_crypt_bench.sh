@@ -0,0 +1,22 @@
+#!/bin/sh
+#
+# Measures the sequential write and read throughput of the root disk and
+# reports which driver the kernel selected for xts(aes).
+
+SIZE_MB=${1:-256}
+FILE=/bench.dat
+
+echo "xts(aes) drivers:"
+grep -A 2 "^name *: xts(aes)" /proc/crypto | grep -E "driver|priority"
+
+echo "Write ${SIZE_MB} MiB:"
+dd if=/dev/zero of=${FILE} bs=1M count=${SIZE_MB} conv=fsync
+
+# Make sure the read goes through dm-crypt and not the page cache
+sync
+echo 3 > /proc/sys/vm/drop_caches
+
+echo "Read ${SIZE_MB} MiB:"
+dd if=${FILE} of=/dev/null bs=1M
+
+rm -f ${FILE}
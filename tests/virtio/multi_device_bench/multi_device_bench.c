@@ -0,0 +1,171 @@
+/*
+ * Drives two virtio block devices and the virtio network device concurrently
+ * to measure the overhead of the event channels under combined load. Each
+ * disk is written by its own thread in 64 KiB blocks with a flush after every
+ * MiB, so that the writes reach the host. The network thread sends UDP
+ * datagrams to the host side of the TAP device.
+ *
+ * Usage: multi_device_bench <seconds> <dir on disk 0> <dir on disk 1> <ip>
+ */
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE (64 * 1024)
+#define BLOCKS_PER_FLUSH 16
+#define FILE_BLOCKS 1024
+#define DATAGRAM_SIZE 1400
+#define DISCARD_PORT 9
+
+static atomic_int stop;
+
+struct disk_args
+{
+    const char* dir;
+    uint64_t bytes;
+};
+
+struct net_args
+{
+    const char* ip;
+    uint64_t packets;
+};
+
+static void* disk_task(void* arg)
+{
+    struct disk_args* args = arg;
+    char path[256];
+    char* buf = malloc(BLOCK_SIZE);
+
+    if (!buf)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memset(buf, 0xa5, BLOCK_SIZE);
+
+    snprintf(path, sizeof(path), "%s/multi_device_bench.dat", args->dir);
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    if (fd < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    for (uint64_t i = 0; !stop; i++)
+    {
+        off_t off = (off_t)(i % FILE_BLOCKS) * BLOCK_SIZE;
+        if (pwrite(fd, buf, BLOCK_SIZE, off) != BLOCK_SIZE)
+        {
+            perror("pwrite");
+            exit(1);
+        }
+        if ((i + 1) % BLOCKS_PER_FLUSH == 0 && fdatasync(fd) < 0)
+        {
+            perror("fdatasync");
+            exit(1);
+        }
+        args->bytes += BLOCK_SIZE;
+    }
+
+    close(fd);
+    unlink(path);
+    free(buf);
+    return NULL;
+}
+
+static void* net_task(void* arg)
+{
+    struct net_args* args = arg;
+    struct sockaddr_in addr;
+    char buf[DATAGRAM_SIZE];
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        exit(1);
+    }
+
+    memset(buf, 0x5a, sizeof(buf));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DISCARD_PORT);
+    if (inet_pton(AF_INET, args->ip, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid address: %s\n", args->ip);
+        exit(1);
+    }
+
+    while (!stop)
+    {
+        if (sendto(
+                fd,
+                buf,
+                sizeof(buf),
+                0,
+                (struct sockaddr*)&addr,
+                sizeof(addr)) == sizeof(buf))
+            args->packets++;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t disk_threads[2], net_thread;
+    struct disk_args disks[2];
+    struct net_args net;
+    struct timespec start, end;
+
+    if (argc != 5)
+    {
+        fprintf(
+            stderr,
+            "Usage: %s <seconds> <dir on disk 0> <dir on disk 1> <ip>\n",
+            argv[0]);
+        return 1;
+    }
+
+    int seconds = atoi(argv[1]);
+    disks[0] = (struct disk_args){argv[2], 0};
+    disks[1] = (struct disk_args){argv[3], 0};
+    net = (struct net_args){argv[4], 0};
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < 2; i++)
+        pthread_create(&disk_threads[i], NULL, disk_task, &disks[i]);
+    pthread_create(&net_thread, NULL, net_task, &net);
+
+    sleep(seconds);
+    stop = 1;
+
+    for (int i = 0; i < 2; i++)
+        pthread_join(disk_threads[i], NULL);
+    pthread_join(net_thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    for (int i = 0; i < 2; i++)
+        printf(
+            "disk%i: %.1f MiB/s\n",
+            i,
+            disks[i].bytes / elapsed / (1024 * 1024));
+    printf("net: %.0f packets/s\n", net.packets / elapsed);
+    printf("TEST PASSED\n");
+
+    return 0;
+}